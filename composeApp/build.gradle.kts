@@ -154,6 +154,12 @@ android {
         }
     }
 
+    // SoundFonts are read in place from the APK, which needs them stored uncompressed.
+    // SF3 samples are Ogg Vorbis already, so zip compression would gain nothing on them
+    androidResources {
+        noCompress += listOf("sf2", "sf3")
+    }
+
     packaging {
         resources {
             excludes += "/META-INF/{AL2.0,LGPL2.1}"
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// Keeps the render thread off FluidSynth's API lock while a long call holds it.
+//
+// The render thread brackets every span with begin_span() / end_span() and only calls
+// functions that take the API lock (note on, CC, voice count...) when begin_span() returned
+// true. A long call enter()s before taking the lock: that raises the busy count and then waits
+// for a span already past its check to end, so the render thread can never be inside such a
+// call when the lock is taken. Both sides store and then load with sequential consistency, so at
+// least one of them sees the other.
+class ApiGate {
+public:
+    // Long calls, before taking the API lock. Waits at most for the rest of one span.
+    void enter() {
+        busy_.fetch_add(1, std::memory_order_seq_cst);
+        while (in_span_.load(std::memory_order_seq_cst)) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    void leave() { busy_.fetch_sub(1, std::memory_order_release); }
+
+    // Render thread: starts a span and returns whether it may take the API lock
+    bool begin_span() {
+        in_span_.store(true, std::memory_order_seq_cst);
+        return busy_.load(std::memory_order_seq_cst) == 0;
+    }
+
+    void end_span() { in_span_.store(false, std::memory_order_release); }
+
+    // Render thread, inside a span: whether a long call is waiting or holds the lock. Reading
+    // false still means the lock is free until end_span().
+    bool busy() const { return busy_.load(std::memory_order_seq_cst) != 0; }
+
+private:
+    std::atomic<int> busy_{0};
+    std::atomic<bool> in_span_{false};
+};
+
+// Holds the gate for the duration of a long API call
+class ApiGateScope {
+public:
+    explicit ApiGateScope(ApiGate *gate) : gate_(gate) { gate_->enter(); }
+    ~ApiGateScope() { gate_->leave(); }
+
+    ApiGateScope(const ApiGateScope &) = delete;
+    ApiGateScope &operator=(const ApiGateScope &) = delete;
+
+private:
+    ApiGate *gate_;
+};
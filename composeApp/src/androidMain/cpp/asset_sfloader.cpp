@@ -0,0 +1,152 @@
+#include "asset_sfloader.h"
+
+#include <android/log.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <unistd.h>
+
+#define LOG_TAG "FluidSynthJNI"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace {
+
+std::atomic<AAssetManager *> asset_manager{nullptr};
+
+// One open asset. data is the mapped contents for uncompressed assets, null when streaming.
+struct AssetFile {
+    AAsset *asset;
+    const uint8_t *data;
+    off64_t size;
+    off64_t pos;
+};
+
+void *asset_open(const char *filename) {
+    const size_t prefix = strlen(ASSET_SFONT_PREFIX);
+    if (strncmp(filename, ASSET_SFONT_PREFIX, prefix) != 0) {
+        return nullptr;
+    }
+    AAssetManager *manager = asset_manager.load(std::memory_order_acquire);
+    if (!manager) {
+        LOGE("No AssetManager set for %s", filename);
+        return nullptr;
+    }
+    AAsset *asset = AAssetManager_open(manager, filename + prefix, AASSET_MODE_RANDOM);
+    if (!asset) {
+        LOGE("Asset not found: %s", filename + prefix);
+        return nullptr;
+    }
+
+    // Only uncompressed assets can be opened as a file descriptor; for those the buffer is a
+    // mapping of the APK rather than an inflated copy
+    const uint8_t *data = nullptr;
+    off64_t start = 0, length = 0;
+    int fd = AAsset_openFileDescriptor64(asset, &start, &length);
+    if (fd >= 0) {
+        close(fd);
+        data = static_cast<const uint8_t *>(AAsset_getBuffer(asset));
+    } else {
+        LOGI("%s is compressed in the APK; add it to noCompress to read it in place", filename);
+    }
+
+    auto *file = new(std::nothrow) AssetFile{asset, data, AAsset_getLength64(asset), 0};
+    if (!file) {
+        AAsset_close(asset);
+    }
+    return file;
+}
+
+int asset_read(void *buf, fluid_long_long_t count, void *handle) {
+    auto *file = static_cast<AssetFile *>(handle);
+    if (count < 0 || file->pos + count > file->size) {
+        return FLUID_FAILED;
+    }
+    if (file->data) {
+        memcpy(buf, file->data + file->pos, static_cast<size_t>(count));
+    } else {
+        auto *out = static_cast<uint8_t *>(buf);
+        fluid_long_long_t done = 0;
+        while (done < count) {
+            int n = AAsset_read(file->asset, out + done, static_cast<size_t>(count - done));
+            if (n <= 0) {
+                return FLUID_FAILED;
+            }
+            done += n;
+        }
+    }
+    file->pos += count;
+    return FLUID_OK;
+}
+
+int asset_seek(void *handle, fluid_long_long_t offset, int origin) {
+    auto *file = static_cast<AssetFile *>(handle);
+    off64_t target;
+    switch (origin) {
+        case SEEK_SET: target = offset; break;
+        case SEEK_CUR: target = file->pos + offset; break;
+        case SEEK_END: target = file->size + offset; break;
+        default: return FLUID_FAILED;
+    }
+    if (target < 0 || target > file->size) {
+        return FLUID_FAILED;
+    }
+    if (!file->data && AAsset_seek64(file->asset, target, SEEK_SET) < 0) {
+        return FLUID_FAILED;
+    }
+    file->pos = target;
+    return FLUID_OK;
+}
+
+fluid_long_long_t asset_tell(void *handle) {
+    return static_cast<AssetFile *>(handle)->pos;
+}
+
+int asset_close(void *handle) {
+    auto *file = static_cast<AssetFile *>(handle);
+    AAsset_close(file->asset);
+    delete file;
+    return FLUID_OK;
+}
+
+void close_asset_mapping(SfontMapping *mapping) {
+    AAsset_close(static_cast<AAsset *>(mapping->context));
+}
+
+} // namespace
+
+fluid_sfloader_t *new_asset_sfloader(fluid_settings_t *settings) {
+    fluid_sfloader_t *loader = new_fluid_defsfloader(settings);
+    if (!loader) {
+        return nullptr;
+    }
+    if (fluid_sfloader_set_callbacks(loader, asset_open, asset_read, asset_seek, asset_tell,
+                                     asset_close) != FLUID_OK) {
+        delete_fluid_sfloader(loader);
+        return nullptr;
+    }
+    return loader;
+}
+
+void set_sfloader_asset_manager(AAssetManager *manager) {
+    asset_manager.store(manager, std::memory_order_release);
+}
+
+bool map_asset_sfont(const char *filename, SfontMapping *mapping) {
+    auto *file = static_cast<AssetFile *>(asset_open(filename));
+    if (!file) {
+        return false;
+    }
+    if (!file->data) {
+        asset_close(file);
+        return false;
+    }
+    mapping->data = file->data;
+    mapping->size = static_cast<size_t>(file->size);
+    mapping->release = close_asset_mapping;
+    mapping->context = file->asset;
+    delete file;
+    return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <fluidsynth.h>
+#include <android/asset_manager.h>
+
+#include "mmap_sfloader.h"
+
+// SoundFonts inside the APK are loaded by name with this prefix, e.g. "asset://sft_gu_gs.sf2"
+#define ASSET_SFONT_PREFIX "asset://"
+
+// SoundFont loader that reads "asset://" names straight from the APK, so nothing has to be
+// extracted to storage first. It is FluidSynth's default SF2 loader with file callbacks over
+// AAsset: an asset stored uncompressed (noCompress in build.gradle.kts) is read through
+// AAsset_getBuffer, i.e. from the memory-mapped APK; a compressed one is streamed, which works
+// but inflates the whole file for every load.
+//
+// The mmap loader (mmap_sfloader.h) is tried first and uses uncompressed assets in place through
+// map_asset_sfont(); this loader covers what it declines. Names without the prefix are left to
+// the synth's default loader. Add the loader with fluid_synth_add_sfloader() before the synth
+// loads its first SoundFont.
+fluid_sfloader_t *new_asset_sfloader(fluid_settings_t *settings);
+
+// Sets the AssetManager that asset:// names resolve against. The caller keeps the Java
+// AssetManager alive (a JNI global reference) for as long as loads may happen.
+void set_sfloader_asset_manager(AAssetManager *manager);
+
+// Maps an "asset://" name stored uncompressed in the APK for the mmap loader: the mapping is
+// AAsset_getBuffer() over the APK, released by closing the asset. Returns false for missing
+// and compressed assets.
+bool map_asset_sfont(const char *filename, SfontMapping *mapping);
@@ -0,0 +1,266 @@
+#include "audio_output.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#ifdef __ANDROID__
+#include <android/log.h>
+#include <SLES/OpenSLES.h>
+#include <SLES/OpenSLES_Android.h>
+
+#define LOG_TAG "FluidSynthJNI"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#else
+#include <cstdio>
+
+#define LOGI(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#define LOGE(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#endif
+
+namespace {
+
+void read_period_settings(fluid_settings_t *settings, int *sample_rate, int *period_size,
+                          int *periods) {
+    double rate = 44100.0;
+    fluid_settings_getnum(settings, "synth.sample-rate", &rate);
+    *sample_rate = static_cast<int>(rate);
+    *period_size = 256;
+    fluid_settings_getint(settings, "audio.period-size", period_size);
+    *periods = 2;
+    fluid_settings_getint(settings, "audio.periods", periods);
+}
+
+#ifdef __ANDROID__
+
+// Android allows one OpenSL ES engine per process, so every output shares one engine and output
+// mix. They are created by the first output to open and destroyed with the last one.
+std::mutex engine_mutex;
+int engine_refs = 0;
+SLObjectItf engine_obj = nullptr;
+SLEngineItf engine_itf = nullptr;
+SLObjectItf mix_obj = nullptr;
+
+void destroy_engine_locked() {
+    if (mix_obj) (*mix_obj)->Destroy(mix_obj);
+    if (engine_obj) (*engine_obj)->Destroy(engine_obj);
+    mix_obj = nullptr;
+    engine_obj = nullptr;
+    engine_itf = nullptr;
+}
+
+// Takes a reference to the shared engine and output mix; false if they cannot be created
+bool acquire_engine(SLEngineItf *engine, SLObjectItf *mix) {
+    std::lock_guard<std::mutex> lock(engine_mutex);
+    if (engine_refs == 0) {
+        if (slCreateEngine(&engine_obj, 0, nullptr, 0, nullptr, nullptr) != SL_RESULT_SUCCESS ||
+            (*engine_obj)->Realize(engine_obj, SL_BOOLEAN_FALSE) != SL_RESULT_SUCCESS ||
+            (*engine_obj)->GetInterface(engine_obj, SL_IID_ENGINE,
+                                        &engine_itf) != SL_RESULT_SUCCESS) {
+            LOGE("Failed to create OpenSL ES engine");
+            destroy_engine_locked();
+            return false;
+        }
+        if ((*engine_itf)->CreateOutputMix(engine_itf, &mix_obj, 0, nullptr,
+                                           nullptr) != SL_RESULT_SUCCESS ||
+            (*mix_obj)->Realize(mix_obj, SL_BOOLEAN_FALSE) != SL_RESULT_SUCCESS) {
+            LOGE("Failed to create OpenSL ES output mix");
+            destroy_engine_locked();
+            return false;
+        }
+    }
+    ++engine_refs;
+    *engine = engine_itf;
+    *mix = mix_obj;
+    return true;
+}
+
+void release_engine() {
+    std::lock_guard<std::mutex> lock(engine_mutex);
+    if (--engine_refs == 0) {
+        destroy_engine_locked();
+    }
+}
+
+// OpenSL ES buffer queue player rendering float stereo. Each completed buffer is refilled
+// from the render callback on OpenSL's audio thread.
+class OpenSLAudioOutput : public AudioOutput {
+public:
+    OpenSLAudioOutput(int sample_rate, int period_size, int periods,
+                      audio_render_func_t render, void *data)
+            : AudioOutput(sample_rate, period_size, periods), render_(render), data_(data),
+              buffers_(static_cast<size_t>(periods) * period_size * 2),
+              left_(period_size), right_(period_size) {}
+
+    ~OpenSLAudioOutput() override {
+        if (play_) {
+            (*play_)->SetPlayState(play_, SL_PLAYSTATE_STOPPED);
+        }
+        // Destroying the player waits for a callback that is currently running
+        if (player_obj_) (*player_obj_)->Destroy(player_obj_);
+        if (has_engine_) release_engine();
+    }
+
+    // Creates and realizes the player without starting it
+    bool prepare() {
+        SLEngineItf engine;
+        SLObjectItf mix;
+        if (!acquire_engine(&engine, &mix)) {
+            return false;
+        }
+        has_engine_ = true;
+
+        SLDataLocator_AndroidSimpleBufferQueue queue_locator = {
+                SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE, static_cast<SLuint32>(periods_)};
+        SLAndroidDataFormat_PCM_EX format = {
+                SL_ANDROID_DATAFORMAT_PCM_EX, 2, static_cast<SLuint32>(sample_rate_) * 1000,
+                32, 32, SL_SPEAKER_FRONT_LEFT | SL_SPEAKER_FRONT_RIGHT,
+                SL_BYTEORDER_LITTLEENDIAN, SL_ANDROID_PCM_REPRESENTATION_FLOAT};
+        SLDataSource source = {&queue_locator, &format};
+        SLDataLocator_OutputMix mix_locator = {SL_DATALOCATOR_OUTPUTMIX, mix};
+        SLDataSink sink = {&mix_locator, nullptr};
+
+        const SLInterfaceID ids[] = {SL_IID_ANDROIDSIMPLEBUFFERQUEUE, SL_IID_ANDROIDCONFIGURATION};
+        const SLboolean required[] = {SL_BOOLEAN_TRUE, SL_BOOLEAN_FALSE};
+        if ((*engine)->CreateAudioPlayer(engine, &player_obj_, &source, &sink, 2, ids,
+                                         required) != SL_RESULT_SUCCESS) {
+            LOGE("Failed to create OpenSL ES audio player");
+            return false;
+        }
+
+        // Ask for the low-latency (AAudio/fast mixer) path where the device supports it
+        SLAndroidConfigurationItf config;
+        if ((*player_obj_)->GetInterface(player_obj_, SL_IID_ANDROIDCONFIGURATION,
+                                         &config) == SL_RESULT_SUCCESS) {
+            SLuint32 mode = SL_ANDROID_PERFORMANCE_LATENCY;
+            (*config)->SetConfiguration(config, SL_ANDROID_KEY_PERFORMANCE_MODE, &mode,
+                                        sizeof(mode));
+        }
+
+        if ((*player_obj_)->Realize(player_obj_, SL_BOOLEAN_FALSE) != SL_RESULT_SUCCESS ||
+            (*player_obj_)->GetInterface(player_obj_, SL_IID_PLAY, &play_) != SL_RESULT_SUCCESS ||
+            (*player_obj_)->GetInterface(player_obj_, SL_IID_ANDROIDSIMPLEBUFFERQUEUE,
+                                         &queue_) != SL_RESULT_SUCCESS ||
+            (*queue_)->RegisterCallback(queue_, on_buffer_done, this) != SL_RESULT_SUCCESS) {
+            LOGE("Failed to realize OpenSL ES audio player");
+            return false;
+        }
+        return true;
+    }
+
+    bool start() override {
+        // Prime the queue with silence; callbacks take over from there
+        for (int i = 0; i < periods_; ++i) {
+            (*queue_)->Enqueue(queue_, buffer(i), period_bytes());
+        }
+        if ((*play_)->SetPlayState(play_, SL_PLAYSTATE_PLAYING) != SL_RESULT_SUCCESS) {
+            LOGE("Failed to start OpenSL ES playback");
+            return false;
+        }
+        LOGI("OpenSL ES output started: %d Hz, %d x %d frames", sample_rate_, periods_,
+             period_size_);
+        return true;
+    }
+
+private:
+    float *buffer(int index) {
+        return buffers_.data() + static_cast<size_t>(index) * period_size_ * 2;
+    }
+
+    SLuint32 period_bytes() const {
+        return static_cast<SLuint32>(period_size_ * 2 * sizeof(float));
+    }
+
+    static void on_buffer_done(SLAndroidSimpleBufferQueueItf queue, void *context) {
+        auto *self = static_cast<OpenSLAudioOutput *>(context);
+        float *out = self->buffer(self->next_buffer_);
+        self->next_buffer_ = (self->next_buffer_ + 1) % self->periods_;
+
+        std::fill(self->left_.begin(), self->left_.end(), 0.0f);
+        std::fill(self->right_.begin(), self->right_.end(), 0.0f);
+        self->render_(self->data_, self->period_size_, self->left_.data(), self->right_.data());
+        for (int i = 0; i < self->period_size_; ++i) {
+            out[2 * i] = self->left_[i];
+            out[2 * i + 1] = self->right_[i];
+        }
+        (*queue)->Enqueue(queue, out, self->period_bytes());
+    }
+
+    audio_render_func_t render_;
+    void *data_;
+    std::vector<float> buffers_;
+    std::vector<float> left_;
+    std::vector<float> right_;
+    int next_buffer_ = 0;
+
+    bool has_engine_ = false;
+    SLObjectItf player_obj_ = nullptr;
+    SLPlayItf play_ = nullptr;
+    SLAndroidSimpleBufferQueueItf queue_ = nullptr;
+};
+
+#else
+
+// Host builds: FluidSynth's default driver in callback mode
+class DriverAudioOutput : public AudioOutput {
+public:
+    DriverAudioOutput(int sample_rate, int period_size, int periods,
+                      audio_render_func_t render, void *data)
+            : AudioOutput(sample_rate, period_size, periods), render_(render), data_(data) {}
+
+    ~DriverAudioOutput() override {
+        if (driver_) delete_fluid_audio_driver(driver_);
+    }
+
+    void prepare(fluid_settings_t *settings) { settings_ = settings; }
+
+    // The driver calls back as soon as it exists, so it is only created here
+    bool start() override {
+        driver_ = new_fluid_audio_driver2(settings_, on_period, this);
+        return driver_ != nullptr;
+    }
+
+private:
+    static int on_period(void *data, int len, int /*nfx*/, float * /*fx*/[], int nout,
+                         float *out[]) {
+        auto *self = static_cast<DriverAudioOutput *>(data);
+        if (nout < 2) {
+            return FLUID_FAILED;
+        }
+        self->render_(self->data_, len, out[0], out[1]);
+        return FLUID_OK;
+    }
+
+    audio_render_func_t render_;
+    void *data_;
+    fluid_settings_t *settings_ = nullptr;
+    fluid_audio_driver_t *driver_ = nullptr;
+};
+
+#endif
+
+} // namespace
+
+AudioOutput *AudioOutput::open(fluid_settings_t *settings, audio_render_func_t render, void *data) {
+    int sample_rate, period_size, periods;
+    read_period_settings(settings, &sample_rate, &period_size, &periods);
+
+#ifdef __ANDROID__
+    auto *output = new(std::nothrow) OpenSLAudioOutput(sample_rate, period_size, periods,
+                                                        render, data);
+    if (output && !output->prepare()) {
+        delete output;
+        output = nullptr;
+    }
+#else
+    auto *output = new(std::nothrow) DriverAudioOutput(sample_rate, period_size, periods,
+                                                       render, data);
+    if (output) {
+        output->prepare(settings);
+    }
+#endif
+    return output;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <fluidsynth.h>
+
+// Renders one period of stereo audio into zeroed, non-interleaved buffers. Runs on the audio
+// thread and must not block.
+typedef void (*audio_render_func_t)(void *data, int frames, float *left, float *right);
+
+// Realtime audio output that calls back into the wrapper for every period, so the wrapper
+// controls what happens around fluid_synth_process() on the audio thread.
+//
+// FluidSynth's oboe and opensles drivers only support new_fluid_audio_driver(), which renders
+// the synth directly. On Android the wrapper therefore drives its own OpenSL ES buffer queue;
+// elsewhere it uses new_fluid_audio_driver2() with the default driver.
+class AudioOutput {
+public:
+    // Opens an output using synth.sample-rate, audio.period-size and audio.periods from settings,
+    // stopped: render is not called before start(), so the caller can set up what it reads from
+    // the output's parameters first. Returns nullptr on failure.
+    static AudioOutput *open(fluid_settings_t *settings, audio_render_func_t render, void *data);
+
+    virtual ~AudioOutput() = default;
+
+    // Starts calling render; false if playback could not start
+    virtual bool start() = 0;
+
+    int sample_rate() const { return sample_rate_; }
+    int period_size() const { return period_size_; }
+    int periods() const { return periods_; }
+
+protected:
+    AudioOutput(int sample_rate, int period_size, int periods)
+            : sample_rate_(sample_rate), period_size_(period_size), periods_(periods) {}
+
+    int sample_rate_;
+    int period_size_;
+    int periods_;
+};
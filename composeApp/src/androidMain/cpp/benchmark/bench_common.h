@@ -0,0 +1,57 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Shared helpers for the host benchmarks. Every benchmark prints one JSON object per line so
+// results can be diffed or collected by scripts.
+
+inline int64_t bench_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Latency samples in nanoseconds
+class LatencyRecorder {
+public:
+    void reserve(size_t n) { samples_.reserve(n); }
+    void add(int64_t ns) { samples_.push_back(ns); }
+
+    void merge(const LatencyRecorder &other) {
+        samples_.insert(samples_.end(), other.samples_.begin(), other.samples_.end());
+    }
+
+    size_t count() const { return samples_.size(); }
+
+    // Must be called before percentile()
+    void finish() { std::sort(samples_.begin(), samples_.end()); }
+
+    int64_t percentile(double p) const {
+        if (samples_.empty()) {
+            return 0;
+        }
+        size_t index = static_cast<size_t>(p / 100.0 * static_cast<double>(samples_.size() - 1));
+        return samples_[index];
+    }
+
+    int64_t max() const { return samples_.empty() ? 0 : samples_.back(); }
+
+    // Appends "p50_ns":..,"p99_ns":..,"p999_ns":..,"max_ns":.. to a JSON object body
+    std::string json_fields() const {
+        char buf[192];
+        snprintf(buf, sizeof(buf),
+                 "\"p50_ns\":%lld,\"p99_ns\":%lld,\"p999_ns\":%lld,\"max_ns\":%lld",
+                 static_cast<long long>(percentile(50.0)),
+                 static_cast<long long>(percentile(99.0)),
+                 static_cast<long long>(percentile(99.9)),
+                 static_cast<long long>(max()));
+        return buf;
+    }
+
+private:
+    std::vector<int64_t> samples_;
+};
@@ -0,0 +1,133 @@
+// Realtime factor versus synth.cpu-cores at 64, 128 and 256 sustained voices, rendered like
+// render_period() in fluidsynth_wrapper.cpp (fluid_synth_process, reverb and chorus on,
+// 256-frame periods). cpu-cores runs from 1 up to the number of online CPUs (at most 8); each
+// value is measured with the workers unpinned and, where sysfs reports core frequencies, pinned
+// to the fastest cores the way EngineConfig's CPU_AFFINITY_FAST_CORES does.
+//
+// speedup is relative to cpu-cores 1 at the same voice count.
+//
+// Usage: bench_cores [seconds_per_workload] [soundfont.sf2 program]
+
+#include <fluidsynth.h>
+
+#include <cstdlib>
+#include <unistd.h>
+
+#include "bench_common.h"
+#include "bench_soundfont.h"
+#include "cpu_affinity.h"
+
+namespace {
+
+const int kPeriodSize = 256;
+const int kMaxCores = 8;
+
+struct Result {
+    double realtime_factor;
+    double avg_active_voices;
+};
+
+Result run(int voices, int cores, uint32_t affinity, const char *soundfont, int program,
+           double seconds) {
+    fluid_settings_t *settings = new_fluid_settings();
+    fluid_settings_setint(settings, "synth.polyphony", 256);
+    fluid_settings_setint(settings, "synth.midi-channels", 16);
+    fluid_settings_setnum(settings, "synth.gain", 0.8);
+    fluid_settings_setint(settings, "audio.period-size", kPeriodSize);
+    fluid_settings_setint(settings, "synth.cpu-cores", cores);
+
+    fluid_synth_t *synth;
+    {
+        ScopedAffinity pin(cores > 1 ? affinity : 0);
+        synth = new_fluid_synth(settings);
+    }
+    double sample_rate = 44100.0;
+    fluid_settings_getnum(settings, "synth.sample-rate", &sample_rate);
+    if (fluid_synth_sfload(synth, soundfont, 1) == FLUID_FAILED) {
+        fprintf(stderr, "Failed to load %s\n", soundfont);
+        exit(1);
+    }
+    for (int chan = 0; chan < 16; ++chan) {
+        fluid_synth_bank_select(synth, chan, 0);
+        fluid_synth_program_change(synth, chan, program);
+    }
+    for (int i = 0; i < voices; ++i) {
+        fluid_synth_noteon(synth, i % 16, 36 + (i / 16) * 3, 100);
+    }
+
+    std::vector<float> left(kPeriodSize);
+    std::vector<float> right(kPeriodSize);
+    float *out[2] = {left.data(), right.data()};
+    float *fx[4] = {left.data(), right.data(), left.data(), right.data()};
+
+    int periods = static_cast<int>(seconds * sample_rate / kPeriodSize);
+    uint64_t voice_periods = 0;
+    int64_t start = bench_now_ns();
+    for (int p = 0; p < periods; ++p) {
+        std::fill(left.begin(), left.end(), 0.0f);
+        std::fill(right.begin(), right.end(), 0.0f);
+        fluid_synth_process(synth, kPeriodSize, 4, fx, 2, out);
+        voice_periods += static_cast<uint64_t>(fluid_synth_get_active_voice_count(synth));
+    }
+    int64_t elapsed = bench_now_ns() - start;
+
+    delete_fluid_synth(synth);
+    delete_fluid_settings(settings);
+
+    double frames = static_cast<double>(periods) * kPeriodSize;
+    return {frames * 1e9 / static_cast<double>(elapsed) / sample_rate,
+            static_cast<double>(voice_periods) / periods};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 5.0;
+    std::string soundfont;
+    int program = BENCH_PROGRAM_SUSTAINED;
+    if (argc > 3) {
+        soundfont = argv[2];
+        program = atoi(argv[3]);
+    } else {
+        soundfont = "/tmp/bench_cores_" + std::to_string(getpid()) + ".sf2";
+        if (!write_bench_soundfont(soundfont)) {
+            fprintf(stderr, "Failed to write %s\n", soundfont.c_str());
+            return 1;
+        }
+    }
+
+    fluid_set_log_function(FLUID_WARN, nullptr, nullptr);
+    fluid_set_log_function(FLUID_INFO, nullptr, nullptr);
+
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_cores = static_cast<int>(std::min<long>(std::max<long>(online, 1), kMaxCores));
+    uint32_t fast = fast_cores_mask() & allowed_cores_mask();
+
+    for (int voices : {64, 128, 256}) {
+        double baseline = 0.0;
+        for (int cores = 1; cores <= max_cores; ++cores) {
+            for (bool pinned : {false, true}) {
+                if (pinned && (fast == 0 || cores == 1)) {
+                    continue;
+                }
+                Result r = run(voices, cores, pinned ? fast : 0, soundfont.c_str(), program,
+                               seconds);
+                if (cores == 1) {
+                    baseline = r.realtime_factor;
+                }
+                printf("{\"bench\":\"cores\",\"voices\":%d,\"cpu_cores\":%d,\"pinned\":%s,"
+                       "\"affinity\":\"0x%x\",\"period_size\":%d,\"avg_active_voices\":%.1f,"
+                       "\"realtime_factor\":%.2f,\"speedup\":%.2f}\n",
+                       voices, cores, pinned ? "true" : "false", pinned ? fast : 0, kPeriodSize,
+                       r.avg_active_voices, r.realtime_factor,
+                       baseline > 0.0 ? r.realtime_factor / baseline : 0.0);
+                fflush(stdout);
+            }
+        }
+    }
+
+    if (argc <= 3) {
+        unlink(soundfont.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,118 @@
+// Per-call versus batched MIDI event submission, mirroring noteOn/controlChange against
+// sendEvents in fluidsynth_wrapper.cpp: one handle lookup per event versus one per batch.
+//
+// The JNI transition itself is not included; on device it adds a fixed cost per crossing,
+// which batching pays once instead of N times.
+//
+// Usage: bench_event_batch [soundfont.sf2] [events_per_run]
+
+#include <fluidsynth.h>
+
+#include <cstdlib>
+
+#include "bench_common.h"
+#include "midi_event.h"
+#include "synth_handle_table.h"
+
+namespace {
+
+struct BenchSynth {
+    fluid_synth_t *synth;
+};
+
+HandleTable<BenchSynth, 64> table;
+
+// Chords: note-on/off pairs. Sweeps: CC 1 ramps. Bursts: a mix, like a dense MIDI file.
+std::vector<uint32_t> make_events(const char *workload, int batch) {
+    std::vector<uint32_t> events;
+    for (int i = 0; i < batch; ++i) {
+        int chan = i % 16;
+        if (workload[0] == 'c') {
+            int key = 48 + (i / 2) % 24;
+            events.push_back(i % 2 == 0 ? pack_midi_event(MIDI_NOTE_ON | chan, key, 100)
+                                        : pack_midi_event(MIDI_NOTE_OFF | chan, key, 0));
+        } else if (workload[0] == 's') {
+            events.push_back(pack_midi_event(MIDI_CONTROL_CHANGE | chan, 1, i % 128));
+        } else {
+            switch (i % 4) {
+                case 0: events.push_back(pack_midi_event(MIDI_NOTE_ON | chan, 60 + i % 12, 90)); break;
+                case 1: events.push_back(pack_midi_event(MIDI_CONTROL_CHANGE | chan, 11, i % 128)); break;
+                case 2: events.push_back(pack_midi_event(MIDI_PITCH_BEND | chan, 0, 64)); break;
+                default: events.push_back(pack_midi_event(MIDI_NOTE_OFF | chan, 60 + i % 12, 0)); break;
+            }
+        }
+    }
+    return events;
+}
+
+void run(const char *workload, int batch, int total_events, int64_t handle) {
+    std::vector<uint32_t> events = make_events(workload, batch);
+    std::vector<uint32_t> mask((batch + 31) / 32);
+    int rounds = std::max(1, total_events / batch);
+
+    LatencyRecorder per_call;
+    LatencyRecorder batched;
+    per_call.reserve(rounds);
+    batched.reserve(rounds);
+
+    for (int r = 0; r < rounds; ++r) {
+        int64_t t0 = bench_now_ns();
+        for (uint32_t event : events) {
+            EpochGuard guard;
+            BenchSynth *s = table.find(handle);
+            apply_midi_event(s->synth, event);
+        }
+        int64_t t1 = bench_now_ns();
+        {
+            EpochGuard guard;
+            BenchSynth *s = table.find(handle);
+            std::fill(mask.begin(), mask.end(), 0);
+            apply_midi_events(s->synth, events.data(), batch, mask.data());
+        }
+        int64_t t2 = bench_now_ns();
+        per_call.add(t1 - t0);
+        batched.add(t2 - t1);
+    }
+
+    per_call.finish();
+    batched.finish();
+    double per_call_eps = batch * 1e9 / static_cast<double>(per_call.percentile(50.0));
+    double batched_eps = batch * 1e9 / static_cast<double>(batched.percentile(50.0));
+    printf("{\"bench\":\"event_batch\",\"workload\":\"%s\",\"batch\":%d,\"rounds\":%d,"
+           "\"per_call_events_per_sec\":%.0f,\"batched_events_per_sec\":%.0f,\"speedup\":%.2f,"
+           "\"per_call\":{%s},\"batched\":{%s}}\n",
+           workload, batch, rounds, per_call_eps, batched_eps, batched_eps / per_call_eps,
+           per_call.json_fields().c_str(), batched.json_fields().c_str());
+    fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    const char *soundfont = argc > 1 ? argv[1] : nullptr;
+    int total_events = argc > 2 ? atoi(argv[2]) : 200000;
+
+    fluid_set_log_function(FLUID_WARN, nullptr, nullptr);
+    fluid_set_log_function(FLUID_INFO, nullptr, nullptr);
+
+    fluid_settings_t *settings = new_fluid_settings();
+    fluid_settings_setint(settings, "synth.polyphony", 256);
+    fluid_synth_t *synth = new_fluid_synth(settings);
+    if (soundfont && fluid_synth_sfload(synth, soundfont, 1) == FLUID_FAILED) {
+        fprintf(stderr, "Failed to load %s\n", soundfont);
+        return 1;
+    }
+    BenchSynth bench_synth{synth};
+    int64_t handle = table.insert(&bench_synth);
+
+    const int batches[] = {1, 3, 8, 16, 64, 256, 1024};
+    for (const char *workload : {"chord", "sweep", "burst"}) {
+        for (int batch : batches) {
+            run(workload, batch, total_events, handle);
+        }
+    }
+
+    delete_fluid_synth(synth);
+    delete_fluid_settings(settings);
+    return 0;
+}
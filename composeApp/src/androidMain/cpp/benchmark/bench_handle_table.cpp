@@ -0,0 +1,165 @@
+// Note-on latency under concurrent callers: the old global mutex + unordered_map lookup versus
+// the wait-free HandleTable used by fluidsynth_wrapper.cpp.
+//
+// A background thread periodically holds the wrapper-level critical section for several
+// milliseconds, standing in for a slow loadSoundFont. With the global mutex every note stalls
+// behind it; with the handle table only the synth that is loading is affected.
+//
+// Usage: bench_handle_table [soundfont.sf2] [calls_per_thread]
+
+#include <fluidsynth.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "bench_common.h"
+#include "synth_handle_table.h"
+
+namespace {
+
+constexpr int kSynthCount = 4;
+constexpr int kLoaderHoldMs = 5;
+constexpr int kLoaderPeriodMs = 50;
+
+struct BenchSynth {
+    fluid_settings_t *settings;
+    fluid_synth_t *synth;
+};
+
+std::unordered_map<int64_t, fluid_synth_t *> baseline_map;
+std::mutex baseline_mutex;
+HandleTable<BenchSynth, 64> table;
+
+int baseline_noteon(int64_t handle, int chan, int key, int vel) {
+    std::lock_guard<std::mutex> lock(baseline_mutex);
+    auto it = baseline_map.find(handle);
+    if (it == baseline_map.end()) {
+        return FLUID_FAILED;
+    }
+    int result = fluid_synth_noteon(it->second, chan, key, vel);
+    fluid_synth_noteoff(it->second, chan, key);
+    return result;
+}
+
+int table_noteon(int64_t handle, int chan, int key, int vel) {
+    EpochGuard guard;
+    BenchSynth *s = table.find(handle);
+    if (!s) {
+        return FLUID_FAILED;
+    }
+    int result = fluid_synth_noteon(s->synth, chan, key, vel);
+    fluid_synth_noteoff(s->synth, chan, key);
+    return result;
+}
+
+// Holds the respective "wrapper lock" like a SoundFont load would
+void loader_loop(bool baseline, std::atomic<bool> *stop) {
+    while (!stop->load(std::memory_order_relaxed)) {
+        if (baseline) {
+            std::lock_guard<std::mutex> lock(baseline_mutex);
+            std::this_thread::sleep_for(std::chrono::milliseconds(kLoaderHoldMs));
+        } else {
+            EpochGuard guard;
+            std::this_thread::sleep_for(std::chrono::milliseconds(kLoaderHoldMs));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(kLoaderPeriodMs));
+    }
+}
+
+void run(const char *mode, int threads, int calls, const std::vector<int64_t> &handles,
+         bool with_loader) {
+    bool baseline = mode[0] == 'm';
+    std::atomic<bool> stop{false};
+    std::thread loader;
+    if (with_loader) {
+        loader = std::thread(loader_loop, baseline, &stop);
+    }
+
+    std::vector<LatencyRecorder> per_thread(threads);
+    std::vector<std::thread> workers;
+    int64_t start = bench_now_ns();
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            LatencyRecorder &rec = per_thread[t];
+            rec.reserve(calls);
+            int64_t handle = handles[t % handles.size()];
+            for (int i = 0; i < calls; ++i) {
+                int key = 36 + (i % 48);
+                int64_t t0 = bench_now_ns();
+                if (baseline) {
+                    baseline_noteon(handle, t % 16, key, 100);
+                } else {
+                    table_noteon(handle, t % 16, key, 100);
+                }
+                rec.add(bench_now_ns() - t0);
+            }
+        });
+    }
+    for (auto &w : workers) {
+        w.join();
+    }
+    int64_t elapsed = bench_now_ns() - start;
+    stop.store(true);
+    if (loader.joinable()) {
+        loader.join();
+    }
+
+    LatencyRecorder all;
+    for (auto &rec : per_thread) {
+        all.merge(rec);
+    }
+    all.finish();
+    double calls_per_sec = static_cast<double>(all.count()) * 1e9 / static_cast<double>(elapsed);
+    printf("{\"bench\":\"handle_table\",\"mode\":\"%s\",\"threads\":%d,\"loader\":%s,"
+           "\"calls\":%zu,\"calls_per_sec\":%.0f,%s}\n",
+           baseline ? "mutex_map" : "handle_table", threads, with_loader ? "true" : "false",
+           all.count(), calls_per_sec, all.json_fields().c_str());
+    fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    const char *soundfont = argc > 1 ? argv[1] : nullptr;
+    int calls = argc > 2 ? atoi(argv[2]) : 20000;
+
+    // Notes without a preset log a warning per call, which would dominate the measurement
+    fluid_set_log_function(FLUID_WARN, nullptr, nullptr);
+    fluid_set_log_function(FLUID_INFO, nullptr, nullptr);
+
+    std::vector<BenchSynth> synths;
+    std::vector<int64_t> handles;
+    for (int i = 0; i < kSynthCount; ++i) {
+        fluid_settings_t *settings = new_fluid_settings();
+        fluid_settings_setint(settings, "synth.polyphony", 256);
+        fluid_settings_setint(settings, "synth.midi-channels", 16);
+        fluid_synth_t *synth = new_fluid_synth(settings);
+        if (soundfont && fluid_synth_sfload(synth, soundfont, 1) == FLUID_FAILED) {
+            fprintf(stderr, "Failed to load %s\n", soundfont);
+            return 1;
+        }
+        synths.push_back({settings, synth});
+    }
+    for (auto &s : synths) {
+        int64_t handle = table.insert(&s);
+        baseline_map[handle] = s.synth;
+        handles.push_back(handle);
+    }
+
+    const int thread_counts[] = {1, 2, 4, 8, 16, 32};
+    for (bool with_loader : {false, true}) {
+        for (int threads : thread_counts) {
+            run("mutex_map", threads, calls, handles, with_loader);
+            run("handle_table", threads, calls, handles, with_loader);
+        }
+    }
+
+    for (auto &s : synths) {
+        delete_fluid_synth(s.synth);
+        delete_fluid_settings(s.settings);
+    }
+    return 0;
+}
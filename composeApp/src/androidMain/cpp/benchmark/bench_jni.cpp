@@ -0,0 +1,228 @@
+// End-to-end cost of the JNI entry points in fluidsynth_wrapper.cpp, called exactly as ART would
+// call them but through a fake JNIEnv (fake_jni.cpp). Everything below the JNI transition is
+// real: handle lookup, argument marshalling, FluidSynth's API lock and event handling, and
+// LOGI/LOGE formatting (the android/log.h shim formats every message and drops it).
+//
+// The synth comes from createOfflineSynth, with a render thread pulling renderFrames() at
+// realtime pace like an audio callback would, so voices are freed and the API lock is contended
+// as on device. Each entry point runs in tight loops on 1-16 threads, all on one shared synth
+// and on one synth per thread.
+//
+// Not measured: the ART JNI transition itself. On device a regular native call adds a roughly
+// constant cost per crossing on top of these numbers.
+//
+// Usage: bench_jni [calls_per_thread] [soundfont.sf2]
+
+#include <fluidsynth.h>
+#include <jni.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+
+#include "bench_common.h"
+#include "bench_soundfont.h"
+#include "fake_jni.h"
+#include "midi_event.h"
+
+extern "C" {
+JNIEXPORT jlong JNICALL Java_org_tetawex_cmpsftdemo_FluidSynthJNI_createOfflineSynth(JNIEnv *, jobject, jintArray);
+JNIEXPORT void JNICALL Java_org_tetawex_cmpsftdemo_FluidSynthJNI_destroySynth(JNIEnv *, jobject, jlong);
+JNIEXPORT jint JNICALL Java_org_tetawex_cmpsftdemo_FluidSynthJNI_loadSoundFont(JNIEnv *, jobject, jlong, jstring);
+JNIEXPORT jint JNICALL Java_org_tetawex_cmpsftdemo_FluidSynthJNI_noteOn(JNIEnv *, jobject, jlong, jint, jint, jint);
+JNIEXPORT jint JNICALL Java_org_tetawex_cmpsftdemo_FluidSynthJNI_noteOff(JNIEnv *, jobject, jlong, jint, jint);
+JNIEXPORT jint JNICALL Java_org_tetawex_cmpsftdemo_FluidSynthJNI_programChange(JNIEnv *, jobject, jlong, jint, jint);
+JNIEXPORT jint JNICALL Java_org_tetawex_cmpsftdemo_FluidSynthJNI_controlChange(JNIEnv *, jobject, jlong, jint, jint, jint);
+JNIEXPORT jint JNICALL Java_org_tetawex_cmpsftdemo_FluidSynthJNI_sendEvents(JNIEnv *, jobject, jlong, jintArray, jint, jintArray);
+JNIEXPORT jint JNICALL Java_org_tetawex_cmpsftdemo_FluidSynthJNI_renderFrames(JNIEnv *, jobject, jlong, jobject, jint);
+JNIEXPORT jdouble JNICALL Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getMasterGain(JNIEnv *, jobject, jlong);
+}
+
+namespace {
+
+const int kRenderFrames = 256;
+const int kBatch = 16;
+
+// Per-thread state handed to every call
+struct Caller {
+    JNIEnv *env;
+    jlong handle;
+    FakeArray<jint> *batch;
+};
+
+struct EntryPoint {
+    const char *name;
+    std::function<void(Caller &, int)> call;
+};
+
+// Renders like an audio callback until stopped
+class RenderThread {
+public:
+    RenderThread(JNIEnv *env, jlong handle)
+            : buffer_(kRenderFrames * 2), direct_(buffer_.data(), kRenderFrames * 2) {
+        thread_ = std::thread([this, env, handle] {
+            int64_t period_ns = static_cast<int64_t>(kRenderFrames * 1e9 / 44100.0);
+            int64_t next = bench_now_ns();
+            while (!stop_.load(std::memory_order_relaxed)) {
+                Java_org_tetawex_cmpsftdemo_FluidSynthJNI_renderFrames(env, nullptr, handle,
+                                                                       direct_.get(),
+                                                                       kRenderFrames);
+                next += period_ns;
+                int64_t wait = next - bench_now_ns();
+                if (wait > 0) usleep(static_cast<useconds_t>(wait / 1000));
+            }
+        });
+    }
+
+    ~RenderThread() {
+        stop_.store(true, std::memory_order_relaxed);
+        thread_.join();
+    }
+
+private:
+    std::vector<float> buffer_;
+    FakeDirectBuffer direct_;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+};
+
+jlong create_synth(JNIEnv *env, FakeString &soundfont) {
+    jlong handle = Java_org_tetawex_cmpsftdemo_FluidSynthJNI_createOfflineSynth(env, nullptr, nullptr);
+    if (handle == -1 ||
+        Java_org_tetawex_cmpsftdemo_FluidSynthJNI_loadSoundFont(env, nullptr, handle,
+                                                                soundfont.jstr()) < 0) {
+        fprintf(stderr, "Failed to create synth with %s\n", soundfont.value.c_str());
+        exit(1);
+    }
+    return handle;
+}
+
+void run(const EntryPoint &entry, int threads, bool shared, int calls, FakeString &soundfont) {
+    JNIEnv *env = fake_jni_env();
+    std::vector<jlong> handles;
+    for (int t = 0; t < (shared ? 1 : threads); ++t) {
+        handles.push_back(create_synth(env, soundfont));
+    }
+    std::vector<std::unique_ptr<RenderThread>> renderers;
+    for (jlong handle : handles) {
+        renderers.emplace_back(new RenderThread(env, handle));
+    }
+
+    std::vector<LatencyRecorder> recorders(threads);
+    std::vector<std::thread> workers;
+    std::atomic<int> ready{0};
+    uint64_t logs_before = fake_log_count();
+    int64_t start = bench_now_ns();
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::vector<jint> events;
+            for (int i = 0; i < kBatch; ++i) {
+                int key = 48 + t % 16 + i / 2;
+                events.push_back(static_cast<jint>(
+                        i % 2 == 0 ? pack_midi_event(MIDI_NOTE_ON | (t % 16), key, 100)
+                                   : pack_midi_event(MIDI_NOTE_OFF | (t % 16), key, 0)));
+            }
+            FakeArray<jint> batch(events);
+            Caller caller{env, handles[shared ? 0 : t], &batch};
+            LatencyRecorder &recorder = recorders[t];
+            recorder.reserve(calls);
+
+            ready.fetch_add(1);
+            while (ready.load() < threads) {}
+            for (int i = 0; i < calls; ++i) {
+                int64_t t0 = bench_now_ns();
+                entry.call(caller, t * 1000 + i);
+                recorder.add(bench_now_ns() - t0);
+            }
+        });
+    }
+    for (auto &w : workers) w.join();
+    int64_t elapsed = bench_now_ns() - start;
+    uint64_t logs = fake_log_count() - logs_before;
+
+    LatencyRecorder all;
+    for (auto &r : recorders) all.merge(r);
+    all.finish();
+
+    double total = static_cast<double>(calls) * threads;
+    printf("{\"bench\":\"jni\",\"entry\":\"%s\",\"threads\":%d,\"synth\":\"%s\",\"calls\":%.0f,"
+           "\"calls_per_sec\":%.0f,\"logs_per_call\":%.2f,%s}\n",
+           entry.name, threads, shared ? "shared" : "per_thread", total,
+           total * 1e9 / static_cast<double>(elapsed), logs / total, all.json_fields().c_str());
+    fflush(stdout);
+
+    renderers.clear();
+    for (jlong handle : handles) {
+        Java_org_tetawex_cmpsftdemo_FluidSynthJNI_destroySynth(env, nullptr, handle);
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    int calls = argc > 1 ? atoi(argv[1]) : 100000;
+    std::string path;
+    if (argc > 2) {
+        path = argv[2];
+    } else {
+        path = "/tmp/bench_jni_" + std::to_string(getpid()) + ".sf2";
+        if (!write_bench_soundfont(path)) {
+            fprintf(stderr, "Failed to write %s\n", path.c_str());
+            return 1;
+        }
+    }
+    FakeString soundfont(path);
+
+    // FluidSynth's own error messages would flood stderr on the bad-channel path
+    fluid_set_log_function(FLUID_ERR, nullptr, nullptr);
+    fluid_set_log_function(FLUID_WARN, nullptr, nullptr);
+    fluid_set_log_function(FLUID_INFO, nullptr, nullptr);
+
+    // Calibration: the cost of the timer and dispatch alone
+    const EntryPoint entries[] = {
+            {"empty", [](Caller &, int) {}},
+            {"noteOn+noteOff", [](Caller &c, int i) {
+                int chan = i % 16;
+                int key = 36 + i % 48;
+                Java_org_tetawex_cmpsftdemo_FluidSynthJNI_noteOn(c.env, nullptr, c.handle, chan, key, 100);
+                Java_org_tetawex_cmpsftdemo_FluidSynthJNI_noteOff(c.env, nullptr, c.handle, chan, key);
+            }},
+            {"controlChange", [](Caller &c, int i) {
+                Java_org_tetawex_cmpsftdemo_FluidSynthJNI_controlChange(c.env, nullptr, c.handle, i % 16, 1, i % 128);
+            }},
+            {"programChange", [](Caller &c, int i) {
+                Java_org_tetawex_cmpsftdemo_FluidSynthJNI_programChange(c.env, nullptr, c.handle, i % 16, i % 2);
+            }},
+            {"sendEvents16", [](Caller &c, int) {
+                Java_org_tetawex_cmpsftdemo_FluidSynthJNI_sendEvents(c.env, nullptr, c.handle,
+                                                                     c.batch->get<jintArray>(), kBatch, nullptr);
+            }},
+            {"getMasterGain", [](Caller &c, int) {
+                Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getMasterGain(c.env, nullptr, c.handle);
+            }},
+            // Error paths: unknown handle, and a channel FluidSynth rejects; both log with LOGE
+            {"noteOn_bad_handle", [](Caller &c, int) {
+                Java_org_tetawex_cmpsftdemo_FluidSynthJNI_noteOn(c.env, nullptr, 0x7fffffff00000001LL, 0, 60, 100);
+            }},
+            {"noteOn_bad_channel", [](Caller &c, int) {
+                Java_org_tetawex_cmpsftdemo_FluidSynthJNI_noteOn(c.env, nullptr, c.handle, 99, 60, 100);
+            }},
+    };
+
+    for (const EntryPoint &entry : entries) {
+        for (int threads : {1, 2, 4, 8, 16}) {
+            run(entry, threads, true, calls, soundfont);
+            if (threads > 1) {
+                run(entry, threads, false, calls, soundfont);
+            }
+        }
+    }
+
+    if (argc <= 2) {
+        unlink(path.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,154 @@
+// Render throughput with the synth settings used by createSynth in fluidsynth_wrapper.cpp
+// (polyphony 256, 16 channels, gain 0.8, 256-frame periods), rendered the way render_period()
+// does: fluid_synth_process() with reverb and chorus mixed into the stereo output.
+//
+// Workloads: 1/16/64/256 simultaneous voices x reverb+chorus on/off x sustained/percussive.
+// Sustained voices are held for the whole run; percussive voices decay and are retriggered
+// every 250 ms, so the active voice count rises and falls like drum or piano parts.
+//
+// Usage: bench_render [seconds_per_workload] [soundfont.sf2 sustained_program percussive_program]
+// Without a SoundFont a generated one is used (see bench_soundfont.h).
+
+#include <fluidsynth.h>
+
+#include <cstdlib>
+#include <unistd.h>
+
+#include "bench_common.h"
+#include "bench_soundfont.h"
+
+namespace {
+
+const int kPeriodSize = 256;
+const int kRetriggerMs = 250;
+
+struct Workload {
+    int voices;
+    bool effects;
+    bool percussive;
+};
+
+fluid_synth_t *create_synth(fluid_settings_t *settings, bool effects) {
+    fluid_settings_setint(settings, "synth.polyphony", 256);
+    fluid_settings_setint(settings, "synth.midi-channels", 16);
+    fluid_settings_setnum(settings, "synth.gain", 0.8);
+    fluid_settings_setint(settings, "audio.period-size", kPeriodSize);
+    fluid_settings_setint(settings, "synth.reverb.active", effects ? 1 : 0);
+    fluid_settings_setint(settings, "synth.chorus.active", effects ? 1 : 0);
+    return new_fluid_synth(settings);
+}
+
+// Spreads voices over the 16 channels, up to 16 keys per channel
+void strike(fluid_synth_t *synth, int voices, bool on) {
+    for (int i = 0; i < voices; ++i) {
+        int chan = i % 16;
+        int key = 36 + (i / 16) * 3;
+        if (on) {
+            fluid_synth_noteon(synth, chan, key, 100);
+        } else {
+            fluid_synth_noteoff(synth, chan, key);
+        }
+    }
+}
+
+void run(const Workload &w, const char *soundfont, int sustained_program,
+         int percussive_program, double seconds) {
+    fluid_settings_t *settings = new_fluid_settings();
+    fluid_synth_t *synth = create_synth(settings, w.effects);
+    double sample_rate = 44100.0;
+    fluid_settings_getnum(settings, "synth.sample-rate", &sample_rate);
+    if (fluid_synth_sfload(synth, soundfont, 1) == FLUID_FAILED) {
+        fprintf(stderr, "Failed to load %s\n", soundfont);
+        exit(1);
+    }
+    int program = w.percussive ? percussive_program : sustained_program;
+    for (int chan = 0; chan < 16; ++chan) {
+        // Channel 10 defaults to the drum bank; keep every channel on the melodic bank
+        fluid_synth_bank_select(synth, chan, 0);
+        fluid_synth_program_change(synth, chan, program);
+    }
+
+    std::vector<float> left(kPeriodSize);
+    std::vector<float> right(kPeriodSize);
+    float *out[2] = {left.data(), right.data()};
+    float *fx[4] = {left.data(), right.data(), left.data(), right.data()};
+
+    int periods = static_cast<int>(seconds * sample_rate / kPeriodSize);
+    int retrigger_periods = std::max(1, static_cast<int>(kRetriggerMs / 1000.0 * sample_rate /
+                                                         kPeriodSize));
+    uint64_t voice_samples = 0;
+    LatencyRecorder period_ns;
+    period_ns.reserve(periods);
+
+    strike(synth, w.voices, true);
+    int64_t start = bench_now_ns();
+    for (int p = 0; p < periods; ++p) {
+        if (w.percussive && p > 0 && p % retrigger_periods == 0) {
+            strike(synth, w.voices, false);
+            strike(synth, w.voices, true);
+        }
+        voice_samples += static_cast<uint64_t>(fluid_synth_get_active_voice_count(synth)) *
+                         kPeriodSize;
+
+        int64_t t0 = bench_now_ns();
+        std::fill(left.begin(), left.end(), 0.0f);
+        std::fill(right.begin(), right.end(), 0.0f);
+        fluid_synth_process(synth, kPeriodSize, 4, fx, 2, out);
+        period_ns.add(bench_now_ns() - t0);
+    }
+    int64_t elapsed = bench_now_ns() - start;
+    period_ns.finish();
+
+    double frames = static_cast<double>(periods) * kPeriodSize;
+    double frames_per_sec = frames * 1e9 / static_cast<double>(elapsed);
+    printf("{\"bench\":\"render\",\"voices\":%d,\"effects\":%s,\"preset\":\"%s\","
+           "\"sample_rate\":%.0f,\"period_size\":%d,\"frames\":%.0f,"
+           "\"frames_per_sec\":%.0f,\"realtime_factor\":%.2f,\"avg_active_voices\":%.1f,"
+           "\"ns_per_voice_sample\":%.2f,\"period\":{%s}}\n",
+           w.voices, w.effects ? "true" : "false", w.percussive ? "percussive" : "sustained",
+           sample_rate, kPeriodSize, frames, frames_per_sec, frames_per_sec / sample_rate,
+           static_cast<double>(voice_samples) / frames,
+           voice_samples > 0 ? static_cast<double>(elapsed) / voice_samples : 0.0,
+           period_ns.json_fields().c_str());
+    fflush(stdout);
+
+    delete_fluid_synth(synth);
+    delete_fluid_settings(settings);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 10.0;
+    std::string soundfont;
+    int sustained_program = BENCH_PROGRAM_SUSTAINED;
+    int percussive_program = BENCH_PROGRAM_PERCUSSIVE;
+    if (argc > 4) {
+        soundfont = argv[2];
+        sustained_program = atoi(argv[3]);
+        percussive_program = atoi(argv[4]);
+    } else {
+        soundfont = "/tmp/bench_render_" + std::to_string(getpid()) + ".sf2";
+        if (!write_bench_soundfont(soundfont)) {
+            fprintf(stderr, "Failed to write %s\n", soundfont.c_str());
+            return 1;
+        }
+    }
+
+    fluid_set_log_function(FLUID_WARN, nullptr, nullptr);
+    fluid_set_log_function(FLUID_INFO, nullptr, nullptr);
+
+    for (bool percussive : {false, true}) {
+        for (bool effects : {false, true}) {
+            for (int voices : {1, 16, 64, 256}) {
+                run({voices, effects, percussive}, soundfont.c_str(), sustained_program,
+                    percussive_program, seconds);
+            }
+        }
+    }
+
+    if (argc <= 4) {
+        unlink(soundfont.c_str());
+    }
+    return 0;
+}
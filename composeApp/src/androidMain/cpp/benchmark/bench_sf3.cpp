@@ -0,0 +1,433 @@
+// SoundFont load time and memory: SF2 versus the same bank as SF3 (Ogg Vorbis samples), with
+// the SF3 decode cache cold and warm (see sf3_cache.h). The SF3 is made from the given SF2 by
+// encoding every sample with libsndfile, so both hold the same instruments.
+//
+// Modes, each measured in a forked child so memory numbers start from a clean process:
+//   sf2            - mmap loader on the SF2, as the app loads it
+//   sf2_fluidsynth - FluidSynth's own loader on the SF2 (reads every sample into memory)
+//   sf3_fluidsynth - FluidSynth's own loader on the SF3 (decodes every sample on each load)
+//   sf3_cold       - mmap loader on the SF3 with an empty cache: decode, write, map
+//   sf3_warm       - mmap loader on the SF3 with the cache filled by a previous load
+//
+// Reported per mode: load time (fluid_synth_sfload) median and min over the iterations, RSS
+// growth right after the load, after one note on every preset (which pages mapped samples in),
+// and peak RSS growth. Files stay in the page cache between runs; a cold-disk SF2 load is
+// slower by however long the device takes to read the preset tables.
+//
+// Usage: bench_sf3 [iterations] [soundfont.sf2]
+// Without a SoundFont a generated one is used (see bench_soundfont.h), which is too small for
+// meaningful numbers but exercises every path.
+
+#include <fluidsynth.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench_common.h"
+#include "bench_soundfont.h"
+#include "mmap_sfloader.h"
+#include "sf2_riff.h"
+#include "sf3_cache.h"
+#include "sndfile_api.h"
+
+namespace {
+
+const int kSampleTypeVorbis = 0x10;
+
+struct Mode {
+    const char *name;
+    const char *file;    // "sf2" or "sf3"
+    bool mmap_loader;
+    bool clear_cache;
+};
+
+struct Result {
+    int ok;
+    double load_ms;
+    double rss_load_mb;
+    double rss_played_mb;
+    double peak_rss_mb;
+};
+
+std::vector<uint8_t> read_file(const std::string &path) {
+    std::vector<uint8_t> data;
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return data;
+    }
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        data.insert(data.end(), buf, buf + n);
+    }
+    fclose(f);
+    return data;
+}
+
+bool write_file(const std::string &path, const std::vector<uint8_t> &data) {
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return fclose(f) == 0 && ok;
+}
+
+double file_mb(const std::string &path) {
+    struct stat st {};
+    return stat(path.c_str(), &st) == 0 ? static_cast<double>(st.st_size) / (1024.0 * 1024.0)
+                                        : 0.0;
+}
+
+double rss_mb() {
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(f);
+    }
+    return static_cast<double>(resident) * sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+}
+
+double peak_rss_mb() {
+    rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_maxrss) / 1024.0;
+}
+
+// libsndfile virtual I/O into a growable buffer, for encoding one sample
+struct MemoryOut {
+    std::vector<uint8_t> data;
+    sf_count_t pos = 0;
+};
+
+sf_count_t out_filelen(void *user) {
+    return static_cast<sf_count_t>(static_cast<MemoryOut *>(user)->data.size());
+}
+
+sf_count_t out_seek(sf_count_t offset, int whence, void *user) {
+    auto *out = static_cast<MemoryOut *>(user);
+    sf_count_t size = static_cast<sf_count_t>(out->data.size());
+    out->pos = whence == SEEK_CUR ? out->pos + offset : whence == SEEK_END ? size + offset : offset;
+    return out->pos;
+}
+
+sf_count_t out_read(void *ptr, sf_count_t count, void *user) {
+    auto *out = static_cast<MemoryOut *>(user);
+    sf_count_t size = static_cast<sf_count_t>(out->data.size());
+    sf_count_t n = std::max<sf_count_t>(0, std::min(count, size - out->pos));
+    memcpy(ptr, out->data.data() + out->pos, static_cast<size_t>(n));
+    out->pos += n;
+    return n;
+}
+
+sf_count_t out_write(const void *ptr, sf_count_t count, void *user) {
+    auto *out = static_cast<MemoryOut *>(user);
+    size_t end = static_cast<size_t>(out->pos + count);
+    if (end > out->data.size()) {
+        out->data.resize(end);
+    }
+    memcpy(out->data.data() + out->pos, ptr, static_cast<size_t>(count));
+    out->pos += count;
+    return count;
+}
+
+sf_count_t out_tell(void *user) {
+    return static_cast<MemoryOut *>(user)->pos;
+}
+
+bool encode_vorbis(const int16_t *points, size_t frames, int rate, std::vector<uint8_t> *ogg) {
+    MemoryOut out;
+    SF_VIRTUAL_IO io{out_filelen, out_seek, out_read, out_write, out_tell};
+    SF_INFO info{};
+    info.samplerate = rate;
+    info.channels = 1;
+    info.format = SF_FORMAT_OGG | SF_FORMAT_VORBIS;
+    SNDFILE *file = sf_open_virtual(&io, SFM_WRITE, &info, &out);
+    if (!file) {
+        return false;
+    }
+    double quality = 0.6;
+    sf_command(file, SFC_SET_VBR_ENCODING_QUALITY, &quality, sizeof(quality));
+    bool ok = sf_writef_short(file, points, static_cast<sf_count_t>(frames)) ==
+              static_cast<sf_count_t>(frames);
+    sf_close(file);
+    *ogg = std::move(out.data);
+    return ok && !ogg->empty();
+}
+
+// Rewrites an SF2 as SF3: every sample becomes an Ogg Vorbis stream, addressed by byte offsets
+// with loop points relative to the sample. Samples libsndfile cannot encode stay 16-bit PCM.
+bool make_sf3(const std::vector<uint8_t> &sf2, std::vector<uint8_t> *sf3, size_t *compressed,
+              size_t *total) {
+    sf2::Chunk riff = sf2::sfbk_body(sf2.data(), sf2.size());
+    sf2::Chunk info, smpl, pdta, shdr;
+    sf2::for_each_chunk(riff, [&](const uint8_t *id, const sf2::Chunk &chunk) {
+        if (memcmp(id, "LIST", 4) != 0 || chunk.size < 4) {
+            return;
+        }
+        sf2::Chunk body{chunk.data + 4, chunk.size - 4};
+        if (memcmp(chunk.data, "INFO", 4) == 0) info = body;
+        if (memcmp(chunk.data, "pdta", 4) == 0) pdta = body;
+        sf2::for_each_chunk(body, [&](const uint8_t *sub, const sf2::Chunk &c) {
+            if (memcmp(sub, "smpl", 4) == 0) smpl = c;
+            if (memcmp(sub, "shdr", 4) == 0) shdr = c;
+        });
+    });
+    if (!info.data || !smpl.data || !pdta.data || !shdr.data) {
+        return false;
+    }
+
+    bench_sf2::ChunkWriter streams;
+    std::vector<uint8_t> records(shdr.data, shdr.data + shdr.size);
+    size_t count = shdr.size / SF_SHDR_SIZE;
+    *compressed = 0;
+    *total = count > 0 ? count - 1 : 0;
+    for (size_t i = 0; i + 1 < count; ++i) {
+        uint8_t *record = records.data() + i * SF_SHDR_SIZE;
+        uint32_t start = sf2::read_u32(record + 20);
+        uint32_t end = sf2::read_u32(record + 24);
+        uint32_t loop_start = sf2::read_u32(record + 28);
+        uint32_t loop_end = sf2::read_u32(record + 32);
+        uint32_t rate = sf2::read_u32(record + 36);
+        uint16_t type = sf2::read_u16(record + 44);
+        if ((type & FLUID_SAMPLETYPE_ROM) || end <= start || end > smpl.size / 2) {
+            continue;
+        }
+        const auto *points = reinterpret_cast<const int16_t *>(smpl.data) + start;
+        std::vector<uint8_t> ogg;
+        if (encode_vorbis(points, end - start, static_cast<int>(rate), &ogg)) {
+            auto offset = static_cast<uint32_t>(streams.data().size());
+            streams.bytes(ogg.data(), ogg.size());
+            // FluidSynth reads end as the stream's last byte
+            sf2::write_u32(record + 20, offset);
+            sf2::write_u32(record + 24, offset + static_cast<uint32_t>(ogg.size()) - 1);
+            sf2::write_u32(record + 28, loop_start - start);
+            sf2::write_u32(record + 32, loop_end - start);
+            type |= kSampleTypeVorbis;
+            record[44] = static_cast<uint8_t>(type);
+            record[45] = static_cast<uint8_t>(type >> 8);
+            ++*compressed;
+        } else {
+            if (streams.data().size() & 1) streams.u8(0);
+            auto offset = static_cast<uint32_t>(streams.data().size() / 2);
+            streams.bytes(reinterpret_cast<const uint8_t *>(points), (end - start) * 2);
+            for (int p = 0; p < 46; ++p) streams.u16(0);
+            sf2::write_u32(record + 20, offset);
+            sf2::write_u32(record + 24, offset + (end - start));
+            sf2::write_u32(record + 28, offset + (loop_start - start));
+            sf2::write_u32(record + 32, offset + (loop_end - start));
+        }
+    }
+
+    bench_sf2::ChunkWriter info_out, sdta_out, pdta_out;
+    sf2::for_each_chunk(info, [&](const uint8_t *id, const sf2::Chunk &c) {
+        char tag[5] = {};
+        memcpy(tag, id, 4);
+        bench_sf2::ChunkWriter body;
+        if (memcmp(id, "ifil", 4) == 0) {
+            body.u16(3);
+            body.u16(1);
+        } else {
+            body.bytes(c.data, c.size);
+        }
+        info_out.chunk(tag, body);
+    });
+    sdta_out.chunk("smpl", streams);
+    sf2::for_each_chunk(pdta, [&](const uint8_t *id, const sf2::Chunk &c) {
+        char tag[5] = {};
+        memcpy(tag, id, 4);
+        bench_sf2::ChunkWriter body;
+        if (memcmp(id, "shdr", 4) == 0) {
+            body.bytes(records.data(), records.size());
+        } else {
+            body.bytes(c.data, c.size);
+        }
+        pdta_out.chunk(tag, body);
+    });
+
+    bench_sf2::ChunkWriter body;
+    body.tag("sfbk");
+    body.list("INFO", info_out);
+    body.list("sdta", sdta_out);
+    body.list("pdta", pdta_out);
+    bench_sf2::ChunkWriter out;
+    out.chunk("RIFF", body);
+    *sf3 = out.data();
+    return true;
+}
+
+void clear_cache(const std::string &dir) {
+    DIR *d = opendir(dir.c_str());
+    if (!d) {
+        return;
+    }
+    while (dirent *entry = readdir(d)) {
+        if (strncmp(entry->d_name, "sf3-", 4) == 0) {
+            unlink((dir + "/" + entry->d_name).c_str());
+        }
+    }
+    closedir(d);
+}
+
+// Loads font in a fresh synth and plays one note on each preset
+Result load_once(const Mode &mode, const std::string &font, const std::string &cache_dir) {
+    Result result{};
+    fluid_settings_t *settings = new_fluid_settings();
+    fluid_settings_setint(settings, "synth.polyphony", 256);
+    fluid_synth_t *synth = new_fluid_synth(settings);
+    if (mode.mmap_loader) {
+        fluid_synth_add_sfloader(synth, new_mmap_sfloader(settings));
+        set_sf3_cache_dir(cache_dir.c_str());
+    }
+
+    double rss_before = rss_mb();
+    int64_t start = bench_now_ns();
+    int id = fluid_synth_sfload(synth, font.c_str(), 1);
+    result.load_ms = static_cast<double>(bench_now_ns() - start) / 1e6;
+    result.ok = id != FLUID_FAILED;
+    result.rss_load_mb = rss_mb() - rss_before;
+
+    if (result.ok) {
+        std::vector<float> left(512), right(512);
+        fluid_sfont_t *sfont = fluid_synth_get_sfont_by_id(synth, id);
+        fluid_sfont_iteration_start(sfont);
+        while (fluid_preset_t *preset = fluid_sfont_iteration_next(sfont)) {
+            fluid_synth_program_select(synth, 0, id, fluid_preset_get_banknum(preset),
+                                       fluid_preset_get_num(preset));
+            fluid_synth_noteon(synth, 0, 60, 100);
+            fluid_synth_write_float(synth, 512, left.data(), 0, 1, right.data(), 0, 1);
+            fluid_synth_all_sounds_off(synth, 0);
+        }
+    }
+    result.rss_played_mb = rss_mb() - rss_before;
+    result.peak_rss_mb = peak_rss_mb() - rss_before;
+
+    delete_fluid_synth(synth);
+    delete_fluid_settings(settings);
+    return result;
+}
+
+Result measure(const Mode &mode, const std::string &font, const std::string &cache_dir) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return Result{};
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        Result result = load_once(mode, font, cache_dir);
+        ssize_t written = write(fds[1], &result, sizeof(result));
+        _exit(written == sizeof(result) ? 0 : 1);
+    }
+    close(fds[1]);
+    Result result{};
+    if (pid < 0 || read(fds[0], &result, sizeof(result)) != sizeof(result)) {
+        result.ok = 0;
+    }
+    close(fds[0]);
+    if (pid > 0) {
+        waitpid(pid, nullptr, 0);
+    }
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? std::max(1, atoi(argv[1])) : 5;
+    std::string tmp = "/tmp/bench_sf3_" + std::to_string(getpid());
+    std::string cache_dir = tmp + "_cache";
+    std::string sf2_path = argc > 2 ? argv[2] : tmp + ".sf2";
+    std::string sf3_path = tmp + ".sf3";
+    if (argc <= 2 && !write_bench_soundfont(sf2_path)) {
+        fprintf(stderr, "Failed to write %s\n", sf2_path.c_str());
+        return 1;
+    }
+    mkdir(cache_dir.c_str(), 0700);
+
+    fluid_set_log_function(FLUID_WARN, nullptr, nullptr);
+    fluid_set_log_function(FLUID_INFO, nullptr, nullptr);
+
+    std::vector<uint8_t> sf3;
+    size_t compressed = 0, total = 0;
+    int64_t encode_start = bench_now_ns();
+    if (!make_sf3(read_file(sf2_path), &sf3, &compressed, &total) || !write_file(sf3_path, sf3)) {
+        fprintf(stderr, "Failed to convert %s to SF3\n", sf2_path.c_str());
+        return 1;
+    }
+    double encode_ms = static_cast<double>(bench_now_ns() - encode_start) / 1e6;
+
+    const Mode modes[] = {
+        {"sf2", "sf2", true, false},
+        {"sf2_fluidsynth", "sf2", false, false},
+        {"sf3_fluidsynth", "sf3", false, false},
+        {"sf3_cold", "sf3", true, true},
+        {"sf3_warm", "sf3", true, false},
+    };
+    for (const Mode &mode : modes) {
+        const std::string &font = strcmp(mode.file, "sf2") == 0 ? sf2_path : sf3_path;
+        LatencyRecorder load_ns;
+        Result sum{};
+        int ok = 0;
+        for (int i = 0; i < iterations; ++i) {
+            if (mode.clear_cache) {
+                clear_cache(cache_dir);
+            }
+            Result r = measure(mode, font, cache_dir);
+            if (!r.ok) {
+                continue;
+            }
+            ++ok;
+            load_ns.add(static_cast<int64_t>(r.load_ms * 1e6));
+            sum.rss_load_mb += r.rss_load_mb;
+            sum.rss_played_mb += r.rss_played_mb;
+            sum.peak_rss_mb += r.peak_rss_mb;
+        }
+        if (ok == 0) {
+            fprintf(stderr, "%s: every load of %s failed\n", mode.name, font.c_str());
+            continue;
+        }
+        load_ns.finish();
+        printf("{\"bench\":\"sf3\",\"mode\":\"%s\",\"runs\":%d,\"load_ms_median\":%.2f,"
+               "\"load_ms_min\":%.2f,\"rss_load_mb\":%.1f,\"rss_played_mb\":%.1f,"
+               "\"peak_rss_mb\":%.1f}\n",
+               mode.name, ok, static_cast<double>(load_ns.percentile(50.0)) / 1e6,
+               static_cast<double>(load_ns.percentile(0.0)) / 1e6, sum.rss_load_mb / ok,
+               sum.rss_played_mb / ok, sum.peak_rss_mb / ok);
+        fflush(stdout);
+    }
+
+    double cache_mb = 0.0;
+    DIR *d = opendir(cache_dir.c_str());
+    while (d) {
+        dirent *entry = readdir(d);
+        if (!entry) {
+            break;
+        }
+        if (strncmp(entry->d_name, "sf3-", 4) == 0) {
+            cache_mb += file_mb(cache_dir + "/" + entry->d_name);
+        }
+    }
+    if (d) {
+        closedir(d);
+    }
+    printf("{\"bench\":\"sf3\",\"samples\":%zu,\"compressed_samples\":%zu,\"sf2_mb\":%.2f,"
+           "\"sf3_mb\":%.2f,\"cache_mb\":%.2f,\"encode_ms\":%.1f}\n",
+           total, compressed, file_mb(sf2_path), file_mb(sf3_path), cache_mb, encode_ms);
+
+    clear_cache(cache_dir);
+    rmdir(cache_dir.c_str());
+    unlink(sf3_path.c_str());
+    if (argc <= 2) {
+        unlink(sf2_path.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Writes a tiny SoundFont so the benchmarks run without shipping an .sf2. Bank 0 holds:
+//   program 0 "Sustained"  - looped waveform, full sustain: voices stay alive until note-off
+//   program 1 "Percussive" - same waveform, volume envelope decays to silence in ~0.3 s
+// Voice cost in FluidSynth does not depend on sample content, so one waveform serves both.
+
+#define BENCH_PROGRAM_SUSTAINED 0
+#define BENCH_PROGRAM_PERCUSSIVE 1
+
+namespace bench_sf2 {
+
+// SoundFont 2.01 generator operators used below
+enum {
+    GEN_VOL_ENV_DECAY = 36,
+    GEN_VOL_ENV_SUSTAIN = 37,
+    GEN_VOL_ENV_RELEASE = 38,
+    GEN_INSTRUMENT = 41,
+    GEN_SAMPLE_ID = 53,
+    GEN_SAMPLE_MODES = 54,
+};
+
+class ChunkWriter {
+public:
+    void u8(uint8_t v) { data_.push_back(v); }
+    void u16(uint16_t v) { u8(v & 0xff); u8(v >> 8); }
+    void u32(uint32_t v) { u16(v & 0xffff); u16(v >> 16); }
+    void tag(const char *id) { data_.insert(data_.end(), id, id + 4); }
+    void bytes(const uint8_t *p, size_t n) { data_.insert(data_.end(), p, p + n); }
+
+    // Fixed-width, zero-padded name field
+    void name(const char *s, size_t width) {
+        size_t n = std::min(strlen(s), width - 1);
+        data_.insert(data_.end(), s, s + n);
+        data_.insert(data_.end(), width - n, 0);
+    }
+
+    void chunk(const char *id, const ChunkWriter &body) {
+        tag(id);
+        u32(static_cast<uint32_t>(body.data_.size()));
+        data_.insert(data_.end(), body.data_.begin(), body.data_.end());
+        if (body.data_.size() & 1) u8(0);
+    }
+
+    void list(const char *type, const ChunkWriter &body) {
+        ChunkWriter list;
+        list.tag(type);
+        list.data_.insert(list.data_.end(), body.data_.begin(), body.data_.end());
+        chunk("LIST", list);
+    }
+
+    const std::vector<uint8_t> &data() const { return data_; }
+
+private:
+    std::vector<uint8_t> data_;
+};
+
+inline void gen(ChunkWriter &w, uint16_t oper, int16_t amount) {
+    w.u16(oper);
+    w.u16(static_cast<uint16_t>(amount));
+}
+
+inline std::vector<uint8_t> build() {
+    const uint32_t kRate = 44100;
+    const uint32_t kPeriod = 100;            // 441 Hz
+    const uint32_t kLength = kPeriod * 40;   // loop over whole cycles
+    const uint32_t kLoopStart = kPeriod * 2;
+    const uint32_t kLoopEnd = kLength - kPeriod * 2;
+
+    ChunkWriter info;
+    {
+        ChunkWriter ifil;
+        ifil.u16(2);
+        ifil.u16(1);
+        info.chunk("ifil", ifil);
+        ChunkWriter isng;
+        isng.name("EMU8000", 8);
+        info.chunk("isng", isng);
+        ChunkWriter inam;
+        inam.name("Benchmark", 10);
+        info.chunk("INAM", inam);
+    }
+
+    ChunkWriter sdta;
+    {
+        // Saw-like waveform with a few harmonics, then the 46 zero samples SF2 requires
+        ChunkWriter smpl;
+        for (uint32_t i = 0; i < kLength; ++i) {
+            double phase = 2.0 * M_PI * (i % kPeriod) / kPeriod;
+            double v = 0.0;
+            for (int h = 1; h <= 6; ++h) v += std::sin(h * phase) / h;
+            smpl.u16(static_cast<uint16_t>(static_cast<int16_t>(v * 12000.0)));
+        }
+        for (int i = 0; i < 46; ++i) smpl.u16(0);
+        sdta.chunk("smpl", smpl);
+    }
+
+    ChunkWriter pdta;
+    {
+        // Presets: one global-less zone each, pointing at instrument 0 and 1
+        ChunkWriter phdr, pbag, pmod, pgen;
+        const char *preset_names[] = {"Sustained", "Percussive"};
+        for (uint16_t p = 0; p < 2; ++p) {
+            phdr.name(preset_names[p], 20);
+            phdr.u16(p);      // program
+            phdr.u16(0);      // bank
+            phdr.u16(p);      // first bag
+            phdr.u32(0);
+            phdr.u32(0);
+            phdr.u32(0);
+            pbag.u16(p);      // first generator
+            pbag.u16(0);
+            gen(pgen, GEN_INSTRUMENT, static_cast<int16_t>(p));
+        }
+        phdr.name("EOP", 20);
+        phdr.u16(0); phdr.u16(0); phdr.u16(2);
+        phdr.u32(0); phdr.u32(0); phdr.u32(0);
+        pbag.u16(2); pbag.u16(0);
+        for (int i = 0; i < 10; ++i) pmod.u8(0);
+        gen(pgen, 0, 0);
+
+        // Instruments: both play sample 0 looped; the percussive one decays to silence
+        ChunkWriter inst, ibag, imod, igen;
+        uint16_t gen_index = 0;
+        const char *inst_names[] = {"Sustained", "Percussive"};
+        for (uint16_t i = 0; i < 2; ++i) {
+            inst.name(inst_names[i], 20);
+            inst.u16(i);
+            ibag.u16(gen_index);
+            ibag.u16(0);
+            gen(igen, GEN_SAMPLE_MODES, 1); ++gen_index;
+            if (i == BENCH_PROGRAM_PERCUSSIVE) {
+                gen(igen, GEN_VOL_ENV_DECAY, -2084); ++gen_index;     // ~0.3 s
+                gen(igen, GEN_VOL_ENV_SUSTAIN, 1440); ++gen_index;    // silent
+            }
+            gen(igen, GEN_VOL_ENV_RELEASE, -3986); ++gen_index;       // ~0.1 s
+            gen(igen, GEN_SAMPLE_ID, 0); ++gen_index;
+        }
+        inst.name("EOI", 20);
+        inst.u16(2);
+        ibag.u16(gen_index);
+        ibag.u16(0);
+        for (int i = 0; i < 10; ++i) imod.u8(0);
+        gen(igen, 0, 0);
+
+        ChunkWriter shdr;
+        shdr.name("Wave", 20);
+        shdr.u32(0);
+        shdr.u32(kLength);
+        shdr.u32(kLoopStart);
+        shdr.u32(kLoopEnd);
+        shdr.u32(kRate);
+        shdr.u8(69);           // A4, 440 Hz
+        shdr.u8(0);
+        shdr.u16(0);
+        shdr.u16(1);           // mono
+        shdr.name("EOS", 20);
+        for (int i = 0; i < 26; ++i) shdr.u8(0);
+
+        pdta.chunk("phdr", phdr);
+        pdta.chunk("pbag", pbag);
+        pdta.chunk("pmod", pmod);
+        pdta.chunk("pgen", pgen);
+        pdta.chunk("inst", inst);
+        pdta.chunk("ibag", ibag);
+        pdta.chunk("imod", imod);
+        pdta.chunk("igen", igen);
+        pdta.chunk("shdr", shdr);
+    }
+
+    ChunkWriter body;
+    body.tag("sfbk");
+    body.list("INFO", info);
+    body.list("sdta", sdta);
+    body.list("pdta", pdta);
+
+    ChunkWriter riff;
+    riff.chunk("RIFF", body);
+    return riff.data();
+}
+
+} // namespace bench_sf2
+
+// Writes the benchmark SoundFont to `path`. Returns false on I/O failure.
+inline bool write_bench_soundfont(const std::string &path) {
+    std::vector<uint8_t> data = bench_sf2::build();
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return fclose(f) == 0 && ok;
+}
@@ -0,0 +1,150 @@
+#include "fake_jni.h"
+
+#include <android/log.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+std::atomic<uint64_t> log_count{0};
+
+template<typename T>
+void get_region(jarray array, jsize start, jsize len, T *buf) {
+    auto *a = FakeObject::from<FakeArrayBase>(array);
+    memcpy(buf, static_cast<T *>(a->elements()) + start, sizeof(T) * static_cast<size_t>(len));
+}
+
+template<typename T>
+void set_region(jarray array, jsize start, jsize len, const T *buf) {
+    auto *a = FakeObject::from<FakeArrayBase>(array);
+    memcpy(static_cast<T *>(a->elements()) + start, buf, sizeof(T) * static_cast<size_t>(len));
+}
+
+const char *GetStringUTFChars(JNIEnv *, jstring s, jboolean *is_copy) {
+    if (is_copy) *is_copy = JNI_FALSE;
+    return FakeObject::from<FakeString>(s)->value.c_str();
+}
+
+void ReleaseStringUTFChars(JNIEnv *, jstring, const char *) {}
+
+jstring NewStringUTF(JNIEnv *, const char *chars) {
+    return (new FakeString(chars))->jstr();
+}
+
+jsize GetArrayLength(JNIEnv *, jarray array) {
+    return FakeObject::from<FakeArrayBase>(array)->length();
+}
+
+void GetIntArrayRegion(JNIEnv *, jintArray a, jsize s, jsize l, jint *b) { get_region(a, s, l, b); }
+void SetIntArrayRegion(JNIEnv *, jintArray a, jsize s, jsize l, const jint *b) { set_region(a, s, l, b); }
+void GetLongArrayRegion(JNIEnv *, jlongArray a, jsize s, jsize l, jlong *b) { get_region(a, s, l, b); }
+void SetLongArrayRegion(JNIEnv *, jlongArray a, jsize s, jsize l, const jlong *b) { set_region(a, s, l, b); }
+void SetFloatArrayRegion(JNIEnv *, jfloatArray a, jsize s, jsize l, const jfloat *b) { set_region(a, s, l, b); }
+void SetDoubleArrayRegion(JNIEnv *, jdoubleArray a, jsize s, jsize l, const jdouble *b) { set_region(a, s, l, b); }
+
+jbyteArray NewByteArray(JNIEnv *, jsize length) {
+    return (new FakeArray<jbyte>(static_cast<size_t>(length)))->get<jbyteArray>();
+}
+
+void GetByteArrayRegion(JNIEnv *, jbyteArray a, jsize s, jsize l, jbyte *b) { get_region(a, s, l, b); }
+void SetByteArrayRegion(JNIEnv *, jbyteArray a, jsize s, jsize l, const jbyte *b) { set_region(a, s, l, b); }
+
+jobject NewDirectByteBuffer(JNIEnv *, void *address, jlong capacity) {
+    return (new FakeDirectBuffer(address, capacity))->get();
+}
+
+void *GetDirectBufferAddress(JNIEnv *, jobject buffer) {
+    return FakeObject::from<FakeDirectBuffer>(buffer)->address;
+}
+
+jlong GetDirectBufferCapacity(JNIEnv *, jobject buffer) {
+    return FakeObject::from<FakeDirectBuffer>(buffer)->capacity;
+}
+
+// Fake objects are owned by the caller, so references need no bookkeeping
+jobject NewGlobalRef(JNIEnv *, jobject object) { return object; }
+void DeleteGlobalRef(JNIEnv *, jobject) {}
+
+jint GetJavaVM(JNIEnv *, JavaVM **vm);
+
+const JNINativeInterface fake_functions = {
+        GetStringUTFChars,
+        ReleaseStringUTFChars,
+        NewStringUTF,
+        GetArrayLength,
+        GetIntArrayRegion,
+        SetIntArrayRegion,
+        GetLongArrayRegion,
+        SetLongArrayRegion,
+        SetFloatArrayRegion,
+        SetDoubleArrayRegion,
+        NewByteArray,
+        GetByteArrayRegion,
+        SetByteArrayRegion,
+        NewDirectByteBuffer,
+        GetDirectBufferAddress,
+        GetDirectBufferCapacity,
+        NewGlobalRef,
+        DeleteGlobalRef,
+        GetJavaVM,
+};
+
+_JNIEnv fake_env = {&fake_functions};
+
+// Every thread shares the one fake env
+jint DetachCurrentThread(JavaVM *) { return JNI_OK; }
+
+jint GetEnv(JavaVM *, void **env, jint) {
+    *env = &fake_env;
+    return JNI_OK;
+}
+
+jint AttachCurrentThread(JavaVM *, JNIEnv **env, void *) {
+    *env = &fake_env;
+    return JNI_OK;
+}
+
+const JNIInvokeInterface fake_vm_functions = {
+        DetachCurrentThread,
+        GetEnv,
+        AttachCurrentThread,
+};
+
+_JavaVM fake_vm = {&fake_vm_functions};
+
+jint GetJavaVM(JNIEnv *, JavaVM **vm) {
+    *vm = &fake_vm;
+    return JNI_OK;
+}
+
+} // namespace
+
+JNIEnv *fake_jni_env() {
+    return &fake_env;
+}
+
+uint64_t fake_log_count() {
+    return log_count.load(std::memory_order_relaxed);
+}
+
+void fake_jni_delete(jobject object) {
+    delete FakeObject::from<FakeObject>(object);
+}
+
+extern "C" int __android_log_print(int prio, const char *tag, const char *fmt, ...) {
+    static const bool to_stderr = getenv("BENCH_LOG") != nullptr;
+    thread_local char message[1024];
+
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(message, sizeof(message), fmt, args);
+    va_end(args);
+    log_count.fetch_add(1, std::memory_order_relaxed);
+    if (to_stderr) {
+        fprintf(stderr, "%d %s: %s\n", prio, tag, message);
+    }
+    return n;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <jni.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A JNIEnv that serves the wrapper's JNI calls from plain C++ memory, so the Java_* entry points
+// can be called directly on the host. Fake objects are owned by the caller and must outlive
+// every call that uses them.
+
+JNIEnv *fake_jni_env();
+
+// Number of __android_log_print calls so far, across all threads
+uint64_t fake_log_count();
+
+// Base of every object behind a fake jobject
+class FakeObject {
+public:
+    virtual ~FakeObject() = default;
+
+    template<typename J = jobject>
+    J get() { return reinterpret_cast<J>(this); }
+
+    template<typename T>
+    static T *from(jobject object) { return static_cast<T *>(reinterpret_cast<FakeObject *>(object)); }
+};
+
+class FakeString : public FakeObject {
+public:
+    explicit FakeString(std::string value) : value(std::move(value)) {}
+    jstring jstr() { return get<jstring>(); }
+
+    std::string value;
+};
+
+class FakeArrayBase : public FakeObject {
+public:
+    virtual jsize length() const = 0;
+    virtual void *elements() = 0;
+};
+
+// Backs jintArray / jlongArray / jfloatArray / jbyteArray with a std::vector
+template<typename T>
+class FakeArray : public FakeArrayBase {
+public:
+    explicit FakeArray(size_t length) : data(length) {}
+    explicit FakeArray(std::vector<T> values) : data(std::move(values)) {}
+
+    jsize length() const override { return static_cast<jsize>(data.size()); }
+    void *elements() override { return data.data(); }
+
+    std::vector<T> data;
+};
+
+// A direct buffer over caller-owned memory
+class FakeDirectBuffer : public FakeObject {
+public:
+    FakeDirectBuffer(void *address, jlong capacity) : address(address), capacity(capacity) {}
+
+    void *address;
+    jlong capacity;
+};
+
+// Releases objects returned by NewStringUTF, NewByteArray and NewDirectByteBuffer
+void fake_jni_delete(jobject object);
@@ -0,0 +1,20 @@
+#pragma once
+
+// Host stand-in for <android/log.h>. __android_log_print() formats the message like logcat
+// would and then drops it, so the harness measures formatting cost without terminal I/O.
+// Set BENCH_LOG=1 to print messages to stderr instead.
+
+enum android_LogPriority {
+    ANDROID_LOG_UNKNOWN = 0,
+    ANDROID_LOG_DEFAULT,
+    ANDROID_LOG_VERBOSE,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+    ANDROID_LOG_FATAL,
+    ANDROID_LOG_SILENT,
+};
+
+extern "C" int __android_log_print(int prio, const char *tag, const char *fmt, ...)
+        __attribute__((format(printf, 3, 4)));
@@ -0,0 +1,142 @@
+#pragma once
+
+// Minimal stand-in for <jni.h> used by the host JNI harness (bench_jni). It keeps the shape of
+// the real header, a function table behind inline JNIEnv methods, but only declares the calls
+// fluidsynth_wrapper.cpp makes. fake_jni.cpp provides the table. Add entries here as the wrapper
+// starts using more of the JNI API.
+
+#include <cstdarg>
+#include <cstdint>
+
+#define JNIEXPORT __attribute__((visibility("default")))
+#define JNICALL
+
+#define JNI_FALSE 0
+#define JNI_TRUE 1
+#define JNI_OK 0
+#define JNI_ERR (-1)
+#define JNI_EDETACHED (-2)
+#define JNI_VERSION_1_6 0x00010006
+
+typedef uint8_t jboolean;
+typedef int8_t jbyte;
+typedef uint16_t jchar;
+typedef int16_t jshort;
+typedef int32_t jint;
+typedef int64_t jlong;
+typedef float jfloat;
+typedef double jdouble;
+typedef jint jsize;
+
+class _jobject {};
+class _jclass : public _jobject {};
+class _jstring : public _jobject {};
+class _jarray : public _jobject {};
+class _jintArray : public _jarray {};
+class _jlongArray : public _jarray {};
+class _jfloatArray : public _jarray {};
+class _jdoubleArray : public _jarray {};
+class _jbyteArray : public _jarray {};
+
+typedef _jobject *jobject;
+typedef _jclass *jclass;
+typedef _jstring *jstring;
+typedef _jarray *jarray;
+typedef _jintArray *jintArray;
+typedef _jlongArray *jlongArray;
+typedef _jfloatArray *jfloatArray;
+typedef _jdoubleArray *jdoubleArray;
+typedef _jbyteArray *jbyteArray;
+
+struct _JNIEnv;
+typedef _JNIEnv JNIEnv;
+struct _JavaVM;
+typedef _JavaVM JavaVM;
+
+struct JNINativeInterface {
+    const char *(*GetStringUTFChars)(JNIEnv *, jstring, jboolean *);
+    void (*ReleaseStringUTFChars)(JNIEnv *, jstring, const char *);
+    jstring (*NewStringUTF)(JNIEnv *, const char *);
+    jsize (*GetArrayLength)(JNIEnv *, jarray);
+    void (*GetIntArrayRegion)(JNIEnv *, jintArray, jsize, jsize, jint *);
+    void (*SetIntArrayRegion)(JNIEnv *, jintArray, jsize, jsize, const jint *);
+    void (*GetLongArrayRegion)(JNIEnv *, jlongArray, jsize, jsize, jlong *);
+    void (*SetLongArrayRegion)(JNIEnv *, jlongArray, jsize, jsize, const jlong *);
+    void (*SetFloatArrayRegion)(JNIEnv *, jfloatArray, jsize, jsize, const jfloat *);
+    void (*SetDoubleArrayRegion)(JNIEnv *, jdoubleArray, jsize, jsize, const jdouble *);
+    jbyteArray (*NewByteArray)(JNIEnv *, jsize);
+    void (*GetByteArrayRegion)(JNIEnv *, jbyteArray, jsize, jsize, jbyte *);
+    void (*SetByteArrayRegion)(JNIEnv *, jbyteArray, jsize, jsize, const jbyte *);
+    jobject (*NewDirectByteBuffer)(JNIEnv *, void *, jlong);
+    void *(*GetDirectBufferAddress)(JNIEnv *, jobject);
+    jlong (*GetDirectBufferCapacity)(JNIEnv *, jobject);
+    jobject (*NewGlobalRef)(JNIEnv *, jobject);
+    void (*DeleteGlobalRef)(JNIEnv *, jobject);
+    jint (*GetJavaVM)(JNIEnv *, JavaVM **);
+};
+
+struct JNIInvokeInterface {
+    jint (*DetachCurrentThread)(JavaVM *);
+    jint (*GetEnv)(JavaVM *, void **, jint);
+    jint (*AttachCurrentThread)(JavaVM *, JNIEnv **, void *);
+};
+
+struct _JavaVM {
+    const JNIInvokeInterface *functions;
+
+    jint DetachCurrentThread() { return functions->DetachCurrentThread(this); }
+    jint GetEnv(void **env, jint version) { return functions->GetEnv(this, env, version); }
+    jint AttachCurrentThread(JNIEnv **env, void *args) {
+        return functions->AttachCurrentThread(this, env, args);
+    }
+};
+
+struct _JNIEnv {
+    const JNINativeInterface *functions;
+
+    const char *GetStringUTFChars(jstring s, jboolean *is_copy) {
+        return functions->GetStringUTFChars(this, s, is_copy);
+    }
+    void ReleaseStringUTFChars(jstring s, const char *chars) {
+        functions->ReleaseStringUTFChars(this, s, chars);
+    }
+    jstring NewStringUTF(const char *chars) { return functions->NewStringUTF(this, chars); }
+    jsize GetArrayLength(jarray array) { return functions->GetArrayLength(this, array); }
+    void GetIntArrayRegion(jintArray array, jsize start, jsize len, jint *buf) {
+        functions->GetIntArrayRegion(this, array, start, len, buf);
+    }
+    void SetIntArrayRegion(jintArray array, jsize start, jsize len, const jint *buf) {
+        functions->SetIntArrayRegion(this, array, start, len, buf);
+    }
+    void GetLongArrayRegion(jlongArray array, jsize start, jsize len, jlong *buf) {
+        functions->GetLongArrayRegion(this, array, start, len, buf);
+    }
+    void SetLongArrayRegion(jlongArray array, jsize start, jsize len, const jlong *buf) {
+        functions->SetLongArrayRegion(this, array, start, len, buf);
+    }
+    void SetFloatArrayRegion(jfloatArray array, jsize start, jsize len, const jfloat *buf) {
+        functions->SetFloatArrayRegion(this, array, start, len, buf);
+    }
+    void SetDoubleArrayRegion(jdoubleArray array, jsize start, jsize len, const jdouble *buf) {
+        functions->SetDoubleArrayRegion(this, array, start, len, buf);
+    }
+    jbyteArray NewByteArray(jsize len) { return functions->NewByteArray(this, len); }
+    void GetByteArrayRegion(jbyteArray array, jsize start, jsize len, jbyte *buf) {
+        functions->GetByteArrayRegion(this, array, start, len, buf);
+    }
+    void SetByteArrayRegion(jbyteArray array, jsize start, jsize len, const jbyte *buf) {
+        functions->SetByteArrayRegion(this, array, start, len, buf);
+    }
+    jobject NewDirectByteBuffer(void *address, jlong capacity) {
+        return functions->NewDirectByteBuffer(this, address, capacity);
+    }
+    void *GetDirectBufferAddress(jobject buffer) {
+        return functions->GetDirectBufferAddress(this, buffer);
+    }
+    jlong GetDirectBufferCapacity(jobject buffer) {
+        return functions->GetDirectBufferCapacity(this, buffer);
+    }
+    jobject NewGlobalRef(jobject object) { return functions->NewGlobalRef(this, object); }
+    void DeleteGlobalRef(jobject object) { functions->DeleteGlobalRef(this, object); }
+    jint GetJavaVM(JavaVM **vm) { return functions->GetJavaVM(this, vm); }
+};
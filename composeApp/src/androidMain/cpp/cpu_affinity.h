@@ -0,0 +1,96 @@
+#pragma once
+
+#include <sched.h>
+#include <cstdint>
+#include <cstdio>
+
+// CPU sets for FluidSynth's voice-rendering threads. FluidSynth starts its synth.cpu-cores - 1
+// worker threads inside new_fluid_synth() and offers no hook to place them, but Linux threads
+// inherit the affinity of the thread that creates them: pinning the creating thread for the
+// duration of the call pins the workers for their lifetime. Idle workers block on FluidSynth's
+// condition variables rather than spinning.
+
+#define CPU_AFFINITY_NONE 0
+#define CPU_AFFINITY_FAST_CORES (-1)   // the cores with the highest maximum frequency
+#define CPU_AFFINITY_MAX_CPUS 31       // masks travel through a Java int
+
+// Mask of the cores with the highest cpuinfo_max_freq (the big cores on big.LITTLE), or 0 if
+// sysfs does not report frequencies
+inline uint32_t fast_cores_mask() {
+    long freqs[CPU_AFFINITY_MAX_CPUS] = {};
+    long fastest = 0;
+    for (int cpu = 0; cpu < CPU_AFFINITY_MAX_CPUS; ++cpu) {
+        char path[96];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq",
+                 cpu);
+        FILE *f = fopen(path, "r");
+        if (!f) {
+            continue;
+        }
+        if (fscanf(f, "%ld", &freqs[cpu]) != 1) {
+            freqs[cpu] = 0;
+        }
+        fclose(f);
+        if (freqs[cpu] > fastest) {
+            fastest = freqs[cpu];
+        }
+    }
+
+    uint32_t mask = 0;
+    for (int cpu = 0; cpu < CPU_AFFINITY_MAX_CPUS; ++cpu) {
+        if (fastest > 0 && freqs[cpu] == fastest) {
+            mask |= 1u << cpu;
+        }
+    }
+    return mask;
+}
+
+// Mask of the cores the calling thread may run on
+inline uint32_t allowed_cores_mask() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return 0;
+    }
+    uint32_t mask = 0;
+    for (int cpu = 0; cpu < CPU_AFFINITY_MAX_CPUS; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) {
+            mask |= 1u << cpu;
+        }
+    }
+    return mask;
+}
+
+// Restricts the calling thread to `mask` until destroyed; threads it starts in the meantime
+// keep the restriction. A zero mask leaves the affinity alone.
+class ScopedAffinity {
+public:
+    explicit ScopedAffinity(uint32_t mask) {
+        if (mask == 0 || sched_getaffinity(0, sizeof(saved_), &saved_) != 0) {
+            return;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu = 0; cpu < CPU_AFFINITY_MAX_CPUS; ++cpu) {
+            if (mask & (1u << cpu)) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        active_ = sched_setaffinity(0, sizeof(set), &set) == 0;
+    }
+
+    ~ScopedAffinity() {
+        if (active_) {
+            sched_setaffinity(0, sizeof(saved_), &saved_);
+        }
+    }
+
+    ScopedAffinity(const ScopedAffinity &) = delete;
+    ScopedAffinity &operator=(const ScopedAffinity &) = delete;
+
+    bool active() const { return active_; }
+
+private:
+    cpu_set_t saved_;
+    bool active_ = false;
+};
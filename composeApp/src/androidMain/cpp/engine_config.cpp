@@ -0,0 +1,139 @@
+#include "engine_config.h"
+#include "cpu_affinity.h"
+
+#include <algorithm>
+#include <unistd.h>
+
+#ifdef __ANDROID__
+#include <android/log.h>
+
+#define LOG_TAG "FluidSynthJNI"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#else
+#include <cstdio>
+
+#define LOGI(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#endif
+
+namespace {
+
+// Clamps value to the range FluidSynth registered for an int setting
+void clamp_int_setting(fluid_settings_t *settings, const char *name, int *value) {
+    int min = 0, max = 0;
+    if (fluid_settings_getint_range(settings, name, &min, &max) != FLUID_OK) {
+        return;
+    }
+    int clamped = std::min(std::max(*value, min), max);
+    if (clamped != *value) {
+        LOGI("Engine config: %s %d out of range [%d, %d], using %d", name, *value, min, max,
+             clamped);
+        *value = clamped;
+    }
+}
+
+} // namespace
+
+EngineConfig EngineConfig::from_array(const int32_t *values) {
+    EngineConfig config;
+    if (values[CONFIG_DEVICE_SAMPLE_RATE] > 0) {
+        config.device_sample_rate = values[CONFIG_DEVICE_SAMPLE_RATE];
+        config.sample_rate = config.device_sample_rate;
+    }
+    if (values[CONFIG_DEVICE_BURST] > 0) {
+        config.device_burst = values[CONFIG_DEVICE_BURST];
+    }
+    if (values[CONFIG_SAMPLE_RATE] > 0) config.sample_rate = values[CONFIG_SAMPLE_RATE];
+    if (values[CONFIG_PERIOD_SIZE] > 0) config.period_size = values[CONFIG_PERIOD_SIZE];
+    if (values[CONFIG_PERIODS] > 0) config.periods = values[CONFIG_PERIODS];
+    if (values[CONFIG_POLYPHONY] > 0) config.polyphony = values[CONFIG_POLYPHONY];
+    if (values[CONFIG_CPU_CORES] > 0) config.cpu_cores = values[CONFIG_CPU_CORES];
+    config.reverb = values[CONFIG_REVERB] != 0;
+    config.chorus = values[CONFIG_CHORUS] != 0;
+    if (values[CONFIG_AUDIO_GROUPS] > 0) config.audio_groups = values[CONFIG_AUDIO_GROUPS];
+    config.cpu_affinity = values[CONFIG_CPU_AFFINITY];
+    return config;
+}
+
+void EngineConfig::to_array(int32_t *values) const {
+    values[CONFIG_SAMPLE_RATE] = sample_rate;
+    values[CONFIG_PERIOD_SIZE] = period_size;
+    values[CONFIG_PERIODS] = periods;
+    values[CONFIG_POLYPHONY] = polyphony;
+    values[CONFIG_CPU_CORES] = cpu_cores;
+    values[CONFIG_REVERB] = reverb ? 1 : 0;
+    values[CONFIG_CHORUS] = chorus ? 1 : 0;
+    values[CONFIG_AUDIO_GROUPS] = audio_groups;
+    values[CONFIG_DEVICE_SAMPLE_RATE] = device_sample_rate;
+    values[CONFIG_DEVICE_BURST] = device_burst;
+    values[CONFIG_CPU_AFFINITY] = cpu_affinity;
+}
+
+void EngineConfig::validate(fluid_settings_t *settings) {
+    double rate_min = 0.0, rate_max = 0.0;
+    if (fluid_settings_getnum_range(settings, "synth.sample-rate", &rate_min, &rate_max) ==
+        FLUID_OK) {
+        int clamped = std::min(std::max(sample_rate, static_cast<int>(rate_min)),
+                               static_cast<int>(rate_max));
+        if (clamped != sample_rate) {
+            LOGI("Engine config: sample rate %d out of range, using %d", sample_rate, clamped);
+            sample_rate = clamped;
+        }
+    }
+    if (device_sample_rate > 0 && sample_rate != device_sample_rate) {
+        LOGI("Engine config: %d Hz differs from the device's %d Hz; output will be resampled "
+             "and cannot use the low-latency path", sample_rate, device_sample_rate);
+    }
+
+    clamp_int_setting(settings, "audio.period-size", &period_size);
+    if (device_burst > 0 && period_size % device_burst != 0) {
+        int rounded = (period_size / device_burst + 1) * device_burst;
+        LOGI("Engine config: period size %d rounded up to %d, a multiple of the device burst %d",
+             period_size, rounded, device_burst);
+        period_size = rounded;
+        clamp_int_setting(settings, "audio.period-size", &period_size);
+    }
+    clamp_int_setting(settings, "audio.periods", &periods);
+    clamp_int_setting(settings, "synth.polyphony", &polyphony);
+
+    clamp_int_setting(settings, "synth.cpu-cores", &cpu_cores);
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online > 0 && cpu_cores > online) {
+        LOGI("Engine config: %d cpu cores requested, %ld online", cpu_cores, online);
+        cpu_cores = static_cast<int>(online);
+    }
+
+    clamp_int_setting(settings, "synth.audio-groups", &audio_groups);
+    if (audio_groups > MAX_AUDIO_GROUPS) {
+        LOGI("Engine config: %d audio groups requested, using %d", audio_groups,
+             MAX_AUDIO_GROUPS);
+        audio_groups = MAX_AUDIO_GROUPS;
+    }
+
+    if (cpu_affinity != CPU_AFFINITY_NONE) {
+        uint32_t requested = cpu_affinity == CPU_AFFINITY_FAST_CORES
+                             ? fast_cores_mask() : static_cast<uint32_t>(cpu_affinity);
+        uint32_t mask = requested & allowed_cores_mask();
+        if (mask != requested || mask == 0) {
+            LOGI("Engine config: cpu affinity 0x%x not available, using 0x%x", requested, mask);
+        }
+        cpu_affinity = static_cast<int>(mask);
+        if (cpu_affinity != CPU_AFFINITY_NONE && cpu_cores > __builtin_popcount(mask)) {
+            LOGI("Engine config: %d cpu cores share %d pinned cores", cpu_cores,
+                 __builtin_popcount(mask));
+        }
+    }
+}
+
+void EngineConfig::apply(fluid_settings_t *settings) const {
+    fluid_settings_setnum(settings, "synth.sample-rate", sample_rate);
+    fluid_settings_setint(settings, "audio.period-size", period_size);
+    fluid_settings_setint(settings, "audio.periods", periods);
+    fluid_settings_setint(settings, "synth.polyphony", polyphony);
+    fluid_settings_setint(settings, "synth.cpu-cores", cpu_cores);
+    fluid_settings_setint(settings, "synth.reverb.active", reverb ? 1 : 0);
+    fluid_settings_setint(settings, "synth.chorus.active", chorus ? 1 : 0);
+    // One stereo pair per group, rendered to separate buffers by GroupBus and mixed down to the
+    // two output channels
+    fluid_settings_setint(settings, "synth.audio-groups", audio_groups);
+    fluid_settings_setint(settings, "synth.audio-channels", audio_groups);
+}
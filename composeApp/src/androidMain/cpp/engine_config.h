@@ -0,0 +1,50 @@
+#pragma once
+
+#include <fluidsynth.h>
+#include <cstdint>
+
+// Layout of the int array passed to createSynth / createOfflineSynth
+#define CONFIG_SAMPLE_RATE 0
+#define CONFIG_PERIOD_SIZE 1
+#define CONFIG_PERIODS 2
+#define CONFIG_POLYPHONY 3
+#define CONFIG_CPU_CORES 4
+#define CONFIG_REVERB 5               // 0 or 1
+#define CONFIG_CHORUS 6               // 0 or 1
+#define CONFIG_AUDIO_GROUPS 7
+#define CONFIG_DEVICE_SAMPLE_RATE 8   // AudioManager PROPERTY_OUTPUT_SAMPLE_RATE, 0 if unknown
+#define CONFIG_DEVICE_BURST 9         // AudioManager PROPERTY_OUTPUT_FRAMES_PER_BUFFER, 0 if unknown
+#define CONFIG_CPU_AFFINITY 10        // CPU mask for render workers, or CPU_AFFINITY_* (cpu_affinity.h)
+#define CONFIG_FIELDS 11
+
+// Channel c plays in audio group c % groups, so groups past the 16 channels Kotlin plays on
+// would stay silent
+#define MAX_AUDIO_GROUPS 16
+
+// Engine parameters fixed when a synth is created. Kotlin passes them as an int array; zero
+// fields take the default (or the device value where one is known).
+struct EngineConfig {
+    int sample_rate = 44100;
+    int period_size = 256;
+    int periods = 2;
+    int polyphony = 256;
+    int cpu_cores = 1;
+    bool reverb = true;
+    bool chorus = true;
+    int audio_groups = 1;
+    int device_sample_rate = 0;
+    int device_burst = 0;
+    int cpu_affinity = 0;
+
+    static EngineConfig from_array(const int32_t *values);
+    void to_array(int32_t *values) const;
+
+    // Clamps every field to the ranges FluidSynth accepts and the CPUs present, and rounds the
+    // period size up to a multiple of the device burst so the output stays on the low-latency
+    // path. A CPU_AFFINITY_FAST_CORES affinity resolves to a concrete mask. Each adjustment is
+    // logged.
+    void validate(fluid_settings_t *settings);
+
+    // Writes the synth.* and audio.* settings; call before new_fluid_synth()
+    void apply(fluid_settings_t *settings) const;
+};
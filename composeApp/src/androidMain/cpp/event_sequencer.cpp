@@ -0,0 +1,155 @@
+#include "event_sequencer.h"
+
+#include "midi_event.h"
+
+namespace {
+
+// Fills evt from a packed channel message; false for anything else
+bool to_seq_event(uint32_t event, fluid_event_t *evt) {
+    int status = static_cast<int>(event & 0xff);
+    int chan = status & 0x0f;
+    int data1 = static_cast<int>((event >> 8) & 0x7f);
+    int data2 = static_cast<int>((event >> 16) & 0x7f);
+    switch (status & 0xf0) {
+        case MIDI_NOTE_OFF:
+            fluid_event_noteoff(evt, chan, static_cast<short>(data1));
+            return true;
+        case MIDI_NOTE_ON:
+            if (data2 == 0) {
+                fluid_event_noteoff(evt, chan, static_cast<short>(data1));
+            } else {
+                fluid_event_noteon(evt, chan, static_cast<short>(data1), static_cast<short>(data2));
+            }
+            return true;
+        case MIDI_KEY_PRESSURE:
+            fluid_event_key_pressure(evt, chan, static_cast<short>(data1), data2);
+            return true;
+        case MIDI_CONTROL_CHANGE:
+            fluid_event_control_change(evt, chan, static_cast<short>(data1), data2);
+            return true;
+        case MIDI_PROGRAM_CHANGE:
+            fluid_event_program_change(evt, chan, data1);
+            return true;
+        case MIDI_CHANNEL_PRESSURE:
+            fluid_event_channel_pressure(evt, chan, data1);
+            return true;
+        case MIDI_PITCH_BEND:
+            fluid_event_pitch_bend(evt, chan, data1 | (data2 << 7));
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Packs a sequencer event back into a channel message; false for the sequencer's own events
+bool from_seq_event(fluid_event_t *evt, uint32_t *packed) {
+    int chan = fluid_event_get_channel(evt) & 0x0f;
+    switch (fluid_event_get_type(evt)) {
+        case FLUID_SEQ_NOTEON:
+            *packed = pack_midi_event(MIDI_NOTE_ON | chan, fluid_event_get_key(evt),
+                                      fluid_event_get_velocity(evt));
+            return true;
+        case FLUID_SEQ_NOTEOFF:
+            *packed = pack_midi_event(MIDI_NOTE_OFF | chan, fluid_event_get_key(evt), 0);
+            return true;
+        case FLUID_SEQ_KEYPRESSURE:
+            *packed = pack_midi_event(MIDI_KEY_PRESSURE | chan, fluid_event_get_key(evt),
+                                      fluid_event_get_value(evt));
+            return true;
+        case FLUID_SEQ_CONTROLCHANGE:
+            *packed = pack_midi_event(MIDI_CONTROL_CHANGE | chan, fluid_event_get_control(evt),
+                                      fluid_event_get_value(evt));
+            return true;
+        case FLUID_SEQ_PROGRAMCHANGE:
+            *packed = pack_midi_event(MIDI_PROGRAM_CHANGE | chan, fluid_event_get_program(evt), 0);
+            return true;
+        case FLUID_SEQ_CHANNELPRESSURE:
+            *packed = pack_midi_event(MIDI_CHANNEL_PRESSURE | chan, fluid_event_get_value(evt), 0);
+            return true;
+        case FLUID_SEQ_PITCHBEND: {
+            int pitch = fluid_event_get_pitch(evt);
+            *packed = pack_midi_event(MIDI_PITCH_BEND | chan, pitch & 0x7f, pitch >> 7);
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+unsigned int frame_to_ms(uint64_t frame, int sample_rate) {
+    return static_cast<unsigned int>(frame * 1000 / static_cast<uint64_t>(sample_rate));
+}
+
+} // namespace
+
+EventSequencer::EventSequencer(PresetLoader *presets, int sample_rate, uint64_t start_frame)
+        : presets_(presets), sample_rate_(sample_rate), seq_(new_fluid_sequencer2(0)) {
+    if (!seq_) {
+        return;
+    }
+    client_ = fluid_sequencer_register_client(seq_, "synth", handle_event, this);
+    if (client_ == FLUID_FAILED) {
+        delete_fluid_sequencer(seq_);
+        seq_ = nullptr;
+        return;
+    }
+    fluid_sequencer_set_time_scale(seq_, SEQUENCER_DEFAULT_SCALE);
+    // Not shared with the render thread yet
+    fluid_sequencer_process(seq_, frame_to_ms(start_frame, sample_rate_));
+}
+
+EventSequencer::~EventSequencer() {
+    if (seq_) {
+        delete_fluid_sequencer(seq_);
+    }
+}
+
+int EventSequencer::schedule(const uint32_t *events, const uint32_t *ticks, int count,
+                             bool absolute) {
+    fluid_event_t *evt = new_fluid_event();
+    if (!evt) {
+        return 0;
+    }
+    fluid_event_set_source(evt, -1);
+    fluid_event_set_dest(evt, client_);
+
+    int scheduled = 0;
+    for (; scheduled < count; ++scheduled) {
+        if (!to_seq_event(events[scheduled], evt)) {
+            break;
+        }
+        // Counted first: the render thread may fire the event before send_at returns
+        pending_.fetch_add(1, std::memory_order_release);
+        if (fluid_sequencer_send_at(seq_, evt, ticks[scheduled], absolute ? 1 : 0) != FLUID_OK) {
+            pending_.fetch_sub(1, std::memory_order_release);
+            break;
+        }
+    }
+    delete_fluid_event(evt);
+    return scheduled;
+}
+
+void EventSequencer::clear() {
+    fluid_sequencer_remove_events(seq_, -1, client_, -1);
+    pending_.store(0, std::memory_order_release);
+}
+
+void EventSequencer::set_time_scale(double ticks_per_second) {
+    fluid_sequencer_set_time_scale(seq_, ticks_per_second);
+}
+
+void EventSequencer::process(uint64_t frame) {
+    fluid_sequencer_process(seq_, frame_to_ms(frame, sample_rate_));
+}
+
+// Render thread, from inside process()
+void EventSequencer::handle_event(unsigned int /*time*/, fluid_event_t *event,
+                                  fluid_sequencer_t * /*seq*/, void *data) {
+    auto *self = static_cast<EventSequencer *>(data);
+    uint32_t packed;
+    if (!from_seq_event(event, &packed)) {
+        return;
+    }
+    self->pending_.fetch_sub(1, std::memory_order_release);
+    self->presets_->apply_event(packed);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <fluidsynth.h>
+#include <atomic>
+#include <cstdint>
+
+#include "preset_loader.h"
+
+// Default sequencer time scale: ticks per second, so one tick is a millisecond
+#define SEQUENCER_DEFAULT_SCALE 1000.0
+
+// Schedules packed MIDI events (midi_event.h) at ticks of a fluid_sequencer running on the
+// synth's sample clock. The sequencer is created with new_fluid_sequencer2(0), so no timer
+// thread advances it: the render thread calls process() at each internal block with the time the
+// block ends, so like timed events they take effect at the start of the block containing their
+// tick, on the same timeline as the audio.
+//
+// Events go to the synth through this class's own sequencer client rather than
+// fluid_sequencer_register_fluidsynth(): that client calls into the synth without regard for
+// the API lock, and the render thread must not wait on it while a long call holds it. The
+// render thread only processes the sequencer when queued events may be applied, so events due
+// meanwhile wait for the next period, in order.
+//
+// Scheduling is thread-safe; fluid_sequencer guards its queue with a lock the render thread
+// shares for the few microseconds an insert takes.
+class EventSequencer {
+public:
+    // Events go to the synth through presets, its SynthInstance::presets, so program changes
+    // never load samples on the render thread. start_frame is the synth's current position on
+    // its audio clock, where tick() starts.
+    EventSequencer(PresetLoader *presets, int sample_rate, uint64_t start_frame);
+
+    // The synth must no longer be rendering
+    ~EventSequencer();
+
+    EventSequencer(const EventSequencer &) = delete;
+    EventSequencer &operator=(const EventSequencer &) = delete;
+
+    bool valid() const { return seq_ != nullptr; }
+
+    // Schedules events[i] at ticks[i], or that many ticks after the current one unless
+    // absolute. Returns how many were scheduled before the first one the sequencer cannot carry
+    // (system messages) or refused.
+    int schedule(const uint32_t *events, const uint32_t *ticks, int count, bool absolute);
+
+    // Drops every scheduled event; notes already started keep sounding
+    void clear();
+
+    // Tick at the end of the block rendered last
+    unsigned int tick() { return fluid_sequencer_get_tick(seq_); }
+
+    // Ticks per second. Already scheduled events keep their ticks.
+    void set_time_scale(double ticks_per_second);
+    double time_scale() { return fluid_sequencer_get_time_scale(seq_); }
+
+    // Render thread: whether scheduled events have not fired yet. Can briefly read true after
+    // they all fired or were cleared, which only costs block-sized render calls.
+    bool pending() const { return pending_.load(std::memory_order_acquire) > 0; }
+
+    // Render thread: fires the events due by frame on the synth's audio clock
+    void process(uint64_t frame);
+
+private:
+    static void handle_event(unsigned int time, fluid_event_t *event, fluid_sequencer_t *seq,
+                             void *data);
+
+    PresetLoader *presets_;
+    int sample_rate_;
+    fluid_sequencer_t *seq_;
+    fluid_seq_id_t client_ = -1;
+    std::atomic<int> pending_{0};
+};
@@ -0,0 +1,202 @@
+#include "export_job.h"
+
+#include <algorithm>
+#include <new>
+#include <unistd.h>
+
+#ifdef __ANDROID__
+#include <android/log.h>
+
+#define LOG_TAG "FluidSynthJNI"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#else
+#include <cstdio>
+
+#define LOGI(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#define LOGE(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#endif
+
+namespace {
+
+bool sndfile_format(int format, int *sf_format) {
+    switch (format) {
+        case EXPORT_FORMAT_WAV:
+            *sf_format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
+            return true;
+        case EXPORT_FORMAT_FLAC:
+            *sf_format = SF_FORMAT_FLAC | SF_FORMAT_PCM_16;
+            return true;
+        case EXPORT_FORMAT_OGG:
+            *sf_format = SF_FORMAT_OGG | SF_FORMAT_VORBIS;
+            return true;
+        default:
+            return false;
+    }
+}
+
+} // namespace
+
+SNDFILE *open_export_file(const char *path, int format, int sample_rate) {
+    SF_INFO info = {};
+    info.samplerate = sample_rate;
+    info.channels = 2;
+    if (!sndfile_format(format, &info.format) || !sf_format_check(&info)) {
+        LOGE("Unsupported export format %d at %d Hz", format, sample_rate);
+        return nullptr;
+    }
+
+    SNDFILE *file = sf_open(path, SFM_WRITE, &info);
+    if (!file) {
+        LOGE("Failed to open export file %s: %s", path, sf_strerror(nullptr));
+        return nullptr;
+    }
+    // Clip instead of wrapping around when a loud mix is converted to integer samples
+    sf_command(file, SFC_SET_CLIPPING, nullptr, SF_TRUE);
+    if (format == EXPORT_FORMAT_OGG) {
+        double quality = 0.6;
+        sf_command(file, SFC_SET_VBR_ENCODING_QUALITY, &quality, sizeof(quality));
+    }
+    return file;
+}
+
+ExportJob *ExportJob::start(const char *path, int format, int sample_rate, int64_t total_frames,
+                            export_render_func_t render, export_done_func_t done) {
+    SNDFILE *file = open_export_file(path, format, sample_rate);
+    if (!file) {
+        return nullptr;
+    }
+
+    auto *job = new(std::nothrow) ExportJob(path, file, total_frames, std::move(render),
+                                            std::move(done));
+    if (!job) {
+        sf_close(file);
+        unlink(path);
+        return nullptr;
+    }
+    job->encode_thread_ = std::thread(&ExportJob::encode_loop, job);
+    job->render_thread_ = std::thread(&ExportJob::render_loop, job);
+    LOGI("Export started: %s, %lld frames", path, static_cast<long long>(total_frames));
+    return job;
+}
+
+ExportJob::ExportJob(std::string path, SNDFILE *file, int64_t total_frames,
+                     export_render_func_t render, export_done_func_t done)
+        : path_(std::move(path)), file_(file), total_frames_(total_frames),
+          render_(std::move(render)), done_(std::move(done)) {
+    for (Block &block : blocks_) {
+        block.samples.resize(EXPORT_BLOCK_FRAMES * 2);
+        free_.push_back(&block);
+    }
+}
+
+ExportJob::~ExportJob() {
+    cancel();
+    wait();
+}
+
+void ExportJob::cancel() {
+    cancelled_.store(true, std::memory_order_release);
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    free_cv_.notify_all();
+}
+
+void ExportJob::wait() {
+    if (render_thread_.joinable()) render_thread_.join();
+    if (encode_thread_.joinable()) encode_thread_.join();
+}
+
+double ExportJob::progress() const {
+    if (total_frames_ <= 0) {
+        return 1.0;
+    }
+    return static_cast<double>(frames_written_.load(std::memory_order_relaxed)) / total_frames_;
+}
+
+void ExportJob::fail(const char *reason) {
+    LOGE("Export of %s failed: %s", path_.c_str(), reason);
+    failed_.store(true, std::memory_order_release);
+    cancel();
+}
+
+void ExportJob::render_loop() {
+    int64_t rendered = 0;
+    while (rendered < total_frames_) {
+        Block *block;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            free_cv_.wait(lock, [this] {
+                return !free_.empty() || cancelled_.load(std::memory_order_acquire);
+            });
+            if (cancelled_.load(std::memory_order_acquire)) {
+                break;
+            }
+            block = free_.front();
+            free_.pop_front();
+        }
+
+        block->frames = static_cast<int>(std::min<int64_t>(EXPORT_BLOCK_FRAMES,
+                                                           total_frames_ - rendered));
+        if (!render_(block->samples.data(), block->frames)) {
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex_);
+                free_.push_back(block);
+            }
+            fail("render callback aborted");
+            break;
+        }
+
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        filled_.push_back(block);
+        filled_cv_.notify_one();
+        rendered += block->frames;
+    }
+
+    done_();
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    render_finished_ = true;
+    filled_cv_.notify_one();
+}
+
+void ExportJob::encode_loop() {
+    while (true) {
+        Block *block;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            filled_cv_.wait(lock, [this] { return !filled_.empty() || render_finished_; });
+            if (filled_.empty()) {
+                break;
+            }
+            block = filled_.front();
+            filled_.pop_front();
+        }
+
+        // After a cancel, keep returning blocks so the render thread never stalls
+        if (!cancelled_.load(std::memory_order_acquire)) {
+            sf_count_t written = sf_writef_float(file_, block->samples.data(), block->frames);
+            if (written != block->frames) {
+                fail(sf_strerror(file_));
+            } else {
+                frames_written_.fetch_add(block->frames, std::memory_order_relaxed);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        free_.push_back(block);
+        free_cv_.notify_one();
+    }
+
+    sf_close(file_);
+    file_ = nullptr;
+    if (failed_.load(std::memory_order_acquire)) {
+        unlink(path_.c_str());
+        status_.store(EXPORT_FAILED, std::memory_order_release);
+    } else if (cancelled_.load(std::memory_order_acquire)) {
+        unlink(path_.c_str());
+        LOGI("Export of %s cancelled", path_.c_str());
+        status_.store(EXPORT_CANCELLED, std::memory_order_release);
+    } else {
+        LOGI("Export of %s finished", path_.c_str());
+        status_.store(EXPORT_DONE, std::memory_order_release);
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sndfile_api.h"
+
+// Container formats accepted by startExport
+#define EXPORT_FORMAT_WAV 0
+#define EXPORT_FORMAT_FLAC 1
+#define EXPORT_FORMAT_OGG 2
+
+// Export job states
+#define EXPORT_FAILED -1
+#define EXPORT_RUNNING 0
+#define EXPORT_DONE 1
+#define EXPORT_CANCELLED 2
+
+#define EXPORT_BLOCK_FRAMES 4096
+#define EXPORT_QUEUE_BLOCKS 8
+
+// Fills `frames` interleaved stereo frames; returning false aborts the export
+typedef std::function<bool(float *interleaved, int frames)> export_render_func_t;
+// Called once on the render thread after its last render call
+typedef std::function<void()> export_done_func_t;
+
+// Opens path for writing interleaved stereo float frames in one of the EXPORT_FORMAT_*
+// containers, clipping on conversion to integer samples. Returns nullptr, logged, if the format
+// or the file cannot be opened.
+SNDFILE *open_export_file(const char *path, int format, int sample_rate);
+
+// Bounces audio to a file on two threads: the render thread fills fixed-size blocks through the
+// render callback and hands them to the encoder thread over a bounded queue, which writes them
+// with libsndfile. Rendering and encoding overlap, and the queue bounds memory use when either
+// side is slower.
+class ExportJob {
+public:
+    // Opens the output file and starts both threads. Returns nullptr if the file or format
+    // cannot be opened; `done` is not called in that case.
+    static ExportJob *start(const char *path, int format, int sample_rate, int64_t total_frames,
+                            export_render_func_t render, export_done_func_t done);
+
+    // Cancels a running export and waits for both threads
+    ~ExportJob();
+
+    ExportJob(const ExportJob &) = delete;
+    ExportJob &operator=(const ExportJob &) = delete;
+
+    // Stops both threads as soon as possible; the partial file is deleted
+    void cancel();
+
+    // Waits for both threads to finish. Not thread-safe against itself.
+    void wait();
+
+    int status() const { return status_.load(std::memory_order_acquire); }
+
+    // Fraction of frames written to the file, 0..1
+    double progress() const;
+
+private:
+    struct Block {
+        std::vector<float> samples;
+        int frames = 0;
+    };
+
+    ExportJob(std::string path, SNDFILE *file, int64_t total_frames, export_render_func_t render,
+              export_done_func_t done);
+
+    void render_loop();
+    void encode_loop();
+    void fail(const char *reason);
+
+    std::string path_;
+    SNDFILE *file_;
+    int64_t total_frames_;
+    export_render_func_t render_;
+    export_done_func_t done_;
+
+    Block blocks_[EXPORT_QUEUE_BLOCKS];
+    std::mutex queue_mutex_;
+    std::condition_variable free_cv_;
+    std::condition_variable filled_cv_;
+    std::deque<Block *> free_;
+    std::deque<Block *> filled_;
+    bool render_finished_ = false;
+
+    std::atomic<bool> cancelled_{false};
+    std::atomic<bool> failed_{false};
+    std::atomic<int64_t> frames_written_{0};
+    std::atomic<int> status_{EXPORT_RUNNING};
+
+    std::thread render_thread_;
+    std::thread encode_thread_;
+};
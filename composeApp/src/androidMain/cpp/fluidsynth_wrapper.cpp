@@ -1,270 +1,2482 @@
 #include <jni.h>
 #include <fluidsynth.h>
 #include <android/log.h>
+#include <algorithm>
+#include <atomic>
+#include <ctime>
 #include <memory>
-#include <unordered_map>
 #include <mutex>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#ifdef __ANDROID__
+#include <android/asset_manager_jni.h>
+#include "asset_sfloader.h"
+#endif
+
+#include "api_gate.h"
+#include "audio_output.h"
+#include "cpu_affinity.h"
+#include "engine_config.h"
+#include "event_sequencer.h"
+#include "export_job.h"
+#include "group_bus.h"
+#include "midi_event.h"
+#include "midi_event_ring.h"
+#include "midi_player.h"
+#include "mmap_sfloader.h"
+#include "preset_catalog.h"
+#include "preset_loader.h"
+#include "sf3_cache.h"
+#include "sfont_load_job.h"
+#include "spectrum_analyzer.h"
+#include "stem_render_job.h"
+#include "synth_handle_table.h"
+#include "synth_stats.h"
+#include "timed_event_queue.h"
 
 #define LOG_TAG "FluidSynthJNI"
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 
-// Constants
-#define FLUID_OK 0
-#define FLUID_FAILED -1
+// Constants
+#define FLUID_OK 0
+#define FLUID_FAILED -1
+
+#define MAX_SYNTH_INSTANCES 64
+#define EVENT_BATCH_CHUNK 256
+#define TIMED_EVENT_CAPACITY 4096
+#define MAX_EXPORT_JOBS 8
+#define MAX_SFONT_LOAD_JOBS 8
+#define MAX_STEM_RENDER_JOBS 4
+
+// Time bases accepted by sendTimedEvents
+#define TIME_BASE_FRAMES 0
+#define TIME_BASE_NANOS 1
+
+// Layout of the array filled by getAudioClock
+#define CLOCK_FRAME 0
+#define CLOCK_TIME_NS 1
+#define CLOCK_SAMPLE_RATE 2
+#define CLOCK_LATENCY_FRAMES 3
+#define CLOCK_BLOCK_SIZE 4
+#define CLOCK_FIELDS 5
+
+// How long reopenAudio waits for the audio thread to fade out before switching anyway
+#define REOPEN_FADE_TIMEOUT_NS 250000000LL
+
+// Output fade states, see render_period()
+#define FADE_NONE 0
+#define FADE_IN 1
+#define FADE_OUT 2
+#define FADE_MUTED 3
+
+// Set by the first setEventRing call. Instances are freed on whichever thread reclaims them,
+// which may need attaching to release their global references.
+static std::atomic<JavaVM *> java_vm{nullptr};
+
+static void delete_global_ref(jobject ref) {
+    JavaVM *vm = java_vm.load(std::memory_order_acquire);
+    JNIEnv *env = nullptr;
+    jint attached = vm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6);
+    if (attached == JNI_EDETACHED) {
+        if (vm->AttachCurrentThread(&env, nullptr) != JNI_OK) {
+            return;
+        }
+    } else if (attached != JNI_OK) {
+        return;
+    }
+    env->DeleteGlobalRef(ref);
+    if (attached == JNI_EDETACHED) {
+        vm->DetachCurrentThread();
+    }
+}
+
+// Everything owned by one synthesizer handle
+struct SynthInstance {
+    fluid_settings_t *settings = nullptr;
+    fluid_synth_t *synth = nullptr;
+    AudioOutput *output = nullptr;
+
+    // Set by createSynth before publishing: renders through an audio output, not renderFrames()
+    bool realtime = false;
+
+    // Serializes reopenAudio and destroySynth around output, and setEventRing; closed once
+    // destroySynth ran
+    std::mutex output_mutex;
+    bool closed = false;
+
+    // FADE_* state; reopenAudio fades the old output out and the new one in
+    std::atomic<int> fade{FADE_NONE};
+
+    // Validated parameters the synth was created with
+    EngineConfig config;
+
+    // Realtime synths only: spectrum of the rendered output, fed by render_period()
+    SpectrumAnalyzer *analyzer = nullptr;
+
+    // Loads presets ahead of program changes and releases unused ones
+    PresetLoader *presets = nullptr;
+
+    // Standard MIDI File playback, ticked from inside the render callback
+    MidiFilePlayer *midi_player = nullptr;
+
+    // Synths with more than one audio group only: per-group buffers, meters and capture
+    GroupBus *group_bus = nullptr;
+
+    // fluid_sequencer on the audio clock, created by the first sequencer call and processed by
+    // render_span(); sequencer_mutex serializes the creation
+    std::atomic<EventSequencer *> sequencer{nullptr};
+    std::mutex sequencer_mutex;
+
+    // Events queued by Kotlin through shared memory, applied on the audio thread. The direct
+    // ByteBuffer holding it stays referenced until the instance is freed, since an offline
+    // render that resolved the handle may still be draining it after destroySynth.
+    MidiEventRing event_ring;
+    jobject event_ring_buffer = nullptr;
+
+    // Events scheduled at a frame on the audio clock, applied within the period they fall in
+    TimedEventQueue timed_events{TIMED_EVENT_CAPACITY};
+    AudioClock clock;
+
+    // Render-callback counters, written by the audio thread only
+    SynthStats stats;
+
+    // Copied from the output when it opens; read without touching output, which destroySynth
+    // frees early and reopenAudio replaces
+    int sample_rate = 0;
+    std::atomic<int> periods{0};
+    std::atomic<int> latency_frames{0};
+    int block_size = 64;
+
+    // Audio thread only: frames rendered since creation
+    uint64_t frames_rendered = 0;
+
+    // Offline synths only: set while renderFrames() or an export renders, and totals for the
+    // realtime factor
+    std::atomic<bool> rendering{false};
+    std::atomic<uint64_t> offline_frames{0};
+    std::atomic<uint64_t> offline_render_ns{0};
+
+    // Entered by long calls that hold FluidSynth's API lock; the audio thread then leaves
+    // queued events for the next period instead of blocking on that lock
+    ApiGate api_gate;
+
+    ~SynthInstance() {
+        delete output;
+        delete analyzer;
+        // The player and sequencer hand their program changes to presets
+        delete midi_player;
+        delete group_bus;
+        delete sequencer.load();
+        delete presets;
+        if (synth) delete_fluid_synth(synth);
+        if (settings) delete_fluid_settings(settings);
+        if (event_ring_buffer) delete_global_ref(event_ring_buffer);
+    }
+};
+
+static int64_t monotonic_now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+// Applies queued events and renders `frames` frames through render(offset, count), splitting the
+// span wherever a timed event falls due. Called by the audio thread, or by the single render
+// thread of an offline synth, between api_gate.begin_span() and end_span(); can_apply is what
+// begin_span() returned.
+//
+// FluidSynth renders whole internal blocks (64 frames) and serves shorter requests from the
+// remainder of the last block, so an event only takes effect at the next block boundary. Timed
+// events are therefore applied at the start of the block containing their frame: up to
+// block_size - 1 frames early, but with a fixed grid instead of the period grid.
+template<typename RenderFn>
+static void render_span(SynthInstance *instance, int frames, bool can_apply, RenderFn &&render) {
+    uint64_t start = instance->frames_rendered;
+    instance->clock.publish(start, monotonic_now_ns());
+
+    instance->midi_player->before_render(can_apply);
+    if (can_apply) {
+        PresetLoader *presets = instance->presets;
+        instance->event_ring.drain([presets](uint32_t event) { presets->apply_event(event); });
+        instance->timed_events.collect();
+    }
+
+    EventSequencer *sequencer = instance->sequencer.load(std::memory_order_acquire);
+    uint64_t block = static_cast<uint64_t>(instance->block_size);
+    uint64_t end = start + static_cast<uint64_t>(frames);
+    uint64_t pos = start;
+    while (pos < end) {
+        uint64_t split = end;
+        if (can_apply) {
+            uint64_t block_end = pos + block - pos % block;
+            TimedEvent due;
+            while (instance->timed_events.pop_due(block_end, &due)) {
+                instance->presets->apply_event(due.event);
+            }
+            uint64_t next;
+            if (instance->timed_events.next_frame(&next)) {
+                split = std::min(end, std::max(pos + 1, next - next % block));
+            }
+            // The sequencer cannot say when its next event is due, so spans are split at every
+            // block while it holds any
+            if (sequencer) {
+                sequencer->process(block_end);
+                if (sequencer->pending()) {
+                    split = std::min(split, block_end);
+                }
+            }
+        }
+        render(static_cast<int>(pos - start), static_cast<int>(split - pos));
+        pos = split;
+    }
+    instance->frames_rendered = end;
+}
+
+// Audio thread: apply everything Kotlin queued since the last period, then render
+static void render_period(void *data, int frames, float *left, float *right) {
+    auto *instance = static_cast<SynthInstance *>(data);
+    fluid_synth_t *synth = instance->synth;
+
+    // While an output switch is in progress the synth is paused: buffers stay silent and
+    // queued events wait in the ring
+    int fade = instance->fade.load(std::memory_order_acquire);
+    if (fade == FADE_MUTED) {
+        return;
+    }
+    if (fade == FADE_IN) {
+        instance->stats.skip_gap();
+    }
+
+    int64_t started = monotonic_now_ns();
+    GroupBus *bus = instance->group_bus;
+    bool can_apply = instance->api_gate.begin_span();
+    render_span(instance, frames, can_apply, [synth, bus, left, right](int offset, int count) {
+        if (bus) {
+            bus->render(synth, count, left + offset, right + offset, 1);
+            return;
+        }
+        // No separate effects buffers: mix reverb and chorus into the dry output
+        float *out[2] = {left + offset, right + offset};
+        float *fx[4] = {out[0], out[1], out[0], out[1]};
+        fluid_synth_process(synth, count, 4, fx, 2, out);
+    });
+
+    // Linear ramp over one period around an output switch, so it does not click
+    if (fade == FADE_IN || fade == FADE_OUT) {
+        float step = 1.0f / static_cast<float>(frames);
+        for (int i = 0; i < frames; ++i) {
+            float gain = fade == FADE_IN ? i * step : 1.0f - i * step;
+            left[i] *= gain;
+            right[i] *= gain;
+        }
+        instance->fade.store(fade == FADE_IN ? FADE_NONE : FADE_MUTED, std::memory_order_release);
+    }
+    instance->analyzer->tap(left, right, frames);
+
+    // The voice count query takes the API lock, so skip it while a long call holds that lock
+    int voices = can_apply ? fluid_synth_get_active_voice_count(synth) : -1;
+    instance->api_gate.end_span();
+    instance->stats.record_period(started, monotonic_now_ns(), frames, instance->sample_rate,
+                                  instance->periods, voices);
+}
+
+// Offline render thread: interleaved stereo straight into the caller's buffer. With audio
+// groups the mix goes through the group bus: fluid_synth_write_float() only writes the first
+// group.
+static void render_interleaved(SynthInstance *instance, float *out, int frames) {
+    fluid_synth_t *synth = instance->synth;
+    GroupBus *bus = instance->group_bus;
+    bool can_apply = instance->api_gate.begin_span();
+    render_span(instance, frames, can_apply, [synth, bus, out](int offset, int count) {
+        float *frame = out + static_cast<size_t>(offset) * 2;
+        if (bus) {
+            bus->render(synth, count, frame, frame + 1, 2);
+        } else {
+            fluid_synth_write_float(synth, count, frame, 0, 2, frame, 1, 2);
+        }
+    });
+    instance->api_gate.end_span();
+}
+
+// Global state management: handles resolve wait-free, destroyed instances are reclaimed
+// once no in-flight JNI call can still reference them
+static HandleTable<SynthInstance, MAX_SYNTH_INSTANCES> synth_table;
+static HandleTable<ExportJob, MAX_EXPORT_JOBS> export_table;
+static HandleTable<SoundFontLoadJob, MAX_SFONT_LOAD_JOBS> sfont_load_table;
+static HandleTable<StemRenderJob, MAX_STEM_RENDER_JOBS> stem_render_table;
+
+// Resolves a handle for the duration of one JNI call
+class SynthRef {
+public:
+    explicit SynthRef(jlong handle) : instance_(synth_table.find(handle)) {}
+
+    explicit operator bool() const { return instance_ != nullptr; }
+    SynthInstance *operator->() const { return instance_; }
+    SynthInstance *get() const { return instance_; }
+    fluid_synth_t *synth() const { return instance_->synth; }
+
+private:
+    EpochGuard guard_;
+    SynthInstance *instance_;
+};
+
+extern "C" {
+
+// Loaders can only be added before the first SoundFont. The last one added is tried first: the
+// mmap loader, then the asset loader for compressed assets, then the default loader for
+// everything else (SF3, DLS)
+static void add_sfloaders(fluid_settings_t *settings, fluid_synth_t *synth) {
+#ifdef __ANDROID__
+    fluid_sfloader_t *asset_loader = new_asset_sfloader(settings);
+    if (asset_loader) {
+        fluid_synth_add_sfloader(synth, asset_loader);
+    } else {
+        LOGE("Failed to create the APK asset SoundFont loader");
+    }
+#endif
+    fluid_sfloader_t *mmap_loader = new_mmap_sfloader(settings);
+    if (mmap_loader) {
+        fluid_synth_add_sfloader(synth, mmap_loader);
+    } else {
+        LOGE("Failed to create the memory-mapped SoundFont loader");
+    }
+}
+
+// Creates settings, synth and event queues from a validated engine configuration
+static SynthInstance *new_synth_instance(const EngineConfig &config) {
+    // Create settings
+    fluid_settings_t *settings = new_fluid_settings();
+    if (!settings) {
+        LOGE("Failed to create FluidSynth settings");
+        return nullptr;
+    }
+
+    // Kotlin plays on the first 16 channels; the rest hold presets for PresetLoader, which
+    // keeps the samples that dynamic sample loading brings in per selected preset
+    fluid_settings_setint(settings, "synth.midi-channels",
+                          PRESET_USER_CHANNELS + PRESET_HOLDER_CHANNELS);
+    fluid_settings_setint(settings, "synth.dynamic-sample-loading", 1);
+    fluid_settings_setnum(settings, "synth.gain", 0.8);
+    // MIDI file players advance with the rendered samples, not a timer thread. They would reset
+    // the synth from the render thread whatever the API lock; MidiFilePlayer queues the reset
+    fluid_settings_setstr(settings, "player.timing-source", "sample");
+    fluid_settings_setint(settings, "player.reset-synth", 0);
+    config.apply(settings);
+
+    // Create synthesizer; its render workers start here and inherit the pinned affinity
+    fluid_synth_t *synth;
+    {
+        ScopedAffinity pin(config.cpu_cores > 1 ? static_cast<uint32_t>(config.cpu_affinity) : 0);
+        synth = new_fluid_synth(settings);
+    }
+    if (!synth) {
+        LOGE("Failed to create FluidSynth synthesizer");
+        delete_fluid_settings(settings);
+        return nullptr;
+    }
+
+    add_sfloaders(settings, synth);
+
+    auto *instance = new SynthInstance();
+    instance->settings = settings;
+    instance->synth = synth;
+    instance->config = config;
+    instance->presets = new PresetLoader(synth, &instance->api_gate);
+    instance->midi_player = new MidiFilePlayer(synth, &instance->api_gate, instance->presets,
+                                               &instance->timed_events);
+    instance->block_size = fluid_synth_get_internal_bufsize(synth);
+    int groups = fluid_synth_count_audio_groups(synth);
+    if (groups > 1) {
+        instance->group_bus = new GroupBus(groups);
+    }
+    double sample_rate = 44100.0;
+    fluid_settings_getnum(settings, "synth.sample-rate", &sample_rate);
+    instance->sample_rate = static_cast<int>(sample_rate);
+    return instance;
+}
+
+// Reads and validates the Kotlin engine config, writing the values actually used back into it.
+// A null array selects the defaults.
+static bool read_engine_config(JNIEnv *env, jintArray values, EngineConfig *config) {
+    int32_t fields[CONFIG_FIELDS];
+    if (values) {
+        if (env->GetArrayLength(values) < CONFIG_FIELDS) {
+            LOGE("Engine config needs %d elements", CONFIG_FIELDS);
+            return false;
+        }
+        env->GetIntArrayRegion(values, 0, CONFIG_FIELDS, reinterpret_cast<jint *>(fields));
+        *config = EngineConfig::from_array(fields);
+    }
+
+    // Ranges come from a throwaway settings object; they do not depend on its values
+    fluid_settings_t *settings = new_fluid_settings();
+    if (!settings) {
+        LOGE("Failed to create FluidSynth settings");
+        return false;
+    }
+    config->validate(settings);
+    delete_fluid_settings(settings);
+
+    if (values) {
+        config->to_array(fields);
+        env->SetIntArrayRegion(values, 0, CONFIG_FIELDS, reinterpret_cast<const jint *>(fields));
+    }
+    return true;
+}
+
+// Applies a packed event from a JNI thread; program changes go through the preset loader, which
+// defers them until the preset's samples are loaded
+static int send_event(SynthInstance *instance, uint32_t event) {
+    if ((event & 0xf0) == MIDI_PROGRAM_CHANGE) {
+        return instance->presets->select(static_cast<int>(event & 0x0f),
+                                         static_cast<int>((event >> 8) & 0x7f));
+    }
+    return apply_midi_event(instance->synth, event);
+}
+
+// Starts loading the preset a queued program change will select while it waits for its frame
+static void prefetch_event(SynthInstance *instance, uint32_t event) {
+    if ((event & 0xf0) == MIDI_PROGRAM_CHANGE) {
+        instance->presets->prefetch(static_cast<int>(event & 0x0f),
+                                    static_cast<int>((event >> 8) & 0x7f));
+    }
+}
+
+// Returns the instance's sequencer, creating it at the current audio clock frame on first use;
+// nullptr if fluid_sequencer could not be created
+static EventSequencer *get_sequencer(SynthInstance *instance) {
+    EventSequencer *sequencer = instance->sequencer.load(std::memory_order_acquire);
+    if (sequencer) {
+        return sequencer;
+    }
+    std::lock_guard<std::mutex> lock(instance->sequencer_mutex);
+    sequencer = instance->sequencer.load(std::memory_order_relaxed);
+    if (!sequencer) {
+        uint64_t frame;
+        int64_t time_ns;
+        instance->clock.read(&frame, &time_ns);
+        std::unique_ptr<EventSequencer> created(
+                new EventSequencer(instance->presets, instance->sample_rate, frame));
+        if (!created->valid()) {
+            LOGE("Failed to create the event sequencer");
+            return nullptr;
+        }
+        sequencer = created.release();
+        instance->sequencer.store(sequencer, std::memory_order_release);
+    }
+    return sequencer;
+}
+
+// Publishes an instance and returns its handle; deletes it if the table is full
+static jlong publish_synth_instance(SynthInstance *instance) {
+    jlong synth_id = synth_table.insert(instance);
+    if (synth_id == -1) {
+        LOGE("Too many synthesizers (max %d)", MAX_SYNTH_INSTANCES);
+        delete instance;
+        return -1;
+    }
+    EpochDomain::instance().reclaim();
+    return synth_id;
+}
+
+// Create a new FluidSynth synthesizer
+JNIEXPORT jlong JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_createSynth(JNIEnv *env, jobject clazz,
+                                                      jintArray config) {
+    try {
+        EngineConfig engine_config;
+        if (!read_engine_config(env, config, &engine_config)) {
+            return -1;
+        }
+        SynthInstance *instance = new_synth_instance(engine_config);
+        if (!instance) {
+            return -1;
+        }
+
+        // Open the audio output stopped; it renders through render_period(), which reads the
+        // fields set from it and feeds the analyzer, so those are set up before it starts
+        instance->realtime = true;
+        instance->output = AudioOutput::open(instance->settings, render_period, instance);
+        if (!instance->output) {
+            LOGE("Failed to create audio output - sound output will not work");
+            delete instance;
+            return -1;
+        }
+        instance->sample_rate = instance->output->sample_rate();
+        instance->periods = instance->output->periods();
+        instance->latency_frames = instance->output->period_size() * instance->output->periods();
+        instance->analyzer = new SpectrumAnalyzer(instance->sample_rate);
+        if (!instance->output->start()) {
+            LOGE("Failed to start audio output - sound output will not work");
+            delete instance;
+            return -1;
+        }
+
+        // Publish the instance and return its handle
+        jlong synth_id = publish_synth_instance(instance);
+        if (synth_id == -1) {
+            return -1;
+        }
+
+        LOGI("Created synthesizer with ID: %lld, audio driver initialized (%d Hz, %d x %d frames)",
+             synth_id, instance->sample_rate, instance->periods.load(),
+             instance->latency_frames.load() / instance->periods.load());
+        return synth_id;
+    } catch (const std::exception &e) {
+        LOGE("Exception in createSynth: %s", e.what());
+        return -1;
+    }
+}
+
+// Create a synthesizer without an audio output, rendered on demand through renderFrames
+JNIEXPORT jlong JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_createOfflineSynth(JNIEnv *env, jobject clazz,
+                                                             jintArray config) {
+    try {
+        EngineConfig engine_config;
+        if (!read_engine_config(env, config, &engine_config)) {
+            return -1;
+        }
+        SynthInstance *instance = new_synth_instance(engine_config);
+        if (!instance) {
+            return -1;
+        }
+
+        jlong synth_id = publish_synth_instance(instance);
+        if (synth_id == -1) {
+            return -1;
+        }
+
+        LOGI("Created offline synthesizer with ID: %lld", synth_id);
+        return synth_id;
+    } catch (const std::exception &e) {
+        LOGE("Exception in createOfflineSynth: %s", e.what());
+        return -1;
+    }
+}
+
+// Destroy a FluidSynth synthesizer
+JNIEXPORT void JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_destroySynth(JNIEnv *env, jobject clazz,
+                                                       jlong synth_handle) {
+    try {
+        SynthInstance *instance = synth_table.remove(synth_handle);
+        if (!instance) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return;
+        }
+
+        // Stop audio right away; the synth and settings are freed once concurrent
+        // calls that already resolved this handle have returned
+        {
+            std::lock_guard<std::mutex> lock(instance->output_mutex);
+            delete instance->output;
+            instance->output = nullptr;
+            instance->closed = true;
+        }
+        EpochDomain::instance().retire(instance);
+        size_t pending = EpochDomain::instance().reclaim();
+
+        LOGI("Destroyed synthesizer with ID: %lld (%zu pending reclamation)", synth_handle, pending);
+    } catch (const std::exception &e) {
+        LOGE("Exception in destroySynth: %s", e.what());
+    }
+}
+
+// Loads a SoundFont file or asset:// name into a synth. Files the mmap loader takes are parsed
+// (and SF3s decoded) without FluidSynth's API lock, so note calls keep going through while a
+// large bank loads; only fluid_synth_add_sfont() runs under it. Anything the mmap loader
+// declines goes through fluid_synth_sfload(), which holds the lock for the whole load. The
+// synth is looked up again after parsing, so destroying it meanwhile only fails the load.
+// Returns the SoundFont ID or FLUID_FAILED.
+static int load_sfont(jlong synth_handle, const std::string &path, SfontLoadProgress *progress) {
+    int polyphony;
+    {
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+        polyphony = fluid_synth_get_polyphony(ref.synth());
+    }
+
+    fluid_sfont_t *sfont = mmap_load_sfont(path.c_str(), polyphony, progress);
+    if (progress && progress->cancelled.load(std::memory_order_acquire)) {
+        if (sfont) {
+            mmap_free_sfont(sfont);
+        }
+        LOGI("Cancelled loading SoundFont %s", path.c_str());
+        return FLUID_FAILED;
+    }
+
+    SynthRef ref(synth_handle);
+    if (!ref) {
+        if (sfont) {
+            mmap_free_sfont(sfont);
+        }
+        LOGE("Synthesizer with ID %lld was destroyed while loading %s", synth_handle,
+             path.c_str());
+        return FLUID_FAILED;
+    }
+    int sfont_id;
+    {
+        ApiGateScope busy(&ref->api_gate);
+        if (sfont) {
+            sfont_id = fluid_synth_add_sfont(ref.synth(), sfont);
+            if (sfont_id == FLUID_FAILED) {
+                mmap_free_sfont(sfont);
+            }
+        } else {
+            sfont_id = fluid_synth_sfload(ref.synth(), path.c_str(), 1);
+            // FluidSynth's loaders cannot be interrupted; undo the load instead
+            if (sfont_id != FLUID_FAILED && progress &&
+                progress->cancelled.load(std::memory_order_acquire)) {
+                fluid_synth_sfunload(ref.synth(), sfont_id, 1);
+                LOGI("Cancelled loading SoundFont %s", path.c_str());
+                return FLUID_FAILED;
+            }
+        }
+    }
+    if (sfont_id == FLUID_FAILED) {
+        LOGE("Failed to load SoundFont: %s", path.c_str());
+        return FLUID_FAILED;
+    }
+
+    LOGI("Loaded SoundFont with ID: %d from %s", sfont_id, path.c_str());
+    return sfont_id;
+}
+
+// Loads path and swaps it in for the SoundFont old_sfont_id without a gap: once the new one is
+// added, the old one's presets are hidden (mmap loader) and every channel is reset onto the new
+// one, while notes already sounding from the old one play out. The preset loader unloads the
+// old SoundFont after its last voice. Until the swap the old one keeps playing; a failed or
+// cancelled load leaves it in place. Returns the new SoundFont ID or FLUID_FAILED.
+static int replace_sfont(jlong synth_handle, int old_sfont_id, const std::string &path,
+                         SfontLoadProgress *progress) {
+    int sfont_id = load_sfont(synth_handle, path, progress);
+    if (sfont_id == FLUID_FAILED) {
+        return FLUID_FAILED;
+    }
+
+    SynthRef ref(synth_handle);
+    if (!ref) {
+        return FLUID_FAILED;
+    }
+    {
+        ApiGateScope busy(&ref->api_gate);
+        fluid_sfont_t *old_sfont = fluid_synth_get_sfont_by_id(ref.synth(), old_sfont_id);
+        if (!old_sfont) {
+            LOGE("SoundFont %d to replace was already unloaded", old_sfont_id);
+            return sfont_id;
+        }
+        mmap_sfont_retire(old_sfont);
+        fluid_synth_program_reset(ref.synth());
+    }
+    ref->presets->retire_sfont(old_sfont_id);
+
+    LOGI("Replaced SoundFont %d with %d", old_sfont_id, sfont_id);
+    return sfont_id;
+}
+
+// Copies a Java string into out; false if it is null or cannot be read
+static bool get_string(JNIEnv *env, jstring value, const char *what, std::string *out) {
+    if (!value) {
+        LOGE("%s is null", what);
+        return false;
+    }
+    const char *chars = env->GetStringUTFChars(value, nullptr);
+    if (!chars) {
+        LOGE("Failed to get UTF chars from %s", what);
+        return false;
+    }
+    *out = chars;
+    env->ReleaseStringUTFChars(value, chars);
+    return true;
+}
+
+// Load a SoundFont file
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_loadSoundFont(JNIEnv *env, jobject clazz,
+                                                        jlong synth_handle, jstring file_path) {
+    try {
+        std::string path;
+        if (!get_string(env, file_path, "file_path", &path)) {
+            return -1;
+        }
+        int sfont_id = load_sfont(synth_handle, path, nullptr);
+        return sfont_id == FLUID_FAILED ? -1 : sfont_id;
+    } catch (const std::exception &e) {
+        LOGE("Exception in loadSoundFont: %s", e.what());
+        return -1;
+    }
+}
+
+#ifdef __ANDROID__
+// Java AssetManager backing asset:// loads; replaced references are kept because a load on
+// another thread may still be reading through them
+static std::mutex asset_manager_mutex;
+static jobject asset_manager_ref = nullptr;
+
+static void use_asset_manager(JNIEnv *env, jobject asset_manager) {
+    std::lock_guard<std::mutex> lock(asset_manager_mutex);
+    if (!asset_manager_ref || !env->IsSameObject(asset_manager_ref, asset_manager)) {
+        asset_manager_ref = env->NewGlobalRef(asset_manager);
+        set_sfloader_asset_manager(AAssetManager_fromJava(env, asset_manager_ref));
+    }
+}
+#endif
+
+// Builds the asset:// name of an asset and makes asset_manager the one asset loads read from
+static bool get_asset_path(JNIEnv *env, jobject asset_manager, jstring asset_name,
+                           std::string *path) {
+#ifdef __ANDROID__
+    if (!asset_manager) {
+        LOGE("asset_manager is null");
+        return false;
+    }
+    std::string name;
+    if (!get_string(env, asset_name, "asset_name", &name)) {
+        return false;
+    }
+    use_asset_manager(env, asset_manager);
+    *path = std::string(ASSET_SFONT_PREFIX) + name;
+    return true;
+#else
+    LOGE("APK assets exist only on Android");
+    return false;
+#endif
+}
+
+// Load a SoundFont stored in the APK's assets without extracting it first
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_loadSoundFontFromAsset(JNIEnv *env, jobject clazz,
+                                                                 jlong synth_handle,
+                                                                 jobject asset_manager,
+                                                                 jstring asset_name) {
+    try {
+        std::string path;
+        if (!get_asset_path(env, asset_manager, asset_name, &path)) {
+            return -1;
+        }
+        int sfont_id = load_sfont(synth_handle, path, nullptr);
+        return sfont_id == FLUID_FAILED ? -1 : sfont_id;
+    } catch (const std::exception &e) {
+        LOGE("Exception in loadSoundFontFromAsset: %s", e.what());
+        return -1;
+    }
+}
+
+// Publishes a background load of path, replacing old_sfont_id unless that is -1; -1 if it
+// cannot start
+static jlong start_sfont_load(jlong synth_handle, std::string path, int old_sfont_id) {
+    {
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return -1;
+        }
+        if (old_sfont_id != -1 && !fluid_synth_get_sfont_by_id(ref.synth(), old_sfont_id)) {
+            LOGE("SoundFont with ID %d not found", old_sfont_id);
+            return -1;
+        }
+    }
+    SoundFontLoadJob *job = SoundFontLoadJob::start(
+            [synth_handle, path, old_sfont_id](SfontLoadProgress *progress) {
+                if (old_sfont_id != -1) {
+                    return replace_sfont(synth_handle, old_sfont_id, path, progress);
+                }
+                return load_sfont(synth_handle, path, progress);
+            });
+    if (!job) {
+        LOGE("Failed to start loading %s", path.c_str());
+        return -1;
+    }
+    jlong load_id = sfont_load_table.insert(job);
+    if (load_id == -1) {
+        LOGE("Too many SoundFont loads (max %d)", MAX_SFONT_LOAD_JOBS);
+        delete job;
+        return -1;
+    }
+    EpochDomain::instance().reclaim();
+    return load_id;
+}
+
+// Start loading a SoundFont file in the background. The synth keeps playing with the SoundFonts
+// it has until the new one is added. Returns a load handle, or -1 on failure.
+JNIEXPORT jlong JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_startSoundFontLoad(JNIEnv *env, jobject clazz,
+                                                             jlong synth_handle,
+                                                             jstring file_path) {
+    try {
+        std::string path;
+        if (!get_string(env, file_path, "file_path", &path)) {
+            return -1;
+        }
+        return start_sfont_load(synth_handle, std::move(path), -1);
+    } catch (const std::exception &e) {
+        LOGE("Exception in startSoundFontLoad: %s", e.what());
+        return -1;
+    }
+}
+
+// Start loading a SoundFont from the APK's assets in the background, see startSoundFontLoad
+JNIEXPORT jlong JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_startSoundFontLoadFromAsset(JNIEnv *env, jobject clazz,
+                                                                      jlong synth_handle,
+                                                                      jobject asset_manager,
+                                                                      jstring asset_name) {
+    try {
+        std::string path;
+        if (!get_asset_path(env, asset_manager, asset_name, &path)) {
+            return -1;
+        }
+        return start_sfont_load(synth_handle, std::move(path), -1);
+    } catch (const std::exception &e) {
+        LOGE("Exception in startSoundFontLoadFromAsset: %s", e.what());
+        return -1;
+    }
+}
+
+// Start replacing a loaded SoundFont with a file in the background: the old one keeps playing
+// until the new one is loaded, then channels switch over without silence and the old one is
+// unloaded once its notes have ended. Returns a load handle like startSoundFontLoad, whose
+// finishSoundFontLoad result is the new SoundFont ID; -1 on failure.
+JNIEXPORT jlong JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_replaceSoundFont(JNIEnv *env, jobject clazz,
+                                                           jlong synth_handle, jint sfont_id,
+                                                           jstring file_path) {
+    try {
+        std::string path;
+        if (!get_string(env, file_path, "file_path", &path)) {
+            return -1;
+        }
+        if (sfont_id < 0) {
+            LOGE("Invalid SoundFont ID %d", sfont_id);
+            return -1;
+        }
+        return start_sfont_load(synth_handle, std::move(path), sfont_id);
+    } catch (const std::exception &e) {
+        LOGE("Exception in replaceSoundFont: %s", e.what());
+        return -1;
+    }
+}
+
+// Start replacing a loaded SoundFont with one from the APK's assets, see replaceSoundFont
+JNIEXPORT jlong JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_replaceSoundFontFromAsset(JNIEnv *env, jobject clazz,
+                                                                    jlong synth_handle,
+                                                                    jint sfont_id,
+                                                                    jobject asset_manager,
+                                                                    jstring asset_name) {
+    try {
+        std::string path;
+        if (!get_asset_path(env, asset_manager, asset_name, &path)) {
+            return -1;
+        }
+        if (sfont_id < 0) {
+            LOGE("Invalid SoundFont ID %d", sfont_id);
+            return -1;
+        }
+        return start_sfont_load(synth_handle, std::move(path), sfont_id);
+    } catch (const std::exception &e) {
+        LOGE("Exception in replaceSoundFontFromAsset: %s", e.what());
+        return -1;
+    }
+}
+
+// Fraction of the SoundFont's bytes loaded so far, 0..1, or -1 if the handle is unknown
+JNIEXPORT jdouble JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getSoundFontLoadProgress(JNIEnv *env, jobject clazz,
+                                                                   jlong load_handle) {
+    try {
+        EpochGuard guard;
+        SoundFontLoadJob *job = sfont_load_table.find(load_handle);
+        if (!job) {
+            LOGE("SoundFont load with ID %lld not found", load_handle);
+            return -1.0;
+        }
+        return job->progress();
+    } catch (const std::exception &e) {
+        LOGE("Exception in getSoundFontLoadProgress: %s", e.what());
+        return -1.0;
+    }
+}
+
+// SFONT_LOAD_RUNNING, SFONT_LOAD_DONE, SFONT_LOAD_CANCELLED or SFONT_LOAD_FAILED
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getSoundFontLoadStatus(JNIEnv *env, jobject clazz,
+                                                                 jlong load_handle) {
+    try {
+        EpochGuard guard;
+        SoundFontLoadJob *job = sfont_load_table.find(load_handle);
+        if (!job) {
+            LOGE("SoundFont load with ID %lld not found", load_handle);
+            return SFONT_LOAD_FAILED;
+        }
+        return job->status();
+    } catch (const std::exception &e) {
+        LOGE("Exception in getSoundFontLoadStatus: %s", e.what());
+        return SFONT_LOAD_FAILED;
+    }
+}
+
+// Ask a running load to stop; a SoundFont it already added is unloaded again
+JNIEXPORT void JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_cancelSoundFontLoad(JNIEnv *env, jobject clazz,
+                                                              jlong load_handle) {
+    try {
+        EpochGuard guard;
+        SoundFontLoadJob *job = sfont_load_table.find(load_handle);
+        if (!job) {
+            LOGE("SoundFont load with ID %lld not found", load_handle);
+            return;
+        }
+        job->cancel();
+    } catch (const std::exception &e) {
+        LOGE("Exception in cancelSoundFontLoad: %s", e.what());
+    }
+}
+
+// Wait for a load to end, release its handle and return the SoundFont ID, or -1 if it failed
+// or was cancelled
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_finishSoundFontLoad(JNIEnv *env, jobject clazz,
+                                                              jlong load_handle) {
+    try {
+        SoundFontLoadJob *job = sfont_load_table.remove(load_handle);
+        if (!job) {
+            LOGE("SoundFont load with ID %lld not found", load_handle);
+            return -1;
+        }
+
+        job->wait();
+        int sfont_id = job->sfont_id();
+        EpochDomain::instance().retire(job);
+        EpochDomain::instance().reclaim();
+        return sfont_id;
+    } catch (const std::exception &e) {
+        LOGE("Exception in finishSoundFontLoad: %s", e.what());
+        return -1;
+    }
+}
+
+// Set the directory SF3 SoundFonts are decoded into and preset indexes are kept in; applies to
+// every synth
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_setSoundFontCacheDir(JNIEnv *env, jobject clazz,
+                                                              jstring dir) {
+    try {
+        if (!dir) {
+            set_sf3_cache_dir(nullptr);
+            return FLUID_OK;
+        }
+        const char *path = env->GetStringUTFChars(dir, nullptr);
+        if (!path) {
+            LOGE("Failed to get UTF chars from dir");
+            return -1;
+        }
+        set_sf3_cache_dir(path);
+        env->ReleaseStringUTFChars(dir, path);
+        return FLUID_OK;
+    } catch (const std::exception &e) {
+        LOGE("Exception in setSoundFontCacheDir: %s", e.what());
+        return -1;
+    }
+}
+
+static jbyteArray to_byte_array(JNIEnv *env, const std::vector<uint8_t> &bytes) {
+    jbyteArray array = env->NewByteArray(static_cast<jsize>(bytes.size()));
+    if (array) {
+        env->SetByteArrayRegion(array, 0, static_cast<jsize>(bytes.size()),
+                                reinterpret_cast<const jbyte *>(bytes.data()));
+    }
+    return array;
+}
+
+// List every preset of a loaded SoundFont in one packed buffer (see preset_catalog.h), and
+// store it in the on-disk index so later launches can read it before loading the SoundFont
+JNIEXPORT jbyteArray JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getPresetCatalog(JNIEnv *env, jobject clazz,
+                                                          jlong synth_handle, jint sfont_id) {
+    try {
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return nullptr;
+        }
+        fluid_sfont_t *sfont = fluid_synth_get_sfont_by_id(ref.synth(), sfont_id);
+        if (!sfont) {
+            LOGE("getPresetCatalog: no SoundFont with ID %d", sfont_id);
+            return nullptr;
+        }
+
+        std::vector<uint8_t> catalog;
+        build_preset_catalog(sfont, &catalog);
+        if (const char *name = fluid_sfont_get_name(sfont)) {
+            store_preset_catalog(name, catalog);
+        }
+        return to_byte_array(env, catalog);
+    } catch (const std::exception &e) {
+        LOGE("Exception in getPresetCatalog: %s", e.what());
+        return nullptr;
+    }
+}
+
+// Read the preset index stored for a SoundFont file, without loading it
+JNIEXPORT jbyteArray JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_readPresetCatalog(JNIEnv *env, jobject clazz,
+                                                           jstring file_path) {
+    try {
+        std::string path;
+        std::vector<uint8_t> catalog;
+        if (!get_string(env, file_path, "file_path", &path) ||
+            !load_preset_catalog(path.c_str(), &catalog)) {
+            return nullptr;
+        }
+        return to_byte_array(env, catalog);
+    } catch (const std::exception &e) {
+        LOGE("Exception in readPresetCatalog: %s", e.what());
+        return nullptr;
+    }
+}
+
+// Read the preset index stored for a SoundFont in the APK's assets, without loading it
+JNIEXPORT jbyteArray JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_readPresetCatalogFromAsset(JNIEnv *env, jobject clazz,
+                                                                    jobject asset_manager,
+                                                                    jstring asset_name) {
+    try {
+        std::string path;
+        std::vector<uint8_t> catalog;
+        if (!get_asset_path(env, asset_manager, asset_name, &path) ||
+            !load_preset_catalog(path.c_str(), &catalog)) {
+            return nullptr;
+        }
+        return to_byte_array(env, catalog);
+    } catch (const std::exception &e) {
+        LOGE("Exception in readPresetCatalogFromAsset: %s", e.what());
+        return nullptr;
+    }
+}
+
+// Kotlin plays on channels 0-15 only; the ones above are PresetLoader's holder channels
+static bool check_user_channel(const char *function, jint channel) {
+    if (channel >= 0 && channel < PRESET_USER_CHANNELS) {
+        return true;
+    }
+    LOGE("%s: channel %d out of range", function, channel);
+    return false;
+}
+
+// Play a note
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_noteOn(JNIEnv *env, jobject clazz, jlong synth_handle,
+                                                 jint channel, jint note, jint velocity) {
+    try {
+        if (!check_user_channel("noteOn", channel)) {
+            return FLUID_FAILED;
+        }
+
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+
+        int result = fluid_synth_noteon(ref.synth(), channel, note, velocity);
+        if (result != FLUID_OK) {
+            LOGE("Failed to play note: channel=%d, note=%d, velocity=%d", channel, note, velocity);
+        }
+        return result;
+    } catch (const std::exception &e) {
+        LOGE("Exception in noteOn: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+// Stop a note
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_noteOff(JNIEnv *env, jobject clazz, jlong synth_handle,
+                                                  jint channel, jint note) {
+    try {
+        if (!check_user_channel("noteOff", channel)) {
+            return FLUID_FAILED;
+        }
+
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+
+        int result = fluid_synth_noteoff(ref.synth(), channel, note);
+        if (result != FLUID_OK) {
+            LOGE("Failed to stop note: channel=%d, note=%d", channel, note);
+        }
+        return result;
+    } catch (const std::exception &e) {
+        LOGE("Exception in noteOff: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+// Set program (instrument)
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_programChange(JNIEnv *env, jobject clazz,
+                                                        jlong synth_handle,
+                                                        jint channel, jint program) {
+    try {
+        if (!check_user_channel("programChange", channel)) {
+            return FLUID_FAILED;
+        }
+
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+
+        // Takes effect once the preset's samples are loaded; the channel keeps its old preset
+        // until then
+        int result = ref->presets->select(channel, program);
+        if (result != FLUID_OK) {
+            LOGE("Failed to change program: channel=%d, program=%d", channel, program);
+        }
+        return result;
+    } catch (const std::exception &e) {
+        LOGE("Exception in programChange: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+// Set channel volume (CC 7)
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_setChannelVolume(JNIEnv *env, jobject clazz,
+                                                           jlong synth_handle,
+                                                           jint channel, jint volume) {
+    try {
+        if (!check_user_channel("setChannelVolume", channel)) {
+            return FLUID_FAILED;
+        }
+
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+
+        int result = fluid_synth_cc(ref.synth(), channel, 7, volume);
+        if (result != FLUID_OK) {
+            LOGE("Failed to set channel volume: channel=%d, volume=%d", channel, volume);
+        }
+        return result;
+    } catch (const std::exception &e) {
+        LOGE("Exception in setChannelVolume: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+// Generic MIDI CC control
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_controlChange(JNIEnv *env, jobject clazz,
+                                                        jlong synth_handle,
+                                                        jint channel, jint controller, jint value) {
+    try {
+        if (!check_user_channel("controlChange", channel)) {
+            return FLUID_FAILED;
+        }
+
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+
+        int result = fluid_synth_cc(ref.synth(), channel, controller, value);
+        if (result != FLUID_OK) {
+            LOGE("Failed to send CC: channel=%d, controller=%d, value=%d", channel, controller,
+                 value);
+        }
+        return result;
+    } catch (const std::exception &e) {
+        LOGE("Exception in controlChange: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+// Copies the per-event failure bits back to Kotlin, if a mask array was supplied
+static void write_failed_mask(JNIEnv *env, jintArray failed_mask, const uint32_t *mask,
+                              jint count) {
+    if (!failed_mask) {
+        return;
+    }
+    jsize words = (count + 31) / 32;
+    if (env->GetArrayLength(failed_mask) < words) {
+        LOGE("sendEvents: failedMask needs %d words", words);
+        return;
+    }
+    env->SetIntArrayRegion(failed_mask, 0, words, reinterpret_cast<const jint *>(mask));
+}
+
+// Apply a batch of packed MIDI events (status | data1 << 8 | data2 << 16) with a single lookup
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_sendEvents(JNIEnv *env, jobject clazz,
+                                                     jlong synth_handle, jintArray events,
+                                                     jint count, jintArray failed_mask) {
+    try {
+        if (!events || count < 0 || count > env->GetArrayLength(events)) {
+            LOGE("sendEvents: invalid event array or count %d", count);
+            return FLUID_FAILED;
+        }
+
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+
+        // Decode in chunks copied onto the stack instead of pinning the Java array
+        std::vector<uint32_t> mask((count + 31) / 32, 0);
+        uint32_t chunk[EVENT_BATCH_CHUNK];
+        int failures = 0;
+        for (jint offset = 0; offset < count; offset += EVENT_BATCH_CHUNK) {
+            jint n = std::min<jint>(EVENT_BATCH_CHUNK, count - offset);
+            env->GetIntArrayRegion(events, offset, n, reinterpret_cast<jint *>(chunk));
+            for (jint i = 0; i < n; ++i) {
+                if (send_event(ref.get(), chunk[i]) != FLUID_OK) {
+                    jint index = offset + i;
+                    mask[index >> 5] |= 1u << (index & 31);
+                    ++failures;
+                }
+            }
+        }
+
+        write_failed_mask(env, failed_mask, mask.data(), count);
+        if (failures > 0) {
+            LOGE("sendEvents: %d of %d events failed", failures, count);
+        }
+        return count - failures;
+    } catch (const std::exception &e) {
+        LOGE("Exception in sendEvents: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+// Same as sendEvents, reading native-order packed events from a direct ByteBuffer without copying
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_sendEventsBuffer(JNIEnv *env, jobject clazz,
+                                                           jlong synth_handle, jobject buffer,
+                                                           jint count, jintArray failed_mask) {
+    try {
+        auto *events = static_cast<const uint32_t *>(buffer ? env->GetDirectBufferAddress(buffer)
+                                                            : nullptr);
+        if (!events || count < 0 ||
+            static_cast<jlong>(count) * 4 > env->GetDirectBufferCapacity(buffer)) {
+            LOGE("sendEventsBuffer: buffer must be direct and hold %d events", count);
+            return FLUID_FAILED;
+        }
+
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+
+        std::vector<uint32_t> mask((count + 31) / 32, 0);
+        int failures = 0;
+        for (jint i = 0; i < count; ++i) {
+            if (send_event(ref.get(), events[i]) != FLUID_OK) {
+                mask[i >> 5] |= 1u << (i & 31);
+                ++failures;
+            }
+        }
+
+        write_failed_mask(env, failed_mask, mask.data(), count);
+        if (failures > 0) {
+            LOGE("sendEventsBuffer: %d of %d events failed", failures, count);
+        }
+        return count - failures;
+    } catch (const std::exception &e) {
+        LOGE("Exception in sendEventsBuffer: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+// Attach a direct ByteBuffer Kotlin allocated as the synth's shared MIDI event ring (layout in
+// midi_event_ring.h). It stays referenced until the synth is freed. One ring per synth.
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_setEventRing(JNIEnv *env, jobject clazz,
+                                                       jlong synth_handle, jobject buffer) {
+    try {
+        void *memory = buffer ? env->GetDirectBufferAddress(buffer) : nullptr;
+        jlong size = buffer ? env->GetDirectBufferCapacity(buffer) : -1;
+        if (!memory || size <= 0) {
+            LOGE("setEventRing: not a direct buffer");
+            return FLUID_FAILED;
+        }
+
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+        std::lock_guard<std::mutex> lock(ref->output_mutex);
+        if (ref->event_ring.attached()) {
+            LOGE("setEventRing: synth %lld already has an event ring", synth_handle);
+            return FLUID_FAILED;
+        }
+        if (!java_vm.load(std::memory_order_acquire)) {
+            JavaVM *vm = nullptr;
+            if (env->GetJavaVM(&vm) != JNI_OK) {
+                return FLUID_FAILED;
+            }
+            java_vm.store(vm, std::memory_order_release);
+        }
+        jobject global = env->NewGlobalRef(buffer);
+        if (!global) {
+            return FLUID_FAILED;
+        }
+        if (!ref->event_ring.attach(memory, static_cast<size_t>(size))) {
+            LOGE("setEventRing: invalid ring header or size %lld", static_cast<long long>(size));
+            env->DeleteGlobalRef(global);
+            return FLUID_FAILED;
+        }
+        ref->event_ring_buffer = global;
+        return FLUID_OK;
+    } catch (const std::exception &e) {
+        LOGE("Exception in setEventRing: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+// Schedule packed MIDI events on the audio clock. times[i] is an absolute frame (TIME_BASE_FRAMES)
+// or a CLOCK_MONOTONIC / System.nanoTime() timestamp (TIME_BASE_NANOS) on the render timeline;
+// events already due play at the start of the next period. Returns the number queued.
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_sendTimedEvents(JNIEnv *env, jobject clazz,
+                                                          jlong synth_handle, jintArray events,
+                                                          jlongArray times, jint count,
+                                                          jint time_base) {
+    try {
+        if (!events || !times || count < 0 || count > env->GetArrayLength(events) ||
+            count > env->GetArrayLength(times)) {
+            LOGE("sendTimedEvents: invalid event/time arrays or count %d", count);
+            return FLUID_FAILED;
+        }
+        if (time_base != TIME_BASE_FRAMES && time_base != TIME_BASE_NANOS) {
+            LOGE("sendTimedEvents: unknown time base %d", time_base);
+            return FLUID_FAILED;
+        }
+
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+        uint64_t clock_frame;
+        int64_t clock_ns;
+        ref->clock.read(&clock_frame, &clock_ns);
+        double frames_per_ns = ref->sample_rate / 1e9;
+
+        uint32_t event_chunk[EVENT_BATCH_CHUNK];
+        jlong time_chunk[EVENT_BATCH_CHUNK];
+        jint queued = 0;
+        for (jint offset = 0; offset < count; offset += EVENT_BATCH_CHUNK) {
+            jint n = std::min<jint>(EVENT_BATCH_CHUNK, count - offset);
+            env->GetIntArrayRegion(events, offset, n, reinterpret_cast<jint *>(event_chunk));
+            env->GetLongArrayRegion(times, offset, n, time_chunk);
+            for (jint i = 0; i < n; ++i) {
+                int64_t frame = time_chunk[i];
+                if (time_base == TIME_BASE_NANOS) {
+                    frame = static_cast<int64_t>(clock_frame) +
+                            static_cast<int64_t>((time_chunk[i] - clock_ns) * frames_per_ns);
+                }
+                if (!ref->timed_events.push(static_cast<uint64_t>(std::max<int64_t>(frame, 0)),
+                                            event_chunk[i])) {
+                    LOGE("sendTimedEvents: queue full, %d of %d events queued", queued, count);
+                    return queued;
+                }
+                // Early is fine: the pages are read while the event waits for its frame
+                prefetch_event(ref.get(), event_chunk[i]);
+                ++queued;
+            }
+        }
+        return queued;
+    } catch (const std::exception &e) {
+        LOGE("Exception in sendTimedEvents: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+// Read the audio clock into clock[CLOCK_FIELDS]: next frame to render, CLOCK_MONOTONIC time the
+// audio thread started it, sample rate, output latency in frames and the timing block size
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getAudioClock(JNIEnv *env, jobject clazz,
+                                                        jlong synth_handle, jlongArray clock) {
+    try {
+        if (!clock || env->GetArrayLength(clock) < CLOCK_FIELDS) {
+            LOGE("getAudioClock: clock array needs %d elements", CLOCK_FIELDS);
+            return FLUID_FAILED;
+        }
+
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+        uint64_t frame;
+        int64_t time_ns;
+        ref->clock.read(&frame, &time_ns);
+
+        jlong values[CLOCK_FIELDS];
+        values[CLOCK_FRAME] = static_cast<jlong>(frame);
+        values[CLOCK_TIME_NS] = time_ns;
+        values[CLOCK_SAMPLE_RATE] = ref->sample_rate;
+        values[CLOCK_LATENCY_FRAMES] = ref->latency_frames;
+        values[CLOCK_BLOCK_SIZE] = ref->block_size;
+        env->SetLongArrayRegion(clock, 0, CLOCK_FIELDS, values);
+        return FLUID_OK;
+    } catch (const std::exception &e) {
+        LOGE("Exception in getAudioClock: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+// Schedule packed MIDI events on the synth's sequencer, which counts ticks (1000 per second by
+// default, see setSequencerTimeScale) on the audio clock. ticks[i] is an absolute tick, or with
+// absolute false an offset from the current tick. Channel messages only: a system message ends
+// the batch. Returns the number scheduled.
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_scheduleSequencerEvents(JNIEnv *env, jobject clazz,
+                                                                  jlong synth_handle,
+                                                                  jintArray events,
+                                                                  jintArray ticks, jint count,
+                                                                  jboolean absolute) {
+    try {
+        if (!events || !ticks || count < 0 || count > env->GetArrayLength(events) ||
+            count > env->GetArrayLength(ticks)) {
+            LOGE("scheduleSequencerEvents: invalid event/tick arrays or count %d", count);
+            return FLUID_FAILED;
+        }
+
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+        EventSequencer *sequencer = get_sequencer(ref.get());
+        if (!sequencer) {
+            return FLUID_FAILED;
+        }
+
+        uint32_t event_chunk[EVENT_BATCH_CHUNK];
+        uint32_t tick_chunk[EVENT_BATCH_CHUNK];
+        jint scheduled = 0;
+        for (jint offset = 0; offset < count; offset += EVENT_BATCH_CHUNK) {
+            jint n = std::min<jint>(EVENT_BATCH_CHUNK, count - offset);
+            env->GetIntArrayRegion(events, offset, n, reinterpret_cast<jint *>(event_chunk));
+            env->GetIntArrayRegion(ticks, offset, n, reinterpret_cast<jint *>(tick_chunk));
+            int done = sequencer->schedule(event_chunk, tick_chunk, n, absolute == JNI_TRUE);
+            for (int i = 0; i < done; ++i) {
+                prefetch_event(ref.get(), event_chunk[i]);
+            }
+            scheduled += done;
+            if (done < n) {
+                LOGE("scheduleSequencerEvents: event rejected, %d of %d events scheduled",
+                     scheduled, count);
+                break;
+            }
+        }
+        return scheduled;
+    } catch (const std::exception &e) {
+        LOGE("Exception in scheduleSequencerEvents: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+// Current sequencer tick: where the audio thread is, for scheduling absolute ticks ahead of it
+JNIEXPORT jlong JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getSequencerTick(JNIEnv *env, jobject clazz,
+                                                           jlong synth_handle) {
+    try {
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+        EventSequencer *sequencer = get_sequencer(ref.get());
+        if (!sequencer) {
+            return FLUID_FAILED;
+        }
+        return static_cast<jlong>(sequencer->tick());
+    } catch (const std::exception &e) {
+        LOGE("Exception in getSequencerTick: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+// Set the sequencer's ticks per second, e.g. from a tempo: bpm / 60 * pulses per quarter note
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_setSequencerTimeScale(JNIEnv *env, jobject clazz,
+                                                                jlong synth_handle,
+                                                                jdouble ticks_per_second) {
+    try {
+        if (!(ticks_per_second > 0.0)) {
+            LOGE("setSequencerTimeScale: invalid time scale %f", ticks_per_second);
+            return FLUID_FAILED;
+        }
+
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+        EventSequencer *sequencer = get_sequencer(ref.get());
+        if (!sequencer) {
+            return FLUID_FAILED;
+        }
+        sequencer->set_time_scale(ticks_per_second);
+        return FLUID_OK;
+    } catch (const std::exception &e) {
+        LOGE("Exception in setSequencerTimeScale: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+JNIEXPORT jdouble JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getSequencerTimeScale(JNIEnv *env, jobject clazz,
+                                                                jlong synth_handle) {
+    try {
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return -1.0;
+        }
+        EventSequencer *sequencer = get_sequencer(ref.get());
+        if (!sequencer) {
+            return -1.0;
+        }
+        return sequencer->time_scale();
+    } catch (const std::exception &e) {
+        LOGE("Exception in getSequencerTimeScale: %s", e.what());
+        return -1.0;
+    }
+}
+
+// Drop every event still scheduled on the sequencer, e.g. when a pattern stops. Notes already
+// playing keep sounding; follow with CC 123 (all notes off) to release them.
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_clearSequencer(JNIEnv *env, jobject clazz,
+                                                         jlong synth_handle) {
+    try {
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+        EventSequencer *sequencer = ref->sequencer.load(std::memory_order_acquire);
+        if (sequencer) {
+            sequencer->clear();
+        }
+        return FLUID_OK;
+    } catch (const std::exception &e) {
+        LOGE("Exception in clearSequencer: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+// Load a Standard MIDI File from memory into the synth's player, replacing the previous one. The
+// bytes are copied, nothing is written to disk. The file starts stopped at its beginning.
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_loadMidiFile(JNIEnv *env, jobject clazz,
+                                                       jlong synth_handle, jbyteArray data) {
+    try {
+        if (!data) {
+            LOGE("loadMidiFile: data is null");
+            return FLUID_FAILED;
+        }
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+        std::vector<uint8_t> bytes(static_cast<size_t>(env->GetArrayLength(data)));
+        env->GetByteArrayRegion(data, 0, static_cast<jsize>(bytes.size()),
+                                reinterpret_cast<jbyte *>(bytes.data()));
+        return ref->midi_player->load(bytes.data(), bytes.size());
+    } catch (const std::exception &e) {
+        LOGE("Exception in loadMidiFile: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+// Stop and drop the loaded MIDI file
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_unloadMidiFile(JNIEnv *env, jobject clazz,
+                                                         jlong synth_handle) {
+    try {
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+        ref->midi_player->unload();
+        return FLUID_OK;
+    } catch (const std::exception &e) {
+        LOGE("Exception in unloadMidiFile: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+// Start or resume the loaded MIDI file; it plays from the start again once it has ended
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_playMidi(JNIEnv *env, jobject clazz,
+                                                   jlong synth_handle) {
+    try {
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+        return ref->midi_player->play();
+    } catch (const std::exception &e) {
+        LOGE("Exception in playMidi: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+// Pause the MIDI file at its current position and release the notes on channels 0-15
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_stopMidi(JNIEnv *env, jobject clazz,
+                                                   jlong synth_handle) {
+    try {
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+        return ref->midi_player->stop();
+    } catch (const std::exception &e) {
+        LOGE("Exception in stopMidi: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+// Move the MIDI file to a position in ticks; applied within the next rendered block
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_seekMidi(JNIEnv *env, jobject clazz,
+                                                   jlong synth_handle, jint ticks) {
+    try {
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+        return ref->midi_player->seek(ticks);
+    } catch (const std::exception &e) {
+        LOGE("Exception in seekMidi: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+// Set how many times the MIDI file plays, -1 for endless
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_setMidiLoop(JNIEnv *env, jobject clazz,
+                                                      jlong synth_handle, jint loops) {
+    try {
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+        return ref->midi_player->set_loop(loops);
+    } catch (const std::exception &e) {
+        LOGE("Exception in setMidiLoop: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+// Set the MIDI file's tempo: a factor on the file's own tempo (FLUID_PLAYER_TEMPO_INTERNAL),
+// or a fixed tempo in BPM or microseconds per quarter note that overrides it
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_setMidiTempo(JNIEnv *env, jobject clazz,
+                                                       jlong synth_handle, jint tempo_type,
+                                                       jdouble tempo) {
+    try {
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+        return ref->midi_player->set_tempo(tempo_type, tempo);
+    } catch (const std::exception &e) {
+        LOGE("Exception in setMidiTempo: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+// Fill position with the MIDI player's status, current and total ticks, BPM, ticks per quarter
+// note and tempo in microseconds per quarter note, see MIDI_POSITION_*. Fails if no file is
+// loaded.
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getMidiPosition(JNIEnv *env, jobject clazz,
+                                                          jlong synth_handle,
+                                                          jintArray position) {
+    try {
+        if (!position || env->GetArrayLength(position) < MIDI_POSITION_FIELDS) {
+            LOGE("getMidiPosition: position array needs %d elements", MIDI_POSITION_FIELDS);
+            return FLUID_FAILED;
+        }
+
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+        int32_t fields[MIDI_POSITION_FIELDS];
+        if (!ref->midi_player->position(fields)) {
+            return FLUID_FAILED;
+        }
+        env->SetIntArrayRegion(position, 0, MIDI_POSITION_FIELDS,
+                               reinterpret_cast<const jint *>(fields));
+        return FLUID_OK;
+    } catch (const std::exception &e) {
+        LOGE("Exception in getMidiPosition: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
+
+// Render frames of interleaved stereo float audio straight into a direct FloatBuffer.
+// Only for synths from createOfflineSynth; one render at a time per synth.
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_renderFrames(JNIEnv *env, jobject clazz,
+                                                       jlong synth_handle, jobject buffer,
+                                                       jint frames) {
+    try {
+        auto *out = static_cast<float *>(buffer ? env->GetDirectBufferAddress(buffer) : nullptr);
+        if (!out || frames < 0 || static_cast<jlong>(frames) * 2 > env->GetDirectBufferCapacity(buffer)) {
+            LOGE("renderFrames: buffer must be a direct FloatBuffer holding %d stereo frames", frames);
+            return FLUID_FAILED;
+        }
+
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+        if (ref->realtime) {
+            LOGE("renderFrames: synthesizer %lld renders to an audio output", synth_handle);
+            return FLUID_FAILED;
+        }
+        if (ref->rendering.exchange(true, std::memory_order_acquire)) {
+            LOGE("renderFrames: synthesizer %lld is already rendering", synth_handle);
+            return FLUID_FAILED;
+        }
 
-// Global state management
-static std::unordered_map<jlong, fluid_synth_t *> synth_instances;
-static std::unordered_map<jlong, fluid_settings_t *> settings_instances;
-static std::unordered_map<jlong, fluid_audio_driver_t *> audio_driver_instances;
-static std::mutex synth_mutex;
-static jlong next_synth_id = 1;
+        int64_t started = monotonic_now_ns();
+        render_interleaved(ref.get(), out, frames);
+        int64_t elapsed = monotonic_now_ns() - started;
 
-extern "C" {
+        ref->offline_frames.fetch_add(static_cast<uint64_t>(frames), std::memory_order_relaxed);
+        ref->offline_render_ns.fetch_add(static_cast<uint64_t>(elapsed), std::memory_order_relaxed);
+        ref->rendering.store(false, std::memory_order_release);
+        return frames;
+    } catch (const std::exception &e) {
+        LOGE("Exception in renderFrames: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
 
-// Create a new FluidSynth synthesizer
+// Audio seconds rendered per wall-clock second across all renderFrames calls, 0 before the first
+JNIEXPORT jdouble JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getRealtimeFactor(JNIEnv *env, jobject clazz,
+                                                            jlong synth_handle) {
+    try {
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return 0.0;
+        }
+
+        uint64_t frames = ref->offline_frames.load(std::memory_order_relaxed);
+        uint64_t elapsed_ns = ref->offline_render_ns.load(std::memory_order_relaxed);
+        if (frames == 0 || elapsed_ns == 0 || ref->sample_rate <= 0) {
+            return 0.0;
+        }
+        double audio_seconds = static_cast<double>(frames) / ref->sample_rate;
+        return audio_seconds / (static_cast<double>(elapsed_ns) / 1e9);
+    } catch (const std::exception &e) {
+        LOGE("Exception in getRealtimeFactor: %s", e.what());
+        return 0.0;
+    }
+}
+
+// Start bouncing `frames` frames of an offline synth to a WAV, FLAC or Ogg Vorbis file in the
+// background. Events must be queued (e.g. with sendTimedEvents) before or during the export.
+// Returns an export handle, or -1 on failure.
 JNIEXPORT jlong JNICALL
-Java_org_tetawex_cmpsftdemo_FluidSynthJNI_createSynth(JNIEnv *env, jobject clazz) {
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_startExport(JNIEnv *env, jobject clazz,
+                                                      jlong synth_handle, jstring file_path,
+                                                      jint format, jlong frames) {
     try {
-        // Create settings
-        fluid_settings_t *settings = new_fluid_settings();
-        if (!settings) {
-            LOGE("Failed to create FluidSynth settings");
+        if (!file_path || frames < 0) {
+            LOGE("startExport: invalid file_path or frame count %lld", frames);
             return -1;
         }
 
-        // Configure settings for optimal audio output
-        fluid_settings_setstr(settings, "synth.audio.driver", "oboe");
-        fluid_settings_setint(settings, "synth.polyphony", 256);
-        fluid_settings_setint(settings, "synth.midi-channels", 16);
-        fluid_settings_setnum(settings, "synth.gain", 0.8);
-        fluid_settings_setint(settings, "audio.periods", 2);
-        fluid_settings_setint(settings, "audio.period-size", 256);
-
-        // Create synthesizer
-        fluid_synth_t *synth = new_fluid_synth(settings);
-        if (!synth) {
-            LOGE("Failed to create FluidSynth synthesizer");
-            delete_fluid_settings(settings);
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return -1;
+        }
+        if (ref->realtime) {
+            LOGE("startExport: synthesizer %lld renders to an audio output", synth_handle);
+            return -1;
+        }
+        if (ref->rendering.exchange(true, std::memory_order_acquire)) {
+            LOGE("startExport: synthesizer %lld is already rendering", synth_handle);
             return -1;
         }
 
-        // Create and connect audio driver to synthesizer
-        fluid_audio_driver_t *adriver = new_fluid_audio_driver(settings, synth);
-        if (!adriver) {
-            LOGE("Failed to create audio driver - sound output will not work");
-            delete_fluid_synth(synth);
-            delete_fluid_settings(settings);
+        const char *path = env->GetStringUTFChars(file_path, nullptr);
+        if (!path) {
+            LOGE("Failed to get UTF chars from file_path");
+            ref->rendering.store(false, std::memory_order_release);
             return -1;
         }
 
-        // Store instances and return handle (thread-safe)
-        std::lock_guard<std::mutex> lock(synth_mutex);
-        jlong synth_id = next_synth_id++;
-        synth_instances[synth_id] = synth;
-        settings_instances[synth_id] = settings;
-        audio_driver_instances[synth_id] = adriver;
+        // The render thread resolves the handle per block, so destroying the synth mid-export
+        // fails the export instead of pinning the synth
+        ExportJob *job = ExportJob::start(
+                path, format, ref->sample_rate, frames,
+                [synth_handle](float *out, int count) {
+                    SynthRef render_ref(synth_handle);
+                    if (!render_ref) {
+                        return false;
+                    }
+                    render_interleaved(render_ref.get(), out, count);
+                    return true;
+                },
+                [synth_handle]() {
+                    SynthRef done_ref(synth_handle);
+                    if (done_ref) {
+                        done_ref->rendering.store(false, std::memory_order_release);
+                    }
+                });
+        env->ReleaseStringUTFChars(file_path, path);
+        if (!job) {
+            ref->rendering.store(false, std::memory_order_release);
+            return -1;
+        }
 
-        LOGI("Created synthesizer with ID: %lld, audio driver initialized", synth_id);
-        return synth_id;
+        jlong export_id = export_table.insert(job);
+        if (export_id == -1) {
+            LOGE("Too many exports (max %d)", MAX_EXPORT_JOBS);
+            delete job;
+            return -1;
+        }
+        EpochDomain::instance().reclaim();
+        return export_id;
     } catch (const std::exception &e) {
-        LOGE("Exception in createSynth: %s", e.what());
+        LOGE("Exception in startExport: %s", e.what());
         return -1;
     }
 }
 
-// Destroy a FluidSynth synthesizer
-JNIEXPORT void JNICALL
-Java_org_tetawex_cmpsftdemo_FluidSynthJNI_destroySynth(JNIEnv *env, jobject clazz,
-                                                       jlong synth_handle) {
+// Fraction of the export written so far, 0..1, or -1 if the handle is unknown
+JNIEXPORT jdouble JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getExportProgress(JNIEnv *env, jobject clazz,
+                                                            jlong export_handle) {
     try {
-        std::lock_guard<std::mutex> lock(synth_mutex);
+        EpochGuard guard;
+        ExportJob *job = export_table.find(export_handle);
+        if (!job) {
+            LOGE("Export with ID %lld not found", export_handle);
+            return -1.0;
+        }
+        return job->progress();
+    } catch (const std::exception &e) {
+        LOGE("Exception in getExportProgress: %s", e.what());
+        return -1.0;
+    }
+}
 
-        // Destroy audio driver first
-        auto adriver_it = audio_driver_instances.find(synth_handle);
-        if (adriver_it != audio_driver_instances.end()) {
-            delete_fluid_audio_driver(adriver_it->second);
-            audio_driver_instances.erase(adriver_it);
+// EXPORT_RUNNING, EXPORT_DONE, EXPORT_CANCELLED or EXPORT_FAILED
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getExportStatus(JNIEnv *env, jobject clazz,
+                                                          jlong export_handle) {
+    try {
+        EpochGuard guard;
+        ExportJob *job = export_table.find(export_handle);
+        if (!job) {
+            LOGE("Export with ID %lld not found", export_handle);
+            return EXPORT_FAILED;
         }
+        return job->status();
+    } catch (const std::exception &e) {
+        LOGE("Exception in getExportStatus: %s", e.what());
+        return EXPORT_FAILED;
+    }
+}
 
-        // Then destroy synthesizer
-        auto synth_it = synth_instances.find(synth_handle);
-        if (synth_it != synth_instances.end()) {
-            delete_fluid_synth(synth_it->second);
-            synth_instances.erase(synth_it);
+// Ask a running export to stop; the partial file is deleted
+JNIEXPORT void JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_cancelExport(JNIEnv *env, jobject clazz,
+                                                       jlong export_handle) {
+    try {
+        EpochGuard guard;
+        ExportJob *job = export_table.find(export_handle);
+        if (!job) {
+            LOGE("Export with ID %lld not found", export_handle);
+            return;
         }
+        job->cancel();
+    } catch (const std::exception &e) {
+        LOGE("Exception in cancelExport: %s", e.what());
+    }
+}
 
-        // Finally destroy settings
-        auto settings_it = settings_instances.find(synth_handle);
-        if (settings_it != settings_instances.end()) {
-            delete_fluid_settings(settings_it->second);
-            settings_instances.erase(settings_it);
+// Wait for an export to end, release its handle and return its final status
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_finishExport(JNIEnv *env, jobject clazz,
+                                                       jlong export_handle) {
+    try {
+        ExportJob *job = export_table.remove(export_handle);
+        if (!job) {
+            LOGE("Export with ID %lld not found", export_handle);
+            return EXPORT_FAILED;
         }
 
-        LOGI("Destroyed synthesizer with ID: %lld", synth_handle);
+        job->wait();
+        int status = job->status();
+        EpochDomain::instance().retire(job);
+        EpochDomain::instance().reclaim();
+        return status;
     } catch (const std::exception &e) {
-        LOGE("Exception in destroySynth: %s", e.what());
+        LOGE("Exception in finishExport: %s", e.what());
+        return EXPORT_FAILED;
     }
 }
 
-// Load a SoundFont file
-JNIEXPORT jint JNICALL
-Java_org_tetawex_cmpsftdemo_FluidSynthJNI_loadSoundFont(JNIEnv *env, jobject clazz,
-                                                        jlong synth_handle, jstring file_path) {
+// Creates a stem synth for startStemRender: the source synth's engine settings and gain on one
+// core, with its SoundFonts loaded in the same stack order. The loaders share their parsed banks.
+static fluid_synth_t *new_stem_synth(const EngineConfig &config, double gain,
+                                     const std::vector<std::string> &sfonts) {
+    fluid_settings_t *settings = new_fluid_settings();
+    if (!settings) {
+        LOGE("Failed to create FluidSynth settings");
+        return nullptr;
+    }
+    fluid_settings_setnum(settings, "synth.gain", gain);
+    config.apply(settings);
+
+    fluid_synth_t *synth = new_fluid_synth(settings);
+    if (!synth) {
+        LOGE("Failed to create FluidSynth synthesizer");
+        delete_fluid_settings(settings);
+        return nullptr;
+    }
+    add_sfloaders(settings, synth);
+    for (const std::string &sfont : sfonts) {
+        if (fluid_synth_sfload(synth, sfont.c_str(), 0) == FLUID_FAILED) {
+            LOGE("Failed to load SoundFont %s into a stem synth", sfont.c_str());
+            delete_fluid_synth(synth);
+            delete_fluid_settings(settings);
+            return nullptr;
+        }
+    }
+    fluid_synth_program_reset(synth);
+    return synth;
+}
+
+// Render a Standard MIDI File as one file per MIDI channel, in parallel on one synth per channel
+// that load the SoundFonts of synth_handle. Files are "<prefix>_chNN.<ext>" plus, with mix,
+// "<prefix>_mix.<ext>". The source synth is only read here and keeps playing. Returns a stem
+// render handle or -1.
+JNIEXPORT jlong JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_startStemRender(JNIEnv *env, jobject clazz,
+                                                          jlong synth_handle, jbyteArray data,
+                                                          jstring output_prefix, jint format,
+                                                          jboolean mix) {
     try {
-        if (!file_path) {
-            LOGE("loadSoundFont: file_path is null");
+        if (!data) {
+            LOGE("startStemRender: data is null");
             return -1;
         }
-
-        std::lock_guard<std::mutex> lock(synth_mutex);
-        auto it = synth_instances.find(synth_handle);
-        if (it == synth_instances.end()) {
-            LOGE("Synthesizer with ID %lld not found", synth_handle);
+        std::string prefix;
+        if (!get_string(env, output_prefix, "output_prefix", &prefix)) {
             return -1;
         }
 
-        const char *path = env->GetStringUTFChars(file_path, nullptr);
-        if (!path) {
-            LOGE("Failed to get UTF chars from file_path");
+        EngineConfig config;
+        double gain;
+        int sample_rate;
+        std::vector<std::string> sfonts;
+        {
+            SynthRef ref(synth_handle);
+            if (!ref) {
+                LOGE("Synthesizer with ID %lld not found", synth_handle);
+                return -1;
+            }
+            config = ref->config;
+            sample_rate = ref->sample_rate;
+            ApiGateScope busy(&ref->api_gate);
+            gain = fluid_synth_get_gain(ref.synth());
+            // Bottom of the stack first, so the stem synths stack them the same way. SoundFonts
+            // retired by a hot-swap are on their way out and left behind.
+            for (int i = fluid_synth_sfcount(ref.synth()) - 1; i >= 0; --i) {
+                fluid_sfont_t *sfont = fluid_synth_get_sfont(ref.synth(), i);
+                if (sfont && !mmap_sfont_retired(sfont)) {
+                    sfonts.emplace_back(fluid_sfont_get_name(sfont));
+                }
+            }
+        }
+        if (sfonts.empty()) {
+            LOGE("startStemRender: synthesizer %lld has no SoundFont loaded", synth_handle);
             return -1;
         }
+        // The stems already render in parallel; extra render workers per synth would only
+        // compete with them
+        config.cpu_cores = 1;
+        config.audio_groups = 1;
+        config.sample_rate = sample_rate;
 
-        int sfont_id = fluid_synth_sfload(it->second, path, 1);
-        env->ReleaseStringUTFChars(file_path, path);
-
-        if (sfont_id == FLUID_FAILED) {
-            LOGE("Failed to load SoundFont: %s", path);
+        std::vector<uint8_t> bytes(static_cast<size_t>(env->GetArrayLength(data)));
+        env->GetByteArrayRegion(data, 0, static_cast<jsize>(bytes.size()),
+                                reinterpret_cast<jbyte *>(bytes.data()));
+        StemRenderJob *job = StemRenderJob::start(
+                bytes.data(), bytes.size(), prefix, format, mix == JNI_TRUE, sample_rate,
+                [config, gain, sfonts]() { return new_stem_synth(config, gain, sfonts); });
+        if (!job) {
             return -1;
         }
 
-        LOGI("Loaded SoundFont with ID: %d from %s", sfont_id, path);
-        return sfont_id;
+        jlong stem_render_id = stem_render_table.insert(job);
+        if (stem_render_id == -1) {
+            LOGE("Too many stem renders (max %d)", MAX_STEM_RENDER_JOBS);
+            delete job;
+            return -1;
+        }
+        EpochDomain::instance().reclaim();
+        return stem_render_id;
     } catch (const std::exception &e) {
-        LOGE("Exception in loadSoundFont: %s", e.what());
+        LOGE("Exception in startStemRender: %s", e.what());
         return -1;
     }
 }
 
-// Play a note
+// Fraction of the stems written so far, 0..1, or -1 if the handle is unknown
+JNIEXPORT jdouble JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getStemRenderProgress(JNIEnv *env, jobject clazz,
+                                                                jlong stem_render_handle) {
+    try {
+        EpochGuard guard;
+        StemRenderJob *job = stem_render_table.find(stem_render_handle);
+        if (!job) {
+            LOGE("Stem render with ID %lld not found", stem_render_handle);
+            return -1.0;
+        }
+        return job->progress();
+    } catch (const std::exception &e) {
+        LOGE("Exception in getStemRenderProgress: %s", e.what());
+        return -1.0;
+    }
+}
+
+// EXPORT_RUNNING, EXPORT_DONE, EXPORT_CANCELLED or EXPORT_FAILED
 JNIEXPORT jint JNICALL
-Java_org_tetawex_cmpsftdemo_FluidSynthJNI_noteOn(JNIEnv *env, jobject clazz, jlong synth_handle,
-                                                 jint channel, jint note, jint velocity) {
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getStemRenderStatus(JNIEnv *env, jobject clazz,
+                                                              jlong stem_render_handle) {
     try {
-        std::lock_guard<std::mutex> lock(synth_mutex);
-        auto it = synth_instances.find(synth_handle);
-        if (it == synth_instances.end()) {
-            LOGE("Synthesizer with ID %lld not found", synth_handle);
+        EpochGuard guard;
+        StemRenderJob *job = stem_render_table.find(stem_render_handle);
+        if (!job) {
+            LOGE("Stem render with ID %lld not found", stem_render_handle);
+            return EXPORT_FAILED;
+        }
+        return job->status();
+    } catch (const std::exception &e) {
+        LOGE("Exception in getStemRenderStatus: %s", e.what());
+        return EXPORT_FAILED;
+    }
+}
+
+// Read the stem count, threads and timings into report[STEM_REPORT_FIELDS]. The scaling field
+// is the render time of all stems over the wall time: how many stems rendered at once.
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getStemRenderReport(JNIEnv *env, jobject clazz,
+                                                              jlong stem_render_handle,
+                                                              jdoubleArray report) {
+    try {
+        if (!report || env->GetArrayLength(report) < STEM_REPORT_FIELDS) {
+            LOGE("getStemRenderReport: report array needs %d elements", STEM_REPORT_FIELDS);
+            return FLUID_FAILED;
+        }
+        EpochGuard guard;
+        StemRenderJob *job = stem_render_table.find(stem_render_handle);
+        if (!job) {
+            LOGE("Stem render with ID %lld not found", stem_render_handle);
             return FLUID_FAILED;
         }
+        double values[STEM_REPORT_FIELDS];
+        job->report(values);
+        env->SetDoubleArrayRegion(report, 0, STEM_REPORT_FIELDS, values);
+        return FLUID_OK;
+    } catch (const std::exception &e) {
+        LOGE("Exception in getStemRenderReport: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
 
-        int result = fluid_synth_noteon(it->second, channel, note, velocity);
-        if (result != FLUID_OK) {
-            LOGE("Failed to play note: channel=%d, note=%d, velocity=%d", channel, note, velocity);
+// Ask a running stem render to stop; every partial file is deleted
+JNIEXPORT void JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_cancelStemRender(JNIEnv *env, jobject clazz,
+                                                           jlong stem_render_handle) {
+    try {
+        EpochGuard guard;
+        StemRenderJob *job = stem_render_table.find(stem_render_handle);
+        if (!job) {
+            LOGE("Stem render with ID %lld not found", stem_render_handle);
+            return;
         }
-        return result;
+        job->cancel();
     } catch (const std::exception &e) {
-        LOGE("Exception in noteOn: %s", e.what());
+        LOGE("Exception in cancelStemRender: %s", e.what());
+    }
+}
+
+// Wait for a stem render to end, release its handle and return its final status
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_finishStemRender(JNIEnv *env, jobject clazz,
+                                                           jlong stem_render_handle) {
+    try {
+        StemRenderJob *job = stem_render_table.remove(stem_render_handle);
+        if (!job) {
+            LOGE("Stem render with ID %lld not found", stem_render_handle);
+            return EXPORT_FAILED;
+        }
+
+        job->wait();
+        int status = job->status();
+        EpochDomain::instance().retire(job);
+        EpochDomain::instance().reclaim();
+        return status;
+    } catch (const std::exception &e) {
+        LOGE("Exception in finishStemRender: %s", e.what());
+        return EXPORT_FAILED;
+    }
+}
+
+// Read the render-callback counters into stats[STATS_FIELDS] with one call
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getStats(JNIEnv *env, jobject clazz, jlong synth_handle,
+                                                   jlongArray stats) {
+    try {
+        if (!stats || env->GetArrayLength(stats) < STATS_FIELDS) {
+            LOGE("getStats: stats array needs %d elements", STATS_FIELDS);
+            return FLUID_FAILED;
+        }
+
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+
+        int64_t values[STATS_FIELDS];
+        ref->stats.snapshot(values, fluid_synth_get_cpu_load(ref.synth()));
+        env->SetLongArrayRegion(stats, 0, STATS_FIELDS, reinterpret_cast<const jlong *>(values));
+        return FLUID_OK;
+    } catch (const std::exception &e) {
+        LOGE("Exception in getStats: %s", e.what());
         return FLUID_FAILED;
     }
 }
 
-// Stop a note
+// Copy the latest spectrum into magnitudes[SPECTRUM_BINS] and bands[SPECTRUM_BANDS], both
+// normalized to 0..1; either array may be null. Fails until the first spectrum is ready.
 JNIEXPORT jint JNICALL
-Java_org_tetawex_cmpsftdemo_FluidSynthJNI_noteOff(JNIEnv *env, jobject clazz, jlong synth_handle,
-                                                  jint channel, jint note) {
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getSpectrum(JNIEnv *env, jobject clazz,
+                                                      jlong synth_handle, jfloatArray magnitudes,
+                                                      jfloatArray bands) {
     try {
-        std::lock_guard<std::mutex> lock(synth_mutex);
-        auto it = synth_instances.find(synth_handle);
-        if (it == synth_instances.end()) {
+        if ((magnitudes && env->GetArrayLength(magnitudes) < SPECTRUM_BINS) ||
+            (bands && env->GetArrayLength(bands) < SPECTRUM_BANDS)) {
+            LOGE("getSpectrum: arrays need %d magnitudes and %d bands", SPECTRUM_BINS,
+                 SPECTRUM_BANDS);
+            return FLUID_FAILED;
+        }
+
+        SynthRef ref(synth_handle);
+        if (!ref) {
             LOGE("Synthesizer with ID %lld not found", synth_handle);
             return FLUID_FAILED;
         }
+        if (!ref->analyzer) {
+            LOGE("getSpectrum: synthesizer %lld has no audio output", synth_handle);
+            return FLUID_FAILED;
+        }
 
-        int result = fluid_synth_noteoff(it->second, channel, note);
-        if (result != FLUID_OK) {
-            LOGE("Failed to stop note: channel=%d, note=%d", channel, note);
+        float magnitude_values[SPECTRUM_BINS];
+        float band_values[SPECTRUM_BANDS];
+        if (!ref->analyzer->read(magnitudes ? magnitude_values : nullptr,
+                                 bands ? band_values : nullptr)) {
+            return FLUID_FAILED;
         }
-        return result;
+        if (magnitudes) {
+            env->SetFloatArrayRegion(magnitudes, 0, SPECTRUM_BINS, magnitude_values);
+        }
+        if (bands) {
+            env->SetFloatArrayRegion(bands, 0, SPECTRUM_BANDS, band_values);
+        }
+        return FLUID_OK;
     } catch (const std::exception &e) {
-        LOGE("Exception in noteOff: %s", e.what());
+        LOGE("Exception in getSpectrum: %s", e.what());
         return FLUID_FAILED;
     }
 }
 
-// Set program (instrument)
+// Read the levels of every audio group into levels[groups * GROUP_LEVEL_FIELDS], group by group:
+// peaks since the previous call and the RMS of the last rendered slice. Returns the number of
+// groups, or FLUID_FAILED for synths created with a single audio group.
 JNIEXPORT jint JNICALL
-Java_org_tetawex_cmpsftdemo_FluidSynthJNI_programChange(JNIEnv *env, jobject clazz,
-                                                        jlong synth_handle,
-                                                        jint channel, jint program) {
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getAudioGroupLevels(JNIEnv *env, jobject clazz,
+                                                              jlong synth_handle,
+                                                              jfloatArray levels) {
     try {
-        std::lock_guard<std::mutex> lock(synth_mutex);
-        auto it = synth_instances.find(synth_handle);
-        if (it == synth_instances.end()) {
+        SynthRef ref(synth_handle);
+        if (!ref) {
             LOGE("Synthesizer with ID %lld not found", synth_handle);
             return FLUID_FAILED;
         }
-
-        int result = fluid_synth_program_change(it->second, channel, program);
-        if (result != FLUID_OK) {
-            LOGE("Failed to change program: channel=%d, program=%d", channel, program);
+        GroupBus *bus = ref->group_bus;
+        if (!bus) {
+            LOGE("getAudioGroupLevels: synthesizer %lld has one audio group", synth_handle);
+            return FLUID_FAILED;
         }
-        return result;
+        int count = bus->groups() * GROUP_LEVEL_FIELDS;
+        if (!levels || env->GetArrayLength(levels) < count) {
+            LOGE("getAudioGroupLevels: levels array needs %d elements", count);
+            return FLUID_FAILED;
+        }
+
+        float values[MAX_AUDIO_GROUPS * GROUP_LEVEL_FIELDS];
+        bus->levels(values);
+        env->SetFloatArrayRegion(levels, 0, count, values);
+        return bus->groups();
     } catch (const std::exception &e) {
-        LOGE("Exception in programChange: %s", e.what());
+        LOGE("Exception in getAudioGroupLevels: %s", e.what());
         return FLUID_FAILED;
     }
 }
 
-// Set channel volume (CC 7)
+// Start or stop copying every audio group's output into its capture ring. Starting drops
+// anything left from an earlier capture.
 JNIEXPORT jint JNICALL
-Java_org_tetawex_cmpsftdemo_FluidSynthJNI_setChannelVolume(JNIEnv *env, jobject clazz,
-                                                           jlong synth_handle,
-                                                           jint channel, jint volume) {
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_setAudioGroupCapture(JNIEnv *env, jobject clazz,
+                                                               jlong synth_handle,
+                                                               jboolean enabled) {
     try {
-        std::lock_guard<std::mutex> lock(synth_mutex);
-        auto it = synth_instances.find(synth_handle);
-        if (it == synth_instances.end()) {
+        SynthRef ref(synth_handle);
+        if (!ref) {
             LOGE("Synthesizer with ID %lld not found", synth_handle);
             return FLUID_FAILED;
         }
+        if (!ref->group_bus) {
+            LOGE("setAudioGroupCapture: synthesizer %lld has one audio group", synth_handle);
+            return FLUID_FAILED;
+        }
+        ref->group_bus->set_capture(enabled == JNI_TRUE);
+        return FLUID_OK;
+    } catch (const std::exception &e) {
+        LOGE("Exception in setAudioGroupCapture: %s", e.what());
+        return FLUID_FAILED;
+    }
+}
 
-        int result = fluid_synth_cc(it->second, channel, 7, volume);
-        if (result != FLUID_OK) {
-            LOGE("Failed to set channel volume: channel=%d, volume=%d", channel, volume);
+// Move up to out.length / 2 captured frames of one audio group into out, interleaved stereo and
+// oldest first. Each group's capture must be read from one thread at a time; about 0.37 s at
+// 44.1 kHz is buffered, and frames that do not fit are dropped. Returns the frames copied or
+// FLUID_FAILED.
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_readAudioGroup(JNIEnv *env, jobject clazz,
+                                                         jlong synth_handle, jint group,
+                                                         jfloatArray out) {
+    try {
+        if (!out) {
+            LOGE("readAudioGroup: out is null");
+            return FLUID_FAILED;
         }
-        return result;
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return FLUID_FAILED;
+        }
+        GroupBus *bus = ref->group_bus;
+        if (!bus || group < 0 || group >= bus->groups()) {
+            LOGE("readAudioGroup: synthesizer %lld has no audio group %d", synth_handle, group);
+            return FLUID_FAILED;
+        }
+
+        jsize offset = 0;
+        return bus->read_capture(group, env->GetArrayLength(out) / 2,
+                                 [env, out, &offset](const float *frames, int count) {
+                                     env->SetFloatArrayRegion(out, offset, count * 2, frames);
+                                     offset += count * 2;
+                                 });
     } catch (const std::exception &e) {
-        LOGE("Exception in setChannelVolume: %s", e.what());
+        LOGE("Exception in readAudioGroup: %s", e.what());
         return FLUID_FAILED;
     }
 }
 
-// Generic MIDI CC control
+// Opens an output from the instance's current settings for reopenAudio and starts it once the
+// period fields the audio thread reads are updated; nullptr on failure
+static AudioOutput *reopen_output(SynthInstance *instance) {
+    AudioOutput *output = AudioOutput::open(instance->settings, render_period, instance);
+    if (!output) {
+        return nullptr;
+    }
+    instance->periods.store(output->periods());
+    instance->latency_frames.store(output->period_size() * output->periods());
+    if (!output->start()) {
+        delete output;
+        return nullptr;
+    }
+    return output;
+}
+
+// Reopen the audio output with a new period size and count, keeping the synth, its SoundFonts
+// and channel state. The old output fades out over one period and the new one fades in; the
+// synth is paused in between. config is laid out as for createSynth, but only CONFIG_PERIOD_SIZE
+// and CONFIG_PERIODS are applied; the values in effect afterwards are written back.
 JNIEXPORT jint JNICALL
-Java_org_tetawex_cmpsftdemo_FluidSynthJNI_controlChange(JNIEnv *env, jobject clazz,
-                                                        jlong synth_handle,
-                                                        jint channel, jint controller, jint value) {
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_reopenAudio(JNIEnv *env, jobject clazz,
+                                                      jlong synth_handle, jintArray config) {
     try {
-        std::lock_guard<std::mutex> lock(synth_mutex);
-        auto it = synth_instances.find(synth_handle);
-        if (it == synth_instances.end()) {
+        if (!config) {
+            LOGE("reopenAudio: config is null");
+            return FLUID_FAILED;
+        }
+
+        SynthRef ref(synth_handle);
+        if (!ref) {
             LOGE("Synthesizer with ID %lld not found", synth_handle);
             return FLUID_FAILED;
         }
+        if (!ref->realtime) {
+            LOGE("reopenAudio: synthesizer %lld has no audio output", synth_handle);
+            return FLUID_FAILED;
+        }
 
-        int result = fluid_synth_cc(it->second, channel, controller, value);
-        if (result != FLUID_OK) {
-            LOGE("Failed to send CC: channel=%d, controller=%d, value=%d", channel, controller,
-                 value);
+        EngineConfig requested;
+        if (!read_engine_config(env, config, &requested)) {
+            return FLUID_FAILED;
+        }
+
+        SynthInstance *instance = ref.get();
+        std::lock_guard<std::mutex> lock(instance->output_mutex);
+        if (instance->closed) {
+            LOGE("reopenAudio: synthesizer %lld is being destroyed", synth_handle);
+            return FLUID_FAILED;
+        }
+
+        EngineConfig next = instance->config;
+        next.period_size = requested.period_size;
+        next.periods = requested.periods;
+        if (requested.sample_rate != next.sample_rate) {
+            LOGI("reopenAudio: sample rate stays at %d Hz; changing it needs a new synthesizer",
+                 next.sample_rate);
+        }
+
+        // Let the audio thread render one faded-out period, then stop the output. An output
+        // that stopped calling back is switched without waiting for the fade.
+        int64_t started = monotonic_now_ns();
+        instance->fade.store(FADE_OUT, std::memory_order_release);
+        while (instance->fade.load(std::memory_order_acquire) != FADE_MUTED &&
+               monotonic_now_ns() - started < REOPEN_FADE_TIMEOUT_NS) {
+            usleep(1000);
+        }
+        instance->fade.store(FADE_MUTED, std::memory_order_release);
+        delete instance->output;
+        instance->output = nullptr;
+
+        fluid_settings_setint(instance->settings, "audio.period-size", next.period_size);
+        fluid_settings_setint(instance->settings, "audio.periods", next.periods);
+        instance->fade.store(FADE_IN, std::memory_order_release);
+        AudioOutput *output = reopen_output(instance);
+        jint result = FLUID_OK;
+        if (!output) {
+            LOGE("reopenAudio: failed to open output with %d x %d frames, restoring %d x %d",
+                 next.periods, next.period_size, instance->config.periods,
+                 instance->config.period_size);
+            next = instance->config;
+            fluid_settings_setint(instance->settings, "audio.period-size", next.period_size);
+            fluid_settings_setint(instance->settings, "audio.periods", next.periods);
+            output = reopen_output(instance);
+            if (!output) {
+                LOGE("reopenAudio: failed to restore the audio output of synthesizer %lld",
+                     synth_handle);
+                return FLUID_FAILED;
+            }
+            result = FLUID_FAILED;
         }
+
+        instance->output = output;
+        instance->config = next;
+
+        int32_t fields[CONFIG_FIELDS];
+        next.to_array(fields);
+        env->SetIntArrayRegion(config, 0, CONFIG_FIELDS, reinterpret_cast<const jint *>(fields));
+
+        LOGI("Reopened audio output of synthesizer %lld: %d x %d frames in %.1f ms", synth_handle,
+             output->periods(), output->period_size(), (monotonic_now_ns() - started) / 1e6);
         return result;
     } catch (const std::exception &e) {
-        LOGE("Exception in controlChange: %s", e.what());
+        LOGE("Exception in reopenAudio: %s", e.what());
         return FLUID_FAILED;
     }
 }
 
+// Start loading a preset in the background without selecting it; returns its PRESET_* state
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_prefetchPreset(JNIEnv *env, jobject clazz,
+                                                         jlong synth_handle, jint bank,
+                                                         jint program) {
+    try {
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return -1;
+        }
+        return ref->presets->prefetch_preset(bank, program);
+    } catch (const std::exception &e) {
+        LOGE("Exception in prefetchPreset: %s", e.what());
+        return -1;
+    }
+}
+
+// PRESET_* state of a preset: PRESET_READY once a note on it plays without loading anything
+JNIEXPORT jint JNICALL
+Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getPresetStatus(JNIEnv *env, jobject clazz,
+                                                          jlong synth_handle, jint bank,
+                                                          jint program) {
+    try {
+        SynthRef ref(synth_handle);
+        if (!ref) {
+            LOGE("Synthesizer with ID %lld not found", synth_handle);
+            return -1;
+        }
+        return ref->presets->status(bank, program);
+    } catch (const std::exception &e) {
+        LOGE("Exception in getPresetStatus: %s", e.what());
+        return -1;
+    }
+}
+
 // Get synthesizer version
 JNIEXPORT jstring JNICALL
 Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getVersion(JNIEnv *env, jobject clazz) {
@@ -278,14 +2490,13 @@ JNIEXPORT jint JNICALL
 Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getSoundFontCount(JNIEnv *env, jobject clazz,
                                                             jlong synth_handle) {
     try {
-        std::lock_guard<std::mutex> lock(synth_mutex);
-        auto it = synth_instances.find(synth_handle);
-        if (it == synth_instances.end()) {
+        SynthRef ref(synth_handle);
+        if (!ref) {
             LOGE("Synthesizer with ID %lld not found", synth_handle);
             return 0;
         }
 
-        int count = fluid_synth_sfcount(it->second);
+        int count = fluid_synth_sfcount(ref.synth());
         LOGI("SoundFont count: %d", count);
         return count;
     } catch (const std::exception &e) {
@@ -299,14 +2510,13 @@ JNIEXPORT jint JNICALL
 Java_org_tetawex_cmpsftdemo_FluidSynthJNI_setMasterGain(JNIEnv *env, jobject clazz,
                                                         jlong synth_handle, jdouble gain) {
     try {
-        std::lock_guard<std::mutex> lock(synth_mutex);
-        auto it = synth_instances.find(synth_handle);
-        if (it == synth_instances.end()) {
+        SynthRef ref(synth_handle);
+        if (!ref) {
             LOGE("Synthesizer with ID %lld not found", synth_handle);
             return FLUID_FAILED;
         }
 
-        fluid_synth_set_gain(it->second, static_cast<float>(gain));
+        fluid_synth_set_gain(ref.synth(), static_cast<float>(gain));
         LOGI("Master gain set to: %f", gain);
         return FLUID_OK;
     } catch (const std::exception &e) {
@@ -320,14 +2530,13 @@ JNIEXPORT jdouble JNICALL
 Java_org_tetawex_cmpsftdemo_FluidSynthJNI_getMasterGain(JNIEnv *env, jobject clazz,
                                                         jlong synth_handle) {
     try {
-        std::lock_guard<std::mutex> lock(synth_mutex);
-        auto it = synth_instances.find(synth_handle);
-        if (it == synth_instances.end()) {
+        SynthRef ref(synth_handle);
+        if (!ref) {
             LOGE("Synthesizer with ID %lld not found", synth_handle);
             return 0.0;
         }
 
-        float gain = fluid_synth_get_gain(it->second);
+        float gain = fluid_synth_get_gain(ref.synth());
         LOGI("Current master gain: %f", gain);
         return static_cast<jdouble>(gain);
     } catch (const std::exception &e) {
@@ -0,0 +1,110 @@
+#include "group_bus.h"
+
+#include <cmath>
+
+GroupBus::GroupBus(int groups)
+        : groups_(groups), groups_data_(new Group[groups]),
+          fx_left_(GROUP_BUS_BLOCK_FRAMES), fx_right_(GROUP_BUS_BLOCK_FRAMES) {
+    for (int i = 0; i < groups_; ++i) {
+        Group &g = groups_data_[i];
+        g.left.resize(GROUP_BUS_BLOCK_FRAMES);
+        g.right.resize(GROUP_BUS_BLOCK_FRAMES);
+        for (int chan = 0; chan < 2; ++chan) {
+            g.peak[chan].store(0.0f, std::memory_order_relaxed);
+            g.rms[chan].store(0.0f, std::memory_order_relaxed);
+        }
+        g.ring.resize(static_cast<size_t>(GROUP_CAPTURE_FRAMES) * 2);
+        outputs_.push_back(g.left.data());
+        outputs_.push_back(g.right.data());
+    }
+}
+
+void GroupBus::render(fluid_synth_t *synth, int frames, float *left, float *right, int incr) {
+    float *fx[4] = {fx_left_.data(), fx_right_.data(), fx_left_.data(), fx_right_.data()};
+    bool capturing = capturing_.load(std::memory_order_acquire);
+    for (int done = 0; done < frames;) {
+        int count = std::min(frames - done, GROUP_BUS_BLOCK_FRAMES);
+
+        // fluid_synth_process() mixes into its buffers
+        for (int i = 0; i < groups_; ++i) {
+            std::fill_n(groups_data_[i].left.data(), count, 0.0f);
+            std::fill_n(groups_data_[i].right.data(), count, 0.0f);
+        }
+        std::fill_n(fx_left_.data(), count, 0.0f);
+        std::fill_n(fx_right_.data(), count, 0.0f);
+        fluid_synth_process(synth, count, 4, fx, groups_ * 2, outputs_.data());
+
+        // The effects buffers become the mix
+        for (int i = 0; i < groups_; ++i) {
+            Group &g = groups_data_[i];
+            meter(g, count);
+            if (capturing) {
+                capture(g, count);
+            }
+            for (int f = 0; f < count; ++f) {
+                fx_left_[f] += g.left[f];
+                fx_right_[f] += g.right[f];
+            }
+        }
+        for (int f = 0; f < count; ++f) {
+            left[static_cast<size_t>(done + f) * incr] = fx_left_[f];
+            right[static_cast<size_t>(done + f) * incr] = fx_right_[f];
+        }
+        done += count;
+    }
+}
+
+void GroupBus::meter(Group &g, int frames) {
+    const float *channels[2] = {g.left.data(), g.right.data()};
+    for (int chan = 0; chan < 2; ++chan) {
+        float peak = 0.0f;
+        float sum = 0.0f;
+        for (int f = 0; f < frames; ++f) {
+            float sample = channels[chan][f];
+            peak = std::max(peak, std::fabs(sample));
+            sum += sample * sample;
+        }
+        // Only the reader lowers the peak, so a plain load and store loses at most a reset
+        if (peak > g.peak[chan].load(std::memory_order_relaxed)) {
+            g.peak[chan].store(peak, std::memory_order_relaxed);
+        }
+        g.rms[chan].store(std::sqrt(sum / static_cast<float>(frames)), std::memory_order_relaxed);
+    }
+}
+
+void GroupBus::capture(Group &g, int frames) {
+    uint64_t write = g.write.load(std::memory_order_relaxed);
+    uint64_t used = write - g.read.load(std::memory_order_acquire);
+    int count = static_cast<int>(std::min<uint64_t>(frames, GROUP_CAPTURE_FRAMES - used));
+    if (count < frames) {
+        dropped_.fetch_add(static_cast<uint64_t>(frames - count), std::memory_order_relaxed);
+    }
+    float *ring = g.ring.data();
+    for (int f = 0; f < count; ++f) {
+        size_t slot = static_cast<size_t>((write + f) & (GROUP_CAPTURE_FRAMES - 1)) * 2;
+        ring[slot] = g.left[f];
+        ring[slot + 1] = g.right[f];
+    }
+    g.write.store(write + count, std::memory_order_release);
+}
+
+void GroupBus::levels(float *fields) {
+    for (int i = 0; i < groups_; ++i) {
+        Group &g = groups_data_[i];
+        float *out = fields + static_cast<size_t>(i) * GROUP_LEVEL_FIELDS;
+        out[GROUP_LEVEL_PEAK_LEFT] = g.peak[0].exchange(0.0f, std::memory_order_relaxed);
+        out[GROUP_LEVEL_PEAK_RIGHT] = g.peak[1].exchange(0.0f, std::memory_order_relaxed);
+        out[GROUP_LEVEL_RMS_LEFT] = g.rms[0].load(std::memory_order_relaxed);
+        out[GROUP_LEVEL_RMS_RIGHT] = g.rms[1].load(std::memory_order_relaxed);
+    }
+}
+
+void GroupBus::set_capture(bool enabled) {
+    if (enabled) {
+        for (int i = 0; i < groups_; ++i) {
+            Group &g = groups_data_[i];
+            g.read.store(g.write.load(std::memory_order_acquire), std::memory_order_release);
+        }
+    }
+    capturing_.store(enabled, std::memory_order_release);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <fluidsynth.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Frames rendered per fluid_synth_process() call; longer spans are rendered in slices
+#define GROUP_BUS_BLOCK_FRAMES 512
+// Per-group capture ring, interleaved stereo frames; a power of two
+#define GROUP_CAPTURE_FRAMES 16384
+
+// Layout of the levels filled per group by getAudioGroupLevels
+#define GROUP_LEVEL_PEAK_LEFT 0       // highest |sample| since the previous read
+#define GROUP_LEVEL_PEAK_RIGHT 1
+#define GROUP_LEVEL_RMS_LEFT 2        // RMS of the last rendered slice
+#define GROUP_LEVEL_RMS_RIGHT 3
+#define GROUP_LEVEL_FIELDS 4
+
+// Multi-output rendering for a synth with synth.audio-groups > 1. FluidSynth sends MIDI channel
+// c to audio group c % groups; one fluid_synth_process() call renders every group's dry signal
+// into its own stereo buffer, and the output is their sum plus reverb and chorus. The effects
+// stay one shared unit mixed into the output only, so group buffers are dry sends that can be
+// processed further without carrying another channel's reverb.
+//
+// For every slice the audio thread updates lock-free per-group meters and, while capture is on,
+// appends each group's audio to its own single-producer/single-consumer ring, so Kotlin can
+// meter, process or record the groups during live play without rendering them separately.
+class GroupBus {
+public:
+    explicit GroupBus(int groups);
+
+    GroupBus(const GroupBus &) = delete;
+    GroupBus &operator=(const GroupBus &) = delete;
+
+    int groups() const { return groups_; }
+
+    // Render thread: renders frames of synth and writes the mix to left[i * incr] and
+    // right[i * incr], overwriting them. Never blocks or allocates.
+    void render(fluid_synth_t *synth, int frames, float *left, float *right, int incr);
+
+    // Any thread: fills GROUP_LEVEL_FIELDS values per group, group by group, and resets the
+    // peaks
+    void levels(float *fields);
+
+    // Turning capture on drops what the rings held from an earlier capture; not while another
+    // thread is in read_capture()
+    void set_capture(bool enabled);
+
+    // Consumer of group's ring, one thread per group: calls sink(interleaved, frames) for up to
+    // max_frames captured frames, oldest first, in at most two runs. Returns the frames passed.
+    template<typename Sink>
+    int read_capture(int group, int max_frames, Sink &&sink) {
+        Group &g = groups_data_[group];
+        uint64_t read = g.read.load(std::memory_order_relaxed);
+        uint64_t available = g.write.load(std::memory_order_acquire) - read;
+        int frames = static_cast<int>(std::min<uint64_t>(available, max_frames));
+        int done = 0;
+        while (done < frames) {
+            uint32_t start = static_cast<uint32_t>((read + done) & (GROUP_CAPTURE_FRAMES - 1));
+            int run = std::min(frames - done, static_cast<int>(GROUP_CAPTURE_FRAMES - start));
+            sink(g.ring.data() + static_cast<size_t>(start) * 2, run);
+            done += run;
+        }
+        g.read.store(read + frames, std::memory_order_release);
+        return frames;
+    }
+
+    // Frames the render thread could not capture because a ring was full, over all groups
+    uint64_t capture_dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    struct Group {
+        std::vector<float> left;
+        std::vector<float> right;
+        std::atomic<float> peak[2];
+        std::atomic<float> rms[2];
+        std::vector<float> ring;
+        std::atomic<uint64_t> write{0};
+        std::atomic<uint64_t> read{0};
+    };
+
+    void meter(Group &g, int frames);
+    void capture(Group &g, int frames);
+
+    int groups_;
+    std::unique_ptr<Group[]> groups_data_;
+    // fluid_synth_process() outputs: left and right of every group in turn
+    std::vector<float *> outputs_;
+    std::vector<float> fx_left_;
+    std::vector<float> fx_right_;
+    std::atomic<bool> capturing_{false};
+    std::atomic<uint64_t> dropped_{0};
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <fluidsynth.h>
+#include <cstdint>
+
+// Packed MIDI events as exchanged with Kotlin: one 32-bit word per channel message laid out like
+// a MIDI short message, status | data1 << 8 | data2 << 16. The top byte is reserved and ignored.
+
+#define MIDI_NOTE_OFF 0x80
+#define MIDI_NOTE_ON 0x90
+#define MIDI_KEY_PRESSURE 0xA0
+#define MIDI_CONTROL_CHANGE 0xB0
+#define MIDI_PROGRAM_CHANGE 0xC0
+#define MIDI_CHANNEL_PRESSURE 0xD0
+#define MIDI_PITCH_BEND 0xE0
+#define MIDI_SYSTEM_RESET 0xFF
+
+inline uint32_t pack_midi_event(int status, int data1, int data2) {
+    return static_cast<uint32_t>(status & 0xff) |
+           (static_cast<uint32_t>(data1 & 0x7f) << 8) |
+           (static_cast<uint32_t>(data2 & 0x7f) << 16);
+}
+
+// Applies one packed event to the synth. Returns FLUID_OK or FLUID_FAILED.
+inline int apply_midi_event(fluid_synth_t *synth, uint32_t event) {
+    int status = static_cast<int>(event & 0xff);
+    int data1 = static_cast<int>((event >> 8) & 0x7f);
+    int data2 = static_cast<int>((event >> 16) & 0x7f);
+    int chan = status & 0x0f;
+
+    switch (status & 0xf0) {
+        case MIDI_NOTE_OFF:
+            return fluid_synth_noteoff(synth, chan, data1);
+        case MIDI_NOTE_ON:
+            return fluid_synth_noteon(synth, chan, data1, data2);
+        case MIDI_KEY_PRESSURE:
+            return fluid_synth_key_pressure(synth, chan, data1, data2);
+        case MIDI_CONTROL_CHANGE:
+            return fluid_synth_cc(synth, chan, data1, data2);
+        case MIDI_PROGRAM_CHANGE:
+            return fluid_synth_program_change(synth, chan, data1);
+        case MIDI_CHANNEL_PRESSURE:
+            return fluid_synth_channel_pressure(synth, chan, data1);
+        case MIDI_PITCH_BEND:
+            return fluid_synth_pitch_bend(synth, chan, data1 | (data2 << 7));
+        default:
+            if (status == MIDI_SYSTEM_RESET) {
+                return fluid_synth_system_reset(synth);
+            }
+            return FLUID_FAILED;
+    }
+}
+
+// Applies count packed events in order. When failed_mask is non-null, bit i of
+// failed_mask[i / 32] is set for every event that failed; the mask must hold
+// (count + 31) / 32 words and be zeroed by the caller. Returns the number of failures.
+inline int apply_midi_events(fluid_synth_t *synth, const uint32_t *events, int count,
+                             uint32_t *failed_mask) {
+    int failures = 0;
+    for (int i = 0; i < count; ++i) {
+        if (apply_midi_event(synth, events[i]) != FLUID_OK) {
+            ++failures;
+            if (failed_mask) {
+                failed_mask[i >> 5] |= 1u << (i & 31);
+            }
+        }
+    }
+    return failures;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Multi-producer/single-consumer ring of packed MIDI events (see midi_event.h) living in a direct
+// ByteBuffer Kotlin allocates and hands over with setEventRing, so the garbage collector owns
+// the memory and a producer racing destroySynth never writes into freed native heap. Kotlin
+// producers (UI, MIDI device threads) claim slot sequence numbers from an AtomicInteger on the
+// JVM side and store one 32-bit word per event; the audio thread drains the ring at the start of
+// every period. No JNI call or lock is involved on either side.
+//
+// Layout (native byte order):
+//   [0]   uint32 capacity in slots, power of two
+//   [64]  uint32 read cursor, written by the consumer only
+//   [128] uint32 slots[capacity], 0 = empty
+//
+// Each slot is its own ready flag, as in a Vyukov queue: a packed event always has its status bit
+// set, so a published slot is never 0. The consumer clears a slot before a release store moves
+// the read cursor past it; a producer may only write slot n after loading a read cursor beyond
+// n - capacity. The Java memory model says nothing about native readers, so MidiEventRing.offer()
+// puts an explicit fence between that load and the slot store (VarHandle.fullFence(), or volatile
+// accesses ART emits as ordered instructions before API 33). A producer stalled between claiming
+// and storing holds up the drain at its slot until it stores; later events wait behind it in
+// order. Keep the offsets in sync with MidiEventRing.kt.
+class MidiEventRing {
+public:
+    static constexpr size_t kCapacityOffset = 0;
+    static constexpr size_t kReadCursorOffset = 64;
+    static constexpr size_t kSlotsOffset = 128;
+
+    MidiEventRing() = default;
+
+    MidiEventRing(const MidiEventRing &) = delete;
+    MidiEventRing &operator=(const MidiEventRing &) = delete;
+
+    // Checks the header of size bytes of memory and starts draining it. Only one ring can be
+    // attached; the caller keeps the memory alive for the ring's lifetime.
+    bool attach(void *memory, size_t size) {
+        if (attached() || !memory || reinterpret_cast<uintptr_t>(memory) % 4 != 0 ||
+            size < kSlotsOffset) {
+            return false;
+        }
+        auto *bytes = static_cast<uint8_t *>(memory);
+        uint32_t capacity = *reinterpret_cast<uint32_t *>(bytes + kCapacityOffset);
+        if (capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+            capacity > (size - kSlotsOffset) / sizeof(uint32_t)) {
+            return false;
+        }
+        capacity_ = capacity;
+        mask_ = capacity - 1;
+        read_cursor_ = __atomic_load_n(reinterpret_cast<uint32_t *>(bytes + kReadCursorOffset),
+                                       __ATOMIC_RELAXED);
+        __atomic_store_n(&memory_, bytes, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    bool attached() const { return __atomic_load_n(&memory_, __ATOMIC_ACQUIRE) != nullptr; }
+
+    // Consumer side, audio thread only. Calls apply(event) for up to one ring's worth of
+    // published events in order and returns how many were consumed.
+    template<typename Fn>
+    int drain(Fn &&apply) {
+        uint8_t *memory = __atomic_load_n(&memory_, __ATOMIC_ACQUIRE);
+        if (!memory) {
+            return 0;
+        }
+        uint32_t *slots = reinterpret_cast<uint32_t *>(memory + kSlotsOffset);
+        int consumed = 0;
+        while (static_cast<uint32_t>(consumed) < capacity_) {
+            uint32_t *slot = &slots[read_cursor_ & mask_];
+            uint32_t event = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+            if (event == 0) {
+                break;
+            }
+            __atomic_store_n(slot, 0u, __ATOMIC_RELAXED);
+            ++read_cursor_;
+            ++consumed;
+            apply(event);
+        }
+        if (consumed > 0) {
+            __atomic_store_n(reinterpret_cast<uint32_t *>(memory + kReadCursorOffset),
+                             read_cursor_, __ATOMIC_RELEASE);
+        }
+        return consumed;
+    }
+
+    uint32_t capacity() const { return capacity_; }
+
+private:
+    // Set once by attach(); the audio thread reads the fields below only after seeing it
+    uint8_t *memory_ = nullptr;
+    uint32_t capacity_ = 0;
+    uint32_t mask_ = 0;
+    uint32_t read_cursor_ = 0;
+};
@@ -0,0 +1,222 @@
+#include "midi_player.h"
+
+#include <cstring>
+
+#include "midi_event.h"
+#include "preset_loader.h"
+
+#ifdef __ANDROID__
+#include <android/log.h>
+
+#define LOG_TAG "FluidSynthJNI"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#else
+#include <cstdio>
+
+#define LOGI(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#define LOGE(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#endif
+
+// MIDI controller that releases every note of a channel
+#define MIDI_CC_ALL_NOTES_OFF 123
+
+namespace {
+
+// Packs a channel message from the player; false for anything else (sysex, meta events)
+bool pack_player_event(const fluid_midi_event_t *event, uint32_t *packed) {
+    int type = fluid_midi_event_get_type(event);
+    int status = type | (fluid_midi_event_get_channel(event) & 0x0f);
+    switch (type) {
+        case MIDI_NOTE_OFF:
+        case MIDI_NOTE_ON:
+            *packed = pack_midi_event(status, fluid_midi_event_get_key(event),
+                                      fluid_midi_event_get_velocity(event));
+            return true;
+        case MIDI_KEY_PRESSURE:
+            *packed = pack_midi_event(status, fluid_midi_event_get_key(event),
+                                      fluid_midi_event_get_value(event));
+            return true;
+        case MIDI_CONTROL_CHANGE:
+            *packed = pack_midi_event(status, fluid_midi_event_get_control(event),
+                                      fluid_midi_event_get_value(event));
+            return true;
+        case MIDI_PROGRAM_CHANGE:
+        case MIDI_CHANNEL_PRESSURE:
+            *packed = pack_midi_event(status, fluid_midi_event_get_program(event), 0);
+            return true;
+        case MIDI_PITCH_BEND: {
+            int pitch = fluid_midi_event_get_pitch(event);
+            *packed = pack_midi_event(status, pitch & 0x7f, pitch >> 7);
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+} // namespace
+
+MidiFilePlayer::MidiFilePlayer(fluid_synth_t *synth, ApiGate *api_gate, PresetLoader *presets,
+                               TimedEventQueue *deferred)
+        : synth_(synth), api_gate_(api_gate), presets_(presets), deferred_(deferred) {}
+
+MidiFilePlayer::~MidiFilePlayer() {
+    for (fluid_player_t *player : retired_) {
+        delete_fluid_player(player);
+    }
+    if (player_) {
+        delete_fluid_player(player_);
+    }
+}
+
+int MidiFilePlayer::load(const uint8_t *data, size_t size) {
+    // fluid_player_add_mem() takes anything; the file is only parsed once playback starts
+    if (size < 14 || memcmp(data, "MThd", 4) != 0) {
+        LOGE("Not a Standard MIDI File (%zu bytes)", size);
+        return FLUID_FAILED;
+    }
+    // Creating a player links its sample timer into the synth, and the render thread unlinks
+    // retired ones under the same lock
+    std::lock_guard<std::mutex> lock(mutex_);
+    fluid_player_t *player = new_fluid_player(synth_);
+    if (!player) {
+        LOGE("Failed to create MIDI player");
+        return FLUID_FAILED;
+    }
+    if (fluid_player_add_mem(player, data, size) != FLUID_OK) {
+        LOGE("Failed to add MIDI file to the player");
+        retired_.push_back(player);
+        has_retired_.store(true, std::memory_order_release);
+        return FLUID_FAILED;
+    }
+    fluid_player_set_playback_callback(player, handle_event, this);
+    retire_locked();
+    player_ = player;
+    LOGI("Loaded MIDI file (%zu bytes)", size);
+    return FLUID_OK;
+}
+
+void MidiFilePlayer::unload() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    retire_locked();
+}
+
+int MidiFilePlayer::play() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!player_) {
+        return FLUID_FAILED;
+    }
+    // Playing from the start resets the synth first, as fluid_player's own player.reset-synth
+    // would, but through the queue so it waits for the API lock like any other event
+    int tick = fluid_player_get_current_tick(player_);
+    if (fluid_player_get_status(player_) != FLUID_PLAYER_PLAYING &&
+        (tick <= 0 || tick >= fluid_player_get_total_ticks(player_))) {
+        deferred_->push(0, MIDI_SYSTEM_RESET);
+    }
+    return fluid_player_play(player_);
+}
+
+int MidiFilePlayer::stop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!player_) {
+        return FLUID_FAILED;
+    }
+    int result = fluid_player_stop(player_);
+    release_notes();
+    return result;
+}
+
+int MidiFilePlayer::seek(int ticks) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return player_ ? fluid_player_seek(player_, ticks) : FLUID_FAILED;
+}
+
+int MidiFilePlayer::set_loop(int loops) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return player_ ? fluid_player_set_loop(player_, loops) : FLUID_FAILED;
+}
+
+int MidiFilePlayer::set_tempo(int tempo_type, double tempo) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return player_ ? fluid_player_set_tempo(player_, tempo_type, tempo) : FLUID_FAILED;
+}
+
+bool MidiFilePlayer::position(int32_t *fields) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!player_) {
+        return false;
+    }
+    fields[MIDI_POSITION_STATUS] = fluid_player_get_status(player_);
+    fields[MIDI_POSITION_TICK] = fluid_player_get_current_tick(player_);
+    fields[MIDI_POSITION_TOTAL_TICKS] = fluid_player_get_total_ticks(player_);
+    fields[MIDI_POSITION_BPM] = fluid_player_get_bpm(player_);
+    fields[MIDI_POSITION_DIVISION] = fluid_player_get_division(player_);
+    fields[MIDI_POSITION_MIDI_TEMPO] = fluid_player_get_midi_tempo(player_);
+    return true;
+}
+
+void MidiFilePlayer::before_render(bool can_apply) {
+    // Anything queued so far is collected and applied ahead of this span's own events
+    if (can_apply) {
+        deferring_ = false;
+    }
+    if (!has_retired_.load(std::memory_order_acquire)) {
+        return;
+    }
+    // Never waits: a JNI call holding the lock only delays the cleanup to the next span
+    std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return;
+    }
+    for (fluid_player_t *player : retired_) {
+        delete_fluid_player(player);
+    }
+    retired_.clear();
+    has_retired_.store(false, std::memory_order_release);
+}
+
+// The render thread may still be emitting the current block's events; queued, the notes-off
+// land after them
+void MidiFilePlayer::release_notes() {
+    for (int chan = 0; chan < PRESET_USER_CHANNELS; ++chan) {
+        uint32_t event = pack_midi_event(MIDI_CONTROL_CHANGE | chan, MIDI_CC_ALL_NOTES_OFF, 0);
+        if (!deferred_->push(0, event)) {
+            fluid_synth_all_notes_off(synth_, chan);
+        }
+    }
+}
+
+void MidiFilePlayer::retire_locked() {
+    if (!player_) {
+        return;
+    }
+    if (fluid_player_get_status(player_) == FLUID_PLAYER_PLAYING) {
+        release_notes();
+    }
+    fluid_player_stop(player_);
+    retired_.push_back(player_);
+    has_retired_.store(true, std::memory_order_release);
+    player_ = nullptr;
+}
+
+// Render thread, from inside fluid_synth_process()
+int MidiFilePlayer::handle_event(void *data, fluid_midi_event_t *event) {
+    auto *self = static_cast<MidiFilePlayer *>(data);
+    uint32_t packed;
+    if (!pack_player_event(event, &packed)) {
+        // Sysex and the like cannot be queued. They are dropped while the API lock may be
+        // taken, or when applying them now would overtake queued events.
+        if (self->deferring_ || self->api_gate_->busy()) {
+            return FLUID_OK;
+        }
+        return fluid_synth_handle_midi_event(self->synth_, event);
+    }
+    if (self->deferring_ || self->api_gate_->busy()) {
+        if (self->deferred_->push(0, packed)) {
+            self->deferring_ = true;
+            return FLUID_OK;
+        }
+    }
+    return self->presets_->apply_event(packed);
+}
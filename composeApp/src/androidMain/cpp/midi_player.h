@@ -0,0 +1,99 @@
+#pragma once
+
+#include <fluidsynth.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "api_gate.h"
+#include "preset_loader.h"
+#include "timed_event_queue.h"
+
+// Layout of the array filled by getMidiPosition
+#define MIDI_POSITION_STATUS 0
+#define MIDI_POSITION_TICK 1
+#define MIDI_POSITION_TOTAL_TICKS 2
+#define MIDI_POSITION_BPM 3
+#define MIDI_POSITION_DIVISION 4
+#define MIDI_POSITION_MIDI_TEMPO 5
+#define MIDI_POSITION_FIELDS 6
+
+// Plays one Standard MIDI File at a time into a synth through FluidSynth's fluid_player.
+//
+// The player runs on the synth's sample timer (player.timing-source "sample"), which FluidSynth
+// ticks from inside fluid_synth_process(): events are emitted on the render thread, at the
+// position of the block being rendered, so playback follows the audio clock and needs no
+// timer thread. While a long call holds FluidSynth's API lock the render thread must not
+// block on it, so channel events arriving then are queued on the synth's timed event queue as
+// due immediately and applied at the start of the next period, in order. Other events (sysex)
+// have no packed form and are dropped meanwhile. The player does not reset the synth itself
+// (player.reset-synth is off); play() queues a MIDI_SYSTEM_RESET when starting from the top.
+//
+// Sample timers are walked by the render thread without a lock, so a replaced player cannot be
+// deleted by the thread that replaced it; it is stopped and handed to the render thread, which
+// deletes it before rendering its next span.
+class MidiFilePlayer {
+public:
+    // api_gate, presets and deferred are the synth's SynthInstance::api_gate, presets and
+    // timed_events; program changes go through presets so they never load samples on the
+    // render thread
+    MidiFilePlayer(fluid_synth_t *synth, ApiGate *api_gate, PresetLoader *presets,
+                   TimedEventQueue *deferred);
+
+    // Deletes every player; the synth must no longer be rendering
+    ~MidiFilePlayer();
+
+    MidiFilePlayer(const MidiFilePlayer &) = delete;
+    MidiFilePlayer &operator=(const MidiFilePlayer &) = delete;
+
+    // Replaces the current file, like unload(), with a copy of data, stopped at its start.
+    // Returns FLUID_OK or FLUID_FAILED if data is not a Standard MIDI File.
+    int load(const uint8_t *data, size_t size);
+
+    // Stops and drops the current file, releasing its notes if it was playing
+    void unload();
+
+    // Starts or resumes playback; from the start again once the file has ended. Starting from
+    // the start resets the synth, but not each pass of a looping file.
+    int play();
+
+    // Pauses at the current position and releases the notes playing on channels 0-15
+    int stop();
+
+    int seek(int ticks);
+
+    // Times to play the file, -1 for endless
+    int set_loop(int loops);
+
+    // tempo_type is one of FLUID_PLAYER_TEMPO_*, see fluid_player_set_tempo()
+    int set_tempo(int tempo_type, double tempo);
+
+    // Fills MIDI_POSITION_FIELDS values; false when no file is loaded
+    bool position(int32_t *fields);
+
+    // Render thread, before each span: deletes replaced players and ends deferral once queued
+    // events can be applied again
+    void before_render(bool can_apply);
+
+private:
+    static int handle_event(void *data, fluid_midi_event_t *event);
+
+    void release_notes();
+    void retire_locked();
+
+    fluid_synth_t *synth_;
+    ApiGate *api_gate_;
+    PresetLoader *presets_;
+    TimedEventQueue *deferred_;
+
+    std::mutex mutex_;
+    fluid_player_t *player_ = nullptr;
+    // Stopped players waiting for the render thread; under mutex_
+    std::vector<fluid_player_t *> retired_;
+    std::atomic<bool> has_retired_{false};
+
+    // Render thread only: events are being queued, so later ones must be queued too
+    bool deferring_ = false;
+};
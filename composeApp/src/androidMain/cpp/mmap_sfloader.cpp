@@ -0,0 +1,1129 @@
+#include "mmap_sfloader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sf2_riff.h"
+#include "sf3_cache.h"
+
+#ifdef __ANDROID__
+#include <android/log.h>
+#include "asset_sfloader.h"
+
+#define LOG_TAG "FluidSynthJNI"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#else
+#define LOGI(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#define LOGE(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#endif
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "SF2 sample data is used in place and is little-endian");
+
+// Standard generators, GEN_STARTADDROFS .. GEN_OVERRIDEROOTKEY
+#define SF_GEN_COUNT (GEN_OVERRIDEROOTKEY + 1)
+
+namespace {
+
+using sf2::Chunk;
+using sf2::for_each_chunk;
+using sf2::read_u16;
+using sf2::read_u32;
+
+// Generators that are not meaningful at preset level, so preset zones never add them
+// (SF2.01 section 8.5)
+bool preset_level_generator(int gen) {
+    switch (gen) {
+        case GEN_STARTADDROFS:
+        case GEN_ENDADDROFS:
+        case GEN_STARTLOOPADDROFS:
+        case GEN_ENDLOOPADDROFS:
+        case GEN_STARTADDRCOARSEOFS:
+        case GEN_ENDADDRCOARSEOFS:
+        case GEN_STARTLOOPADDRCOARSEOFS:
+        case GEN_ENDLOOPADDRCOARSEOFS:
+        case GEN_KEYNUM:
+        case GEN_VELOCITY:
+        case GEN_SAMPLEMODE:
+        case GEN_EXCLUSIVECLASS:
+        case GEN_OVERRIDEROOTKEY:
+            return false;
+        default:
+            return true;
+    }
+}
+
+// Generators a zone stores as a value; ranges and links are kept separately, the rest is unused
+bool value_generator(int gen) {
+    switch (gen) {
+        case GEN_UNUSED1:
+        case GEN_UNUSED2:
+        case GEN_UNUSED3:
+        case GEN_UNUSED4:
+        case GEN_INSTRUMENT:
+        case GEN_RESERVED1:
+        case GEN_KEYRANGE:
+        case GEN_VELRANGE:
+        case GEN_RESERVED2:
+        case GEN_SAMPLEID:
+        case GEN_RESERVED3:
+            return false;
+        default:
+            return gen >= 0 && gen < SF_GEN_COUNT;
+    }
+}
+
+// Converts an SF2 modulator source operand to FluidSynth's source and flags
+bool convert_mod_source(uint16_t operand, int *src, int *flags) {
+    int type = operand >> 10;
+    if (type > 3) {
+        return false;
+    }
+    *src = operand & 0x7f;
+    *flags = (operand & 0x80 ? FLUID_MOD_CC : FLUID_MOD_GC) |
+             (operand & 0x100 ? FLUID_MOD_NEGATIVE : FLUID_MOD_POSITIVE) |
+             (operand & 0x200 ? FLUID_MOD_BIPOLAR : FLUID_MOD_UNIPOLAR) | type * 4;
+    if (!(*flags & FLUID_MOD_CC)) {
+        switch (*src) {
+            case FLUID_MOD_NONE:
+            case FLUID_MOD_VELOCITY:
+            case FLUID_MOD_KEY:
+            case FLUID_MOD_KEYPRESSURE:
+            case FLUID_MOD_CHANNELPRESSURE:
+            case FLUID_MOD_PITCHWHEEL:
+            case FLUID_MOD_PITCHWHEELSENS:
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+// Builds a FluidSynth modulator from one pmod/imod record; null for ones FluidSynth would
+// ignore anyway (linked modulators, unknown sources, transforms or destinations)
+fluid_mod_t *convert_mod(const uint8_t *record) {
+    uint16_t src_operand = read_u16(record);
+    uint16_t dest = read_u16(record + 2);
+    auto amount = static_cast<int16_t>(read_u16(record + 4));
+    uint16_t amount_operand = read_u16(record + 6);
+    uint16_t transform = read_u16(record + 8);
+
+    int src1, flags1, src2, flags2;
+    if ((dest & 0x8000) || !value_generator(dest) ||
+        !convert_mod_source(src_operand, &src1, &flags1) ||
+        !convert_mod_source(amount_operand, &src2, &flags2) ||
+        (transform != FLUID_MOD_TRANSFORM_LINEAR && transform != FLUID_MOD_TRANSFORM_ABS)) {
+        return nullptr;
+    }
+    if (!(flags1 & FLUID_MOD_CC) && src1 == FLUID_MOD_NONE) {
+        return nullptr;
+    }
+
+    fluid_mod_t *mod = new_fluid_mod();
+    if (!mod) {
+        return nullptr;
+    }
+    fluid_mod_set_source1(mod, src1, flags1);
+    fluid_mod_set_source2(mod, src2, flags2);
+    fluid_mod_set_dest(mod, dest);
+    fluid_mod_set_amount(mod, amount);
+    fluid_mod_set_transform(mod, transform);
+    return mod;
+}
+
+// One preset or instrument zone
+struct Zone {
+    int key_lo = 0, key_hi = 127;
+    int vel_lo = 0, vel_hi = 127;
+    // Instrument index for preset zones, sample index for instrument zones
+    int target = -1;
+    // Bit n set when generator n has a value in gen[n]
+    uint64_t gen_set = 0;
+    int16_t gen[SF_GEN_COUNT] = {};
+    // Owned by the SoundFont
+    std::vector<fluid_mod_t *> mods;
+
+    bool has(int g) const { return (gen_set >> g) & 1; }
+    bool inside(int key, int vel) const {
+        return key >= key_lo && key <= key_hi && vel >= vel_lo && vel <= vel_hi;
+    }
+};
+
+// Zones of one preset or instrument; global is valid when has_global is set
+struct ZoneList {
+    Zone global;
+    bool has_global = false;
+    std::vector<Zone> zones;
+};
+
+// Sample header with the sample's data in the mapping. data is null for samples that cannot
+// be played (ROM, compressed, out of bounds).
+struct SampleInfo {
+    char name[21] = {};
+    short *data = nullptr;
+    char *data24 = nullptr;
+    unsigned int frames = 0;
+    unsigned int rate = 0;
+    unsigned int loop_start = 0;
+    unsigned int loop_end = 0;
+    int pitch = 60;
+    int correction = 0;
+};
+
+struct BankPreset {
+    char name[21] = {};
+    int bank = 0;
+    int num = 0;
+    ZoneList zones;
+    // Byte ranges of the mapping holding this preset's samples, sorted and merged
+    std::vector<std::pair<size_t, size_t>> ranges;
+};
+
+// A mapped SoundFont file and everything parsed from it. Immutable once parsed and shared by
+// all synths that load the same file, see acquire_bank().
+struct Bank {
+    std::string name;
+    std::string key;
+    SfontMapping mapping;
+
+    // By shdr index
+    std::vector<SampleInfo> samples;
+    std::vector<ZoneList> instruments;
+    // Sorted by bank, then program
+    std::vector<BankPreset> presets;
+    std::vector<fluid_mod_t *> mods;
+
+    // SoundFonts built on this bank; under bank_mutex
+    int users = 0;
+    // Per preset, how many synths have it paged in; under registry_mutex
+    std::vector<int> paged_in;
+
+    ~Bank() {
+        for (fluid_mod_t *mod : mods) {
+            delete_fluid_mod(mod);
+        }
+        if (mapping.release) {
+            mapping.release(&mapping);
+        }
+    }
+
+    bool parse();
+    bool parse_samples(const Chunk &smpl, const Chunk &sm24, const Chunk &shdr);
+    bool parse_zones(const Chunk &bags, const Chunk &gens, const Chunk &mod_records,
+                     int first_bag, int end_bag, int target_gen, size_t target_count,
+                     ZoneList *list);
+    void collect_ranges(BankPreset *preset, const Chunk &smpl, const Chunk &sm24,
+                        const Chunk &shdr) const;
+};
+
+void release_bank(Bank *bank);
+
+struct MmapSoundFont;
+
+// A bank preset as one synth sees it
+struct Preset {
+    MmapSoundFont *font = nullptr;
+    fluid_preset_t *preset = nullptr;
+    const BankPreset *info = nullptr;
+};
+
+// One synth's SoundFont: FluidSynth objects over a shared bank. Samples are not shared because
+// voices update their reference counts without synchronization.
+struct MmapSoundFont {
+    std::string name;
+    Bank *bank = nullptr;
+    fluid_sfont_t *sfont = nullptr;
+
+    // By shdr index; null where the bank's sample cannot be played
+    std::vector<fluid_sample_t *> samples;
+    // In the order of bank->presets
+    std::vector<Preset> presets;
+    size_t iteration = 0;
+
+    // Voices started from this font with the id they had, so free() can tell whether any of
+    // them still reads the mapping. A fixed table of synth.polyphony slots allocated at load:
+    // preset_noteon() reuses the slots of finished voices instead of growing it on the audio
+    // thread. voice is only touched under the synth's API lock; the id is also published
+    // atomically so mmap_sfont_playing() can read it from another thread.
+    struct VoiceSlot {
+        fluid_voice_t *voice = nullptr;
+        unsigned int id = 0;
+        // id + 1 once the voice has started, 0 while the slot was never used
+        std::atomic<unsigned int> published{0};
+    };
+    std::unique_ptr<VoiceSlot[]> voices;
+    size_t voice_slots = 0;
+    // Where the search for a free slot starts
+    size_t next_voice_slot = 0;
+
+    // Set once a replacement took over; get_preset() then finds nothing, so program changes
+    // and resets resolve to the other SoundFonts while started voices play out
+    std::atomic<bool> retired{false};
+
+    // Per preset, this font's share of bank->paged_in, given back when it is freed; under
+    // registry_mutex
+    std::vector<int> paged_in;
+
+    ~MmapSoundFont() {
+        for (Preset &preset : presets) {
+            if (preset.preset) {
+                delete_fluid_preset(preset.preset);
+            }
+        }
+        for (fluid_sample_t *sample : samples) {
+            if (sample) {
+                delete_fluid_sample(sample);
+            }
+        }
+        if (bank) {
+            release_bank(bank);
+        }
+    }
+
+    // Whether the slot's voice has finished or was reused for another note
+    static bool slot_free(const VoiceSlot &slot) {
+        return !slot.voice || fluid_voice_get_id(slot.voice) != slot.id ||
+               !fluid_voice_is_playing(slot.voice);
+    }
+
+    // A slot for the next voice, or null when every slot holds a voice that still plays, which
+    // takes more voices than synth.polyphony had at load
+    VoiceSlot *free_voice_slot() {
+        for (size_t n = 0; n < voice_slots; ++n) {
+            size_t i = (next_voice_slot + n) % voice_slots;
+            if (slot_free(voices[i])) {
+                next_voice_slot = i + 1;
+                return &voices[i];
+            }
+        }
+        return nullptr;
+    }
+
+    bool has_voices() const {
+        for (size_t i = 0; i < voice_slots; ++i) {
+            if (!slot_free(voices[i])) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// Live SoundFonts from this loader, so prefetch can tell its presets apart from other loaders'
+std::mutex registry_mutex;
+std::unordered_set<fluid_sfont_t *> registry;
+
+// Parsed files by bank_key(), shared by every synth that loads them
+std::mutex bank_mutex;
+std::unordered_map<std::string, Bank *> banks;
+
+bool Bank::parse() {
+    Chunk riff = sf2::sfbk_body(mapping.data, mapping.size);
+    if (!riff.data) {
+        return false;
+    }
+
+    Chunk smpl, sm24, phdr, pbag, pmod, pgen, inst, ibag, imod, igen, shdr;
+    int major_version = 0;
+    for_each_chunk(riff, [&](const uint8_t *id, const Chunk &chunk) {
+        if (memcmp(id, "LIST", 4) != 0 || chunk.size < 4) {
+            return;
+        }
+        Chunk body{chunk.data + 4, chunk.size - 4};
+        for_each_chunk(body, [&](const uint8_t *sub, const Chunk &c) {
+            if (memcmp(sub, "ifil", 4) == 0 && c.size >= 4) major_version = read_u16(c.data);
+            else if (memcmp(sub, "smpl", 4) == 0) smpl = c;
+            else if (memcmp(sub, "sm24", 4) == 0) sm24 = c;
+            else if (memcmp(sub, "phdr", 4) == 0) phdr = c;
+            else if (memcmp(sub, "pbag", 4) == 0) pbag = c;
+            else if (memcmp(sub, "pmod", 4) == 0) pmod = c;
+            else if (memcmp(sub, "pgen", 4) == 0) pgen = c;
+            else if (memcmp(sub, "inst", 4) == 0) inst = c;
+            else if (memcmp(sub, "ibag", 4) == 0) ibag = c;
+            else if (memcmp(sub, "imod", 4) == 0) imod = c;
+            else if (memcmp(sub, "igen", 4) == 0) igen = c;
+            else if (memcmp(sub, "shdr", 4) == 0) shdr = c;
+        });
+    });
+
+    // SF3 that could not be decoded into the cache (see mmap_load); leave it to the default loader
+    if (major_version != 2 || !smpl.data || !phdr.data || !inst.data || !shdr.data ||
+        !pbag.data || !pgen.data || !ibag.data || !igen.data) {
+        return false;
+    }
+    if (reinterpret_cast<uintptr_t>(smpl.data) & 1) {
+        LOGI("%s: sample data is not 16-bit aligned, loading it the usual way", name.c_str());
+        return false;
+    }
+
+    if (!parse_samples(smpl, sm24, shdr)) {
+        return false;
+    }
+
+    size_t inst_count = inst.size / SF_INST_SIZE;
+    if (inst_count < 2) {
+        return false;
+    }
+    instruments.resize(inst_count - 1);
+    for (size_t i = 0; i + 1 < inst_count; ++i) {
+        const uint8_t *record = inst.data + i * SF_INST_SIZE;
+        if (!parse_zones(ibag, igen, imod, read_u16(record + 20),
+                         read_u16(record + SF_INST_SIZE + 20), GEN_SAMPLEID, samples.size(),
+                         &instruments[i])) {
+            return false;
+        }
+        // Zones whose sample was skipped cannot play
+        auto &zones = instruments[i].zones;
+        zones.erase(std::remove_if(zones.begin(), zones.end(),
+                                   [this](const Zone &z) { return !samples[z.target].data; }),
+                    zones.end());
+    }
+
+    size_t preset_count = phdr.size / SF_PHDR_SIZE;
+    if (preset_count < 2) {
+        return false;
+    }
+    presets.resize(preset_count - 1);
+    for (size_t i = 0; i + 1 < preset_count; ++i) {
+        const uint8_t *record = phdr.data + i * SF_PHDR_SIZE;
+        BankPreset &preset = presets[i];
+        memcpy(preset.name, record, 20);
+        preset.num = read_u16(record + 20);
+        preset.bank = read_u16(record + 22);
+        if (!parse_zones(pbag, pgen, pmod, read_u16(record + 24),
+                         read_u16(record + SF_PHDR_SIZE + 24), GEN_INSTRUMENT,
+                         instruments.size(), &preset.zones)) {
+            return false;
+        }
+        collect_ranges(&preset, smpl, sm24, shdr);
+    }
+    std::sort(presets.begin(), presets.end(), [](const BankPreset &a, const BankPreset &b) {
+        return a.bank != b.bank ? a.bank < b.bank : a.num < b.num;
+    });
+    paged_in.assign(presets.size(), 0);
+    return true;
+}
+
+bool Bank::parse_samples(const Chunk &smpl, const Chunk &sm24, const Chunk &shdr) {
+    size_t frames_total = smpl.size / 2;
+    // sm24 holds one extra byte per sample point and is ignored unless it covers all of them
+    const uint8_t *extra = sm24.data && sm24.size >= frames_total ? sm24.data : nullptr;
+    size_t count = shdr.size / SF_SHDR_SIZE;
+    if (count < 2) {
+        return false;
+    }
+    samples.assign(count - 1, SampleInfo());
+
+    size_t skipped = 0;
+    for (size_t i = 0; i + 1 < count; ++i) {
+        const uint8_t *record = shdr.data + i * SF_SHDR_SIZE;
+        uint32_t start = read_u32(record + 20);
+        uint32_t end = read_u32(record + 24);
+        uint32_t loop_start = read_u32(record + 28);
+        uint32_t loop_end = read_u32(record + 32);
+        uint32_t rate = read_u32(record + 36);
+        uint8_t pitch = record[40];
+        auto correction = static_cast<int8_t>(record[41]);
+        uint16_t type = read_u16(record + 44);
+
+        if ((type & (FLUID_SAMPLETYPE_ROM | FLUID_SAMPLETYPE_OGG_VORBIS)) || end <= start ||
+            end > frames_total || rate == 0) {
+            ++skipped;
+            continue;
+        }
+
+        SampleInfo &sample = samples[i];
+        memcpy(sample.name, record, 20);
+        // Points straight into the mapping; FluidSynth only reads sample data
+        sample.data = reinterpret_cast<short *>(const_cast<uint8_t *>(smpl.data)) + start;
+        sample.data24 = extra ? reinterpret_cast<char *>(const_cast<uint8_t *>(extra)) + start
+                              : nullptr;
+        sample.frames = end - start;
+        sample.rate = rate;
+
+        // Loops outside the sample are a common authoring error; play those as whole-sample loops
+        if (loop_start < start || loop_end > end || loop_start >= loop_end) {
+            loop_start = start;
+            loop_end = end - 1;
+        }
+        sample.loop_start = loop_start - start;
+        sample.loop_end = loop_end - start;
+        sample.pitch = pitch <= 127 ? pitch : 60;
+        sample.correction = correction;
+    }
+    if (skipped > 0) {
+        LOGI("%s: skipped %zu unplayable samples", name.c_str(), skipped);
+    }
+    return true;
+}
+
+bool Bank::parse_zones(const Chunk &bags, const Chunk &gens, const Chunk &mod_records,
+                                int first_bag, int end_bag, int target_gen, size_t target_count,
+                                ZoneList *list) {
+    size_t bag_count = bags.size / SF_BAG_SIZE;
+    size_t gen_count = gens.size / SF_GEN_SIZE;
+    size_t mod_count = mod_records.size / SF_MOD_SIZE;
+    if (first_bag > end_bag || static_cast<size_t>(end_bag) >= bag_count) {
+        LOGE("%s: corrupt zone table", name.c_str());
+        return false;
+    }
+
+    for (int b = first_bag; b < end_bag; ++b) {
+        const uint8_t *bag = bags.data + b * SF_BAG_SIZE;
+        size_t gen_begin = read_u16(bag), gen_end = read_u16(bag + SF_BAG_SIZE);
+        size_t mod_begin = read_u16(bag + 2), mod_end = read_u16(bag + SF_BAG_SIZE + 2);
+        if (gen_begin > gen_end || gen_end > gen_count || mod_begin > mod_end ||
+            mod_end > mod_count) {
+            LOGE("%s: corrupt zone table", name.c_str());
+            return false;
+        }
+
+        Zone zone;
+        for (size_t g = gen_begin; g < gen_end; ++g) {
+            const uint8_t *record = gens.data + g * SF_GEN_SIZE;
+            int oper = read_u16(record);
+            if (oper == GEN_KEYRANGE) {
+                zone.key_lo = record[2];
+                zone.key_hi = record[3];
+            } else if (oper == GEN_VELRANGE) {
+                zone.vel_lo = record[2];
+                zone.vel_hi = record[3];
+            } else if (oper == target_gen) {
+                // The instrument or sample link ends a zone's generator list
+                zone.target = read_u16(record + 2);
+                break;
+            } else if (value_generator(oper)) {
+                zone.gen[oper] = static_cast<int16_t>(read_u16(record + 2));
+                zone.gen_set |= uint64_t{1} << oper;
+            }
+        }
+        for (size_t m = mod_begin; m < mod_end; ++m) {
+            fluid_mod_t *mod = convert_mod(mod_records.data + m * SF_MOD_SIZE);
+            if (mod) {
+                mods.push_back(mod);
+                zone.mods.push_back(mod);
+            }
+        }
+
+        if (zone.target < 0) {
+            // Only the first zone may be global; later ones without a link are ignored
+            if (b == first_bag) {
+                list->global = std::move(zone);
+                list->has_global = true;
+            }
+        } else if (static_cast<size_t>(zone.target) < target_count) {
+            list->zones.push_back(std::move(zone));
+        }
+    }
+    return true;
+}
+
+void Bank::collect_ranges(BankPreset *preset, const Chunk &smpl, const Chunk &sm24,
+                                   const Chunk &shdr) const {
+    size_t smpl_offset = static_cast<size_t>(smpl.data - mapping.data);
+    size_t sm24_offset = sm24.data ? static_cast<size_t>(sm24.data - mapping.data) : 0;
+    bool with_sm24 = sm24.data && sm24.size >= smpl.size / 2;
+
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (const Zone &preset_zone : preset->zones.zones) {
+        for (const Zone &zone : instruments[preset_zone.target].zones) {
+            const uint8_t *record = shdr.data + zone.target * SF_SHDR_SIZE;
+            size_t start = read_u32(record + 20), end = read_u32(record + 24);
+            ranges.emplace_back(smpl_offset + start * 2, smpl_offset + end * 2);
+            if (with_sm24) {
+                ranges.emplace_back(sm24_offset + start, sm24_offset + end);
+            }
+        }
+    }
+    std::sort(ranges.begin(), ranges.end());
+    for (const auto &range : ranges) {
+        if (!preset->ranges.empty() && range.first <= preset->ranges.back().second) {
+            preset->ranges.back().second = std::max(preset->ranges.back().second, range.second);
+        } else {
+            preset->ranges.push_back(range);
+        }
+    }
+}
+
+// Adds a zone's modulators to a voice; global ones only where the local zone has no
+// modulator with the same identity (SF2.01 section 9.5)
+void add_zone_mods(fluid_voice_t *voice, const ZoneList &list, const Zone &zone, int mode) {
+    for (fluid_mod_t *mod : zone.mods) {
+        // A zero amount still matters when it overrides a default modulator
+        if (mode == FLUID_VOICE_ADD && fluid_mod_get_amount(mod) == 0.0) {
+            continue;
+        }
+        fluid_voice_add_mod(voice, mod, mode);
+    }
+    if (!list.has_global) {
+        return;
+    }
+    for (fluid_mod_t *mod : list.global.mods) {
+        if (mode == FLUID_VOICE_ADD && fluid_mod_get_amount(mod) == 0.0) {
+            continue;
+        }
+        bool overridden = std::any_of(zone.mods.begin(), zone.mods.end(),
+                                      [mod](const fluid_mod_t *local) {
+                                          return fluid_mod_test_identity(local, mod);
+                                      });
+        if (!overridden) {
+            fluid_voice_add_mod(voice, mod, mode);
+        }
+    }
+}
+
+// Starts one voice per matching preset zone / instrument zone pair, the way FluidSynth's own
+// SF2 loader does: instrument generators set absolute values, preset generators add to them
+int preset_noteon(fluid_preset_t *fluid_preset, fluid_synth_t *synth, int chan, int key,
+                  int vel) {
+    auto *preset = static_cast<Preset *>(fluid_preset_get_data(fluid_preset));
+    MmapSoundFont *font = preset->font;
+
+    const ZoneList &preset_zones = preset->info->zones;
+    for (const Zone &preset_zone : preset_zones.zones) {
+        if (!preset_zone.inside(key, vel)) {
+            continue;
+        }
+        const ZoneList &inst = font->bank->instruments[preset_zone.target];
+        for (const Zone &zone : inst.zones) {
+            if (!zone.inside(key, vel)) {
+                continue;
+            }
+            MmapSoundFont::VoiceSlot *slot = font->free_voice_slot();
+            if (!slot) {
+                return FLUID_FAILED;
+            }
+            fluid_voice_t *voice =
+                    fluid_synth_alloc_voice(synth, font->samples[zone.target], chan, key, vel);
+            if (!voice) {
+                return FLUID_FAILED;
+            }
+
+            for (int g = 0; g < SF_GEN_COUNT; ++g) {
+                if (zone.has(g)) {
+                    fluid_voice_gen_set(voice, g, zone.gen[g]);
+                } else if (inst.has_global && inst.global.has(g)) {
+                    fluid_voice_gen_set(voice, g, inst.global.gen[g]);
+                }
+            }
+            add_zone_mods(voice, inst, zone, FLUID_VOICE_OVERWRITE);
+
+            for (int g = 0; g < SF_GEN_COUNT; ++g) {
+                if (!preset_level_generator(g)) {
+                    continue;
+                }
+                if (preset_zone.has(g)) {
+                    fluid_voice_gen_incr(voice, g, preset_zone.gen[g]);
+                } else if (preset_zones.has_global && preset_zones.global.has(g)) {
+                    fluid_voice_gen_incr(voice, g, preset_zones.global.gen[g]);
+                }
+            }
+            add_zone_mods(voice, preset_zones, preset_zone, FLUID_VOICE_ADD);
+
+            fluid_synth_start_voice(synth, voice);
+            slot->voice = voice;
+            slot->id = fluid_voice_get_id(voice);
+            slot->published.store(slot->id + 1, std::memory_order_release);
+        }
+    }
+    return FLUID_OK;
+}
+
+const char *preset_get_name(fluid_preset_t *preset) {
+    return static_cast<Preset *>(fluid_preset_get_data(preset))->info->name;
+}
+
+int preset_get_bank(fluid_preset_t *preset) {
+    return static_cast<Preset *>(fluid_preset_get_data(preset))->info->bank;
+}
+
+int preset_get_num(fluid_preset_t *preset) {
+    return static_cast<Preset *>(fluid_preset_get_data(preset))->info->num;
+}
+
+// Presets are owned and deleted by their SoundFont
+void preset_free(fluid_preset_t * /*preset*/) {}
+
+const char *sfont_get_name(fluid_sfont_t *sfont) {
+    return static_cast<MmapSoundFont *>(fluid_sfont_get_data(sfont))->name.c_str();
+}
+
+// Runs on the audio thread for program changes, so it must not allocate or lock
+fluid_preset_t *sfont_get_preset(fluid_sfont_t *sfont, int bank, int prenum) {
+    auto *font = static_cast<MmapSoundFont *>(fluid_sfont_get_data(sfont));
+    if (font->retired.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    auto it = std::lower_bound(font->presets.begin(), font->presets.end(),
+                               std::make_pair(bank, prenum),
+                               [](const Preset &p, const std::pair<int, int> &key) {
+                                   return std::make_pair(p.info->bank, p.info->num) < key;
+                               });
+    if (it == font->presets.end() || it->info->bank != bank || it->info->num != prenum) {
+        return nullptr;
+    }
+    return it->preset;
+}
+
+void sfont_iteration_start(fluid_sfont_t *sfont) {
+    static_cast<MmapSoundFont *>(fluid_sfont_get_data(sfont))->iteration = 0;
+}
+
+fluid_preset_t *sfont_iteration_next(fluid_sfont_t *sfont) {
+    auto *font = static_cast<MmapSoundFont *>(fluid_sfont_get_data(sfont));
+    if (font->iteration >= font->presets.size()) {
+        return nullptr;
+    }
+    return font->presets[font->iteration++].preset;
+}
+
+// Refuses while a voice may still read the mapping; FluidSynth then retries later
+int sfont_free(fluid_sfont_t *sfont) {
+    auto *font = static_cast<MmapSoundFont *>(fluid_sfont_get_data(sfont));
+    if (font->has_voices()) {
+        return -1;
+    }
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.erase(sfont);
+        // Presets still paged in stay resident until the bank is unmapped or another synth
+        // sharing it pages them out
+        for (size_t i = 0; i < font->paged_in.size(); ++i) {
+            font->bank->paged_in[i] -= font->paged_in[i];
+        }
+    }
+    delete font;
+    delete_fluid_sfont(sfont);
+    return 0;
+}
+
+void unmap_file(SfontMapping *mapping) {
+    munmap(const_cast<uint8_t *>(mapping->data), mapping->size);
+}
+
+bool map_file(const char *filename, SfontMapping *mapping) {
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st {};
+    if (fstat(fd, &st) != 0 || st.st_size < 12) {
+        close(fd);
+        return false;
+    }
+    void *data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        LOGE("Failed to map %s", filename);
+        return false;
+    }
+    mapping->data = static_cast<const uint8_t *>(data);
+    mapping->size = static_cast<size_t>(st.st_size);
+    mapping->release = unmap_file;
+    return true;
+}
+
+// Banks are shared by canonical path, modification time and size, so a file replaced on disk
+// is loaded afresh while synths still playing the old one keep it
+bool bank_key(const char *filename, std::string *key) {
+#ifdef __ANDROID__
+    // The APK cannot change while the app runs
+    if (strncmp(filename, ASSET_SFONT_PREFIX, strlen(ASSET_SFONT_PREFIX)) == 0) {
+        *key = filename;
+        return true;
+    }
+#endif
+    char resolved[PATH_MAX];
+    struct stat st {};
+    if (!realpath(filename, resolved) || stat(resolved, &st) != 0) {
+        return false;
+    }
+    char suffix[64];
+    snprintf(suffix, sizeof(suffix), "@%lld.%09ld:%lld", static_cast<long long>(st.st_mtim.tv_sec),
+             static_cast<long>(st.st_mtim.tv_nsec), static_cast<long long>(st.st_size));
+    *key = std::string(resolved) + suffix;
+    return true;
+}
+
+// Maps and parses filename, or takes another reference to the bank another synth loaded from
+// the same file. shared is set in the latter case. progress may be null.
+Bank *acquire_bank(const char *filename, bool *shared, SfontLoadProgress *progress) {
+    auto cancelled = [progress] {
+        return progress && progress->cancelled.load(std::memory_order_relaxed);
+    };
+    std::string key;
+    if (!bank_key(filename, &key)) {
+        return nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(bank_mutex);
+        auto it = banks.find(key);
+        if (it != banks.end()) {
+            ++it->second->users;
+            *shared = true;
+            if (progress) {
+                auto size = static_cast<int64_t>(it->second->mapping.size);
+                progress->total.store(size, std::memory_order_relaxed);
+                progress->done.store(size, std::memory_order_relaxed);
+            }
+            return it->second;
+        }
+    }
+
+    // Parsed without the lock so loads of other files are not held up
+    auto *bank = new(std::nothrow) Bank();
+    if (!bank) {
+        return nullptr;
+    }
+    bank->name = filename;
+    bank->key = key;
+    if (!map_sfont(filename, &bank->mapping)) {
+        delete bank;
+        return nullptr;
+    }
+    auto size = static_cast<int64_t>(bank->mapping.size);
+    if (progress) {
+        progress->total.store(size, std::memory_order_relaxed);
+    }
+    // SF3 samples are Ogg Vorbis; they are decoded once into an SF2 in the cache directory,
+    // which is then mapped in place of the original
+    if (!cancelled() && is_sf3(bank->mapping)) {
+        std::string cached;
+        bool decoded = sf3_cached_sf2(bank->mapping, filename, &cached, progress);
+        bank->mapping.release(&bank->mapping);
+        bank->mapping = SfontMapping();
+        if (!decoded || !map_file(cached.c_str(), &bank->mapping)) {
+            delete bank;
+            return nullptr;
+        }
+    }
+    if (cancelled() || !bank->parse() || cancelled()) {
+        delete bank;
+        return nullptr;
+    }
+    if (progress) {
+        progress->done.store(size, std::memory_order_relaxed);
+    }
+
+    // Another synth may have loaded the same file meanwhile; keep the first bank
+    Bank *result;
+    {
+        std::lock_guard<std::mutex> lock(bank_mutex);
+        result = banks.emplace(key, bank).first->second;
+        ++result->users;
+    }
+    if (result != bank) {
+        delete bank;
+        *shared = true;
+    }
+    return result;
+}
+
+void release_bank(Bank *bank) {
+    {
+        std::lock_guard<std::mutex> lock(bank_mutex);
+        if (--bank->users > 0) {
+            return;
+        }
+        banks.erase(bank->key);
+    }
+    delete bank;
+}
+
+fluid_sfont_t *load_sfont(const char *filename, int polyphony, SfontLoadProgress *progress) {
+    auto start = std::chrono::steady_clock::now();
+    bool shared = false;
+    Bank *bank = acquire_bank(filename, &shared, progress);
+    if (!bank) {
+        return nullptr;
+    }
+    auto *font = new(std::nothrow) MmapSoundFont();
+    if (!font) {
+        release_bank(bank);
+        return nullptr;
+    }
+    font->name = filename;
+    font->bank = bank;
+
+    font->samples.assign(bank->samples.size(), nullptr);
+    for (size_t i = 0; i < bank->samples.size(); ++i) {
+        const SampleInfo &info = bank->samples[i];
+        if (!info.data) {
+            continue;
+        }
+        fluid_sample_t *sample = new_fluid_sample();
+        if (!sample) {
+            delete font;
+            return nullptr;
+        }
+        font->samples[i] = sample;
+        fluid_sample_set_name(sample, info.name);
+        fluid_sample_set_sound_data(sample, info.data, info.data24, info.frames, info.rate, 0);
+        fluid_sample_set_loop(sample, info.loop_start, info.loop_end);
+        fluid_sample_set_pitch(sample, info.pitch, info.correction);
+    }
+
+    fluid_sfont_t *sfont = new_fluid_sfont(sfont_get_name, sfont_get_preset,
+                                           sfont_iteration_start, sfont_iteration_next,
+                                           sfont_free);
+    if (!sfont) {
+        delete font;
+        return nullptr;
+    }
+    font->sfont = sfont;
+    fluid_sfont_set_data(sfont, font);
+    font->presets.resize(bank->presets.size());
+    for (size_t i = 0; i < bank->presets.size(); ++i) {
+        Preset &preset = font->presets[i];
+        preset.font = font;
+        preset.info = &bank->presets[i];
+        preset.preset = new_fluid_preset(sfont, preset_get_name, preset_get_bank,
+                                         preset_get_num, preset_noteon, preset_free);
+        if (!preset.preset) {
+            delete font;
+            delete_fluid_sfont(sfont);
+            return nullptr;
+        }
+        fluid_preset_set_data(preset.preset, &preset);
+    }
+    font->paged_in.assign(font->presets.size(), 0);
+
+    // Voice bookkeeping never allocates on the audio thread
+    font->voice_slots = static_cast<size_t>(std::max(polyphony, 1));
+    font->voices.reset(new MmapSoundFont::VoiceSlot[font->voice_slots]);
+
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.insert(sfont);
+    }
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                             start);
+    LOGI("Mapped SoundFont %s: %zu presets, %zu samples, %.1f MB %s (%.1f ms)", filename,
+         font->presets.size(), font->samples.size(),
+         static_cast<double>(bank->mapping.size) / (1024.0 * 1024.0),
+         shared ? "shared with another synth" : "in place", elapsed.count());
+    return sfont;
+}
+
+fluid_sfont_t *mmap_load(fluid_sfloader_t *loader, const char *filename) {
+    int polyphony = 256;
+    auto *settings = static_cast<fluid_settings_t *>(fluid_sfloader_get_data(loader));
+    if (settings) {
+        fluid_settings_getint(settings, "synth.polyphony", &polyphony);
+    }
+    return load_sfont(filename, polyphony, nullptr);
+}
+
+void mmap_loader_free(fluid_sfloader_t *loader) {
+    delete_fluid_sfloader(loader);
+}
+
+// madvise() needs a page-aligned start; both kinds of mapping cover whole pages
+void advise(const uint8_t *base, size_t offset, size_t length, int advice) {
+    static const uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    auto begin = reinterpret_cast<uintptr_t>(base + offset);
+    uintptr_t aligned = begin & ~(page - 1);
+    madvise(reinterpret_cast<void *>(aligned), length + (begin - aligned), advice);
+}
+
+} // namespace
+
+bool map_sfont(const char *filename, SfontMapping *mapping) {
+#ifdef __ANDROID__
+    if (strncmp(filename, ASSET_SFONT_PREFIX, strlen(ASSET_SFONT_PREFIX)) == 0) {
+        return map_asset_sfont(filename, mapping);
+    }
+#endif
+    return map_file(filename, mapping);
+}
+
+fluid_sfloader_t *new_mmap_sfloader(fluid_settings_t *settings) {
+    fluid_sfloader_t *loader = new_fluid_sfloader(mmap_load, mmap_loader_free);
+    if (!loader) {
+        return nullptr;
+    }
+    fluid_sfloader_set_data(loader, settings);
+    return loader;
+}
+
+fluid_sfont_t *mmap_load_sfont(const char *filename, int polyphony, SfontLoadProgress *progress) {
+    return load_sfont(filename, polyphony, progress);
+}
+
+void mmap_free_sfont(fluid_sfont_t *sfont) {
+    sfont_free(sfont);
+}
+
+bool mmap_sfont_retire(fluid_sfont_t *sfont) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    if (registry.count(sfont) == 0) {
+        return false;
+    }
+    static_cast<MmapSoundFont *>(fluid_sfont_get_data(sfont))->retired.store(
+            true, std::memory_order_release);
+    return true;
+}
+
+bool mmap_sfont_retired(fluid_sfont_t *sfont) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    if (registry.count(sfont) == 0) {
+        return false;
+    }
+    return static_cast<MmapSoundFont *>(fluid_sfont_get_data(sfont))->retired.load(
+            std::memory_order_acquire);
+}
+
+bool mmap_sfont_playing(fluid_synth_t *synth, fluid_sfont_t *sfont) {
+    // The voices themselves belong to the render thread; only the published ids are read here
+    std::vector<unsigned int> ids;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        if (registry.count(sfont) == 0) {
+            return false;
+        }
+        auto *font = static_cast<MmapSoundFont *>(fluid_sfont_get_data(sfont));
+        for (size_t i = 0; i < font->voice_slots; ++i) {
+            unsigned int published = font->voices[i].published.load(std::memory_order_acquire);
+            if (published != 0) {
+                ids.push_back(published - 1);
+            }
+        }
+    }
+    // One note-on gives all its voices the same id. Asked without registry_mutex, which
+    // sfont_free() takes under the API lock. An id past INT_MAX matches any voice, which only
+    // delays the unload.
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    for (unsigned int id : ids) {
+        fluid_voice_t *playing[2] = {};
+        fluid_synth_get_voicelist(synth, playing, 2, static_cast<int>(id));
+        if (playing[0]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool mmap_preset_page_in(fluid_preset_t *preset) {
+    Bank *bank;
+    const BankPreset *info;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        fluid_sfont_t *sfont = fluid_preset_get_sfont(preset);
+        if (registry.count(sfont) == 0) {
+            return false;
+        }
+        auto *font = static_cast<MmapSoundFont *>(fluid_sfont_get_data(sfont));
+        bank = font->bank;
+        info = static_cast<Preset *>(fluid_preset_get_data(preset))->info;
+        size_t index = info - bank->presets.data();
+        ++bank->paged_in[index];
+        ++font->paged_in[index];
+        // The font may be freed once the lock is released; the bank and its immutable preset
+        // table stay alive through this reference
+        std::lock_guard<std::mutex> bank_lock(bank_mutex);
+        ++bank->users;
+    }
+
+    // Disk I/O, outside registry_mutex: sfont_free() takes that under the synth's API lock
+    for (const auto &range : info->ranges) {
+        advise(bank->mapping.data, range.first, range.second - range.first, MADV_WILLNEED);
+    }
+    static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    uint8_t sum = 0;
+    for (const auto &range : info->ranges) {
+        for (size_t offset = range.first; offset < range.second; offset += page) {
+            sum += *static_cast<const volatile uint8_t *>(bank->mapping.data + offset);
+        }
+    }
+    (void) sum;
+    release_bank(bank);
+    return true;
+}
+
+bool mmap_preset_page_out(fluid_preset_t *preset, const std::vector<fluid_preset_t *> &keep) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    fluid_sfont_t *sfont = fluid_preset_get_sfont(preset);
+    if (registry.count(sfont) == 0) {
+        return false;
+    }
+    auto *font = static_cast<MmapSoundFont *>(fluid_sfont_get_data(sfont));
+    Bank *bank = font->bank;
+    const BankPreset *info = static_cast<Preset *>(fluid_preset_get_data(preset))->info;
+    size_t index = info - bank->presets.data();
+    if (font->paged_in[index] > 0) {
+        --font->paged_in[index];
+    }
+    int &paged_in = bank->paged_in[index];
+    if (paged_in > 0 && --paged_in > 0) {
+        // Another synth sharing the bank still uses it
+        return true;
+    }
+
+    // Ranges of the kept presets of the same bank, and of presets other synths sharing the
+    // bank have paged in, sorted so they can be skipped in one pass
+    std::vector<std::pair<size_t, size_t>> kept;
+    for (fluid_preset_t *other : keep) {
+        fluid_sfont_t *other_sfont = fluid_preset_get_sfont(other);
+        if (other != preset && registry.count(other_sfont) != 0 &&
+            static_cast<MmapSoundFont *>(fluid_sfont_get_data(other_sfont))->bank == bank) {
+            const auto &ranges = static_cast<Preset *>(fluid_preset_get_data(other))->info->ranges;
+            kept.insert(kept.end(), ranges.begin(), ranges.end());
+        }
+    }
+    for (size_t i = 0; i < bank->presets.size(); ++i) {
+        if (bank->paged_in[i] > 0) {
+            const auto &ranges = bank->presets[i].ranges;
+            kept.insert(kept.end(), ranges.begin(), ranges.end());
+        }
+    }
+    std::sort(kept.begin(), kept.end());
+
+    // Only whole pages can be dropped: shrink each remaining piece to the pages inside it
+    static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    auto base = reinterpret_cast<uintptr_t>(bank->mapping.data);
+    auto drop = [&](size_t begin, size_t end) {
+        uintptr_t first = (base + begin + page - 1) & ~(page - 1);
+        uintptr_t last = (base + end) & ~(page - 1);
+        if (first < last) {
+            madvise(reinterpret_cast<void *>(first), last - first, MADV_DONTNEED);
+        }
+    };
+    for (const auto &range : info->ranges) {
+        size_t pos = range.first;
+        for (const auto &k : kept) {
+            if (k.second <= pos) {
+                continue;
+            }
+            if (k.first >= range.second) {
+                break;
+            }
+            if (k.first > pos) {
+                drop(pos, k.first);
+            }
+            pos = std::max(pos, k.second);
+        }
+        if (pos < range.second) {
+            drop(pos, range.second);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <fluidsynth.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Read-only bytes of a whole SoundFont file, valid until release() is called
+struct SfontMapping {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    void (*release)(SfontMapping *mapping) = nullptr;
+    void *context = nullptr;
+};
+
+// Progress of one SoundFont load in bytes of the file, and a flag that asks it to stop. The
+// loading thread writes done and total; any thread may read them or set cancelled.
+struct SfontLoadProgress {
+    std::atomic<int64_t> done{0};
+    std::atomic<int64_t> total{0};
+    std::atomic<bool> cancelled{false};
+};
+
+// Maps filename read-only: plain paths with mmap(), on Android "asset://" names stored
+// uncompressed in the APK through the AssetManager. Returns false if it cannot be mapped.
+bool map_sfont(const char *filename, SfontMapping *mapping);
+
+// SoundFont loader that memory-maps SF2 files instead of reading them. Only the preset and
+// instrument tables are parsed at load time; every sample is handed to FluidSynth as a pointer
+// into the mapping, so loading a large bank costs about as much as reading its headers, and
+// sample pages are read in by the kernel when a voice first plays them. Cold pages count as
+// clean file cache, which the OS drops under memory pressure instead of killing the process.
+//
+// Plain paths are mapped with mmap(); on Android "asset://" names stored uncompressed in the
+// APK are used in place through the AssetManager's own mapping. Anything this loader declines
+// (DLS, compressed assets, SF3 without a cache directory, files it cannot parse) falls through
+// to the loaders added before it. Add it with fluid_synth_add_sfloader() after those, before
+// the first SoundFont is loaded.
+//
+// Sample data is little-endian 16-bit (plus the optional sm24 bytes) and used as is, so the
+// loader only works on little-endian CPUs, which every Android ABI is.
+//
+// The parsed bank is shared process-wide: loading a file another synth already has loaded
+// (same canonical path, modification time and size, or the same asset name) reuses its mapping
+// and tables and only creates that synth's own sample and preset objects. The bank is unmapped
+// when the last synth using it unloads it.
+fluid_sfloader_t *new_mmap_sfloader(fluid_settings_t *settings);
+
+// Loads filename the way the loader above does, but outside any synth, so the parsing (and an
+// SF3 decode) holds no FluidSynth lock; hand the result to fluid_synth_add_sfont(), which takes
+// ownership. polyphony is the synth's synth.polyphony. progress may be null. Returns nullptr
+// if the loader declines the file, it fails, or progress->cancelled was set.
+fluid_sfont_t *mmap_load_sfont(const char *filename, int polyphony, SfontLoadProgress *progress);
+
+// Frees a SoundFont from mmap_load_sfont() that was never added to a synth
+void mmap_free_sfont(fluid_sfont_t *sfont);
+
+// Hides the presets of sfont if it comes from this loader, so program changes and
+// fluid_synth_program_reset() pass it over while its voices keep playing. There is no undo; the
+// SoundFont is meant to be unloaded once mmap_sfont_playing() turns false. Returns false for
+// other loaders' SoundFonts.
+bool mmap_sfont_retire(fluid_sfont_t *sfont);
+
+// Whether mmap_sfont_retire() was called on sfont; false for other loaders' SoundFonts
+bool mmap_sfont_retired(fluid_sfont_t *sfont);
+
+// Whether a voice started from sfont on synth still plays. Only reliable after
+// mmap_sfont_retire() and a program reset, when no channel can start new voices from it any
+// more. Asks synth under its API lock, so enter the synth's ApiGate around the call. False for
+// other loaders' SoundFonts.
+bool mmap_sfont_playing(fluid_synth_t *synth, fluid_sfont_t *sfont);
+
+// Pages in the samples of preset if it comes from this loader: madvise(MADV_WILLNEED) to queue
+// the reads, then a touch of every page so they are resident on return. Calls are counted per
+// bank, so each must be balanced by mmap_preset_page_out(). Blocks on I/O; call on
+// a background thread, never the audio thread. Returns false for other loaders' presets.
+bool mmap_preset_page_in(fluid_preset_t *preset);
+
+// Releases the pages of preset from the process with madvise(MADV_DONTNEED), except ranges
+// shared with a preset in keep. Does nothing while another synth sharing the bank still has
+// the preset paged in, and never drops ranges of presets paged in there. They stay in the page
+// cache until the kernel needs the memory. Returns false for other loaders' presets.
+bool mmap_preset_page_out(fluid_preset_t *preset, const std::vector<fluid_preset_t *> &keep);
@@ -0,0 +1,165 @@
+#include "preset_catalog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+#include "mmap_sfloader.h"
+#include "sf2_riff.h"
+#include "sf3_cache.h"
+
+#ifdef __ANDROID__
+#include <android/log.h>
+
+#define LOG_TAG "FluidSynthJNI"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#else
+#define LOGI(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#define LOGE(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#endif
+
+// Longest catalog index read back; a full 128-bank SoundFont is well under 1 MB
+#define PRESET_CATALOG_MAX_SIZE (4 * 1024 * 1024)
+
+namespace {
+
+using sf2::Chunk;
+using sf2::read_u32;
+using sf2::write_u32;
+
+// Index file of filename under the cache directory
+bool index_path(const char *filename, std::string *path) {
+    std::string dir = sf3_cache_dir();
+    if (dir.empty()) {
+        return false;
+    }
+    SfontMapping mapping;
+    if (!map_sfont(filename, &mapping)) {
+        return false;
+    }
+    // The preset list only depends on the pdta chunk, so that is all that is hashed
+    Chunk tables{mapping.data, mapping.size};
+    sf2::for_each_chunk(sf2::sfbk_body(mapping.data, mapping.size),
+                        [&](const uint8_t *id, const Chunk &chunk) {
+                            if (memcmp(id, "LIST", 4) == 0 && chunk.size >= 4 &&
+                                memcmp(chunk.data, "pdta", 4) == 0) {
+                                tables = chunk;
+                            }
+                        });
+    uint64_t hash = sf2::content_hash(tables.data, tables.size);
+    size_t size = mapping.size;
+    if (mapping.release) {
+        mapping.release(&mapping);
+    }
+
+    char file_name[80];
+    snprintf(file_name, sizeof(file_name), "/presets-v%d-%zx-%016llx.idx",
+             PRESET_CATALOG_VERSION, size, static_cast<unsigned long long>(hash));
+    *path = dir + file_name;
+    return true;
+}
+
+bool valid_catalog(const std::vector<uint8_t> &catalog) {
+    if (catalog.size() < PRESET_CATALOG_HEADER_SIZE || memcmp(catalog.data(), "PCAT", 4) != 0 ||
+        read_u32(catalog.data() + 4) != PRESET_CATALOG_VERSION) {
+        return false;
+    }
+    uint32_t count = read_u32(catalog.data() + 8);
+    size_t pos = PRESET_CATALOG_HEADER_SIZE;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (catalog.size() - pos < PRESET_CATALOG_RECORD_SIZE) {
+            return false;
+        }
+        size_t record = PRESET_CATALOG_RECORD_SIZE + catalog[pos + 3];
+        if (catalog.size() - pos < record) {
+            return false;
+        }
+        pos += record;
+    }
+    return pos == catalog.size();
+}
+
+} // namespace
+
+void build_preset_catalog(fluid_sfont_t *sfont, std::vector<uint8_t> *catalog) {
+    catalog->assign(PRESET_CATALOG_HEADER_SIZE, 0);
+    memcpy(catalog->data(), "PCAT", 4);
+    write_u32(catalog->data() + 4, PRESET_CATALOG_VERSION);
+
+    uint32_t count = 0;
+    fluid_sfont_iteration_start(sfont);
+    while (fluid_preset_t *preset = fluid_sfont_iteration_next(sfont)) {
+        const char *name = fluid_preset_get_name(preset);
+        size_t length = name ? std::min<size_t>(strlen(name), UINT8_MAX) : 0;
+        int bank = fluid_preset_get_banknum(preset);
+        uint8_t record[PRESET_CATALOG_RECORD_SIZE] = {
+                static_cast<uint8_t>(bank), static_cast<uint8_t>(bank >> 8),
+                static_cast<uint8_t>(fluid_preset_get_num(preset)),
+                static_cast<uint8_t>(length)};
+        catalog->insert(catalog->end(), record, record + PRESET_CATALOG_RECORD_SIZE);
+        catalog->insert(catalog->end(), name, name + length);
+        ++count;
+    }
+    write_u32(catalog->data() + 8, count);
+}
+
+bool store_preset_catalog(const char *filename, const std::vector<uint8_t> &catalog) {
+    std::string path;
+    if (!index_path(filename, &path)) {
+        return false;
+    }
+    // The name covers the contents, so an existing index is already up to date
+    if (access(path.c_str(), R_OK) == 0) {
+        return true;
+    }
+
+    // Written under a unique name and renamed, so no launch ever reads a partial index
+    static std::atomic<unsigned> temp_counter{0};
+    std::string temp = path + "." + std::to_string(getpid()) + "." +
+                       std::to_string(temp_counter.fetch_add(1)) + ".tmp";
+    FILE *out = fopen(temp.c_str(), "wb");
+    if (!out) {
+        LOGE("Failed to create %s", temp.c_str());
+        return false;
+    }
+    bool ok = fwrite(catalog.data(), 1, catalog.size(), out) == catalog.size();
+    ok = fclose(out) == 0 && ok;
+    if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+        LOGE("Failed to write preset index %s", path.c_str());
+        unlink(temp.c_str());
+        return false;
+    }
+    LOGI("Stored preset index of %s: %u presets", filename, read_u32(catalog.data() + 8));
+    return true;
+}
+
+bool load_preset_catalog(const char *filename, std::vector<uint8_t> *catalog) {
+    std::string path;
+    if (!index_path(filename, &path)) {
+        return false;
+    }
+    FILE *in = fopen(path.c_str(), "rb");
+    if (!in) {
+        return false;
+    }
+    long size = -1;
+    if (fseek(in, 0, SEEK_END) == 0) {
+        size = ftell(in);
+    }
+    bool ok = size >= 0 && size <= PRESET_CATALOG_MAX_SIZE && fseek(in, 0, SEEK_SET) == 0;
+    if (ok) {
+        catalog->resize(static_cast<size_t>(size));
+        ok = fread(catalog->data(), 1, catalog->size(), in) == catalog->size();
+    }
+    fclose(in);
+    if (!ok || !valid_catalog(*catalog)) {
+        LOGE("Ignoring invalid preset index %s", path.c_str());
+        catalog->clear();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <fluidsynth.h>
+#include <cstdint>
+#include <vector>
+
+// Every preset of a SoundFont in one little-endian buffer, so Kotlin reads a whole bank with a
+// single JNI call instead of one per preset:
+//
+//   header  "PCAT", u32 PRESET_CATALOG_VERSION, u32 preset count
+//   record  u16 bank, u8 program, u8 name length, name bytes (no terminator)
+//
+// Records follow the SoundFont's own iteration order. Keep in sync with PresetCatalog.kt.
+#define PRESET_CATALOG_VERSION 1
+#define PRESET_CATALOG_HEADER_SIZE 12
+#define PRESET_CATALOG_RECORD_SIZE 4
+
+// Fills catalog with every preset of sfont, walking fluid_sfont_iteration_start/next
+void build_preset_catalog(fluid_sfont_t *sfont, std::vector<uint8_t> *catalog);
+
+// The catalog is also kept on disk under the SF3 cache directory (sf3_cache.h), in an index
+// file named after the SoundFont's size and a hash of its preset tables, so a later launch can
+// list the presets before the SoundFont itself has loaded. Hashing only reads the pdta chunk
+// (the whole file for non-SF2 formats), a few hundred KB even for large banks.
+
+// Writes catalog to the index of filename (a path or "asset://" name) unless it is already
+// there. Returns false if no cache directory is set or the file cannot be written.
+bool store_preset_catalog(const char *filename, const std::vector<uint8_t> &catalog);
+
+// Reads the index of filename into catalog. Returns false if there is none yet or it is not a
+// valid catalog.
+bool load_preset_catalog(const char *filename, std::vector<uint8_t> *catalog);
@@ -0,0 +1,487 @@
+#include "preset_loader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "midi_event.h"
+#include "mmap_sfloader.h"
+
+#ifdef __ANDROID__
+#include <android/log.h>
+
+#define LOG_TAG "FluidSynthJNI"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#else
+#include <cstdio>
+
+#define LOGI(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#define LOGE(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#endif
+
+namespace {
+
+int64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Bank a program change on chan would select from: the channel's current bank selection
+int channel_bank(fluid_synth_t *synth, int chan) {
+    int sfont_id = 0, bank = 0, program = 0;
+    fluid_synth_get_program(synth, chan, &sfont_id, &bank, &program);
+    return bank;
+}
+
+} // namespace
+
+PresetLoader::PresetLoader(fluid_synth_t *synth, ApiGate *api_gate)
+        : synth_(synth), api_gate_(api_gate), thread_(&PresetLoader::run, this) {}
+
+PresetLoader::~PresetLoader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+}
+
+int PresetLoader::select(int chan, int program) {
+    if (chan < 0 || chan >= PRESET_USER_CHANNELS) {
+        return FLUID_FAILED;
+    }
+    uint32_t generation = generation_[chan].fetch_add(1, std::memory_order_acq_rel) + 1;
+    return apply_change(chan, program, generation);
+}
+
+int PresetLoader::select_async(int chan, int program) {
+    if (chan < 0 || chan >= PRESET_USER_CHANNELS) {
+        return FLUID_FAILED;
+    }
+    uint32_t generation = generation_[chan].fetch_add(1, std::memory_order_acq_rel) + 1;
+
+    Key key;
+    if (find_preset(channel_bank(synth_, chan), program, &key)) {
+        std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+        if (lock.owns_lock()) {
+            auto it = entries_.find(key);
+            if (it != entries_.end() && it->second.status == PRESET_READY) {
+                pending_[chan].active = false;
+                it->second.last_used_ms = now_ms();
+                return fluid_synth_program_change(synth_, chan, program);
+            }
+        }
+    }
+
+    // The notify is not under the lock, so the loader can miss it while about to wait; it then
+    // picks the change up when its wait times out
+    handed_off_[chan].store(static_cast<uint64_t>(generation) << 32 |
+                            static_cast<uint64_t>(program + 1), std::memory_order_release);
+    has_handed_off_.store(true, std::memory_order_release);
+    wake_.notify_one();
+    return FLUID_OK;
+}
+
+int PresetLoader::apply_event(uint32_t event) {
+    if ((event & 0xf0) == MIDI_PROGRAM_CHANGE) {
+        return select_async(static_cast<int>(event & 0x0f),
+                            static_cast<int>((event >> 8) & 0x7f));
+    }
+    return apply_midi_event(synth_, event);
+}
+
+// Applies a program change unless a later one on the same channel superseded it
+int PresetLoader::apply_change(int chan, int program, uint32_t generation) {
+    Key key;
+    bool found = find_preset(channel_bank(synth_, chan), program, &key);
+
+    // Changes are applied under the lock so a pending one can never overtake a later one
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation_[chan].load(std::memory_order_acquire) != generation) {
+        return FLUID_OK;
+    }
+    if (!found) {
+        // Nothing to load ahead of time; FluidSynth applies its own fallbacks
+        pending_[chan].active = false;
+        return fluid_synth_program_change(synth_, chan, program);
+    }
+    Entry &entry = entries_[key];
+    if (entry.status == PRESET_READY) {
+        pending_[chan].active = false;
+        entry.last_used_ms = now_ms();
+        return fluid_synth_program_change(synth_, chan, program);
+    }
+    pending_[chan] = PendingChange{true, program, key};
+    enqueue_locked(key);
+    return FLUID_OK;
+}
+
+// Loader thread, without the lock: applies the changes select_async() handed off
+void PresetLoader::apply_handed_off() {
+    for (int chan = 0; chan < PRESET_USER_CHANNELS; ++chan) {
+        uint64_t value = handed_off_[chan].exchange(0, std::memory_order_acquire);
+        if (value != 0) {
+            apply_change(chan, static_cast<int>(value & 0xffffffffu) - 1,
+                         static_cast<uint32_t>(value >> 32));
+        }
+    }
+}
+
+void PresetLoader::prefetch(int chan, int program) {
+    if (chan >= 0 && chan < PRESET_USER_CHANNELS) {
+        prefetch_preset(channel_bank(synth_, chan), program);
+    }
+}
+
+int PresetLoader::prefetch_preset(int bank, int program) {
+    Key key;
+    if (!find_preset(bank, program, &key)) {
+        return PRESET_NOT_LOADED;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry &entry = entries_[key];
+    entry.last_used_ms = now_ms();
+    entry.prefetched = true;
+    enqueue_locked(key);
+    return entry.status;
+}
+
+int PresetLoader::status(int bank, int program) {
+    Key key;
+    if (!find_preset(bank, program, &key)) {
+        return PRESET_NOT_LOADED;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    return it == entries_.end() ? PRESET_NOT_LOADED : it->second.status;
+}
+
+void PresetLoader::retire_sfont(int sfont_id) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        retired_.push_back(sfont_id);
+    }
+    wake_.notify_one();
+}
+
+// Searches the SoundFonts in the synth's order, most recently loaded first
+bool PresetLoader::find_preset(int bank, int program, Key *key) {
+    int count = fluid_synth_sfcount(synth_);
+    for (int i = 0; i < count; ++i) {
+        fluid_sfont_t *sfont = fluid_synth_get_sfont(synth_, i);
+        if (sfont && fluid_sfont_get_preset(sfont, bank, program)) {
+            *key = Key(fluid_sfont_get_id(sfont), bank, program);
+            return true;
+        }
+    }
+    return false;
+}
+
+fluid_preset_t *PresetLoader::resolve(const Key &key) {
+    fluid_sfont_t *sfont = fluid_synth_get_sfont_by_id(synth_, std::get<0>(key));
+    return sfont ? fluid_sfont_get_preset(sfont, std::get<1>(key), std::get<2>(key)) : nullptr;
+}
+
+void PresetLoader::enqueue_locked(const Key &key) {
+    Entry &entry = entries_[key];
+    if (entry.status == PRESET_NOT_LOADED) {
+        entry.status = PRESET_LOADING;
+        queue_.push_back(key);
+        wake_.notify_one();
+    }
+}
+
+void PresetLoader::apply_pending_locked(const Key &key) {
+    for (int chan = 0; chan < PRESET_USER_CHANNELS; ++chan) {
+        PendingChange &pending = pending_[chan];
+        if (pending.active && pending.key == key) {
+            pending.active = false;
+            fluid_synth_program_change(synth_, chan, pending.program);
+        }
+    }
+}
+
+bool PresetLoader::pending_locked(const Key &key) const {
+    for (const PendingChange &pending : pending_) {
+        if (pending.active && pending.key == key) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Picks a free holder channel, or takes the one of the least recently used preset
+int PresetLoader::acquire_holder_locked(const Key &loading) {
+    for (int h = 0; h < PRESET_HOLDER_CHANNELS; ++h) {
+        if (!holder_used_[h]) {
+            holder_used_[h] = true;
+            return h;
+        }
+    }
+    auto victim = entries_.end();
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->second.holder >= 0 && it->first != loading &&
+            (victim == entries_.end() || it->second.last_used_ms < victim->second.last_used_ms)) {
+            victim = it;
+        }
+    }
+    if (victim == entries_.end()) {
+        return -1;
+    }
+    // Selecting the new preset on the channel unselects the old one
+    int holder = victim->second.holder;
+    entries_.erase(victim);
+    return holder;
+}
+
+// Loader thread, without the lock: pins the preset on a holder channel, or pages it in
+bool PresetLoader::load(const Key &key, Entry *entry) {
+    fluid_preset_t *preset = resolve(key);
+    if (!preset) {
+        return false;
+    }
+    if (mmap_preset_page_in(preset)) {
+        entry->mapped = true;
+        return true;
+    }
+
+    int holder;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        holder = acquire_holder_locked(key);
+    }
+    if (holder < 0) {
+        return false;
+    }
+    // Loading the samples holds the API lock; the audio thread leaves queued events alone
+    api_gate_->enter();
+    int result = fluid_synth_program_select(synth_, PRESET_USER_CHANNELS + holder,
+                                            std::get<0>(key), std::get<1>(key),
+                                            std::get<2>(key));
+    api_gate_->leave();
+    if (result != FLUID_OK) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        holder_used_[holder] = false;
+        return false;
+    }
+    entry->holder = holder;
+    return true;
+}
+
+// Loader thread, without the lock
+void PresetLoader::release(Entry *entry) {
+    if (entry->holder >= 0) {
+        api_gate_->enter();
+        fluid_synth_unset_program(synth_, PRESET_USER_CHANNELS + entry->holder);
+        api_gate_->leave();
+        std::lock_guard<std::mutex> lock(mutex_);
+        holder_used_[entry->holder] = false;
+    }
+}
+
+// Loader thread, without the lock: drops the entries of retired SoundFonts and unloads the ones
+// no voice plays from any more; the others are checked again later
+void PresetLoader::unload_retired() {
+    std::vector<int> retired;
+    std::vector<Entry> held;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        retired.swap(retired_);
+        auto is_retired = [&retired](const Key &key) {
+            return std::find(retired.begin(), retired.end(), std::get<0>(key)) != retired.end();
+        };
+        // Mapped presets need no page-out: the SoundFont gives its pages back when it is freed
+        for (auto it = entries_.begin(); it != entries_.end();) {
+            if (is_retired(it->first)) {
+                if (it->second.holder >= 0) {
+                    held.push_back(it->second);
+                }
+                it = entries_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        // Changes still waiting for a retired preset resolve against the remaining SoundFonts
+        for (int chan = 0; chan < PRESET_USER_CHANNELS; ++chan) {
+            PendingChange &pending = pending_[chan];
+            if (pending.active && is_retired(pending.key)) {
+                pending.active = false;
+                fluid_synth_program_change(synth_, chan, pending.program);
+            }
+        }
+    }
+    for (Entry &entry : held) {
+        release(&entry);
+    }
+
+    std::vector<int> playing;
+    for (int sfont_id : retired) {
+        fluid_sfont_t *sfont = fluid_synth_get_sfont_by_id(synth_, sfont_id);
+        if (!sfont) {
+            continue;
+        }
+        api_gate_->enter();
+        bool still_playing = mmap_sfont_playing(synth_, sfont);
+        api_gate_->leave();
+        if (still_playing) {
+            playing.push_back(sfont_id);
+            continue;
+        }
+        api_gate_->enter();
+        int result = fluid_synth_sfunload(synth_, sfont_id, 1);
+        api_gate_->leave();
+        if (result == FLUID_OK) {
+            LOGI("Unloaded replaced SoundFont %d", sfont_id);
+        } else {
+            LOGE("Failed to unload replaced SoundFont %d", sfont_id);
+        }
+    }
+    if (!playing.empty()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        retired_.insert(retired_.end(), playing.begin(), playing.end());
+    }
+}
+
+void PresetLoader::scan() {
+    // What the user and holder channels have selected, read without the lock
+    Key selected[PRESET_USER_CHANNELS];
+    bool has_selected[PRESET_USER_CHANNELS];
+    for (int chan = 0; chan < PRESET_USER_CHANNELS; ++chan) {
+        int sfont_id, bank, program;
+        has_selected[chan] = fluid_synth_get_channel_preset(synth_, chan) &&
+                             fluid_synth_get_program(synth_, chan, &sfont_id, &bank,
+                                                     &program) == FLUID_OK;
+        if (has_selected[chan]) {
+            selected[chan] = Key(sfont_id, bank, program);
+        }
+    }
+    Key held[PRESET_HOLDER_CHANNELS];
+    for (int h = 0; h < PRESET_HOLDER_CHANNELS; ++h) {
+        int sfont_id = -1, bank = -1, program = -1;
+        fluid_synth_get_program(synth_, PRESET_USER_CHANNELS + h, &sfont_id, &bank, &program);
+        held[h] = Key(sfont_id, bank, program);
+    }
+
+    std::vector<std::pair<Key, Entry>> expired;
+    std::vector<Key> keep;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int64_t now = now_ms();
+        for (int chan = 0; chan < PRESET_USER_CHANNELS; ++chan) {
+            if (has_selected[chan]) {
+                // Also covers presets selected without select(), such as by a system reset:
+                // they are pinned so their grace period applies too
+                Entry &entry = entries_[selected[chan]];
+                entry.last_used_ms = now;
+                entry.prefetched = true;
+                enqueue_locked(selected[chan]);
+                keep.push_back(selected[chan]);
+            }
+        }
+        for (auto it = entries_.begin(); it != entries_.end();) {
+            Entry &entry = it->second;
+            // A system reset reselects every channel, holders included
+            if (entry.holder >= 0 && held[entry.holder] != it->first) {
+                holder_used_[entry.holder] = false;
+                entry.holder = -1;
+                entry.status = PRESET_NOT_LOADED;
+            }
+            if (entry.status == PRESET_READY && now - entry.last_used_ms > PRESET_GRACE_MS) {
+                expired.emplace_back(it->first, entry);
+                it = entries_.erase(it);
+                continue;
+            }
+            if (entry.status == PRESET_READY) {
+                keep.push_back(it->first);
+            }
+            ++it;
+        }
+    }
+    if (expired.empty()) {
+        return;
+    }
+
+    std::vector<fluid_preset_t *> keep_presets;
+    for (const Key &key : keep) {
+        if (fluid_preset_t *preset = resolve(key)) {
+            keep_presets.push_back(preset);
+        }
+    }
+    for (auto &item : expired) {
+        if (item.second.mapped) {
+            if (fluid_preset_t *preset = resolve(item.first)) {
+                mmap_preset_page_out(preset, keep_presets);
+            }
+        }
+        release(&item.second);
+    }
+    LOGI("Released %zu presets unused for %d s", expired.size(), PRESET_GRACE_MS / 1000);
+}
+
+void PresetLoader::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    int64_t next_scan = now_ms() + PRESET_SCAN_INTERVAL_MS;
+    int64_t next_retire = 0;
+    while (!stop_) {
+        if (queue_.empty()) {
+            int64_t wake_at = retired_.empty() ? next_scan : std::min(next_scan, next_retire);
+            auto timeout = std::chrono::milliseconds(std::max<int64_t>(wake_at - now_ms(), 0));
+            size_t retired = retired_.size();
+            wake_.wait_for(lock, timeout, [this, retired] {
+                return stop_ || !queue_.empty() || retired_.size() > retired ||
+                       has_handed_off_.load(std::memory_order_acquire);
+            });
+        }
+        if (!stop_ && has_handed_off_.exchange(false, std::memory_order_acq_rel)) {
+            lock.unlock();
+            apply_handed_off();
+            lock.lock();
+        }
+        while (!stop_ && !queue_.empty()) {
+            Key key = queue_.front();
+            queue_.pop_front();
+            auto it = entries_.find(key);
+            if (it == entries_.end() || it->second.status != PRESET_LOADING) {
+                continue;
+            }
+            // Skips presets a later program change on the same channel superseded, such as
+            // the ones passed while dragging through programs
+            if (!it->second.prefetched && !pending_locked(key)) {
+                entries_.erase(it);
+                continue;
+            }
+
+            Entry loaded = it->second;
+            lock.unlock();
+            bool ok = load(key, &loaded);
+            lock.lock();
+
+            // Only this thread erases entries, but acquire_holder_locked() may have evicted
+            // this one's neighbours; look it up again
+            Entry &entry = entries_[key];
+            entry.mapped = loaded.mapped;
+            entry.holder = loaded.holder;
+            entry.status = ok ? PRESET_READY : PRESET_NOT_LOADED;
+            entry.last_used_ms = now_ms();
+            if (!ok) {
+                LOGE("Failed to load preset %d:%d", std::get<1>(key), std::get<2>(key));
+            }
+            // A failed load still gets its program change; FluidSynth handles it as usual
+            apply_pending_locked(key);
+        }
+        if (!stop_ && !retired_.empty() && now_ms() >= next_retire) {
+            lock.unlock();
+            unload_retired();
+            lock.lock();
+            next_retire = now_ms() + PRESET_RETIRE_POLL_MS;
+        }
+        if (!stop_ && now_ms() >= next_scan) {
+            lock.unlock();
+            scan();
+            lock.lock();
+            next_scan = now_ms() + PRESET_SCAN_INTERVAL_MS;
+        }
+    }
+}
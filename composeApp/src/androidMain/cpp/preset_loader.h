@@ -0,0 +1,141 @@
+#pragma once
+
+#include <fluidsynth.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "api_gate.h"
+
+// Preset states reported by getPresetStatus / prefetchPreset
+#define PRESET_NOT_LOADED 0
+#define PRESET_LOADING 1
+#define PRESET_READY 2
+
+// MIDI channels Kotlin plays on. The synth is created with twice as many: the upper half are
+// silent holder channels the loader selects presets on to keep their samples loaded.
+#define PRESET_USER_CHANNELS 16
+#define PRESET_HOLDER_CHANNELS 16
+
+// How long a preset stays loaded after no channel selects it any more
+#define PRESET_GRACE_MS 30000
+#define PRESET_SCAN_INTERVAL_MS 1000
+
+// How often a replaced SoundFont is checked for voices still playing from it
+#define PRESET_RETIRE_POLL_MS 100
+
+// Keeps the samples of the presets in use loaded, and only those.
+//
+// The synth runs with synth.dynamic-sample-loading, so FluidSynth's own loader reads a preset's
+// samples when a channel selects it and frees them when none does. Selecting a preset that is
+// not loaded yet would block that thread on file I/O, so select() hands such program changes
+// to a background thread: it loads the preset by selecting it on a holder channel, then applies
+// the change. Until then the channel keeps playing its previous preset. Presets from the mmap
+// loader (mmap_sfloader.h) are paged in on the same thread instead.
+//
+// The render thread goes through select_async(), which never waits for the loader's lock: it
+// applies the change only when it gets the lock and finds the preset ready, and otherwise leaves
+// the change in a per-channel slot the loader thread picks up. Every change bumps its channel's
+// generation, so a handed-off change a later one superseded is dropped instead of applied late.
+//
+// Every second the thread looks at what channels 0-15 have selected; presets no channel has
+// used for PRESET_GRACE_MS are released (holder channel unset, or pages dropped), so switching
+// back and forth between instruments does not reload them every time.
+//
+// SoundFonts handed to retire_sfont() are unloaded on the same thread once none of their voices
+// plays any more, so replacing a SoundFont does not cut off the notes still sounding from it.
+class PresetLoader {
+public:
+    // api_gate is the synth's SynthInstance::api_gate, entered while a load holds the API lock
+    PresetLoader(fluid_synth_t *synth, ApiGate *api_gate);
+    ~PresetLoader();
+
+    PresetLoader(const PresetLoader &) = delete;
+    PresetLoader &operator=(const PresetLoader &) = delete;
+
+    // Program change on a user channel. Applied right away when the preset is loaded, otherwise
+    // after the loader thread has loaded it. Returns FLUID_OK, or FLUID_FAILED for a channel
+    // outside 0-15.
+    int select(int chan, int program);
+
+    // Render thread: like select(), but hands everything it cannot apply at once to the loader
+    // thread. Returns FLUID_OK or FLUID_FAILED.
+    int select_async(int chan, int program);
+
+    // Render thread: applies a packed event (midi_event.h), program changes through
+    // select_async()
+    int apply_event(uint32_t event);
+
+    // Starts loading the preset a program change on chan would select, without selecting it
+    void prefetch(int chan, int program);
+
+    // Starts loading bank/program and returns its PRESET_* state
+    int prefetch_preset(int bank, int program);
+
+    // PRESET_* state of the preset bank/program resolves to
+    int status(int bank, int program);
+
+    // Forgets the presets of a SoundFont that was replaced and unloads it with
+    // fluid_synth_sfunload() after its last voice has finished. For the mmap loader's
+    // SoundFonts call mmap_sfont_retire() and reset the programs first; others are unloaded
+    // right away, and FluidSynth frees them once their samples are no longer in use.
+    void retire_sfont(int sfont_id);
+
+private:
+    // SoundFont id, bank, program
+    using Key = std::tuple<int, int, int>;
+
+    struct Entry {
+        int status = PRESET_NOT_LOADED;
+        int holder = -1;       // holder channel pinning the preset, -1 if none
+        bool mapped = false;   // paged in through the mmap loader
+        bool prefetched = false; // wanted by itself, not only by a pending program change
+        int64_t last_used_ms = 0;
+    };
+
+    struct PendingChange {
+        bool active = false;
+        int program = 0;
+        Key key;
+    };
+
+    int apply_change(int chan, int program, uint32_t generation);
+    void apply_handed_off();
+    bool find_preset(int bank, int program, Key *key);
+    fluid_preset_t *resolve(const Key &key);
+    void enqueue_locked(const Key &key);
+    void apply_pending_locked(const Key &key);
+    bool pending_locked(const Key &key) const;
+    bool load(const Key &key, Entry *entry);
+    void release(Entry *entry);
+    int acquire_holder_locked(const Key &loading);
+    void unload_retired();
+    void scan();
+    void run();
+
+    fluid_synth_t *synth_;
+    ApiGate *api_gate_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+    std::map<Key, Entry> entries_;
+    std::deque<Key> queue_;
+    PendingChange pending_[PRESET_USER_CHANNELS];
+    bool holder_used_[PRESET_HOLDER_CHANNELS] = {};
+    // Bumped by every program change on the channel
+    std::atomic<uint32_t> generation_[PRESET_USER_CHANNELS] = {};
+    // Changes select_async() handed off: generation << 32 | (program + 1), 0 when empty
+    std::atomic<uint64_t> handed_off_[PRESET_USER_CHANNELS] = {};
+    std::atomic<bool> has_handed_off_{false};
+    // SoundFont ids waiting for retire_sfont() to unload them
+    std::vector<int> retired_;
+
+    std::thread thread_;
+};
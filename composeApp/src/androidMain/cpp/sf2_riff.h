@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Little-endian RIFF reading shared by the SF2 loader (mmap_sfloader.cpp), the SF3 decoder
+// (sf3_cache.cpp) and the preset catalog index (preset_catalog.cpp)
+
+// Record sizes in the pdta chunk (SF2.04 section 7)
+#define SF_PHDR_SIZE 38
+#define SF_BAG_SIZE 4
+#define SF_MOD_SIZE 10
+#define SF_GEN_SIZE 4
+#define SF_INST_SIZE 22
+#define SF_SHDR_SIZE 46
+
+namespace sf2 {
+
+inline uint16_t read_u16(const uint8_t *p) { return static_cast<uint16_t>(p[0] | p[1] << 8); }
+
+inline uint32_t read_u32(const uint8_t *p) {
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+           static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+inline void write_u32(uint8_t *p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+    p[2] = static_cast<uint8_t>(v >> 16);
+    p[3] = static_cast<uint8_t>(v >> 24);
+}
+
+struct Chunk {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+};
+
+// Calls visit(id, chunk) for every sub-chunk of a RIFF list body
+template <typename Visit>
+void for_each_chunk(const Chunk &list, Visit visit) {
+    size_t pos = 0;
+    while (pos + 8 <= list.size) {
+        const uint8_t *header = list.data + pos;
+        size_t size = read_u32(header + 4);
+        if (size > list.size - pos - 8) {
+            size = list.size - pos - 8;
+        }
+        visit(header, Chunk{header + 8, size});
+        pos += 8 + size + (size & 1);
+    }
+}
+
+// Body of an "sfbk" RIFF file after the form type, or an empty chunk if data is not one
+inline Chunk sfbk_body(const uint8_t *data, size_t size) {
+    if (size < 12 || data[0] != 'R' || data[1] != 'I' || data[2] != 'F' || data[3] != 'F' ||
+        data[8] != 's' || data[9] != 'f' || data[10] != 'b' || data[11] != 'k') {
+        return Chunk{};
+    }
+    size_t riff_size = read_u32(data + 4);
+    if (riff_size > size - 8) {
+        riff_size = size - 8;
+    }
+    if (riff_size < 4) {
+        return Chunk{};
+    }
+    return Chunk{data + 12, riff_size - 4};
+}
+
+// FNV-1a over 64-bit words, with a fold after each so high input bits reach the low output bits
+inline uint64_t content_hash(const uint8_t *data, size_t size) {
+    const uint64_t prime = 1099511628211ull;
+    uint64_t hash = 14695981039346656037ull ^ size;
+    size_t words = size / 8;
+    for (size_t i = 0; i < words; ++i) {
+        uint64_t word;
+        memcpy(&word, data + i * 8, 8);
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 32;
+    }
+    for (size_t i = words * 8; i < size; ++i) {
+        hash = (hash ^ data[i]) * prime;
+    }
+    return hash;
+}
+
+} // namespace sf2
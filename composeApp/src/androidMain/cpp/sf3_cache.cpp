@@ -0,0 +1,511 @@
+#include "sf3_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sf2_riff.h"
+#include "sndfile_api.h"
+
+#ifdef __ANDROID__
+#include <android/log.h>
+
+#define LOG_TAG "FluidSynthJNI"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#else
+#define LOGI(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#define LOGE(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#endif
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "Decoded samples are written in native byte order, which SF2 requires to be LE");
+
+// Part of every cache file name; bump it when the decoded layout changes
+#define SF3_CACHE_VERSION 1
+#define SF3_MAX_DECODE_THREADS 8
+// Total size of the decoded SF2s kept; the least recently used go first, never the newest
+#define SF3_CACHE_MAX_BYTES (1024LL * 1024 * 1024)
+
+// SF2 wants at least 46 zero sample points after every sample (SF2.04 section 6.1)
+#define SF_SAMPLE_PADDING 46
+
+// sfSampleType bit of SF3 samples stored as Ogg Vorbis (FLUID_SAMPLETYPE_OGG_VORBIS)
+#define SF3_SAMPLETYPE_VORBIS 0x10
+
+namespace {
+
+using sf2::Chunk;
+using sf2::for_each_chunk;
+using sf2::read_u16;
+using sf2::read_u32;
+
+std::mutex cache_dir_mutex;
+std::string cache_dir;
+
+// Held for a whole decode, so loading the same SF3 twice at once decodes it only once
+std::mutex decode_mutex;
+
+struct Layout {
+    Chunk info;   // INFO list body, after the list type
+    Chunk smpl;
+    Chunk pdta;   // whole pdta LIST chunk, header included
+    Chunk shdr;
+};
+
+bool find_layout(const SfontMapping &mapping, Layout *layout, int *major_version) {
+    Chunk riff = sf2::sfbk_body(mapping.data, mapping.size);
+    if (!riff.data) {
+        return false;
+    }
+    for_each_chunk(riff, [&](const uint8_t *id, const Chunk &chunk) {
+        if (memcmp(id, "LIST", 4) != 0 || chunk.size < 4) {
+            return;
+        }
+        Chunk body{chunk.data + 4, chunk.size - 4};
+        if (memcmp(chunk.data, "INFO", 4) == 0) {
+            layout->info = body;
+        } else if (memcmp(chunk.data, "pdta", 4) == 0) {
+            layout->pdta = Chunk{id, chunk.size + 8};
+        }
+        for_each_chunk(body, [&](const uint8_t *sub, const Chunk &c) {
+            if (memcmp(sub, "ifil", 4) == 0 && c.size >= 4) *major_version = read_u16(c.data);
+            else if (memcmp(sub, "smpl", 4) == 0) layout->smpl = c;
+            else if (memcmp(sub, "shdr", 4) == 0) layout->shdr = c;
+        });
+    });
+    return true;
+}
+
+// libsndfile virtual I/O over one Ogg stream inside the SoundFont mapping
+struct MemoryFile {
+    const uint8_t *data;
+    sf_count_t size;
+    sf_count_t pos;
+};
+
+sf_count_t vio_get_filelen(void *user_data) {
+    return static_cast<MemoryFile *>(user_data)->size;
+}
+
+sf_count_t vio_seek(sf_count_t offset, int whence, void *user_data) {
+    auto *file = static_cast<MemoryFile *>(user_data);
+    sf_count_t pos = whence == SEEK_CUR ? file->pos + offset
+                   : whence == SEEK_END ? file->size + offset
+                   : offset;
+    file->pos = std::min(std::max<sf_count_t>(pos, 0), file->size);
+    return file->pos;
+}
+
+sf_count_t vio_read(void *ptr, sf_count_t count, void *user_data) {
+    auto *file = static_cast<MemoryFile *>(user_data);
+    sf_count_t n = std::min(count, file->size - file->pos);
+    memcpy(ptr, file->data + file->pos, static_cast<size_t>(n));
+    file->pos += n;
+    return n;
+}
+
+sf_count_t vio_write(const void *, sf_count_t, void *) {
+    return 0;
+}
+
+sf_count_t vio_tell(void *user_data) {
+    return static_cast<MemoryFile *>(user_data)->pos;
+}
+
+// Decodes one Ogg Vorbis stream to 16-bit PCM; SF2 samples are mono, so only the first
+// channel of a multi-channel stream is kept
+bool decode_vorbis(const uint8_t *data, size_t size, std::vector<int16_t> *pcm) {
+    MemoryFile file{data, static_cast<sf_count_t>(size), 0};
+    SF_VIRTUAL_IO io{vio_get_filelen, vio_seek, vio_read, vio_write, vio_tell};
+    SF_INFO info{};
+    SNDFILE *sndfile = sf_open_virtual(&io, SFM_READ, &info, &file);
+    if (!sndfile) {
+        return false;
+    }
+    // Loud samples would otherwise wrap around when converted to 16 bits
+    sf_command(sndfile, SFC_SET_CLIPPING, nullptr, SF_TRUE);
+
+    const sf_count_t block_frames = 4096;
+    int channels = std::max(info.channels, 1);
+    std::vector<short> block(static_cast<size_t>(block_frames * channels));
+    if (info.frames > 0 && info.frames < (sf_count_t(1) << 28)) {
+        pcm->reserve(static_cast<size_t>(info.frames));
+    }
+    sf_count_t read;
+    while ((read = sf_readf_short(sndfile, block.data(), block_frames)) > 0) {
+        for (sf_count_t i = 0; i < read; ++i) {
+            pcm->push_back(block[static_cast<size_t>(i * channels)]);
+        }
+    }
+    sf_close(sndfile);
+    return !pcm->empty();
+}
+
+struct Sample {
+    const uint8_t *record;      // shdr record in the SF3
+    bool compressed = false;
+    const uint8_t *data = nullptr;
+    size_t size = 0;            // bytes of the Ogg stream, or sample points of PCM
+    std::vector<int16_t> pcm;   // decoded points of a compressed sample
+    uint32_t start = 0;         // position in the output smpl chunk, in sample points
+
+    size_t frames() const { return compressed ? pcm.size() : size; }
+};
+
+// Collects the sample data each shdr record refers to. Uncompressed samples, which SF3 allows
+// too, are copied over as they are.
+bool collect_samples(const Layout &layout, std::vector<Sample> *samples) {
+    size_t count = layout.shdr.size / SF_SHDR_SIZE;
+    if (count < 2 || !layout.smpl.data) {
+        return false;
+    }
+    samples->resize(count - 1);
+    for (size_t i = 0; i + 1 < count; ++i) {
+        Sample &sample = (*samples)[i];
+        sample.record = layout.shdr.data + i * SF_SHDR_SIZE;
+        uint32_t start = read_u32(sample.record + 20);
+        uint32_t end = read_u32(sample.record + 24);
+        uint16_t type = read_u16(sample.record + 44);
+        if (type & FLUID_SAMPLETYPE_ROM) {
+            continue;
+        }
+        if (type & SF3_SAMPLETYPE_VORBIS) {
+            // Byte offsets into smpl; like FluidSynth, treat end as the stream's last byte
+            size_t last = std::min<size_t>(static_cast<size_t>(end) + 1, layout.smpl.size);
+            if (start < last) {
+                sample.compressed = true;
+                sample.data = layout.smpl.data + start;
+                sample.size = last - start;
+            }
+        } else if (start < end && end <= layout.smpl.size / 2) {
+            sample.data = layout.smpl.data + static_cast<size_t>(start) * 2;
+            sample.size = end - start;
+        }
+    }
+    return true;
+}
+
+// Decodes all compressed samples on up to SF3_MAX_DECODE_THREADS threads, the caller's
+// included, until progress is cancelled. Returns the number of threads used.
+unsigned decode_samples(std::vector<Sample> *samples, size_t *failed,
+                        SfontLoadProgress *progress) {
+    std::vector<Sample *> jobs;
+    for (Sample &sample : *samples) {
+        if (sample.compressed) {
+            jobs.push_back(&sample);
+        }
+    }
+    // Largest streams first, so no thread is left with a long one at the end
+    std::sort(jobs.begin(), jobs.end(),
+              [](const Sample *a, const Sample *b) { return a->size > b->size; });
+
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> failures{0};
+    auto work = [&] {
+        size_t i;
+        while ((i = next.fetch_add(1, std::memory_order_relaxed)) < jobs.size()) {
+            if (progress && progress->cancelled.load(std::memory_order_relaxed)) {
+                break;
+            }
+            Sample *sample = jobs[i];
+            bool ok = false;
+            try {
+                ok = decode_vorbis(sample->data, sample->size, &sample->pcm);
+            } catch (const std::bad_alloc &) {
+            }
+            if (!ok) {
+                failures.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (progress) {
+                progress->done.fetch_add(static_cast<int64_t>(sample->size),
+                                         std::memory_order_relaxed);
+            }
+        }
+    };
+
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<size_t>(
+            std::min<unsigned>(threads, SF3_MAX_DECODE_THREADS), std::max<size_t>(jobs.size(), 1)));
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t) {
+        try {
+            pool.emplace_back(work);
+        } catch (const std::system_error &) {
+            break;
+        }
+    }
+    work();
+    for (std::thread &thread : pool) {
+        thread.join();
+    }
+    *failed = failures.load();
+    return static_cast<unsigned>(pool.size()) + 1;
+}
+
+void put_u32(std::vector<uint8_t> *out, uint32_t v) {
+    uint8_t bytes[4];
+    sf2::write_u32(bytes, v);
+    out->insert(out->end(), bytes, bytes + 4);
+}
+
+void put_chunk_header(std::vector<uint8_t> *out, const char *id, uint32_t size) {
+    out->insert(out->end(), id, id + 4);
+    put_u32(out, size);
+}
+
+// Writes the SF2: the SF3's INFO with the version set to 2.04, the decoded samples, and its
+// pdta with the sample headers pointing at them
+bool write_sf2(const Layout &layout, std::vector<Sample> &samples, FILE *out) {
+    std::vector<uint8_t> info;
+    info.insert(info.end(), {'I', 'N', 'F', 'O'});
+    for_each_chunk(layout.info, [&](const uint8_t *id, const Chunk &chunk) {
+        bool ifil = memcmp(id, "ifil", 4) == 0;
+        size_t size = ifil ? 4 : chunk.size;
+        info.insert(info.end(), id, id + 4);
+        put_u32(&info, static_cast<uint32_t>(size));
+        if (ifil) {
+            info.insert(info.end(), {2, 0, 4, 0});
+        } else {
+            info.insert(info.end(), chunk.data, chunk.data + size);
+            if (size & 1) info.push_back(0);
+        }
+    });
+
+    uint64_t points = 0;
+    for (Sample &sample : samples) {
+        sample.start = static_cast<uint32_t>(points);
+        if (sample.frames() > 0) {
+            points += sample.frames() + SF_SAMPLE_PADDING;
+        }
+        if (points > 0x7ffffff0u / 2) {
+            LOGE("Decoded samples exceed the SF2 size limit");
+            return false;
+        }
+    }
+    auto smpl_size = static_cast<uint32_t>(points * 2);
+
+    std::vector<uint8_t> pdta(layout.pdta.data, layout.pdta.data + layout.pdta.size);
+    uint8_t *shdr = pdta.data() + (layout.shdr.data - layout.pdta.data);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        const Sample &sample = samples[i];
+        uint8_t *record = shdr + i * SF_SHDR_SIZE;
+        uint32_t start = read_u32(record + 20);
+        uint32_t loop_start = read_u32(record + 28);
+        uint32_t loop_end = read_u32(record + 32);
+        // SF3 loop points are relative to the sample, SF2 ones index the smpl chunk
+        if (!sample.compressed) {
+            bool valid = loop_start >= start && loop_end >= start;
+            loop_start = valid ? loop_start - start : 0;
+            loop_end = valid ? loop_end - start : 0;
+        }
+        auto frames = static_cast<uint32_t>(sample.frames());
+        sf2::write_u32(record + 20, sample.start);
+        sf2::write_u32(record + 24, sample.start + frames);
+        sf2::write_u32(record + 28, sample.start + std::min(loop_start, frames));
+        sf2::write_u32(record + 32, sample.start + std::min(loop_end, frames));
+        uint16_t type = read_u16(record + 44) & ~SF3_SAMPLETYPE_VORBIS;
+        record[44] = static_cast<uint8_t>(type);
+        record[45] = static_cast<uint8_t>(type >> 8);
+    }
+
+    std::vector<uint8_t> header;
+    uint32_t sdta_size = 4 + 8 + smpl_size;
+    uint32_t riff_size = 4 + 8 + static_cast<uint32_t>(info.size()) + 8 + sdta_size +
+                         static_cast<uint32_t>(pdta.size());
+    put_chunk_header(&header, "RIFF", riff_size);
+    header.insert(header.end(), {'s', 'f', 'b', 'k'});
+    put_chunk_header(&header, "LIST", static_cast<uint32_t>(info.size()));
+    header.insert(header.end(), info.begin(), info.end());
+    put_chunk_header(&header, "LIST", sdta_size);
+    header.insert(header.end(), {'s', 'd', 't', 'a'});
+    put_chunk_header(&header, "smpl", smpl_size);
+
+    static const int16_t padding[SF_SAMPLE_PADDING] = {};
+    if (fwrite(header.data(), 1, header.size(), out) != header.size()) {
+        return false;
+    }
+    for (const Sample &sample : samples) {
+        size_t frames = sample.frames();
+        if (frames == 0) {
+            continue;
+        }
+        const void *data = sample.compressed ? static_cast<const void *>(sample.pcm.data())
+                                             : static_cast<const void *>(sample.data);
+        if (fwrite(data, 2, frames, out) != frames ||
+            fwrite(padding, 2, SF_SAMPLE_PADDING, out) != SF_SAMPLE_PADDING) {
+            return false;
+        }
+    }
+    return fwrite(pdta.data(), 1, pdta.size(), out) == pdta.size();
+}
+
+bool decode_to_file(const Layout &layout, const char *name, const std::string &path,
+                    SfontLoadProgress *progress) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Sample> samples;
+    if (!collect_samples(layout, &samples)) {
+        LOGE("%s: no sample headers to decode", name);
+        return false;
+    }
+    size_t failed = 0;
+    unsigned threads = decode_samples(&samples, &failed, progress);
+    if (progress && progress->cancelled.load(std::memory_order_relaxed)) {
+        LOGI("%s: decoding cancelled", name);
+        return false;
+    }
+    // A cache entry missing samples would be used from then on; FluidSynth's own loader
+    // decodes the file instead
+    if (failed > 0) {
+        LOGE("%s: %zu samples could not be decoded, not caching it", name, failed);
+        return false;
+    }
+
+    // Written under a unique name and renamed, so no load ever maps a partial file
+    static std::atomic<unsigned> temp_counter{0};
+    std::string temp = path + "." + std::to_string(getpid()) + "." +
+                       std::to_string(temp_counter.fetch_add(1)) + ".tmp";
+    FILE *out = fopen(temp.c_str(), "wb");
+    if (!out) {
+        LOGE("Failed to create %s", temp.c_str());
+        return false;
+    }
+    bool ok = write_sf2(layout, samples, out);
+    ok = fflush(out) == 0 && ok;
+    ok = fsync(fileno(out)) == 0 && ok;
+    long size = ftell(out);
+    ok = fclose(out) == 0 && ok;
+    if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+        LOGE("Failed to write decoded SoundFont %s", path.c_str());
+        unlink(temp.c_str());
+        return false;
+    }
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                             start);
+    LOGI("Decoded SF3 %s: %zu samples on %u threads, %.1f MB of PCM cached (%.1f ms)", name,
+         samples.size(), threads, static_cast<double>(size) / (1024.0 * 1024.0),
+         elapsed.count());
+    return true;
+}
+
+// Evicts cache entries after keep was written: every entry of another SF3_CACHE_VERSION, then
+// the least recently used ones (by modification time, which cache hits refresh) until all fit
+// in SF3_CACHE_MAX_BYTES. keep itself always stays. Entries still mapped stay readable until
+// unmapped.
+void evict_entries(const std::string &dir, const char *keep) {
+    DIR *entries = opendir(dir.c_str());
+    if (!entries) {
+        return;
+    }
+    char prefix[16];
+    snprintf(prefix, sizeof(prefix), "sf3-v%d-", SF3_CACHE_VERSION);
+    struct Cached {
+        std::string path;
+        time_t used;
+        off_t size;
+    };
+    std::vector<Cached> current;
+    off_t total = 0;
+    while (dirent *entry = readdir(entries)) {
+        size_t length = strlen(entry->d_name);
+        if (strncmp(entry->d_name, "sf3-v", 5) != 0 || length <= 4 ||
+            strcmp(entry->d_name + length - 4, ".sf2") != 0) {
+            continue;
+        }
+        std::string path = dir + "/" + entry->d_name;
+        if (strncmp(entry->d_name, prefix, strlen(prefix)) != 0) {
+            if (unlink(path.c_str()) == 0) {
+                LOGI("Removed SF3 cache entry %s of another cache version", entry->d_name);
+            }
+            continue;
+        }
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            continue;
+        }
+        total += st.st_size;
+        if (strcmp(entry->d_name, keep) != 0) {
+            current.push_back(Cached{path, st.st_mtime, st.st_size});
+        }
+    }
+    closedir(entries);
+
+    std::sort(current.begin(), current.end(),
+              [](const Cached &a, const Cached &b) { return a.used < b.used; });
+    for (const Cached &cached : current) {
+        if (total <= SF3_CACHE_MAX_BYTES) {
+            break;
+        }
+        if (unlink(cached.path.c_str()) == 0) {
+            total -= cached.size;
+            LOGI("Evicted SF3 cache entry %s", cached.path.c_str());
+        }
+    }
+}
+
+} // namespace
+
+void set_sf3_cache_dir(const char *dir) {
+    std::lock_guard<std::mutex> lock(cache_dir_mutex);
+    cache_dir = dir ? dir : "";
+}
+
+std::string sf3_cache_dir() {
+    std::lock_guard<std::mutex> lock(cache_dir_mutex);
+    return cache_dir;
+}
+
+bool is_sf3(const SfontMapping &mapping) {
+    Layout layout;
+    int major_version = 0;
+    return find_layout(mapping, &layout, &major_version) && major_version == 3;
+}
+
+bool sf3_cached_sf2(const SfontMapping &sf3, const char *name, std::string *path,
+                    SfontLoadProgress *progress) {
+    std::string dir = sf3_cache_dir();
+    if (dir.empty()) {
+        LOGI("%s: no SF3 cache directory set, decoding it the usual way", name);
+        return false;
+    }
+
+    Layout layout;
+    int major_version = 0;
+    if (!find_layout(sf3, &layout, &major_version) || major_version != 3 || !layout.pdta.data ||
+        !layout.shdr.data ||
+        layout.shdr.data < layout.pdta.data ||
+        layout.shdr.data + layout.shdr.size > layout.pdta.data + layout.pdta.size) {
+        return false;
+    }
+    char file_name[64];
+    snprintf(file_name, sizeof(file_name), "/sf3-v%d-%016llx.sf2", SF3_CACHE_VERSION,
+             static_cast<unsigned long long>(sf2::content_hash(sf3.data, sf3.size)));
+    *path = dir + file_name;
+
+    if (access(path->c_str(), R_OK) == 0) {
+        // Marks the entry as recently used for evict_entries()
+        utimensat(AT_FDCWD, path->c_str(), nullptr, 0);
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(decode_mutex);
+    if (access(path->c_str(), R_OK) == 0) {
+        return true;
+    }
+    if (!decode_to_file(layout, name, *path, progress)) {
+        return false;
+    }
+    evict_entries(dir, file_name + 1);
+    return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+
+#include "mmap_sfloader.h"
+
+// SF3 SoundFonts store every sample as an Ogg Vorbis stream, which FluidSynth's own loader
+// decodes on every load. The mmap loader instead decodes an SF3 once into a plain SF2 (16-bit
+// native-endian PCM, i.e. little-endian on every Android ABI) under the cache directory and maps
+// that, so only the first load pays for decoding and later ones cost as much as an SF2.
+//
+// Samples are decoded in parallel on a pool of worker threads. Cache files are named after a
+// hash of the SF3's contents, so a changed SoundFont gets a new entry; they are written to a
+// temporary name and renamed, so a load never sees a partial file. Writing an entry deletes the
+// ones of other cache versions, then the least recently used until all fit in 1 GB, so
+// switching between SF3 banks keeps each one's entry. An SF3 with samples that fail to
+// decode is not cached at all and is left to FluidSynth's loader.
+
+// Directory cache files are written to, e.g. Context.getCacheDir(). Until it is set SF3 files
+// are left to FluidSynth's loader.
+void set_sf3_cache_dir(const char *dir);
+
+// Directory set with set_sf3_cache_dir(), or an empty string. The preset catalog index
+// (preset_catalog.h) is kept there too.
+std::string sf3_cache_dir();
+
+// True if mapping holds an SF3 (version 3) SoundFont
+bool is_sf3(const SfontMapping &mapping);
+
+// Stores in path the cached SF2 decoded from sf3, decoding it first if there is none yet.
+// name is only used for logging. Blocks for the whole decode on a cache miss, during which
+// progress (may be null) counts the compressed bytes decoded and is checked for cancellation.
+// Returns false if no cache directory is set, any sample fails to decode, writing fails, or it
+// was cancelled.
+bool sf3_cached_sf2(const SfontMapping &sf3, const char *name, std::string *path,
+                    SfontLoadProgress *progress = nullptr);
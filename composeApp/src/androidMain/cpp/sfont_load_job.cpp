@@ -0,0 +1,58 @@
+#include "sfont_load_job.h"
+
+#include <algorithm>
+#include <new>
+#include <system_error>
+
+SoundFontLoadJob *SoundFontLoadJob::start(sfont_load_func_t load) {
+    auto *job = new(std::nothrow) SoundFontLoadJob(std::move(load));
+    if (!job) {
+        return nullptr;
+    }
+    try {
+        job->thread_ = std::thread(&SoundFontLoadJob::run, job);
+    } catch (const std::system_error &) {
+        delete job;
+        return nullptr;
+    }
+    return job;
+}
+
+SoundFontLoadJob::SoundFontLoadJob(sfont_load_func_t load) : load_(std::move(load)) {}
+
+SoundFontLoadJob::~SoundFontLoadJob() {
+    cancel();
+    wait();
+}
+
+void SoundFontLoadJob::cancel() {
+    progress_.cancelled.store(true, std::memory_order_release);
+}
+
+void SoundFontLoadJob::wait() {
+    if (thread_.joinable()) thread_.join();
+}
+
+double SoundFontLoadJob::progress() const {
+    if (status() == SFONT_LOAD_DONE) {
+        return 1.0;
+    }
+    int64_t total = progress_.total.load(std::memory_order_relaxed);
+    if (total <= 0) {
+        return 0.0;
+    }
+    int64_t done = progress_.done.load(std::memory_order_relaxed);
+    return std::min(1.0, static_cast<double>(done) / static_cast<double>(total));
+}
+
+void SoundFontLoadJob::run() {
+    int sfont_id = load_(&progress_);
+    if (sfont_id >= 0) {
+        sfont_id_.store(sfont_id, std::memory_order_release);
+        status_.store(SFONT_LOAD_DONE, std::memory_order_release);
+    } else if (progress_.cancelled.load(std::memory_order_acquire)) {
+        status_.store(SFONT_LOAD_CANCELLED, std::memory_order_release);
+    } else {
+        status_.store(SFONT_LOAD_FAILED, std::memory_order_release);
+    }
+}
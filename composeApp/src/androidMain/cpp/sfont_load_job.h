@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include "mmap_sfloader.h"
+
+// SoundFont load job states
+#define SFONT_LOAD_FAILED -1
+#define SFONT_LOAD_RUNNING 0
+#define SFONT_LOAD_DONE 1
+#define SFONT_LOAD_CANCELLED 2
+
+// Loads a SoundFont into a synth and returns its ID, or -1. Runs on the job's thread; reports
+// through progress and stops early once progress->cancelled is set.
+typedef std::function<int(SfontLoadProgress *progress)> sfont_load_func_t;
+
+// Runs one SoundFont load on its own thread, so the caller can poll progress and cancel it
+// instead of blocking for the seconds a large bank or an SF3 decode takes.
+class SoundFontLoadJob {
+public:
+    // Starts the thread. Returns nullptr if it cannot be created.
+    static SoundFontLoadJob *start(sfont_load_func_t load);
+
+    // Cancels a running load and waits for the thread
+    ~SoundFontLoadJob();
+
+    SoundFontLoadJob(const SoundFontLoadJob &) = delete;
+    SoundFontLoadJob &operator=(const SoundFontLoadJob &) = delete;
+
+    // Asks the load to stop; a SoundFont it already added is unloaded again
+    void cancel();
+
+    // Waits for the thread to finish. Not thread-safe against itself.
+    void wait();
+
+    int status() const { return status_.load(std::memory_order_acquire); }
+
+    // Fraction of the file's bytes processed, 0..1; stays 0 for loads FluidSynth's own loaders
+    // handle, which report nothing until they are done
+    double progress() const;
+
+    // The loaded SoundFont's ID once status() is SFONT_LOAD_DONE, otherwise -1
+    int sfont_id() const { return sfont_id_.load(std::memory_order_acquire); }
+
+private:
+    explicit SoundFontLoadJob(sfont_load_func_t load);
+
+    void run();
+
+    sfont_load_func_t load_;
+    SfontLoadProgress progress_;
+    std::atomic<int> sfont_id_{-1};
+    std::atomic<int> status_{SFONT_LOAD_RUNNING};
+    std::thread thread_;
+};
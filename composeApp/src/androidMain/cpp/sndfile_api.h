@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+
+// The subset of the libsndfile API used by the exporter and the SF3 decoder. The prebuilt libsndfile.so ships
+// without its header, so the declarations are mirrored here from sndfile.h (1.x ABI).
+
+extern "C" {
+
+typedef int64_t sf_count_t;
+typedef struct SNDFILE_tag SNDFILE;
+
+struct SF_INFO {
+    sf_count_t frames;
+    int samplerate;
+    int channels;
+    int format;
+    int sections;
+    int seekable;
+};
+
+enum {
+    SF_FORMAT_WAV = 0x010000,
+    SF_FORMAT_FLAC = 0x170000,
+    SF_FORMAT_OGG = 0x200000,
+
+    SF_FORMAT_PCM_16 = 0x0002,
+    SF_FORMAT_PCM_24 = 0x0003,
+    SF_FORMAT_FLOAT = 0x0006,
+    SF_FORMAT_VORBIS = 0x0060,
+};
+
+enum {
+    SFM_READ = 0x10,
+    SFM_WRITE = 0x20,
+};
+
+enum {
+    SFC_SET_CLIPPING = 0x10C0,
+    SFC_SET_VBR_ENCODING_QUALITY = 0x1300,
+};
+
+enum {
+    SF_FALSE = 0,
+    SF_TRUE = 1,
+};
+
+typedef sf_count_t (*sf_vio_get_filelen)(void *user_data);
+typedef sf_count_t (*sf_vio_seek)(sf_count_t offset, int whence, void *user_data);
+typedef sf_count_t (*sf_vio_read)(void *ptr, sf_count_t count, void *user_data);
+typedef sf_count_t (*sf_vio_write)(const void *ptr, sf_count_t count, void *user_data);
+typedef sf_count_t (*sf_vio_tell)(void *user_data);
+
+struct SF_VIRTUAL_IO {
+    sf_vio_get_filelen get_filelen;
+    sf_vio_seek seek;
+    sf_vio_read read;
+    sf_vio_write write;
+    sf_vio_tell tell;
+};
+
+SNDFILE *sf_open(const char *path, int mode, SF_INFO *sfinfo);
+SNDFILE *sf_open_virtual(SF_VIRTUAL_IO *sfvirtual, int mode, SF_INFO *sfinfo, void *user_data);
+int sf_format_check(const SF_INFO *info);
+int sf_command(SNDFILE *sndfile, int command, void *data, int datasize);
+sf_count_t sf_writef_float(SNDFILE *sndfile, const float *ptr, sf_count_t frames);
+sf_count_t sf_writef_short(SNDFILE *sndfile, const short *ptr, sf_count_t frames);
+sf_count_t sf_readf_short(SNDFILE *sndfile, short *ptr, sf_count_t frames);
+const char *sf_strerror(SNDFILE *sndfile);
+int sf_close(SNDFILE *sndfile);
+
+}
@@ -0,0 +1,281 @@
+#include "spectrum_analyzer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+typedef float v4sf __attribute__((vector_size(16)));
+
+const int kComplexSize = SPECTRUM_FFT_SIZE / 2;
+const int kLog2ComplexSize = 10;
+const float kSmoothing = 0.8f;
+const float kMinDecibels = -100.0f;
+const float kMaxDecibels = -30.0f;
+const float kLowestBandHz = 40.0f;
+const float kHighestBandHz = 16000.0f;
+const auto kInterval = std::chrono::milliseconds(16);
+const int64_t kIdleAfterNs = 1000000000LL;
+
+static_assert((1 << kLog2ComplexSize) == kComplexSize, "FFT size must match its log2");
+
+inline v4sf load4(const float *p) {
+    v4sf v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void store4(float *p, v4sf v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+SpectrumAnalyzer::SpectrumAnalyzer(int sample_rate)
+        : sample_rate_(sample_rate), ring_(kRingSize), window_(SPECTRUM_FFT_SIZE),
+          input_(SPECTRUM_FFT_SIZE), re_(kComplexSize), im_(kComplexSize),
+          twiddle_re_(kComplexSize), twiddle_im_(kComplexSize), split_cos_(kComplexSize),
+          split_sin_(kComplexSize), bit_reverse_(kComplexSize), smoothed_(SPECTRUM_BINS, 0.0f),
+          normalized_(SPECTRUM_BINS, 0.0f), band_edges_(SPECTRUM_BANDS + 1) {
+    const double pi = 3.14159265358979323846;
+    const double n = SPECTRUM_FFT_SIZE;
+
+    // Blackman window with alpha = 0.16, as AnalyserNode uses
+    for (int i = 0; i < SPECTRUM_FFT_SIZE; ++i) {
+        window_[i] = static_cast<float>(0.42 - 0.5 * std::cos(2.0 * pi * i / n) +
+                                        0.08 * std::cos(4.0 * pi * i / n));
+    }
+
+    for (int i = 0; i < kComplexSize; ++i) {
+        uint32_t r = 0;
+        for (int b = 0; b < kLog2ComplexSize; ++b) {
+            r |= ((i >> b) & 1u) << (kLog2ComplexSize - 1 - b);
+        }
+        bit_reverse_[i] = r;
+    }
+
+    // Per-stage twiddles stored contiguously: the stage with half-size h starts at h - 1
+    for (int h = 1; h < kComplexSize; h <<= 1) {
+        for (int j = 0; j < h; ++j) {
+            double angle = -pi * j / h;
+            twiddle_re_[h - 1 + j] = static_cast<float>(std::cos(angle));
+            twiddle_im_[h - 1 + j] = static_cast<float>(std::sin(angle));
+        }
+    }
+
+    // Twiddles that split the half-size complex FFT back into the real FFT
+    for (int k = 0; k < kComplexSize; ++k) {
+        split_cos_[k] = static_cast<float>(std::cos(2.0 * pi * k / n));
+        split_sin_[k] = static_cast<float>(std::sin(2.0 * pi * k / n));
+    }
+
+    // Log-spaced band edges in bins, each band at least one bin wide
+    double bin_hz = static_cast<double>(sample_rate_) / n;
+    double high = std::min<double>(kHighestBandHz, sample_rate_ / 2.0);
+    uint32_t previous = 0;
+    for (int b = 0; b <= SPECTRUM_BANDS; ++b) {
+        double hz = kLowestBandHz * std::pow(high / kLowestBandHz,
+                                             static_cast<double>(b) / SPECTRUM_BANDS);
+        auto edge = static_cast<uint32_t>(std::lround(hz / bin_hz));
+        edge = std::max<uint32_t>(edge, b == 0 ? 1 : previous + 1);
+        band_edges_[b] = std::min<uint32_t>(edge, SPECTRUM_BINS);
+        previous = band_edges_[b];
+    }
+
+    thread_ = std::thread(&SpectrumAnalyzer::run, this);
+}
+
+SpectrumAnalyzer::~SpectrumAnalyzer() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stop_ = true;
+    }
+    wake_cv_.notify_one();
+    thread_.join();
+}
+
+void SpectrumAnalyzer::tap(const float *left, const float *right, int frames) {
+    if (!active_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    uint64_t written = written_.load(std::memory_order_relaxed);
+    for (int i = 0; i < frames; ++i) {
+        ring_[(written + i) & (kRingSize - 1)].store(0.5f * (left[i] + right[i]),
+                                                     std::memory_order_relaxed);
+    }
+    written_.store(written + frames, std::memory_order_release);
+}
+
+bool SpectrumAnalyzer::read(float *magnitudes, float *bands) {
+    last_read_ns_.store(now_ns(), std::memory_order_relaxed);
+    if (!active_.exchange(true, std::memory_order_relaxed)) {
+        // Taking the mutex orders this after an idle thread's check, so the wakeup is not lost
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        wake_cv_.notify_one();
+    }
+
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        uint32_t published = published_.load(std::memory_order_acquire);
+        if (published == 0) {
+            return false;
+        }
+        Frame &frame = frames_[published & 1];
+        if (magnitudes) {
+            for (int i = 0; i < SPECTRUM_BINS; ++i) {
+                magnitudes[i] = frame.magnitudes[i].load(std::memory_order_relaxed);
+            }
+        }
+        if (bands) {
+            for (int i = 0; i < SPECTRUM_BANDS; ++i) {
+                bands[i] = frame.bands[i].load(std::memory_order_relaxed);
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // The frame just copied is only rewritten once the analyzer starts on published + 2
+        if (writing_.load(std::memory_order_relaxed) - published <= 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SpectrumAnalyzer::run() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            // Idle analyzers sleep until read() is called again instead of polling
+            if (active_.load(std::memory_order_relaxed)) {
+                wake_cv_.wait_for(lock, kInterval, [this] { return stop_; });
+            } else {
+                wake_cv_.wait(lock, [this] {
+                    return stop_ || active_.load(std::memory_order_relaxed);
+                });
+            }
+            if (stop_) {
+                return;
+            }
+        }
+
+        if (!active_.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        if (now_ns() - last_read_ns_.load(std::memory_order_relaxed) > kIdleAfterNs) {
+            active_.store(false, std::memory_order_relaxed);
+            continue;
+        }
+        if (capture(input_.data())) {
+            analyze();
+            publish();
+        }
+    }
+}
+
+// Copies the latest SPECTRUM_FFT_SIZE samples; false if there is nothing new or the audio
+// thread overwrote part of the window during the copy
+bool SpectrumAnalyzer::capture(float *window) {
+    uint64_t end = written_.load(std::memory_order_acquire);
+    if (end < SPECTRUM_FFT_SIZE || end == analyzed_up_to_) {
+        return false;
+    }
+    uint64_t start = end - SPECTRUM_FFT_SIZE;
+    for (int i = 0; i < SPECTRUM_FFT_SIZE; ++i) {
+        window[i] = ring_[(start + i) & (kRingSize - 1)].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (written_.load(std::memory_order_relaxed) - start > kRingSize) {
+        return false;
+    }
+    analyzed_up_to_ = end;
+    return true;
+}
+
+void SpectrumAnalyzer::analyze() {
+    float *re = re_.data();
+    float *im = im_.data();
+
+    // Window, then pack even/odd samples into the real/imaginary parts in bit-reversed order
+    for (int i = 0; i < SPECTRUM_FFT_SIZE; i += 4) {
+        store4(&input_[i], load4(&input_[i]) * load4(&window_[i]));
+    }
+    for (int i = 0; i < kComplexSize; ++i) {
+        re[bit_reverse_[i]] = input_[2 * i];
+        im[bit_reverse_[i]] = input_[2 * i + 1];
+    }
+
+    // Radix-2 butterflies; stages with at least 4 butterflies per group run 4 at a time
+    for (int h = 1; h < kComplexSize; h <<= 1) {
+        const float *wr = &twiddle_re_[h - 1];
+        const float *wi = &twiddle_im_[h - 1];
+        for (int g = 0; g < kComplexSize; g += 2 * h) {
+            if (h >= 4) {
+                for (int j = 0; j < h; j += 4) {
+                    v4sf ar = load4(re + g + j), ai = load4(im + g + j);
+                    v4sf br = load4(re + g + h + j), bi = load4(im + g + h + j);
+                    v4sf c = load4(wr + j), s = load4(wi + j);
+                    v4sf tr = br * c - bi * s;
+                    v4sf ti = br * s + bi * c;
+                    store4(re + g + j, ar + tr);
+                    store4(im + g + j, ai + ti);
+                    store4(re + g + h + j, ar - tr);
+                    store4(im + g + h + j, ai - ti);
+                }
+            } else {
+                for (int j = 0; j < h; ++j) {
+                    float br = re[g + h + j], bi = im[g + h + j];
+                    float tr = br * wr[j] - bi * wi[j];
+                    float ti = br * wi[j] + bi * wr[j];
+                    re[g + h + j] = re[g + j] - tr;
+                    im[g + h + j] = im[g + j] - ti;
+                    re[g + j] += tr;
+                    im[g + j] += ti;
+                }
+            }
+        }
+    }
+
+    // Split into the real FFT: X[k] = E[k] + e^(-2 pi i k / N) O[k], then smooth and map to 0..1
+    const float scale = 1.0f / SPECTRUM_FFT_SIZE;
+    const float db_range = kMaxDecibels - kMinDecibels;
+    for (int k = 0; k < SPECTRUM_BINS; ++k) {
+        int m = (kComplexSize - k) & (kComplexSize - 1);
+        float er = 0.5f * (re[k] + re[m]);
+        float ei = 0.5f * (im[k] - im[m]);
+        float or_ = 0.5f * (im[k] + im[m]);
+        float oi = -0.5f * (re[k] - re[m]);
+        float c = split_cos_[k], s = split_sin_[k];
+        float xr = er + c * or_ + s * oi;
+        float xi = ei + c * oi - s * or_;
+
+        float magnitude = std::sqrt(xr * xr + xi * xi) * scale;
+        smoothed_[k] = kSmoothing * smoothed_[k] + (1.0f - kSmoothing) * magnitude;
+        float db = smoothed_[k] > 0.0f ? 20.0f * std::log10(smoothed_[k]) : kMinDecibels;
+        normalized_[k] = std::min(1.0f, std::max(0.0f, (db - kMinDecibels) / db_range));
+    }
+}
+
+void SpectrumAnalyzer::publish() {
+    uint32_t next = published_.load(std::memory_order_relaxed) + 1;
+    writing_.store(next, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    Frame &frame = frames_[next & 1];
+    for (int i = 0; i < SPECTRUM_BINS; ++i) {
+        frame.magnitudes[i].store(normalized_[i], std::memory_order_relaxed);
+    }
+    for (int b = 0; b < SPECTRUM_BANDS; ++b) {
+        float sum = 0.0f;
+        for (uint32_t k = band_edges_[b]; k < band_edges_[b + 1]; ++k) {
+            sum += normalized_[k];
+        }
+        uint32_t width = band_edges_[b + 1] - band_edges_[b];
+        frame.bands[b].store(width > 0 ? sum / width : 0.0f, std::memory_order_relaxed);
+    }
+    published_.store(next, std::memory_order_release);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define SPECTRUM_FFT_SIZE 2048
+#define SPECTRUM_BINS (SPECTRUM_FFT_SIZE / 2)
+#define SPECTRUM_BANDS 64
+
+// Spectrum of a synth's output for the Spectrogram composable.
+//
+// The audio thread tap()s every rendered period into a lock-free ring holding the most recent
+// samples. A background thread takes the latest SPECTRUM_FFT_SIZE samples about 60 times a
+// second, applies a window and a real FFT, and publishes magnitudes and 64 log-spaced bands
+// double-buffered. Windowing and scaling follow the Web Audio AnalyserNode used on WASM
+// (Blackman window, 1/N scaling, 0.8 time smoothing, -100..-30 dB mapped to 0..1), so both
+// platforms look alike.
+//
+// The FFT packs the real input into a half-size complex FFT and runs its butterflies on 4-wide
+// GCC/Clang vector types, which compile to NEON on ARM and SSE on x86.
+//
+// Analysis only runs while someone is reading: when read() has not been called for a second the
+// tap goes idle and the thread sleeps without a timeout until the next read().
+class SpectrumAnalyzer {
+public:
+    explicit SpectrumAnalyzer(int sample_rate);
+    ~SpectrumAnalyzer();
+
+    SpectrumAnalyzer(const SpectrumAnalyzer &) = delete;
+    SpectrumAnalyzer &operator=(const SpectrumAnalyzer &) = delete;
+
+    // Audio thread: appends the mono mix of one period. Never blocks.
+    void tap(const float *left, const float *right, int frames);
+
+    // Any thread: copies the latest published spectrum. Either array may be null; magnitudes
+    // holds SPECTRUM_BINS values and bands SPECTRUM_BANDS, all normalized to 0..1. Returns
+    // false if nothing has been published yet.
+    bool read(float *magnitudes, float *bands);
+
+    int sample_rate() const { return sample_rate_; }
+
+private:
+    struct Frame {
+        std::atomic<float> magnitudes[SPECTRUM_BINS];
+        std::atomic<float> bands[SPECTRUM_BANDS];
+    };
+
+    void run();
+    bool capture(float *window);
+    void analyze();
+    void publish();
+
+    int sample_rate_;
+
+    // Most recent samples, written by the audio thread only
+    static constexpr uint32_t kRingSize = SPECTRUM_FFT_SIZE * 4;
+    std::vector<std::atomic<float>> ring_;
+    std::atomic<uint64_t> written_{0};
+    uint64_t analyzed_up_to_ = 0;
+
+    // Analysis state, background thread only
+    std::vector<float> window_;
+    std::vector<float> input_;
+    std::vector<float> re_;
+    std::vector<float> im_;
+    std::vector<float> twiddle_re_;
+    std::vector<float> twiddle_im_;
+    std::vector<float> split_cos_;
+    std::vector<float> split_sin_;
+    std::vector<uint32_t> bit_reverse_;
+    std::vector<float> smoothed_;
+    std::vector<float> normalized_;
+    std::vector<uint32_t> band_edges_;
+
+    // Double-buffered output. frames_[published_ & 1] is the latest spectrum; the analyzer fills
+    // the other frame, announcing it in writing_ first so a reader can tell whether its copy
+    // raced with a write to the frame it was reading.
+    Frame frames_[2];
+    std::atomic<uint32_t> published_{0};
+    std::atomic<uint32_t> writing_{0};
+
+    std::atomic<bool> active_{false};
+    std::atomic<int64_t> last_read_ns_{0};
+    std::mutex wake_mutex_;
+    std::condition_variable wake_cv_;
+    bool stop_ = false;
+    std::thread thread_;
+};
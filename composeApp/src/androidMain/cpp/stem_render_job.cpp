@@ -0,0 +1,509 @@
+#include "stem_render_job.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <unistd.h>
+
+#include "midi_event.h"
+
+#ifdef __ANDROID__
+#include <android/log.h>
+
+#define LOG_TAG "FluidSynthJNI"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#else
+#define LOGI(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#define LOGE(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#endif
+
+#define MIDI_CHANNELS 16
+// Standard MIDI File default: 120 BPM until the first tempo event
+#define SMF_DEFAULT_TEMPO_US 500000
+
+namespace {
+
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char *format_extension(int format) {
+    switch (format) {
+        case EXPORT_FORMAT_FLAC:
+            return "flac";
+        case EXPORT_FORMAT_OGG:
+            return "ogg";
+        default:
+            return "wav";
+    }
+}
+
+// Bounds-checked reads from a chunk of the file; each returns false past end
+struct SmfReader {
+    const uint8_t *data;
+    size_t pos;
+    size_t end;
+
+    bool byte(uint8_t *value) {
+        if (pos >= end) return false;
+        *value = data[pos++];
+        return true;
+    }
+
+    bool skip(uint32_t count) {
+        if (count > end - pos) return false;
+        pos += count;
+        return true;
+    }
+
+    // Variable-length quantity: at most four bytes, seven bits each
+    bool vlq(uint32_t *value) {
+        *value = 0;
+        for (int i = 0; i < 4; ++i) {
+            uint8_t b;
+            if (!byte(&b)) return false;
+            *value = (*value << 7) | (b & 0x7f);
+            if (!(b & 0x80)) return true;
+        }
+        return false;
+    }
+};
+
+uint32_t read_be(const uint8_t *p, int bytes) {
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+// A channel message, or a tempo change when tempo_us is non-zero, at an absolute tick
+struct SmfEvent {
+    uint64_t tick;
+    uint32_t event;
+    uint32_t tempo_us;
+};
+
+// Appends the events of one MTrk chunk. A truncated or corrupt track keeps the events read up
+// to the damage, the way players treat them.
+void parse_track(SmfReader reader, std::vector<SmfEvent> *events) {
+    uint64_t tick = 0;
+    uint8_t running = 0;
+    uint32_t delta;
+    while (reader.vlq(&delta)) {
+        tick += delta;
+        uint8_t status;
+        if (!reader.byte(&status)) return;
+
+        if (status == 0xff) {
+            uint8_t type;
+            uint32_t length;
+            if (!reader.byte(&type) || !reader.vlq(&length) || length > reader.end - reader.pos) {
+                return;
+            }
+            if (type == 0x2f) return;
+            if (type == 0x51 && length == 3) {
+                uint32_t tempo = read_be(reader.data + reader.pos, 3);
+                if (tempo > 0) {
+                    events->push_back({tick, 0, tempo});
+                }
+            }
+            reader.pos += length;
+            running = 0;
+            continue;
+        }
+        if (status == 0xf0 || status == 0xf7) {
+            uint32_t length;
+            if (!reader.vlq(&length) || !reader.skip(length)) return;
+            running = 0;
+            continue;
+        }
+
+        uint8_t data1;
+        if (status & 0x80) {
+            // System common and realtime messages do not belong in a file
+            if (status >= 0xf0 || !reader.byte(&data1)) return;
+            running = status;
+        } else {
+            if (!running) return;
+            data1 = status;
+            status = running;
+        }
+        uint8_t data2 = 0;
+        int type = status & 0xf0;
+        if (type != MIDI_PROGRAM_CHANGE && type != MIDI_CHANNEL_PRESSURE &&
+            !reader.byte(&data2)) {
+            return;
+        }
+        events->push_back({tick, pack_midi_event(status, data1, data2), 0});
+    }
+}
+
+} // namespace
+
+bool StemRenderJob::parse_midi(const uint8_t *data, size_t size, int sample_rate,
+                               std::vector<StemEvent> *channels, int64_t *end_frame) {
+    if (size < 14 || memcmp(data, "MThd", 4) != 0) {
+        LOGE("Not a Standard MIDI File (%zu bytes)", size);
+        return false;
+    }
+    uint32_t header_length = read_be(data + 4, 4);
+    int division = static_cast<int>(read_be(data + 12, 2));
+    if (header_length < 6 || division == 0) {
+        LOGE("Invalid MIDI file header");
+        return false;
+    }
+
+    std::vector<SmfEvent> events;
+    size_t pos = 8 + static_cast<size_t>(std::min<uint32_t>(header_length, size - 8));
+    int tracks = 0;
+    while (size - pos >= 8) {
+        size_t length = std::min<size_t>(read_be(data + pos + 4, 4), size - pos - 8);
+        if (memcmp(data + pos, "MTrk", 4) == 0) {
+            parse_track({data, pos + 8, pos + 8 + length}, &events);
+            ++tracks;
+        }
+        pos += 8 + length;
+    }
+    if (tracks == 0) {
+        LOGE("MIDI file has no tracks");
+        return false;
+    }
+
+    // Tracks play at once: merge them by tick, keeping each track's order and, on equal ticks,
+    // the order of the tracks
+    std::stable_sort(events.begin(), events.end(), [](const SmfEvent &a, const SmfEvent &b) {
+        return a.tick < b.tick;
+    });
+
+    // SMPTE divisions count ticks per second and ignore tempo events
+    bool smpte = (division & 0x8000) != 0;
+    double ticks_per_second = 0.0;
+    if (smpte) {
+        int fps = -static_cast<int8_t>(division >> 8);
+        ticks_per_second = (fps == 29 ? 29.97 : fps) * (division & 0xff);
+        if (ticks_per_second <= 0.0) {
+            LOGE("Invalid SMPTE division 0x%04x", division);
+            return false;
+        }
+    }
+    double frames_per_tick = smpte ? sample_rate / ticks_per_second
+                                   : SMF_DEFAULT_TEMPO_US * 1e-6 * sample_rate / division;
+
+    double frame = 0.0;
+    uint64_t tick = 0;
+    *end_frame = 0;
+    for (const SmfEvent &event : events) {
+        frame += static_cast<double>(event.tick - tick) * frames_per_tick;
+        tick = event.tick;
+        int64_t at = static_cast<int64_t>(std::llround(frame));
+        *end_frame = at;
+        if (event.tempo_us != 0) {
+            if (!smpte) {
+                frames_per_tick = event.tempo_us * 1e-6 * sample_rate / division;
+            }
+            continue;
+        }
+        channels[event.event & 0x0f].push_back({at, event.event});
+    }
+    return true;
+}
+
+StemRenderJob *StemRenderJob::start(const uint8_t *midi, size_t size, const std::string &prefix,
+                                    int format, bool mix, int sample_rate,
+                                    stem_synth_func_t create_synth) {
+    std::vector<StemEvent> channels[MIDI_CHANNELS];
+    int64_t end_frame;
+    if (!parse_midi(midi, size, sample_rate, channels, &end_frame)) {
+        return nullptr;
+    }
+
+    auto *job = new(std::nothrow) StemRenderJob(sample_rate, std::move(create_synth));
+    if (!job) {
+        return nullptr;
+    }
+    const char *extension = format_extension(format);
+    for (int chan = 0; chan < MIDI_CHANNELS; ++chan) {
+        bool has_notes = std::any_of(channels[chan].begin(), channels[chan].end(),
+                                     [](const StemEvent &e) {
+                                         return (e.event & 0xf0) == MIDI_NOTE_ON &&
+                                                ((e.event >> 16) & 0x7f) != 0;
+                                     });
+        if (!has_notes) {
+            continue;
+        }
+        Stem stem;
+        stem.channel = chan;
+        stem.events = std::move(channels[chan]);
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), "_ch%02d.", chan + 1);
+        stem.path = prefix + suffix + extension;
+        job->stems_.push_back(std::move(stem));
+    }
+    if (job->stems_.empty()) {
+        LOGE("MIDI file has no notes to render");
+        delete job;
+        return nullptr;
+    }
+    job->total_frames_ = end_frame + static_cast<int64_t>(STEM_TAIL_SECONDS) * sample_rate;
+
+    for (Stem &stem : job->stems_) {
+        stem.file = open_export_file(stem.path.c_str(), format, sample_rate);
+        if (!stem.file) {
+            job->failed_.store(true, std::memory_order_release);
+            break;
+        }
+    }
+    if (mix && !job->failed_.load(std::memory_order_acquire)) {
+        job->mix_path_ = prefix + "_mix." + extension;
+        job->mix_file_ = open_export_file(job->mix_path_.c_str(), format, sample_rate);
+        if (!job->mix_file_) {
+            job->failed_.store(true, std::memory_order_release);
+        } else {
+            job->mix_buffer_.resize(STEM_CHUNK_FRAMES * 2);
+        }
+    }
+    if (job->failed_.load(std::memory_order_acquire)) {
+        job->close_files();
+        delete job;
+        return nullptr;
+    }
+
+    unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    job->threads_ = static_cast<int>(std::min<size_t>(job->stems_.size(), cpus));
+    job->next_stem_ = job->stems_.size();
+    job->thread_ = std::thread(&StemRenderJob::run, job);
+    LOGI("Stem render started: %zu stems on %d threads, %lld frames%s", job->stems_.size(),
+         job->threads_, static_cast<long long>(job->total_frames_), mix ? ", with mix" : "");
+    return job;
+}
+
+StemRenderJob::StemRenderJob(int sample_rate, stem_synth_func_t create_synth)
+        : sample_rate_(sample_rate), create_synth_(std::move(create_synth)) {}
+
+StemRenderJob::~StemRenderJob() {
+    cancel();
+    wait();
+}
+
+void StemRenderJob::cancel() {
+    cancelled_.store(true, std::memory_order_release);
+}
+
+void StemRenderJob::wait() {
+    if (thread_.joinable()) thread_.join();
+}
+
+double StemRenderJob::progress() const {
+    if (total_frames_ <= 0) {
+        return 1.0;
+    }
+    return static_cast<double>(frames_written_.load(std::memory_order_relaxed)) / total_frames_;
+}
+
+void StemRenderJob::report(double *fields) const {
+    int mask = 0;
+    for (const Stem &stem : stems_) {
+        mask |= 1 << stem.channel;
+    }
+    double wall_ms = wall_ns_.load(std::memory_order_acquire) / 1e6;
+    double render_ms = render_ns_.load(std::memory_order_acquire) / 1e6;
+    fields[STEM_REPORT_STEMS] = static_cast<double>(stems_.size());
+    fields[STEM_REPORT_THREADS] = threads_;
+    fields[STEM_REPORT_CHANNEL_MASK] = mask;
+    fields[STEM_REPORT_FRAMES] = static_cast<double>(total_frames_);
+    fields[STEM_REPORT_WALL_MS] = wall_ms;
+    fields[STEM_REPORT_RENDER_MS] = render_ms;
+    fields[STEM_REPORT_SCALING] = wall_ms > 0.0 ? render_ms / wall_ms : 0.0;
+    fields[STEM_REPORT_REALTIME_FACTOR] =
+            wall_ms > 0.0 ? static_cast<double>(total_frames_) / sample_rate_ / (wall_ms / 1e3)
+                          : 0.0;
+}
+
+void StemRenderJob::fail(const char *reason) {
+    LOGE("Stem render failed: %s", reason);
+    failed_.store(true, std::memory_order_release);
+    cancel();
+}
+
+void StemRenderJob::close_files() {
+    bool keep = !failed_.load(std::memory_order_acquire) &&
+                !cancelled_.load(std::memory_order_acquire);
+    for (Stem &stem : stems_) {
+        if (stem.file) {
+            sf_close(stem.file);
+            stem.file = nullptr;
+            if (!keep) unlink(stem.path.c_str());
+        }
+    }
+    if (mix_file_) {
+        sf_close(mix_file_);
+        mix_file_ = nullptr;
+        if (!keep) unlink(mix_path_.c_str());
+    }
+}
+
+void StemRenderJob::run() {
+    for (int i = 0; i < threads_; ++i) {
+        workers_.emplace_back(&StemRenderJob::worker_loop, this);
+    }
+
+    start_round(-1);
+    wait_round();
+
+    int rounds = static_cast<int>((total_frames_ + STEM_CHUNK_FRAMES - 1) / STEM_CHUNK_FRAMES);
+    int64_t started = now_ns();
+    if (rounds > 0 && !cancelled_.load(std::memory_order_acquire)) {
+        start_round(0);
+    }
+    for (int round = 0; round < rounds && !cancelled_.load(std::memory_order_acquire); ++round) {
+        wait_round();
+        if (cancelled_.load(std::memory_order_acquire)) {
+            break;
+        }
+        // Workers fill the other buffer of every stem while this round is mixed
+        if (round + 1 < rounds) {
+            start_round(round + 1);
+        }
+        if (mix_file_) {
+            write_mix(round);
+        }
+        int64_t frames = std::min<int64_t>(STEM_CHUNK_FRAMES,
+                                           total_frames_ - int64_t{round} * STEM_CHUNK_FRAMES);
+        frames_written_.fetch_add(frames, std::memory_order_relaxed);
+    }
+    // A round started before a cancel is still claimed by the workers
+    wait_round();
+    wall_ns_.store(now_ns() - started, std::memory_order_release);
+
+    {
+        std::lock_guard<std::mutex> lock(round_mutex_);
+        quit_ = true;
+        round_cv_.notify_all();
+    }
+    for (std::thread &worker : workers_) {
+        worker.join();
+    }
+
+    int64_t render_ns = 0;
+    for (Stem &stem : stems_) {
+        render_ns += stem.render_ns;
+        if (stem.synth) {
+            fluid_settings_t *settings = fluid_synth_get_settings(stem.synth);
+            delete_fluid_synth(stem.synth);
+            delete_fluid_settings(settings);
+            stem.synth = nullptr;
+        }
+    }
+    render_ns_.store(render_ns, std::memory_order_release);
+
+    close_files();
+    if (failed_.load(std::memory_order_acquire)) {
+        status_.store(EXPORT_FAILED, std::memory_order_release);
+    } else if (cancelled_.load(std::memory_order_acquire)) {
+        LOGI("Stem render cancelled");
+        status_.store(EXPORT_CANCELLED, std::memory_order_release);
+    } else {
+        double fields[STEM_REPORT_FIELDS];
+        report(fields);
+        LOGI("Stem render finished: %d stems, %.0f ms, %.2fx scaling on %d threads, %.1fx realtime",
+             static_cast<int>(stems_.size()), fields[STEM_REPORT_WALL_MS],
+             fields[STEM_REPORT_SCALING], threads_, fields[STEM_REPORT_REALTIME_FACTOR]);
+        status_.store(EXPORT_DONE, std::memory_order_release);
+    }
+}
+
+void StemRenderJob::worker_loop() {
+    std::unique_lock<std::mutex> lock(round_mutex_);
+    while (true) {
+        round_cv_.wait(lock, [this] { return quit_ || next_stem_ < stems_.size(); });
+        if (quit_) {
+            return;
+        }
+        Stem &stem = stems_[next_stem_++];
+        int round = round_;
+        lock.unlock();
+        // After a cancel stems are still claimed, so the round ends without rendering
+        if (!cancelled_.load(std::memory_order_acquire)) {
+            run_task(stem, round);
+        }
+        lock.lock();
+        if (--pending_ == 0) {
+            done_cv_.notify_one();
+        }
+    }
+}
+
+void StemRenderJob::start_round(int round) {
+    std::lock_guard<std::mutex> lock(round_mutex_);
+    round_ = round;
+    next_stem_ = 0;
+    pending_ = stems_.size();
+    round_cv_.notify_all();
+}
+
+void StemRenderJob::wait_round() {
+    std::unique_lock<std::mutex> lock(round_mutex_);
+    done_cv_.wait(lock, [this] { return pending_ == 0; });
+}
+
+void StemRenderJob::run_task(Stem &stem, int round) {
+    if (round < 0) {
+        stem.synth = create_synth_();
+        if (!stem.synth) {
+            fail("cannot create a stem synth");
+            return;
+        }
+        stem.buffers[0].resize(STEM_CHUNK_FRAMES * 2);
+        stem.buffers[1].resize(STEM_CHUNK_FRAMES * 2);
+        return;
+    }
+
+    float *out = stem.buffers[round % 2].data();
+    int64_t start = int64_t{round} * STEM_CHUNK_FRAMES;
+    int64_t end = std::min<int64_t>(start + STEM_CHUNK_FRAMES, total_frames_);
+    int64_t started = now_ns();
+    // Events apply at their frame, which FluidSynth rounds up to its next internal block
+    int64_t pos = start;
+    while (pos < end) {
+        while (stem.next_event < stem.events.size() && stem.events[stem.next_event].frame <= pos) {
+            apply_midi_event(stem.synth, stem.events[stem.next_event++].event);
+        }
+        int64_t split = end;
+        if (stem.next_event < stem.events.size()) {
+            split = std::min(end, stem.events[stem.next_event].frame);
+        }
+        float *frame = out + (pos - start) * 2;
+        fluid_synth_write_float(stem.synth, static_cast<int>(split - pos), frame, 0, 2, frame, 1, 2);
+        pos = split;
+    }
+    stem.render_ns += now_ns() - started;
+
+    sf_count_t frames = end - start;
+    if (sf_writef_float(stem.file, out, frames) != frames) {
+        fail(sf_strerror(stem.file));
+    }
+}
+
+// FluidSynth mixes voices, reverb and chorus linearly, so the stems' sum is the file as one synth
+// plays it, up to polyphony limits
+void StemRenderJob::write_mix(int round) {
+    int64_t start = int64_t{round} * STEM_CHUNK_FRAMES;
+    sf_count_t frames = std::min<int64_t>(STEM_CHUNK_FRAMES, total_frames_ - start);
+    float *mix = mix_buffer_.data();
+    std::fill(mix, mix + frames * 2, 0.0f);
+    for (const Stem &stem : stems_) {
+        const float *in = stem.buffers[round % 2].data();
+        for (sf_count_t i = 0; i < frames * 2; ++i) {
+            mix[i] += in[i];
+        }
+    }
+    if (sf_writef_float(mix_file_, mix, frames) != frames) {
+        fail(sf_strerror(mix_file_));
+    }
+}
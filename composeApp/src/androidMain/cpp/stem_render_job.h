@@ -0,0 +1,143 @@
+#pragma once
+
+#include <fluidsynth.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "export_job.h"
+#include "sndfile_api.h"
+
+// Frames every stem renders per round; the mix is summed and written round by round
+#define STEM_CHUNK_FRAMES 16384
+// Rendered after the last event so releases and reverb tails are not cut off
+#define STEM_TAIL_SECONDS 2
+
+// Layout of the array filled by getStemRenderReport
+#define STEM_REPORT_STEMS 0
+#define STEM_REPORT_THREADS 1
+#define STEM_REPORT_CHANNEL_MASK 2    // bit n set when MIDI channel n has a stem
+#define STEM_REPORT_FRAMES 3          // length of every stem
+#define STEM_REPORT_WALL_MS 4         // rendering and encoding, from the first round to the last
+#define STEM_REPORT_RENDER_MS 5       // sum over the stems of the time spent in FluidSynth
+#define STEM_REPORT_SCALING 6         // RENDER_MS / WALL_MS: the stems rendering at once
+#define STEM_REPORT_REALTIME_FACTOR 7 // seconds of audio per second of wall time
+#define STEM_REPORT_FIELDS 8
+
+// Creates one stem's synth with the source synth's settings and SoundFonts, or returns nullptr.
+// Called on the worker threads, one stem at a time per thread. The job deletes the synth and
+// then its settings (fluid_synth_get_settings()).
+typedef std::function<fluid_synth_t *()> stem_synth_func_t;
+
+// Renders a Standard MIDI File as one audio file per MIDI channel, on a pool of independent
+// synths. The file is parsed once, in start(); every channel with a note becomes a stem and
+// keeps its channel number, so channel 10 still plays drums. Each stem gets its own synth
+// (synth.cpu-cores 1), which loads the same SoundFonts; the mmap loader shares their parsed
+// banks, so this costs new preset objects, not a second parse.
+//
+// Stems render on up to one thread per CPU, in rounds of STEM_CHUNK_FRAMES: each worker takes
+// the next stem of the round, renders its chunk and encodes it to the stem's file. With a mix,
+// the job thread sums a finished round and writes it to the mix file while the workers render
+// the next one, so memory stays at two chunks per stem however long the file is. Every stem, and
+// the mix, is as long as the file plus STEM_TAIL_SECONDS.
+class StemRenderJob {
+public:
+    // Parses midi, opens "<prefix>_chNN.<ext>" for every stem (NN the 1-based channel) and,
+    // with mix, "<prefix>_mix.<ext>", then starts rendering. format is one of EXPORT_FORMAT_*.
+    // Returns nullptr if midi is not a Standard MIDI File, has no notes, or a file cannot be
+    // opened; files already opened are deleted again.
+    static StemRenderJob *start(const uint8_t *midi, size_t size, const std::string &prefix,
+                                int format, bool mix, int sample_rate,
+                                stem_synth_func_t create_synth);
+
+    // Cancels a running job and waits for its threads
+    ~StemRenderJob();
+
+    StemRenderJob(const StemRenderJob &) = delete;
+    StemRenderJob &operator=(const StemRenderJob &) = delete;
+
+    // Stops after the current round; every partial file is deleted
+    void cancel();
+
+    // Waits for the job to finish. Not thread-safe against itself.
+    void wait();
+
+    // EXPORT_RUNNING, EXPORT_DONE, EXPORT_CANCELLED or EXPORT_FAILED
+    int status() const { return status_.load(std::memory_order_acquire); }
+
+    // Fraction of frames written, 0..1
+    double progress() const;
+
+    // Fills STEM_REPORT_FIELDS values; the timings are final once status() is EXPORT_DONE
+    void report(double *fields) const;
+
+private:
+    struct StemEvent {
+        int64_t frame;
+        uint32_t event;
+    };
+
+    struct Stem {
+        int channel = 0;
+        std::vector<StemEvent> events;
+        size_t next_event = 0;
+        std::string path;
+        SNDFILE *file = nullptr;
+        fluid_synth_t *synth = nullptr;
+        std::vector<float> buffers[2];
+        int64_t render_ns = 0;
+    };
+
+    StemRenderJob(int sample_rate, stem_synth_func_t create_synth);
+
+    // Splits the file's channel messages by channel, timed in frames; false if it is not a
+    // Standard MIDI File. Returns the frame of the last event in *end_frame.
+    static bool parse_midi(const uint8_t *data, size_t size, int sample_rate,
+                           std::vector<StemEvent> *channels, int64_t *end_frame);
+
+    void close_files();
+    void fail(const char *reason);
+
+    void run();
+    void worker_loop();
+    void start_round(int round);
+    void wait_round();
+    void run_task(Stem &stem, int round);
+    void write_mix(int round);
+
+    int sample_rate_;
+    stem_synth_func_t create_synth_;
+    std::vector<Stem> stems_;
+    int64_t total_frames_ = 0;
+    std::string mix_path_;
+    SNDFILE *mix_file_ = nullptr;
+    std::vector<float> mix_buffer_;
+    int threads_ = 0;
+
+    // Round dispatch: round -1 creates the synths, round k >= 0 renders the frames from
+    // k * STEM_CHUNK_FRAMES. Workers claim stems under round_mutex_ until next_stem_ reaches
+    // the stem count; pending_ counts the ones not finished yet.
+    int round_ = -1;
+    size_t next_stem_ = 0;
+    size_t pending_ = 0;
+    bool quit_ = false;
+    std::mutex round_mutex_;
+    std::condition_variable round_cv_;
+    std::condition_variable done_cv_;
+
+    std::atomic<bool> cancelled_{false};
+    std::atomic<bool> failed_{false};
+    std::atomic<int64_t> frames_written_{0};
+    std::atomic<int> status_{EXPORT_RUNNING};
+    std::atomic<int64_t> wall_ns_{0};
+    std::atomic<int64_t> render_ns_{0};
+
+    std::vector<std::thread> workers_;
+    std::thread thread_;
+};
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+// Epoch-based reclamation for objects that are looked up without locks.
+//
+// Readers bracket every access with an EpochGuard. Writers unpublish an object first and then
+// retire it; the object is only deleted once every reader that could still have seen it has
+// left its critical section.
+class EpochDomain {
+public:
+    static EpochDomain &instance() {
+        static EpochDomain domain;
+        return domain;
+    }
+
+    // Enters a read-side critical section. Wait-free once the calling thread is registered.
+    void enter() {
+        ThreadState &state = thread_state();
+        if (state.depth++ > 0) {
+            return;
+        }
+        if (!state.reader) {
+            state.reader = acquire_reader();
+        }
+        state.reader->epoch.store(global_epoch_.load(std::memory_order_relaxed),
+                                  std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void exit() {
+        ThreadState &state = thread_state();
+        if (--state.depth == 0) {
+            state.reader->epoch.store(kIdle, std::memory_order_release);
+        }
+    }
+
+    // Schedules an already unpublished object for deletion.
+    template<typename T>
+    void retire(T *object) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t epoch = global_epoch_.fetch_add(1, std::memory_order_acq_rel);
+        std::lock_guard<std::mutex> lock(retire_mutex_);
+        retired_.push_back({object, [](void *p) { delete static_cast<T *>(p); }, epoch});
+    }
+
+    // Deletes every retired object no reader can still observe. Returns the number still pending.
+    size_t reclaim() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t min_active = kIdle;
+        for (Reader *r = readers_.load(std::memory_order_acquire); r; r = r->next) {
+            uint64_t epoch = r->epoch.load(std::memory_order_acquire);
+            if (epoch < min_active) {
+                min_active = epoch;
+            }
+        }
+
+        std::vector<Retired> ready;
+        size_t pending;
+        {
+            std::lock_guard<std::mutex> lock(retire_mutex_);
+            auto keep = retired_.begin();
+            for (auto &item : retired_) {
+                if (item.epoch < min_active) {
+                    ready.push_back(item);
+                } else {
+                    *keep++ = item;
+                }
+            }
+            retired_.erase(keep, retired_.end());
+            pending = retired_.size();
+        }
+        for (auto &item : ready) {
+            item.deleter(item.object);
+        }
+        return pending;
+    }
+
+private:
+    static constexpr uint64_t kIdle = std::numeric_limits<uint64_t>::max();
+
+    struct Reader {
+        std::atomic<uint64_t> epoch{kIdle};
+        std::atomic<bool> in_use{true};
+        Reader *next = nullptr;
+    };
+
+    struct ThreadState {
+        Reader *reader = nullptr;
+        uint32_t depth = 0;
+
+        ~ThreadState() {
+            if (reader) {
+                reader->epoch.store(kIdle, std::memory_order_release);
+                reader->in_use.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    struct Retired {
+        void *object;
+        void (*deleter)(void *);
+        uint64_t epoch;
+    };
+
+    static ThreadState &thread_state() {
+        thread_local ThreadState state;
+        return state;
+    }
+
+    // Reader records are never freed; threads that exit hand theirs to the next new thread.
+    Reader *acquire_reader() {
+        for (Reader *r = readers_.load(std::memory_order_acquire); r; r = r->next) {
+            bool expected = false;
+            if (!r->in_use.load(std::memory_order_relaxed) &&
+                r->in_use.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+                return r;
+            }
+        }
+        Reader *reader = new Reader();
+        Reader *head = readers_.load(std::memory_order_relaxed);
+        do {
+            reader->next = head;
+        } while (!readers_.compare_exchange_weak(head, reader, std::memory_order_release,
+                                                 std::memory_order_relaxed));
+        return reader;
+    }
+
+    std::atomic<uint64_t> global_epoch_{1};
+    std::atomic<Reader *> readers_{nullptr};
+    std::mutex retire_mutex_;
+    std::vector<Retired> retired_;
+};
+
+// RAII read-side critical section on the process-wide epoch domain.
+class EpochGuard {
+public:
+    EpochGuard() { EpochDomain::instance().enter(); }
+    ~EpochGuard() { EpochDomain::instance().exit(); }
+    EpochGuard(const EpochGuard &) = delete;
+    EpochGuard &operator=(const EpochGuard &) = delete;
+};
+
+// Fixed-capacity table mapping generation-tagged handles (jlong on the Kotlin side) to objects.
+//
+// A handle packs (generation << 32) | (slot + 1), so it is always positive and a stale handle
+// to a reused slot never resolves. find() is wait-free and must be called inside an EpochGuard;
+// insert() and remove() serialize on a writer-only mutex.
+template<typename T, size_t Capacity>
+class HandleTable {
+public:
+    HandleTable() {
+        for (size_t i = 0; i < Capacity; ++i) {
+            free_slots_.push_back(static_cast<uint32_t>(Capacity - 1 - i));
+        }
+    }
+
+    // Publishes an object and returns its handle, or -1 when the table is full.
+    int64_t insert(T *object) {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        if (free_slots_.empty()) {
+            return -1;
+        }
+        uint32_t index = free_slots_.back();
+        free_slots_.pop_back();
+
+        Slot &slot = slots_[index];
+        uint32_t generation = slot.generation.load(std::memory_order_relaxed);
+        slot.value.store(object, std::memory_order_release);
+        return make_handle(generation, index);
+    }
+
+    T *find(int64_t handle) const {
+        uint32_t index;
+        uint32_t generation;
+        if (!decode(handle, &index, &generation)) {
+            return nullptr;
+        }
+        const Slot &slot = slots_[index];
+        T *object = slot.value.load(std::memory_order_acquire);
+        if (!object || slot.generation.load(std::memory_order_acquire) != generation) {
+            return nullptr;
+        }
+        return object;
+    }
+
+    // Unpublishes a handle and returns the object so the caller can retire it.
+    T *remove(int64_t handle) {
+        uint32_t index;
+        uint32_t generation;
+        if (!decode(handle, &index, &generation)) {
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        Slot &slot = slots_[index];
+        if (slot.generation.load(std::memory_order_relaxed) != generation) {
+            return nullptr;
+        }
+        T *object = slot.value.exchange(nullptr, std::memory_order_acq_rel);
+        if (!object) {
+            return nullptr;
+        }
+        uint32_t next = generation + 1;
+        slot.generation.store(next > kMaxGeneration ? 1 : next, std::memory_order_release);
+        free_slots_.push_back(index);
+        return object;
+    }
+
+    // Calls fn(handle, object) for every published object. Must be called inside an EpochGuard.
+    template<typename Fn>
+    void for_each(Fn &&fn) const {
+        for (uint32_t i = 0; i < Capacity; ++i) {
+            T *object = slots_[i].value.load(std::memory_order_acquire);
+            if (object) {
+                fn(make_handle(slots_[i].generation.load(std::memory_order_acquire), i), object);
+            }
+        }
+    }
+
+private:
+    static constexpr uint32_t kMaxGeneration = 0x7fffffff;
+
+    struct Slot {
+        std::atomic<T *> value{nullptr};
+        std::atomic<uint32_t> generation{1};
+    };
+
+    static int64_t make_handle(uint32_t generation, uint32_t index) {
+        return (static_cast<int64_t>(generation) << 32) | static_cast<int64_t>(index + 1);
+    }
+
+    static bool decode(int64_t handle, uint32_t *index, uint32_t *generation) {
+        if (handle <= 0) {
+            return false;
+        }
+        uint32_t low = static_cast<uint32_t>(handle & 0xffffffff);
+        if (low == 0 || low > Capacity) {
+            return false;
+        }
+        *index = low - 1;
+        *generation = static_cast<uint32_t>(handle >> 32);
+        return true;
+    }
+
+    Slot slots_[Capacity];
+    std::mutex write_mutex_;
+    std::vector<uint32_t> free_slots_;
+};
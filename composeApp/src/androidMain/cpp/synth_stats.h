@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+// Layout of the array filled by getStats
+#define STATS_RENDER_CALLS 0
+#define STATS_FRAMES 1
+#define STATS_CPU_LOAD 2              // fluid_synth_get_cpu_load() in hundredths of a percent
+#define STATS_ACTIVE_VOICES 3
+#define STATS_PEAK_VOICES 4
+#define STATS_MISSED_DEADLINES 5      // callbacks that took longer than their period
+#define STATS_XRUNS 6                 // callback gaps longer than the whole output queue
+#define STATS_RENDER_NS_LAST 7
+#define STATS_RENDER_NS_MAX 8
+#define STATS_PERIOD_BUDGET_NS 9
+#define STATS_HISTOGRAM 10            // STATS_HISTOGRAM_BUCKETS counters, see SynthStats
+#define STATS_HISTOGRAM_BUCKETS 12
+#define STATS_FIELDS (STATS_HISTOGRAM + STATS_HISTOGRAM_BUCKETS)
+
+// Render-callback counters for one synth. The audio thread is the only writer and never
+// blocks; readers on other threads see each counter atomically, though not all counters from
+// the same period.
+//
+// The histogram buckets callback duration relative to the period budget on a log2 scale:
+// bucket i counts durations in [2^(i-8), 2^(i-7)) budgets, with the first and last buckets open
+// ended. Buckets 8 and up are missed deadlines.
+class SynthStats {
+public:
+    // Audio thread: one rendered period. active_voices < 0 means it could not be sampled.
+    void record_period(int64_t start_ns, int64_t end_ns, int frames, int sample_rate,
+                       int periods, int active_voices) {
+        int64_t budget_ns = static_cast<int64_t>(frames) * 1000000000LL / sample_rate;
+        int64_t render_ns = end_ns - start_ns;
+
+        bump(render_calls_);
+        frames_.store(frames_.load(std::memory_order_relaxed) + frames, std::memory_order_relaxed);
+        render_ns_last_.store(render_ns, std::memory_order_relaxed);
+        if (render_ns > render_ns_max_.load(std::memory_order_relaxed)) {
+            render_ns_max_.store(render_ns, std::memory_order_relaxed);
+        }
+        budget_ns_.store(budget_ns, std::memory_order_relaxed);
+        if (render_ns > budget_ns) {
+            bump(missed_deadlines_);
+        }
+        if (last_start_ns_ != 0 && start_ns - last_start_ns_ > budget_ns * periods) {
+            bump(xruns_);
+        }
+        last_start_ns_ = start_ns;
+
+        if (active_voices >= 0) {
+            active_voices_.store(active_voices, std::memory_order_relaxed);
+            if (active_voices > peak_voices_.load(std::memory_order_relaxed)) {
+                peak_voices_.store(active_voices, std::memory_order_relaxed);
+            }
+        }
+
+        bump(histogram_[bucket(render_ns, budget_ns)]);
+    }
+
+    // Audio thread: the next period follows a deliberate pause, so its gap is not an xrun
+    void skip_gap() {
+        last_start_ns_ = 0;
+    }
+
+    // Any thread: fills out[STATS_FIELDS]
+    void snapshot(int64_t *out, double cpu_load) const {
+        out[STATS_RENDER_CALLS] = load(render_calls_);
+        out[STATS_FRAMES] = load(frames_);
+        out[STATS_CPU_LOAD] = static_cast<int64_t>(cpu_load * 100.0);
+        out[STATS_ACTIVE_VOICES] = active_voices_.load(std::memory_order_relaxed);
+        out[STATS_PEAK_VOICES] = peak_voices_.load(std::memory_order_relaxed);
+        out[STATS_MISSED_DEADLINES] = load(missed_deadlines_);
+        out[STATS_XRUNS] = load(xruns_);
+        out[STATS_RENDER_NS_LAST] = render_ns_last_.load(std::memory_order_relaxed);
+        out[STATS_RENDER_NS_MAX] = render_ns_max_.load(std::memory_order_relaxed);
+        out[STATS_PERIOD_BUDGET_NS] = budget_ns_.load(std::memory_order_relaxed);
+        for (int i = 0; i < STATS_HISTOGRAM_BUCKETS; ++i) {
+            out[STATS_HISTOGRAM + i] = load(histogram_[i]);
+        }
+    }
+
+private:
+    // Single writer, so a plain load + store is enough and avoids a locked RMW on the audio thread
+    static void bump(std::atomic<uint64_t> &counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    static int64_t load(const std::atomic<uint64_t> &counter) {
+        return static_cast<int64_t>(counter.load(std::memory_order_relaxed));
+    }
+
+    static int bucket(int64_t render_ns, int64_t budget_ns) {
+        if (render_ns <= 0 || budget_ns <= 0) {
+            return 0;
+        }
+        int exponent;
+        std::frexp(static_cast<double>(render_ns) / static_cast<double>(budget_ns), &exponent);
+        // frexp gives ratio = m * 2^exponent with m in [0.5, 1), so floor(log2(ratio)) = exponent - 1
+        int index = exponent - 1 + 8;
+        return index < 0 ? 0 : (index >= STATS_HISTOGRAM_BUCKETS ? STATS_HISTOGRAM_BUCKETS - 1
+                                                                 : index);
+    }
+
+    std::atomic<uint64_t> render_calls_{0};
+    std::atomic<uint64_t> frames_{0};
+    std::atomic<int> active_voices_{0};
+    std::atomic<int> peak_voices_{0};
+    std::atomic<uint64_t> missed_deadlines_{0};
+    std::atomic<uint64_t> xruns_{0};
+    std::atomic<int64_t> render_ns_last_{0};
+    std::atomic<int64_t> render_ns_max_{0};
+    std::atomic<int64_t> budget_ns_{0};
+    std::atomic<uint64_t> histogram_[STATS_HISTOGRAM_BUCKETS] = {};
+    int64_t last_start_ns_ = 0;
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Packed MIDI event (see midi_event.h) due at an absolute position on the audio clock
+struct TimedEvent {
+    uint64_t frame;
+    uint32_t event;
+    uint32_t order;
+};
+
+// Events scheduled ahead of time for the audio thread.
+//
+// Any thread may push(); pushes go through a bounded multi-producer queue with per-cell sequence
+// numbers, so producers never take a lock. The audio thread alone calls collect(), which moves
+// queued events into a preallocated min-heap ordered by frame, then pop_due() in frame order.
+// Events due at the same frame keep their submission order.
+class TimedEventQueue {
+public:
+    explicit TimedEventQueue(uint32_t capacity) : mask_(capacity - 1), cells_(capacity) {
+        for (uint32_t i = 0; i < capacity; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        pending_.reserve(capacity);
+    }
+
+    TimedEventQueue(const TimedEventQueue &) = delete;
+    TimedEventQueue &operator=(const TimedEventQueue &) = delete;
+
+    // Producer side. Returns false when the queue is full.
+    bool push(uint64_t frame, uint32_t event) {
+        uint32_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true) {
+            cell = &cells_[pos & mask_];
+            uint32_t seq = cell->sequence.load(std::memory_order_acquire);
+            int32_t diff = static_cast<int32_t>(seq - pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->frame = frame;
+        cell->event = event;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Audio thread: moves queued events into the pending heap while it has room
+    void collect() {
+        while (pending_.size() < pending_.capacity()) {
+            Cell *cell = &cells_[dequeue_pos_ & mask_];
+            if (cell->sequence.load(std::memory_order_acquire) != dequeue_pos_ + 1) {
+                break;
+            }
+            pending_.push_back({cell->frame, cell->event, next_order_++});
+            std::push_heap(pending_.begin(), pending_.end(), Later());
+            cell->sequence.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+            ++dequeue_pos_;
+        }
+    }
+
+    // Audio thread: frame of the earliest pending event, if any
+    bool next_frame(uint64_t *frame) const {
+        if (pending_.empty()) {
+            return false;
+        }
+        *frame = pending_.front().frame;
+        return true;
+    }
+
+    // Audio thread: removes the earliest pending event if it is due before `frame`
+    bool pop_due(uint64_t frame, TimedEvent *out) {
+        if (pending_.empty() || pending_.front().frame >= frame) {
+            return false;
+        }
+        std::pop_heap(pending_.begin(), pending_.end(), Later());
+        *out = pending_.back();
+        pending_.pop_back();
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<uint32_t> sequence{0};
+        uint64_t frame = 0;
+        uint32_t event = 0;
+    };
+
+    struct Later {
+        bool operator()(const TimedEvent &a, const TimedEvent &b) const {
+            return a.frame != b.frame ? a.frame > b.frame
+                                      : static_cast<int32_t>(a.order - b.order) > 0;
+        }
+    };
+
+    uint32_t mask_;
+    std::vector<Cell> cells_;
+    alignas(64) std::atomic<uint32_t> enqueue_pos_{0};
+    alignas(64) uint32_t dequeue_pos_ = 0;
+    uint32_t next_order_ = 0;
+    std::vector<TimedEvent> pending_;
+};
+
+// Position of the audio thread, published once per period. A reader gets the frame index of the
+// next period to be rendered and the CLOCK_MONOTONIC time at which the audio thread started it,
+// which together map nanosecond timestamps onto frames.
+class AudioClock {
+public:
+    // Audio thread only
+    void publish(uint64_t frame, int64_t time_ns) {
+        uint32_t seq = seq_.load(std::memory_order_relaxed);
+        seq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        frame_.store(frame, std::memory_order_relaxed);
+        time_ns_.store(time_ns, std::memory_order_relaxed);
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    void read(uint64_t *frame, int64_t *time_ns) const {
+        while (true) {
+            uint32_t seq = seq_.load(std::memory_order_acquire);
+            if (seq & 1) {
+                continue;
+            }
+            *frame = frame_.load(std::memory_order_relaxed);
+            *time_ns = time_ns_.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq_.load(std::memory_order_relaxed) == seq) {
+                return;
+            }
+        }
+    }
+
+private:
+    std::atomic<uint32_t> seq_{0};
+    std::atomic<uint64_t> frame_{0};
+    std::atomic<int64_t> time_ns_{0};
+};
@@ -0,0 +1,92 @@
+package org.tetawex.cmpsftdemo
+
+import android.content.Context
+import android.media.AudioManager
+
+/**
+ * Engine parameters fixed when a synth is created (see cpp/engine_config.h).
+ * Passed to [FluidSynthJNI.createSynth] as an int array; native code clamps every value to what
+ * FluidSynth and the device support and [fromArray] reads back what was actually used.
+ */
+data class EngineConfig(
+    /** Output sample rate in Hz; 0 uses the device rate */
+    val sampleRate: Int = 0,
+    /** Frames per audio callback; rounded up to a multiple of the device burst */
+    val periodSize: Int = 256,
+    /** Number of periods queued to the output; latency is periodSize * periods */
+    val periods: Int = 2,
+    val polyphony: Int = 256,
+    /** Threads FluidSynth renders voices on, including the audio thread */
+    val cpuCores: Int = 1,
+    val reverb: Boolean = true,
+    val chorus: Boolean = true,
+    /**
+     * Stereo groups rendered separately, up to 16; MIDI channel c plays in group c % audioGroups.
+     * The output is their mix; see [FluidSynthJNI.getAudioGroupLevels] and
+     * [FluidSynthJNI.readAudioGroup] for the groups themselves
+     */
+    val audioGroups: Int = 1,
+    /** AudioManager PROPERTY_OUTPUT_SAMPLE_RATE, 0 if unknown */
+    val deviceSampleRate: Int = 0,
+    /** AudioManager PROPERTY_OUTPUT_FRAMES_PER_BUFFER, 0 if unknown */
+    val deviceBurst: Int = 0,
+    /**
+     * CPUs the [cpuCores] - 1 render workers are pinned to: a bit mask,
+     * [FluidSynthJNI.CPU_AFFINITY_NONE] or [FluidSynthJNI.CPU_AFFINITY_FAST_CORES] (big cores)
+     */
+    val cpuAffinity: Int = FluidSynthJNI.CPU_AFFINITY_NONE
+) {
+    fun toArray(): IntArray = IntArray(FluidSynthJNI.CONFIG_FIELDS).also {
+        it[FluidSynthJNI.CONFIG_SAMPLE_RATE] = sampleRate
+        it[FluidSynthJNI.CONFIG_PERIOD_SIZE] = periodSize
+        it[FluidSynthJNI.CONFIG_PERIODS] = periods
+        it[FluidSynthJNI.CONFIG_POLYPHONY] = polyphony
+        it[FluidSynthJNI.CONFIG_CPU_CORES] = cpuCores
+        it[FluidSynthJNI.CONFIG_REVERB] = if (reverb) 1 else 0
+        it[FluidSynthJNI.CONFIG_CHORUS] = if (chorus) 1 else 0
+        it[FluidSynthJNI.CONFIG_AUDIO_GROUPS] = audioGroups
+        it[FluidSynthJNI.CONFIG_DEVICE_SAMPLE_RATE] = deviceSampleRate
+        it[FluidSynthJNI.CONFIG_DEVICE_BURST] = deviceBurst
+        it[FluidSynthJNI.CONFIG_CPU_AFFINITY] = cpuAffinity
+    }
+
+    companion object {
+        fun fromArray(values: IntArray) = EngineConfig(
+            sampleRate = values[FluidSynthJNI.CONFIG_SAMPLE_RATE],
+            periodSize = values[FluidSynthJNI.CONFIG_PERIOD_SIZE],
+            periods = values[FluidSynthJNI.CONFIG_PERIODS],
+            polyphony = values[FluidSynthJNI.CONFIG_POLYPHONY],
+            cpuCores = values[FluidSynthJNI.CONFIG_CPU_CORES],
+            reverb = values[FluidSynthJNI.CONFIG_REVERB] != 0,
+            chorus = values[FluidSynthJNI.CONFIG_CHORUS] != 0,
+            audioGroups = values[FluidSynthJNI.CONFIG_AUDIO_GROUPS],
+            deviceSampleRate = values[FluidSynthJNI.CONFIG_DEVICE_SAMPLE_RATE],
+            deviceBurst = values[FluidSynthJNI.CONFIG_DEVICE_BURST],
+            cpuAffinity = values[FluidSynthJNI.CONFIG_CPU_AFFINITY]
+        )
+
+        /**
+         * Default configuration at the device's native sample rate and burst size, which keeps
+         * the output on Android's low-latency path. Devices with 4+ cores render voices on a
+         * second thread pinned to the big cores.
+         */
+        fun forDevice(context: Context): EngineConfig {
+            val audioManager = context.getSystemService(Context.AUDIO_SERVICE) as AudioManager
+            val rate = audioManager.getProperty(AudioManager.PROPERTY_OUTPUT_SAMPLE_RATE)
+                ?.toIntOrNull() ?: 0
+            val burst = audioManager.getProperty(AudioManager.PROPERTY_OUTPUT_FRAMES_PER_BUFFER)
+                ?.toIntOrNull() ?: 0
+            val multiCore = Runtime.getRuntime().availableProcessors() >= 4
+            return EngineConfig(
+                cpuCores = if (multiCore) 2 else 1,
+                deviceSampleRate = rate,
+                deviceBurst = burst,
+                cpuAffinity = if (multiCore) {
+                    FluidSynthJNI.CPU_AFFINITY_FAST_CORES
+                } else {
+                    FluidSynthJNI.CPU_AFFINITY_NONE
+                }
+            )
+        }
+    }
+}
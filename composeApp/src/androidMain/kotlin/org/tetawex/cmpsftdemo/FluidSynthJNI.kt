@@ -1,17 +1,59 @@
 package org.tetawex.cmpsftdemo
 
+import android.content.res.AssetManager
+
 /**
  * JNI interface for FluidSynth synthesizer operations.
  * Provides native method bindings for FluidSynth C++ library.
  */
 object FluidSynthJNI {
     
+    /** Indices into the engine config array, see [EngineConfig] */
+    const val CONFIG_SAMPLE_RATE = 0
+    const val CONFIG_PERIOD_SIZE = 1
+    const val CONFIG_PERIODS = 2
+    const val CONFIG_POLYPHONY = 3
+    const val CONFIG_CPU_CORES = 4
+    const val CONFIG_REVERB = 5
+    const val CONFIG_CHORUS = 6
+    const val CONFIG_AUDIO_GROUPS = 7
+    const val CONFIG_DEVICE_SAMPLE_RATE = 8
+    const val CONFIG_DEVICE_BURST = 9
+    const val CONFIG_CPU_AFFINITY = 10
+    const val CONFIG_FIELDS = 11
+
+    /** Special [CONFIG_CPU_AFFINITY] values; anything else is a mask of CPUs 0-30 */
+    const val CPU_AFFINITY_NONE = 0
+    const val CPU_AFFINITY_FAST_CORES = -1
+
     /**
      * Create a new FluidSynth synthesizer instance.
+     * @param config [EngineConfig.toArray] of at least [CONFIG_FIELDS] elements, or null for the
+     * defaults. Overwritten with the values actually used after validation.
      * @return Handle (ID) to the synthesizer, or -1 on failure
      */
-    external fun createSynth(): Long
+    external fun createSynth(config: IntArray?): Long
     
+    /**
+     * Reopen the audio output with a new period size and count without touching the synth:
+     * loaded SoundFonts, programs and controllers are kept. The switch fades out and back in
+     * over one period each and takes milliseconds. The sample rate cannot change this way.
+     * @param synthHandle The synthesizer handle returned from createSynth()
+     * @param config [EngineConfig.toArray]; only [CONFIG_PERIOD_SIZE] and [CONFIG_PERIODS] are
+     * applied. Overwritten with the configuration in effect afterwards.
+     * @return FLUID_OK (0) on success, FLUID_FAILED (-1) if the new output could not be opened
+     * (the previous one is restored if possible)
+     */
+    external fun reopenAudio(synthHandle: Long, config: IntArray): Int
+
+    /**
+     * Create a synthesizer without an audio output, for export and tests.
+     * Audio is produced only by [renderFrames], as fast as the CPU allows.
+     * @param config As for [createSynth]; the period fields are ignored
+     * @return Handle (ID) to the synthesizer, or -1 on failure
+     */
+    external fun createOfflineSynth(config: IntArray?): Long
+
     /**
      * Destroy a FluidSynth synthesizer instance.
      * @param synthHandle The synthesizer handle returned from createSynth()
@@ -19,12 +61,136 @@ object FluidSynthJNI {
     external fun destroySynth(synthHandle: Long)
     
     /**
-     * Load a SoundFont file (.sf2).
+     * Load a SoundFont file (.sf2, or .sf3 with Ogg Vorbis samples).
      * @param synthHandle The synthesizer handle
      * @param filePath Path to the SoundFont file
      * @return SoundFont ID on success, -1 on failure
      */
     external fun loadSoundFont(synthHandle: Long, filePath: String): Int
+
+    /**
+     * Load a SoundFont straight from the APK's assets, without extracting it to storage.
+     * Assets listed under noCompress are read in place from the mapped APK.
+     * @param synthHandle The synthesizer handle
+     * @param assetManager The app's AssetManager (Context.getAssets())
+     * @param assetName Path of the SoundFont inside assets/
+     * @return SoundFont ID on success, -1 on failure
+     */
+    external fun loadSoundFontFromAsset(
+        synthHandle: Long,
+        assetManager: AssetManager,
+        assetName: String
+    ): Int
+
+    /** SoundFont load states returned by [getSoundFontLoadStatus] */
+    const val SFONT_LOAD_FAILED = -1
+    const val SFONT_LOAD_RUNNING = 0
+    const val SFONT_LOAD_DONE = 1
+    const val SFONT_LOAD_CANCELLED = 2
+
+    /**
+     * Start loading a SoundFont file on a native worker thread. The file is parsed (and an
+     * SF3 decoded) without blocking note calls, and the synth keeps playing the SoundFonts it
+     * has until the new one is added. Poll [getSoundFontLoadStatus], then call
+     * [finishSoundFontLoad] once for every handle.
+     * @param synthHandle The synthesizer handle
+     * @param filePath Path to the SoundFont file
+     * @return Load handle, or -1 on failure
+     */
+    external fun startSoundFontLoad(synthHandle: Long, filePath: String): Long
+
+    /**
+     * Like [startSoundFontLoad], for a SoundFont in the APK's assets.
+     * @return Load handle, or -1 on failure
+     */
+    external fun startSoundFontLoadFromAsset(
+        synthHandle: Long,
+        assetManager: AssetManager,
+        assetName: String
+    ): Long
+
+    /**
+     * Replace a loaded SoundFont with another file in the background. The old one keeps
+     * playing until the new one is loaded; then every channel switches to the new one without
+     * a gap, and the old one is unloaded once its sounding notes have ended. Track it like
+     * [startSoundFontLoad]; [finishSoundFontLoad] returns the new SoundFont ID. A failed or
+     * cancelled replacement leaves the old SoundFont loaded.
+     * @param synthHandle The synthesizer handle
+     * @param sfontId ID of the SoundFont to replace
+     * @param filePath Path to the new SoundFont file
+     * @return Load handle, or -1 on failure
+     */
+    external fun replaceSoundFont(synthHandle: Long, sfontId: Int, filePath: String): Long
+
+    /**
+     * Like [replaceSoundFont], for a SoundFont in the APK's assets.
+     * @return Load handle, or -1 on failure
+     */
+    external fun replaceSoundFontFromAsset(
+        synthHandle: Long,
+        sfontId: Int,
+        assetManager: AssetManager,
+        assetName: String
+    ): Long
+
+    /**
+     * Fraction of the SoundFont file processed so far. Stays 0 until done for formats
+     * FluidSynth's own loaders handle (DLS, compressed assets).
+     * @return 0.0-1.0, or -1.0 if the handle is unknown
+     */
+    external fun getSoundFontLoadProgress(loadHandle: Long): Double
+
+    /**
+     * @return [SFONT_LOAD_RUNNING], [SFONT_LOAD_DONE], [SFONT_LOAD_CANCELLED] or [SFONT_LOAD_FAILED]
+     */
+    external fun getSoundFontLoadStatus(loadHandle: Long): Int
+
+    /**
+     * Ask a running load to stop. A SoundFont it already added to the synth is unloaded again.
+     */
+    external fun cancelSoundFontLoad(loadHandle: Long)
+
+    /**
+     * Wait for a load to end and release its handle.
+     * @return SoundFont ID, or -1 if the load failed or was cancelled
+     */
+    external fun finishSoundFontLoad(loadHandle: Long): Int
+
+    /**
+     * Set the directory SF3 SoundFonts are decoded into, shared by all synths. The first load
+     * of an SF3 decodes its samples into a cached SF2 there; later loads map that file and are
+     * as fast as loading an SF2. Without a cache directory SF3 files are decoded in memory on
+     * every load. Preset indexes (see [getPresetCatalog]) are kept there too.
+     * @param dir Writable directory, e.g. Context.getCacheDir(), or null to stop caching
+     * @return FLUID_OK (0) on success, FLUID_FAILED (-1) on failure
+     */
+    external fun setSoundFontCacheDir(dir: String?): Int
+
+    /**
+     * List every preset of a loaded SoundFont in one packed buffer, decoded by
+     * [PresetCatalog.parse]. Also stores the list in an index under the cache directory, keyed
+     * by the SoundFont's size and a hash of its preset tables.
+     * @param synthHandle The synthesizer handle
+     * @param sfontId ID returned by [loadSoundFont] or [loadSoundFontFromAsset]
+     * @return The packed catalog, or null on failure
+     */
+    external fun getPresetCatalog(synthHandle: Long, sfontId: Int): ByteArray?
+
+    /**
+     * Read the preset index stored for a SoundFont file by an earlier [getPresetCatalog] call,
+     * without loading the SoundFont. Only reads its preset tables to check the index is current.
+     * @param filePath Path to the SoundFont file
+     * @return The packed catalog, or null if there is no current index
+     */
+    external fun readPresetCatalog(filePath: String): ByteArray?
+
+    /**
+     * Like [readPresetCatalog], for a SoundFont in the APK's assets.
+     * @param assetManager The app's AssetManager (Context.getAssets())
+     * @param assetName Path of the SoundFont inside assets/
+     * @return The packed catalog, or null if there is no current index
+     */
+    external fun readPresetCatalogFromAsset(assetManager: AssetManager, assetName: String): ByteArray?
     
     /**
      * Play a note (note on).
@@ -46,7 +212,9 @@ object FluidSynthJNI {
     external fun noteOff(synthHandle: Long, channel: Int, note: Int): Int
     
     /**
-     * Change the program (instrument) for a channel.
+     * Change the program (instrument) for a channel. If the preset's samples are not loaded yet
+     * they are loaded in the background and the change takes effect afterwards; until then the
+     * channel keeps its previous instrument. See [getPresetStatus].
      * @param synthHandle The synthesizer handle
      * @param channel MIDI channel (0-15)
      * @param program Program number (0-127)
@@ -73,6 +241,447 @@ object FluidSynthJNI {
      */
     external fun controlChange(synthHandle: Long, channel: Int, controller: Int, value: Int): Int
     
+    /**
+     * Apply a batch of packed MIDI events with a single JNI call.
+     * Each event is one Int laid out like a MIDI short message, see [packEvent].
+     * @param synthHandle The synthesizer handle
+     * @param events Packed events, applied in order
+     * @param count Number of events to apply from the start of [events]
+     * @param failedMask Optional bitmask receiving per-event failures (bit i of word i / 32),
+     *   must hold at least (count + 31) / 32 words
+     * @return Number of events applied successfully, or FLUID_FAILED (-1) for an invalid handle
+     */
+    external fun sendEvents(synthHandle: Long, events: IntArray, count: Int, failedMask: IntArray?): Int
+
+    /**
+     * Same as [sendEvents], reading native-order packed events from a direct ByteBuffer
+     * without copying them.
+     */
+    external fun sendEventsBuffer(synthHandle: Long, events: java.nio.ByteBuffer, count: Int, failedMask: IntArray?): Int
+
+    /**
+     * Attach a shared-memory MIDI event ring, drained by the audio thread every period. The
+     * synth keeps a reference to the buffer until it is freed; one ring per synth.
+     * @param synthHandle The synthesizer handle
+     * @param buffer [MidiEventRing.buffer]
+     * @return FLUID_OK (0) on success, FLUID_FAILED (-1) on failure
+     */
+    external fun setEventRing(synthHandle: Long, buffer: java.nio.ByteBuffer): Int
+
+    /** Preset states returned by [prefetchPreset] and [getPresetStatus] */
+    const val PRESET_NOT_LOADED = 0
+    const val PRESET_LOADING = 1
+    const val PRESET_READY = 2
+
+    /**
+     * Start loading a preset's samples in the background so a later program change to it takes
+     * effect at once. Loaded presets are released 30 s after no channel uses them any more.
+     * @param synthHandle The synthesizer handle
+     * @param bank Bank number (128 for percussion)
+     * @param program Program number (0-127)
+     * @return [PRESET_NOT_LOADED] if no SoundFont has the preset, [PRESET_LOADING], [PRESET_READY],
+     *   or FLUID_FAILED (-1) for an invalid handle
+     */
+    external fun prefetchPreset(synthHandle: Long, bank: Int, program: Int): Int
+
+    /**
+     * Get the loading state of a preset without starting a load.
+     * @return [PRESET_NOT_LOADED], [PRESET_LOADING], [PRESET_READY], or FLUID_FAILED (-1) for an
+     *   invalid handle
+     */
+    external fun getPresetStatus(synthHandle: Long, bank: Int, program: Int): Int
+
+    /** [sendTimedEvents] times are absolute frames on the audio clock */
+    const val TIME_BASE_FRAMES = 0
+
+    /** [sendTimedEvents] times are System.nanoTime() values on the render timeline */
+    const val TIME_BASE_NANOS = 1
+
+    /** Indices into the array filled by [getAudioClock] */
+    const val CLOCK_FRAME = 0
+    const val CLOCK_TIME_NS = 1
+    const val CLOCK_SAMPLE_RATE = 2
+    const val CLOCK_LATENCY_FRAMES = 3
+    const val CLOCK_BLOCK_SIZE = 4
+    const val CLOCK_FIELDS = 5
+
+    /**
+     * Schedule packed events at precise positions on the audio clock.
+     * Events are applied at the start of the FluidSynth block (see [CLOCK_BLOCK_SIZE], 64 frames)
+     * containing their time; events already in the past play at the start of the next period.
+     * @param synthHandle The synthesizer handle
+     * @param events Packed events, see [packEvent]
+     * @param times Time of each event in [timeBase] units
+     * @param count Number of events to read from both arrays
+     * @param timeBase [TIME_BASE_FRAMES] or [TIME_BASE_NANOS]
+     * @return Number of events queued (fewer if the queue filled up), or FLUID_FAILED (-1)
+     */
+    external fun sendTimedEvents(synthHandle: Long, events: IntArray, times: LongArray, count: Int, timeBase: Int): Int
+
+    /**
+     * Read the audio clock so events can be scheduled slightly ahead of the audio thread.
+     * [CLOCK_FRAME] is the next frame to be rendered and [CLOCK_TIME_NS] the System.nanoTime()
+     * at which rendering of that frame's period started; audio is heard about
+     * [CLOCK_LATENCY_FRAMES] later.
+     * @param synthHandle The synthesizer handle
+     * @param clock Array of at least [CLOCK_FIELDS] elements to fill
+     * @return FLUID_OK (0) on success, FLUID_FAILED (-1) on failure
+     */
+    external fun getAudioClock(synthHandle: Long, clock: LongArray): Int
+
+    /**
+     * Schedule packed channel events (notes, CCs, program changes, pitch bend, pressure) on the
+     * synth's sequencer, which counts ticks on the audio clock: 1000 per second unless changed
+     * with [setSequencerTimeScale]. One batch can hold a whole pattern or arpeggio; note lengths
+     * are note-offs scheduled at their end. Like [sendTimedEvents], events take effect at the
+     * start of the FluidSynth block containing their tick.
+     * @param synthHandle The synthesizer handle
+     * @param events Packed events, see [packEvent]; a system message ends the batch
+     * @param ticks Tick of each event
+     * @param count Number of events to read from both arrays
+     * @param absolute Whether [ticks] are absolute (see [getSequencerTick]) or offsets from now
+     * @return Number of events scheduled, or FLUID_FAILED (-1)
+     */
+    external fun scheduleSequencerEvents(synthHandle: Long, events: IntArray, ticks: IntArray, count: Int, absolute: Boolean): Int
+
+    /**
+     * Get the sequencer's current tick, for scheduling the next pattern bar at absolute ticks
+     * @return The tick, or FLUID_FAILED (-1)
+     */
+    external fun getSequencerTick(synthHandle: Long): Long
+
+    /**
+     * Set how many sequencer ticks make a second, e.g. bpm / 60 * ticks per quarter note
+     * @return FLUID_OK (0) on success, FLUID_FAILED (-1) on failure
+     */
+    external fun setSequencerTimeScale(synthHandle: Long, ticksPerSecond: Double): Int
+
+    /**
+     * Get the sequencer's ticks per second
+     * @return The time scale, or -1.0 for an invalid handle
+     */
+    external fun getSequencerTimeScale(synthHandle: Long): Double
+
+    /**
+     * Drop every event still scheduled on the sequencer. Notes already playing keep sounding.
+     * @return FLUID_OK (0) on success, FLUID_FAILED (-1) on failure
+     */
+    external fun clearSequencer(synthHandle: Long): Int
+
+    /** MIDI player states in [MIDI_POSITION_STATUS], FluidSynth's fluid_player_status */
+    const val MIDI_PLAYER_READY = 0
+    const val MIDI_PLAYER_PLAYING = 1
+    const val MIDI_PLAYER_STOPPING = 2
+    const val MIDI_PLAYER_DONE = 3
+
+    /** Tempo types accepted by [setMidiTempo], FluidSynth's fluid_player_set_tempo_type */
+    const val MIDI_TEMPO_INTERNAL = 0
+    const val MIDI_TEMPO_EXTERNAL_BPM = 1
+    const val MIDI_TEMPO_EXTERNAL_MIDI = 2
+
+    /** Indices into the array filled by [getMidiPosition] */
+    const val MIDI_POSITION_STATUS = 0
+    const val MIDI_POSITION_TICK = 1
+    const val MIDI_POSITION_TOTAL_TICKS = 2
+    const val MIDI_POSITION_BPM = 3
+    const val MIDI_POSITION_DIVISION = 4
+    const val MIDI_POSITION_MIDI_TEMPO = 5
+    const val MIDI_POSITION_FIELDS = 6
+
+    /**
+     * Load a Standard MIDI File into the synth's player, replacing the previous one. The bytes
+     * are copied natively; no temporary file is written. The player advances with the rendered
+     * audio, so playback stays locked to the audio clock without any JNI call per event.
+     * @param synthHandle The synthesizer handle
+     * @param data Contents of a .mid file
+     * @return FLUID_OK (0) on success, FLUID_FAILED (-1) if it is not a MIDI file
+     */
+    external fun loadMidiFile(synthHandle: Long, data: ByteArray): Int
+
+    /**
+     * Stop and drop the loaded MIDI file.
+     * @return FLUID_OK (0) on success, FLUID_FAILED (-1) on failure
+     */
+    external fun unloadMidiFile(synthHandle: Long): Int
+
+    /**
+     * Start or resume the loaded MIDI file; after it has ended it plays from the start again.
+     * Playing from the start resets the synth's channels first.
+     * @return FLUID_OK (0) on success, FLUID_FAILED (-1) if no file is loaded
+     */
+    external fun playMidi(synthHandle: Long): Int
+
+    /**
+     * Pause the MIDI file at its current position and release the notes on channels 0-15.
+     * @return FLUID_OK (0) on success, FLUID_FAILED (-1) if no file is loaded
+     */
+    external fun stopMidi(synthHandle: Long): Int
+
+    /**
+     * Move the MIDI file to a position in ticks (see [MIDI_POSITION_DIVISION]).
+     * @return FLUID_OK (0) on success, FLUID_FAILED (-1) if out of range or a seek is pending
+     */
+    external fun seekMidi(synthHandle: Long, ticks: Int): Int
+
+    /**
+     * Set how many times the MIDI file plays.
+     * @param loops Number of plays, -1 for endless
+     * @return FLUID_OK (0) on success, FLUID_FAILED (-1) if no file is loaded
+     */
+    external fun setMidiLoop(synthHandle: Long, loops: Int): Int
+
+    /**
+     * Set the MIDI file's tempo.
+     * @param tempoType [MIDI_TEMPO_INTERNAL]: tempo is a factor on the file's own tempo;
+     * [MIDI_TEMPO_EXTERNAL_BPM] / [MIDI_TEMPO_EXTERNAL_MIDI]: tempo in BPM / microseconds per
+     * quarter note, overriding the file's tempo changes
+     * @return FLUID_OK (0) on success, FLUID_FAILED (-1) on failure
+     */
+    external fun setMidiTempo(synthHandle: Long, tempoType: Int, tempo: Double): Int
+
+    /**
+     * Read the MIDI player's state and position.
+     * @param position Array of at least [MIDI_POSITION_FIELDS] elements to fill
+     * @return FLUID_OK (0) on success, FLUID_FAILED (-1) if no file is loaded
+     */
+    external fun getMidiPosition(synthHandle: Long, position: IntArray): Int
+
+    /**
+     * Render audio from an offline synthesizer (see [createOfflineSynth]) straight into [buffer].
+     * Queued and timed events are applied as on the audio thread; the frame clock advances by
+     * [frames]. Call from one thread at a time.
+     * @param synthHandle The synthesizer handle
+     * @param buffer Direct, native-order FloatBuffer receiving interleaved stereo (L, R) samples
+     * @param frames Number of stereo frames to render; the buffer must hold frames * 2 floats
+     * @return Number of frames rendered, or FLUID_FAILED (-1) on failure
+     */
+    external fun renderFrames(synthHandle: Long, buffer: java.nio.FloatBuffer, frames: Int): Int
+
+    /**
+     * Realtime factor achieved by [renderFrames] so far: seconds of audio per second of wall time.
+     * @param synthHandle The synthesizer handle
+     * @return The realtime factor, or 0.0 if nothing has been rendered
+     */
+    external fun getRealtimeFactor(synthHandle: Long): Double
+
+    /** [startExport] formats: 16-bit WAV, 16-bit FLAC, Ogg Vorbis */
+    const val EXPORT_FORMAT_WAV = 0
+    const val EXPORT_FORMAT_FLAC = 1
+    const val EXPORT_FORMAT_OGG = 2
+
+    /** Export states returned by [getExportStatus] and [finishExport] */
+    const val EXPORT_FAILED = -1
+    const val EXPORT_RUNNING = 0
+    const val EXPORT_DONE = 1
+    const val EXPORT_CANCELLED = 2
+
+    /**
+     * Bounce an offline synthesizer (see [createOfflineSynth]) to a file in the background.
+     * One thread renders while a second one encodes; queue the events to render with
+     * [sendTimedEvents] using [TIME_BASE_FRAMES]. The synth cannot be used with [renderFrames]
+     * until the export ends, and destroying it fails the export.
+     * @param synthHandle The synthesizer handle
+     * @param filePath Output file path
+     * @param format [EXPORT_FORMAT_WAV], [EXPORT_FORMAT_FLAC] or [EXPORT_FORMAT_OGG]
+     * @param frames Length of the export in frames
+     * @return Export handle, or -1 on failure
+     */
+    external fun startExport(synthHandle: Long, filePath: String, format: Int, frames: Long): Long
+
+    /**
+     * @param exportHandle Handle returned from startExport()
+     * @return Fraction of the export written so far (0.0-1.0), or -1.0 if the handle is unknown
+     */
+    external fun getExportProgress(exportHandle: Long): Double
+
+    /**
+     * @param exportHandle Handle returned from startExport()
+     * @return [EXPORT_RUNNING], [EXPORT_DONE], [EXPORT_CANCELLED] or [EXPORT_FAILED]
+     */
+    external fun getExportStatus(exportHandle: Long): Int
+
+    /**
+     * Stop a running export; the partial file is deleted. Call [finishExport] afterwards.
+     * @param exportHandle Handle returned from startExport()
+     */
+    external fun cancelExport(exportHandle: Long)
+
+    /**
+     * Wait for an export to end and release its handle.
+     * @param exportHandle Handle returned from startExport()
+     * @return Final status: [EXPORT_DONE], [EXPORT_CANCELLED] or [EXPORT_FAILED]
+     */
+    external fun finishExport(exportHandle: Long): Int
+
+    /** Indices into the array filled by [getStemRenderReport] */
+    const val STEM_REPORT_STEMS = 0
+    const val STEM_REPORT_THREADS = 1
+    /** Bit n is set when MIDI channel n (0-based) has a stem */
+    const val STEM_REPORT_CHANNEL_MASK = 2
+    const val STEM_REPORT_FRAMES = 3
+    const val STEM_REPORT_WALL_MS = 4
+    /** Time all stems spent rendering, summed */
+    const val STEM_REPORT_RENDER_MS = 5
+    /** [STEM_REPORT_RENDER_MS] / [STEM_REPORT_WALL_MS]: how many stems rendered at once */
+    const val STEM_REPORT_SCALING = 6
+    const val STEM_REPORT_REALTIME_FACTOR = 7
+    const val STEM_REPORT_FIELDS = 8
+
+    /**
+     * Render a Standard MIDI File to one file per MIDI channel in the background. Every channel
+     * with notes gets its own synthesizer, loaded with the SoundFonts and settings of
+     * [synthHandle], and the stems render in parallel at full speed. Files are named
+     * "<outputPrefix>_chNN.<ext>" with NN the 1-based channel, plus "<outputPrefix>_mix.<ext>"
+     * when [mix] is set; all of them run 2 s past the last event. The source synthesizer is
+     * only read at the start and can keep playing.
+     * @param synthHandle Synthesizer whose SoundFonts and settings to use
+     * @param data Contents of a .mid file
+     * @param outputPrefix Output path without the suffix
+     * @param format [EXPORT_FORMAT_WAV], [EXPORT_FORMAT_FLAC] or [EXPORT_FORMAT_OGG]
+     * @param mix Whether to also write the sum of all stems
+     * @return Stem render handle, or -1 on failure
+     */
+    external fun startStemRender(
+        synthHandle: Long,
+        data: ByteArray,
+        outputPrefix: String,
+        format: Int,
+        mix: Boolean
+    ): Long
+
+    /**
+     * @param stemRenderHandle Handle returned from startStemRender()
+     * @return Fraction written so far (0.0-1.0), or -1.0 if the handle is unknown
+     */
+    external fun getStemRenderProgress(stemRenderHandle: Long): Double
+
+    /**
+     * @param stemRenderHandle Handle returned from startStemRender()
+     * @return [EXPORT_RUNNING], [EXPORT_DONE], [EXPORT_CANCELLED] or [EXPORT_FAILED]
+     */
+    external fun getStemRenderStatus(stemRenderHandle: Long): Int
+
+    /**
+     * Read the stems and the scaling achieved; the timings are final once the render is done.
+     * @param stemRenderHandle Handle returned from startStemRender()
+     * @param report Array of at least [STEM_REPORT_FIELDS] elements to fill
+     * @return 0 on success, -1 on failure
+     */
+    external fun getStemRenderReport(stemRenderHandle: Long, report: DoubleArray): Int
+
+    /**
+     * Stop a running stem render; every partial file is deleted. Call [finishStemRender]
+     * afterwards.
+     * @param stemRenderHandle Handle returned from startStemRender()
+     */
+    external fun cancelStemRender(stemRenderHandle: Long)
+
+    /**
+     * Wait for a stem render to end and release its handle.
+     * @param stemRenderHandle Handle returned from startStemRender()
+     * @return Final status: [EXPORT_DONE], [EXPORT_CANCELLED] or [EXPORT_FAILED]
+     */
+    external fun finishStemRender(stemRenderHandle: Long): Int
+
+    /** Indices into the array filled by [getStats] */
+    const val STATS_RENDER_CALLS = 0
+    const val STATS_FRAMES = 1
+    /** fluid_synth_get_cpu_load() in hundredths of a percent */
+    const val STATS_CPU_LOAD = 2
+    const val STATS_ACTIVE_VOICES = 3
+    const val STATS_PEAK_VOICES = 4
+    /** Audio callbacks that took longer than their period */
+    const val STATS_MISSED_DEADLINES = 5
+    /** Gaps between audio callbacks longer than the whole output queue, i.e. likely underruns */
+    const val STATS_XRUNS = 6
+    const val STATS_RENDER_NS_LAST = 7
+    const val STATS_RENDER_NS_MAX = 8
+    const val STATS_PERIOD_BUDGET_NS = 9
+    /**
+     * First of [STATS_HISTOGRAM_BUCKETS] callback duration counters. Bucket i counts durations
+     * between 2^(i-8) and 2^(i-7) period budgets; buckets 8 and up are missed deadlines.
+     */
+    const val STATS_HISTOGRAM = 10
+    const val STATS_HISTOGRAM_BUCKETS = 12
+    const val STATS_FIELDS = STATS_HISTOGRAM + STATS_HISTOGRAM_BUCKETS
+
+    /**
+     * Read the synth's audio-callback performance counters in one call. Counters accumulate
+     * since createSynth(); offline synths report zeros.
+     * @param synthHandle The synthesizer handle
+     * @param stats Array of at least [STATS_FIELDS] elements to fill
+     * @return FLUID_OK (0) on success, FLUID_FAILED (-1) on failure
+     */
+    external fun getStats(synthHandle: Long, stats: LongArray): Int
+
+    /** Sizes of the arrays filled by [getSpectrum] */
+    const val SPECTRUM_FFT_SIZE = 2048
+    const val SPECTRUM_BINS = SPECTRUM_FFT_SIZE / 2
+    const val SPECTRUM_BANDS = 64
+
+    /**
+     * Copy the latest spectrum of the synth's audio output. Analysis runs natively on a
+     * background thread and pauses when this has not been called for a second.
+     * @param synthHandle The synthesizer handle (createSynth only; offline synths have no analyzer)
+     * @param magnitudes Array of at least [SPECTRUM_BINS] elements for the FFT bins, or null
+     * @param bands Array of at least [SPECTRUM_BANDS] elements for log-spaced display bands, or null
+     * @return FLUID_OK (0) on success, FLUID_FAILED (-1) on failure or before the first spectrum
+     */
+    external fun getSpectrum(synthHandle: Long, magnitudes: FloatArray?, bands: FloatArray?): Int
+
+    /** Per-group fields of the array filled by [getAudioGroupLevels] */
+    const val GROUP_LEVEL_PEAK_LEFT = 0
+    const val GROUP_LEVEL_PEAK_RIGHT = 1
+    const val GROUP_LEVEL_RMS_LEFT = 2
+    const val GROUP_LEVEL_RMS_RIGHT = 3
+    const val GROUP_LEVEL_FIELDS = 4
+
+    /**
+     * Read the levels of every audio group of a synth created with [EngineConfig.audioGroups] > 1.
+     * Group buffers are dry: reverb and chorus are only mixed into the output.
+     * @param synthHandle The synthesizer handle
+     * @param levels Array of at least audioGroups * [GROUP_LEVEL_FIELDS] elements, filled group
+     * by group with the peaks since the previous call and the RMS of the last rendered slice
+     * @return Number of groups, or FLUID_FAILED (-1) on failure
+     */
+    external fun getAudioGroupLevels(synthHandle: Long, levels: FloatArray): Int
+
+    /**
+     * Start or stop capturing the audio of every group for [readAudioGroup]. Starting drops
+     * anything left from an earlier capture.
+     * @param synthHandle The synthesizer handle
+     * @param enabled Whether to capture
+     * @return FLUID_OK (0) on success, FLUID_FAILED (-1) for synths with one audio group
+     */
+    external fun setAudioGroupCapture(synthHandle: Long, enabled: Boolean): Int
+
+    /**
+     * Take captured audio of one group, interleaved stereo, oldest first. Read each group from
+     * one thread at a time and often enough: about 16384 frames are buffered per group and
+     * later frames are dropped while the buffer is full.
+     * @param synthHandle The synthesizer handle
+     * @param group Audio group, 0 until audioGroups
+     * @param out Array filled with up to out.size / 2 frames
+     * @return Number of frames copied, or FLUID_FAILED (-1) on failure
+     */
+    external fun readAudioGroup(synthHandle: Long, group: Int, out: FloatArray): Int
+
+    /**
+     * Pack a channel message for [sendEvents]: status | data1 << 8 | data2 << 16.
+     */
+    fun packEvent(status: Int, data1: Int, data2: Int = 0): Int =
+        (status and 0xFF) or ((data1 and 0x7F) shl 8) or ((data2 and 0x7F) shl 16)
+
+    fun packNoteOn(channel: Int, note: Int, velocity: Int): Int = packEvent(0x90 or channel, note, velocity)
+
+    fun packNoteOff(channel: Int, note: Int): Int = packEvent(0x80 or channel, note)
+
+    fun packControlChange(channel: Int, controller: Int, value: Int): Int = packEvent(0xB0 or channel, controller, value)
+
+    fun packProgramChange(channel: Int, program: Int): Int = packEvent(0xC0 or channel, program)
+
+    fun packPitchBend(channel: Int, value: Int): Int = packEvent(0xE0 or channel, value and 0x7F, value shr 7)
+
     /**
      * Get the FluidSynth version string.
      * @return Version string
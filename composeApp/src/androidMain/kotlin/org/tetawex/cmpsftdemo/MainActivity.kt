@@ -13,8 +13,7 @@ class MainActivity : ComponentActivity() {
         enableEdgeToEdge()
         super.onCreate(savedInstanceState)
         
-        // Extract SoundFont from resources if not already present
-        extractSoundFontIfNeeded()
+        deleteExtractedSoundFont()
         
         // Initialize synth manager
         initializeSynthManager(this)
@@ -24,28 +23,11 @@ class MainActivity : ComponentActivity() {
         }
     }
     
-    private fun extractSoundFontIfNeeded() {
+    // Earlier versions copied the SoundFont into filesDir; it is now read from the APK
+    private fun deleteExtractedSoundFont() {
         val soundFontFile = File(filesDir, "sft_gu_gs.sf2")
-        if (!soundFontFile.exists()) {
-            try {
-                // Read from raw resources (filename: sft_gu_gs.sf2)
-                val resourceId = resources.getIdentifier("sft_gu_gs", "raw", packageName)
-                if (resourceId != 0) {
-                    val inputStream = resources.openRawResource(resourceId)
-                    inputStream.use { input ->
-                        soundFontFile.outputStream().use { output ->
-                            input.copyTo(output)
-                        }
-                    }
-                    android.util.Log.i("MainActivity", "SoundFont extracted to: ${soundFontFile.absolutePath}")
-                } else {
-                    android.util.Log.e("MainActivity", "SoundFont resource not found")
-                }
-            } catch (e: Exception) {
-                android.util.Log.e("MainActivity", "Failed to extract SoundFont", e)
-            }
-        } else {
-            android.util.Log.i("MainActivity", "SoundFont already exists at: ${soundFontFile.absolutePath}")
+        if (soundFontFile.exists() && soundFontFile.delete()) {
+            android.util.Log.i("MainActivity", "Deleted extracted SoundFont: ${soundFontFile.absolutePath}")
         }
     }
 }
@@ -0,0 +1,71 @@
+package org.tetawex.cmpsftdemo
+
+import android.os.Build
+import java.lang.invoke.VarHandle
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.util.concurrent.atomic.AtomicInteger
+
+/**
+ * Producer side of a synth's shared-memory MIDI event ring (see cpp/midi_event_ring.h).
+ * Any number of threads may call [offer]; the native audio thread drains the ring at the start
+ * of every period. Enqueuing claims a slot with a compare-and-set on a JVM-side cursor and
+ * publishes the event with one 32-bit store into it, with no JNI call and no lock.
+ *
+ * The ring lives in a direct buffer allocated here and handed to the synth with
+ * [FluidSynthJNI.setEventRing], so the garbage collector owns it: an [offer] racing
+ * destroySynth() writes into a buffer nobody drains any more, never into freed memory.
+ *
+ * @param capacity Slots in the ring, a power of two
+ */
+class MidiEventRing(private val capacity: Int = DEFAULT_CAPACITY) {
+    init {
+        require(capacity > 0 && (capacity and (capacity - 1)) == 0) { "capacity must be a power of two" }
+    }
+
+    /** The ring's memory, for [FluidSynthJNI.setEventRing] */
+    val buffer: ByteBuffer = ByteBuffer.allocateDirect(SLOTS_OFFSET + capacity * 4)
+        .order(ByteOrder.nativeOrder())
+        .putInt(CAPACITY_OFFSET, capacity)
+    private val mask = capacity - 1
+
+    /** Sequence number of the next slot to hand out; the consumer's read cursor trails it */
+    private val claimed = AtomicInteger()
+
+    /**
+     * Queue a packed event (see [FluidSynthJNI.packEvent]).
+     * @return false if the ring is full; the caller should fall back to a direct JNI call
+     */
+    fun offer(event: Int): Boolean {
+        var position: Int
+        do {
+            position = claimed.get()
+            if (position - buffer.getInt(READ_CURSOR_OFFSET) >= capacity) return false
+        } while (!claimed.compareAndSet(position, position + 1))
+        // The slot is free once the read cursor has passed it, so its store must not move ahead
+        // of that load. The nonzero event itself marks the slot published.
+        loadStoreFence()
+        buffer.putInt(SLOTS_OFFSET + (position and mask) * 4, event)
+        return true
+    }
+
+    private fun loadStoreFence() {
+        if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.TIRAMISU) {
+            VarHandle.fullFence()
+        } else {
+            // No fence API before 33. ART emits volatile accesses as ordered instructions
+            // (stlxr / ldar on arm64, dmb on arm32), and a volatile load after the successful
+            // compare-and-set keeps every later access behind both.
+            claimed.get()
+        }
+    }
+
+    companion object {
+        const val DEFAULT_CAPACITY = 1024
+
+        // Keep in sync with cpp/midi_event_ring.h
+        private const val CAPACITY_OFFSET = 0
+        private const val READ_CURSOR_OFFSET = 64
+        private const val SLOTS_OFFSET = 128
+    }
+}
@@ -0,0 +1,36 @@
+package org.tetawex.cmpsftdemo
+
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+/**
+ * Decodes the packed preset list returned by [FluidSynthJNI.getPresetCatalog] and
+ * [FluidSynthJNI.readPresetCatalog] (see cpp/preset_catalog.h).
+ */
+object PresetCatalog {
+    // Keep in sync with cpp/preset_catalog.h
+    private const val MAGIC = 0x54414350 // "PCAT" read little-endian
+    private const val VERSION = 1
+
+    /**
+     * @return the presets in SoundFont order, or an empty list if [buffer] is not a catalog
+     */
+    fun parse(buffer: ByteArray?): List<PresetInfo> {
+        if (buffer == null || buffer.size < 12) return emptyList()
+        val data = ByteBuffer.wrap(buffer).order(ByteOrder.LITTLE_ENDIAN)
+        if (data.getInt() != MAGIC || data.getInt() != VERSION) return emptyList()
+        val count = data.getInt()
+        val presets = ArrayList<PresetInfo>(count.coerceIn(0, buffer.size / 4))
+        repeat(count) {
+            if (data.remaining() < 4) return presets
+            val bank = data.getShort().toInt() and 0xFFFF
+            val program = data.get().toInt() and 0xFF
+            val nameLength = data.get().toInt() and 0xFF
+            if (data.remaining() < nameLength) return presets
+            val name = String(buffer, data.position(), nameLength, Charsets.ISO_8859_1).trim()
+            data.position(data.position() + nameLength)
+            presets.add(PresetInfo(bank, program, name))
+        }
+        return presets
+    }
+}
@@ -2,8 +2,8 @@ package org.tetawex.cmpsftdemo
 
 import android.content.Context
 import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.delay
 import kotlinx.coroutines.withContext
-import java.io.File
 
 /**
  * Android implementation of SynthManager using FluidSynthJNI
@@ -12,40 +12,69 @@ class AndroidSynthManager(private val context: Context) : SynthManager {
     private var synthHandle: Long = -1
     private var isInit = false
     private var currentChannel = 0
+    @Volatile
+    private var eventRing: MidiEventRing? = null
+    @Volatile
+    private var hasSoundFont = false
+    @Volatile
+    private var soundFontId = -1
+    @Volatile
+    private var soundFontLoad = -1L
+    private var engineConfig = EngineConfig.forDevice(context)
+
+    // Reused by every getSpectrumData() call so polling at frame rate does not allocate
+    private val spectrumMagnitudes = FloatArray(FluidSynthJNI.SPECTRUM_BINS)
+    private val spectrumBands = FloatArray(FluidSynthJNI.SPECTRUM_BANDS)
+    private var spectrumData: SpectrumData? = null
 
     override suspend fun initialize(): Boolean {
         return withContext(Dispatchers.Default) {
             try {
                 // Create synth
-                synthHandle = FluidSynthJNI.createSynth()
+                val config = engineConfig.toArray()
+                synthHandle = FluidSynthJNI.createSynth(config)
                 if (synthHandle == -1L) {
                     android.util.Log.e("SynthManager", "Failed to create synthesizer")
                     return@withContext false
                 }
-                android.util.Log.i("SynthManager", "Synthesizer created with handle: $synthHandle")
-
-                // Try to load a default soundfont
-                val soundFontPath = getSoundFontPath()
-                if (soundFontPath != null) {
-                    android.util.Log.i("SynthManager", "Loading soundfont from: $soundFontPath")
-                    val sfId = FluidSynthJNI.loadSoundFont(synthHandle, soundFontPath)
-                    if (sfId == -1) {
-                        android.util.Log.e("SynthManager", "Failed to load soundfont")
-                    } else {
-                        android.util.Log.i("SynthManager", "Soundfont loaded with ID: $sfId")
-                    }
+                engineConfig = EngineConfig.fromArray(config)
+                android.util.Log.i("SynthManager", "Synthesizer created with handle: $synthHandle, $engineConfig")
+
+                val ring = MidiEventRing()
+                eventRing = ring.takeIf { FluidSynthJNI.setEventRing(synthHandle, it.buffer) == 0 }
+                if (eventRing == null) {
+                    android.util.Log.w("SynthManager", "Event ring unavailable, using direct JNI calls")
+                }
+
+                // Load the default soundfont in place from the APK. The SF3 build is preferred;
+                // its samples are decoded once into the cache directory
+                FluidSynthJNI.setSoundFontCacheDir(context.cacheDir.absolutePath)
+                val asset = soundFontAsset()
+                android.util.Log.i("SynthManager", "Loading soundfont from assets: $asset")
+                val sfId = loadSoundFont(asset)
+                if (sfId == -1) {
+                    android.util.Log.e("SynthManager", "Failed to load soundfont")
                 } else {
-                    android.util.Log.w("SynthManager", "No soundfont file found")
+                    android.util.Log.i("SynthManager", "Soundfont loaded with ID: $sfId")
+                    soundFontId = sfId
                 }
 
                 val sfCount = FluidSynthJNI.getSoundFontCount(synthHandle)
                 android.util.Log.i("SynthManager", "Current soundfont count: $sfCount")
+                hasSoundFont = sfCount > 0
                 
                 // Set master gain to a reasonable level for audio output
                 val gainResult = FluidSynthJNI.setMasterGain(synthHandle, 0.8)
                 val currentGain = FluidSynthJNI.getMasterGain(synthHandle)
                 android.util.Log.i("SynthManager", "Master gain set: result=$gainResult, current=$currentGain")
 
+                spectrumData = SpectrumData(
+                    spectrumMagnitudes,
+                    engineConfig.sampleRate,
+                    FluidSynthJNI.SPECTRUM_FFT_SIZE,
+                    spectrumBands
+                )
+
                 isInit = true
                 true
             } catch (e: Exception) {
@@ -55,15 +84,68 @@ class AndroidSynthManager(private val context: Context) : SynthManager {
         }
     }
 
+    // Loads on the native worker, so a decode or a large bank does not hold the synth's lock
+    private suspend fun loadSoundFont(asset: String): Int {
+        return awaitSoundFontLoad(
+            FluidSynthJNI.startSoundFontLoadFromAsset(synthHandle, context.assets, asset)
+        )
+    }
+
+    private suspend fun awaitSoundFontLoad(loadHandle: Long): Int {
+        if (loadHandle == -1L) return -1
+        soundFontLoad = loadHandle
+        try {
+            while (FluidSynthJNI.getSoundFontLoadStatus(loadHandle) == FluidSynthJNI.SFONT_LOAD_RUNNING) {
+                delay(LOAD_POLL_MS)
+            }
+        } finally {
+            soundFontLoad = -1L
+        }
+        return FluidSynthJNI.finishSoundFontLoad(loadHandle)
+    }
+
+    override suspend fun replaceSoundFont(path: String): Boolean {
+        if (!isInit || synthHandle == -1L) return false
+        return withContext(Dispatchers.Default) {
+            try {
+                // Notes keep sounding from the current SoundFont until the new one takes over
+                val oldId = soundFontId
+                val loadHandle = if (oldId == -1) {
+                    FluidSynthJNI.startSoundFontLoad(synthHandle, path)
+                } else {
+                    FluidSynthJNI.replaceSoundFont(synthHandle, oldId, path)
+                }
+                val sfId = awaitSoundFontLoad(loadHandle)
+                if (sfId == -1) {
+                    android.util.Log.e("SynthManager", "Failed to replace soundfont with $path")
+                    return@withContext false
+                }
+                android.util.Log.i("SynthManager", "Soundfont $oldId replaced with ID: $sfId")
+                soundFontId = sfId
+                hasSoundFont = true
+                true
+            } catch (e: Exception) {
+                android.util.Log.e("SynthManager", "Error replacing soundfont", e)
+                false
+            }
+        }
+    }
+
+    override fun getSoundFontLoadProgress(): Float? {
+        val loadHandle = soundFontLoad
+        if (loadHandle == -1L) return null
+        val progress = FluidSynthJNI.getSoundFontLoadProgress(loadHandle)
+        return if (progress < 0) null else progress.toFloat()
+    }
+
     override fun playNote(note: Int, velocity: Int) {
         if (!isInit || synthHandle == -1L) return
+        if (!hasSoundFont) {
+            android.util.Log.e("SynthManager", "Cannot play note: no soundfonts loaded")
+            return
+        }
+        if (eventRing?.offer(FluidSynthJNI.packNoteOn(currentChannel, note, velocity)) == true) return
         try {
-            // Check if soundfonts are loaded
-            val sfCount = FluidSynthJNI.getSoundFontCount(synthHandle)
-            if (sfCount == 0) {
-                android.util.Log.e("SynthManager", "Cannot play note: no soundfonts loaded")
-                return
-            }
             val result = FluidSynthJNI.noteOn(synthHandle, currentChannel, note, velocity)
             if (result != 0) {
                 android.util.Log.e("SynthManager", "noteOn returned: $result")
@@ -75,6 +157,7 @@ class AndroidSynthManager(private val context: Context) : SynthManager {
 
     override fun stopNote(note: Int) {
         if (!isInit || synthHandle == -1L) return
+        if (eventRing?.offer(FluidSynthJNI.packNoteOff(currentChannel, note)) == true) return
         try {
             FluidSynthJNI.noteOff(synthHandle, currentChannel, note)
         } catch (e: Exception) {
@@ -84,6 +167,8 @@ class AndroidSynthManager(private val context: Context) : SynthManager {
 
     override fun changeProgram(program: Int) {
         if (!isInit || synthHandle == -1L) return
+        // Not through the event ring: the native side loads the preset's samples in the
+        // background first instead of on the audio thread
         try {
             FluidSynthJNI.programChange(synthHandle, currentChannel, program)
         } catch (e: Exception) {
@@ -91,8 +176,37 @@ class AndroidSynthManager(private val context: Context) : SynthManager {
         }
     }
 
+    override fun isProgramReady(program: Int): Boolean {
+        if (!isInit || synthHandle == -1L) return true
+        return try {
+            FluidSynthJNI.getPresetStatus(synthHandle, 0, program) != FluidSynthJNI.PRESET_LOADING
+        } catch (e: Exception) {
+            true
+        }
+    }
+
+    override suspend fun getPresets(): List<PresetInfo> {
+        return withContext(Dispatchers.IO) {
+            try {
+                val sfId = soundFontId
+                val catalog = if (isInit && synthHandle != -1L && sfId != -1) {
+                    FluidSynthJNI.getPresetCatalog(synthHandle, sfId)
+                } else {
+                    // Not loaded yet: the index stored on an earlier launch, if any
+                    FluidSynthJNI.setSoundFontCacheDir(context.cacheDir.absolutePath)
+                    FluidSynthJNI.readPresetCatalogFromAsset(context.assets, soundFontAsset())
+                }
+                PresetCatalog.parse(catalog)
+            } catch (e: Exception) {
+                android.util.Log.e("SynthManager", "Error listing presets", e)
+                emptyList()
+            }
+        }
+    }
+
     override fun setVolume(volume: Int) {
         if (!isInit || synthHandle == -1L) return
+        if (eventRing?.offer(FluidSynthJNI.packControlChange(currentChannel, 7, volume)) == true) return
         try {
             FluidSynthJNI.setChannelVolume(synthHandle, currentChannel, volume)
         } catch (e: Exception) {
@@ -101,13 +215,47 @@ class AndroidSynthManager(private val context: Context) : SynthManager {
     }
 
     override fun setBufferSize(bufferSize: Int) {
-        // No-op on Android - buffer size is configured at native level
+        engineConfig = engineConfig.copy(periodSize = bufferSize)
+        if (!isInit || synthHandle == -1L) return
+        // Only the audio output is replaced; SoundFonts and channel state stay loaded
+        try {
+            val config = engineConfig.toArray()
+            val result = FluidSynthJNI.reopenAudio(synthHandle, config)
+            engineConfig = EngineConfig.fromArray(config)
+            if (result != 0) {
+                android.util.Log.e("SynthManager", "Failed to apply buffer size $bufferSize")
+            }
+        } catch (e: Exception) {
+            android.util.Log.e("SynthManager", "Error setting buffer size", e)
+        }
     }
 
     override fun isInitialized(): Boolean = isInit
 
+    override fun isSpectrumAnalysisAvailable(): Boolean = isInit && synthHandle != -1L
+
+    override fun getSpectrumData(): SpectrumData? {
+        if (!isInit || synthHandle == -1L) return null
+        return try {
+            if (FluidSynthJNI.getSpectrum(synthHandle, spectrumMagnitudes, spectrumBands) == 0) {
+                spectrumData
+            } else {
+                null
+            }
+        } catch (e: Exception) {
+            android.util.Log.e("SynthManager", "Error reading spectrum", e)
+            null
+        }
+    }
+
     override fun cleanup() {
+        val loadHandle = soundFontLoad
+        if (loadHandle != -1L) {
+            FluidSynthJNI.cancelSoundFontLoad(loadHandle)
+        }
         if (synthHandle != -1L) {
+            isInit = false
+            eventRing = null
             try {
                 FluidSynthJNI.destroySynth(synthHandle)
             } catch (e: Exception) {
@@ -118,17 +266,20 @@ class AndroidSynthManager(private val context: Context) : SynthManager {
         }
     }
 
-    private fun getSoundFontPath(): String? {
-        // Look for the extracted sft_gu_gs.sf2 file
-        val soundFontFile = File(context.filesDir, "sft_gu_gs.sf2")
-        return if (soundFontFile.exists()) {
-            val path = soundFontFile.absolutePath
-            android.util.Log.i("SynthManager", "Found soundfont at: $path")
-            path
-        } else {
-            android.util.Log.w("SynthManager", "Soundfont file not found at: ${soundFontFile.absolutePath}")
-            null
-        }
+    private fun soundFontAsset(): String {
+        val assetNames = context.assets.list("").orEmpty()
+        return if (SOUNDFONT_ASSET_SF3 in assetNames) SOUNDFONT_ASSET_SF3 else SOUNDFONT_ASSET
+    }
+
+    companion object {
+        /** Stored uncompressed in the APK, see noCompress in build.gradle.kts */
+        const val SOUNDFONT_ASSET = "sft_gu_gs.sf2"
+
+        /** Ogg Vorbis-compressed build of [SOUNDFONT_ASSET], used instead when it is bundled */
+        const val SOUNDFONT_ASSET_SF3 = "sft_gu_gs.sf3"
+
+        /** How often a background SoundFont load is checked on */
+        private const val LOAD_POLL_MS = 50L
     }
 }
 
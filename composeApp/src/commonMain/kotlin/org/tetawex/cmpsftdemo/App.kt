@@ -136,12 +136,16 @@ fun App() {
         val midiManager = remember { getMidiManager(synthManager) }
         
         var synthInitialized by remember { mutableStateOf(false) }
+        var synthInitializing by remember { mutableStateOf(true) }
+        var soundFontProgress by remember { mutableStateOf<Float?>(null) }
         var midiState by remember { mutableStateOf(MidiState.NOT_INITIALIZED) }
         var midiDevices by remember { mutableStateOf<List<MidiDeviceInfo>>(emptyList()) }
         var enabledMidiInputs by remember { mutableStateOf<Set<String>>(emptySet()) }
         
         var volume by remember { mutableStateOf(100f) }
         var program by remember { mutableStateOf(0f) }
+        var programReady by remember { mutableStateOf(true) }
+        var presets by remember { mutableStateOf<List<PresetInfo>>(emptyList()) }
         
         // Octave selector (MIDI octave 0-8, default to 4 which is middle C)
         var baseOctave by remember { mutableStateOf(4) }
@@ -172,6 +176,16 @@ fun App() {
         // Initialize synth on first composition
         LaunchedEffect(Unit) {
             synthInitialized = synthManager.initialize()
+            synthInitializing = false
+        }
+
+        // Show how far the SoundFont has loaded while initializing
+        LaunchedEffect(synthInitializing) {
+            while (synthInitializing) {
+                soundFontProgress = synthManager.getSoundFontLoadProgress()
+                delay(100)
+            }
+            soundFontProgress = null
         }
         
         // Check MIDI support (but don't request permission yet - needs user gesture)
@@ -208,6 +222,23 @@ fun App() {
             }
         }
 
+        // Instrument names: from the stored index right away, then from the loaded SoundFont
+        LaunchedEffect(synthInitialized) {
+            val loaded = synthManager.getPresets()
+            if (loaded.isNotEmpty()) {
+                presets = loaded
+            }
+        }
+
+        // Poll until the selected instrument's samples have loaded
+        LaunchedEffect(program.toInt(), synthInitialized) {
+            programReady = synthManager.isProgramReady(program.toInt())
+            while (!programReady) {
+                delay(100)
+                programReady = synthManager.isProgramReady(program.toInt())
+            }
+        }
+
         // Cleanup on disposal
         DisposableEffect(Unit) {
             onDispose {
@@ -350,7 +381,10 @@ fun App() {
                     // Instrument Control
                     Column(modifier = Modifier.weight(1f)) {
                         Text(
-                            "Instrument: ${program.toInt()}",
+                            "Instrument: ${program.toInt()}" +
+                                (presets.firstOrNull { it.bank == 0 && it.program == program.toInt() }
+                                    ?.let { " ${it.name}" } ?: "") +
+                                if (programReady) "" else " (loading…)",
                             style = MaterialTheme.typography.labelMedium,
                             color = MaterialTheme.colorScheme.onSurfaceVariant
                         )
@@ -466,6 +500,14 @@ fun App() {
                         )
                     }
                 }
+            } else if (synthInitializing) {
+                Text(
+                    "Loading SoundFont…" +
+                        (soundFontProgress?.let { " ${(it * 100).toInt()}%" } ?: ""),
+                    style = MaterialTheme.typography.bodyMedium,
+                    color = MaterialTheme.colorScheme.onSurfaceVariant,
+                    modifier = Modifier.padding(top = 32.dp)
+                )
             } else {
                 Text(
                     "Synth not available on this platform",
@@ -718,7 +760,12 @@ private fun Spectrogram(
         while (true) {
             if (synthManager.isInitialized() && synthManager.isSpectrumAnalysisAvailable()) {
                 val data = synthManager.getSpectrumData()
-                if (data != null && data.magnitudes.isNotEmpty()) {
+                val bands = data?.bands
+                if (bands != null && bands.size == numBars) {
+                    for (i in 0 until numBars) {
+                        displayMagnitudes[i] = (bands[i] * 1.5f).coerceIn(0f, 1f)
+                    }
+                } else if (data != null && data.magnitudes.isNotEmpty()) {
                     val magnitudes = data.magnitudes
                     val totalBins = magnitudes.size
                     
@@ -19,7 +19,13 @@ data class SpectrumData(
     /**
      * FFT size used for this analysis
      */
-    val fftSize: Int = 2048
+    val fftSize: Int = 2048,
+
+    /**
+     * Optional precomputed display bands (0.0 to 1.0 normalized, low to high frequency)
+     * Platforms that analyze natively fill this so the UI can skip its own binning
+     */
+    val bands: FloatArray? = null
 ) {
     /**
      * Get the frequency (Hz) for a given bin index
@@ -35,6 +41,10 @@ data class SpectrumData(
         if (!magnitudes.contentEquals(other.magnitudes)) return false
         if (sampleRate != other.sampleRate) return false
         if (fftSize != other.fftSize) return false
+        if (bands != null) {
+            if (other.bands == null) return false
+            if (!bands.contentEquals(other.bands)) return false
+        } else if (other.bands != null) return false
         return true
     }
 
@@ -42,6 +52,7 @@ data class SpectrumData(
         var result = magnitudes.contentHashCode()
         result = 31 * result + sampleRate.hashCode()
         result = 31 * result + fftSize
+        result = 31 * result + (bands?.contentHashCode() ?: 0)
         return result
     }
     
@@ -50,6 +61,15 @@ data class SpectrumData(
     }
 }
 
+/**
+ * An instrument of the loaded SoundFont
+ */
+data class PresetInfo(
+    val bank: Int,
+    val program: Int,
+    val name: String
+)
+
 /**
  * Platform-independent interface for synth operations
  */
@@ -59,6 +79,21 @@ interface SynthManager {
      */
     suspend fun initialize(): Boolean
     
+    /**
+     * Fraction of the SoundFont loaded so far (0.0 to 1.0) while initialize() or
+     * replaceSoundFont() is loading it, or null when no load is running or the platform does
+     * not report progress
+     */
+    fun getSoundFontLoadProgress(): Float? = null
+
+    /**
+     * Switch to another SoundFont file without stopping playback (Android). The current one
+     * keeps playing while the new one loads and is unloaded once its notes have ended
+     * @param path Path to the SoundFont file
+     * @return true if the new SoundFont is in use
+     */
+    suspend fun replaceSoundFont(path: String): Boolean = false
+
     /**
      * Play a note
      * @param note MIDI note number (0-127)
@@ -77,6 +112,19 @@ interface SynthManager {
      * @param program Program number (0-127)
      */
     fun changeProgram(program: Int)
+
+    /**
+     * Check whether the instrument is ready to play. False while a program change to it
+     * is still waiting for its samples to load (Android)
+     * @param program Program number (0-127)
+     */
+    fun isProgramReady(program: Int): Boolean = true
+
+    /**
+     * List the instruments of the SoundFont. Before initialize() has finished this returns
+     * the list indexed on an earlier launch if there is one (Android), otherwise an empty list
+     */
+    suspend fun getPresets(): List<PresetInfo> = emptyList()
     
     /**
      * Set the volume
@@ -85,7 +133,7 @@ interface SynthManager {
     fun setVolume(volume: Int)
     
     /**
-     * Set the audio buffer size (WASM only, no-op on other platforms)
+     * Set the audio buffer size (WASM and Android; no-op on other platforms)
      * @param bufferSize Buffer size in samples (e.g., 128, 256, 512, 1024)
      * Lower values = lower latency but higher CPU usage
      */